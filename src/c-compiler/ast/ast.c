@@ -9,6 +9,7 @@
 #include "../parser/lexer.h"
 #include "../shared/fileio.h"
 #include "../shared/error.h"
+#include "../shared/timetrace.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -64,12 +65,16 @@ void astPrintNode(AstNode *node) {
 		nameUsePrint((NameUseAstNode *)node); break;
 	case VarNameDclNode: case VtypeNameDclNode: case PermNameDclNode: case AllocNameDclNode:
 		nameDclPrint((NameDclAstNode *)node); break;
+	case GenericNode:
+		genericPrint((GenericAstNode *)node); break;
 	case BlockNode:
 		blockPrint((BlockAstNode *)node); break;
 	case IfNode:
 		ifPrint((IfAstNode *)node); break;
 	case WhileNode:
 		whilePrint((WhileAstNode *)node); break;
+	case ForNode:
+		forPrint((ForAstNode *)node); break;
 	case BreakNode:
 		astFprint("break"); break;
 	case ContinueNode:
@@ -98,6 +103,8 @@ void astPrintNode(AstNode *node) {
 		flitPrint((FLitAstNode *)node); break;
 	case SLitNode:
 		slitPrint((SLitAstNode *)node); break;
+	case AggLitNode:
+		aggLitPrint((AggLitAstNode *)node); break;
 	case FnSig:
 		fnSigPrint((FnSigAstNode *)node); break;
 	case RefType: case PtrType:
@@ -107,6 +114,8 @@ void astPrintNode(AstNode *node) {
 		structPrint((StructAstNode *)node); break;
 	case ArrayType:
 		arrayPrint((ArrayAstNode *)node); break;
+	case VectorType:
+		vectorPrint((VectorAstNode *)node); break;
 	case IntNbrType: case UintNbrType: case FloatNbrType:
 		nbrTypePrint((NbrAstNode *)node); break;
 	case PermType:
@@ -138,12 +147,16 @@ void astPass(PassState *pstate, AstNode *node) {
 		nameVtypeDclPass(pstate, (NameDclAstNode *)node); break;
 	case NameUseNode:
 		nameUsePass(pstate, (NameUseAstNode *)node); break;
+	case GenericNode:
+		genericPass(pstate, (GenericAstNode *)node); break;
 	case BlockNode:
 		blockPass(pstate, (BlockAstNode *)node); break;
 	case IfNode:
 		ifPass(pstate, (IfAstNode *)node); break;
 	case WhileNode:
 		whilePass(pstate, (WhileAstNode *)node); break;
+	case ForNode:
+		forPass(pstate, (ForAstNode *)node); break;
 	case BreakNode:
 	case ContinueNode:
 		breakPass(pstate, node); break;
@@ -181,7 +194,9 @@ void astPass(PassState *pstate, AstNode *node) {
 	case ULitNode:
 	case FLitNode:
 	case SLitNode:
+	case AggLitNode:
 	case IntNbrType: case UintNbrType: case FloatNbrType:
+	case VectorType:
 	case PermType:
 	case VoidType:
 		break;
@@ -190,22 +205,71 @@ void astPass(PassState *pstate, AstNode *node) {
 	}
 }
 
-// Run all passes against the AST (after parse and before gen)
-void astPasses(ModuleAstNode *mod) {
+// Return the name of a pass (e.g., for time tracing)
+char *astPassName(int pass) {
+	switch (pass) {
+	case NameResolution: return "NameResolution";
+	case TypeCheck: return "TypeCheck";
+	default: return "Pass";
+	}
+}
+
+// Run all passes against the AST (after parse and before gen).
+// inlining is 0 when calls must stay calls (e.g., so that profiling counts them).
+void astPasses(ModuleAstNode *mod, int inlining) {
 	PassState pstate;
 	pstate.mod = mod;
 	pstate.fnsig = NULL;
 	pstate.blk = NULL;
 	pstate.scope = 0;
 	pstate.flags = 0;
+	genericBegin();
 
 	// Resolve all name uses to their appropriate declaration
 	pstate.pass = NameResolution;
+	timeTraceBegin(astPassName(pstate.pass), NULL);
 	astPass(&pstate, (AstNode*) mod);
+	timeTraceEnd();
+	if (errors)
+		return;
+
+	// Copy the generics' instances named so far from their templates
+	timeTraceBegin("Instantiate", NULL);
+	genericInstances(NameResolution);
+	timeTraceEnd();
 	if (errors)
 		return;
 
 	// Apply syntactic sugar, and perform type inference/check
 	pstate.pass = TypeCheck;
+	timeTraceBegin(astPassName(pstate.pass), NULL);
 	astPass(&pstate, (AstNode*)mod);
+	genericInstances(TypeCheck);
+	timeTraceEnd();
+	if (errors)
+		return;
+
+	// Compute global variables' initial values (and local consts) at compile time
+	timeTraceBegin("ConstEval", NULL);
+	constEvaluate(mod);
+	timeTraceEnd();
+	if (errors)
+		return;
+
+	// Replace calls to @inline and tiny functions with copies of their bodies
+	if (inlining) {
+		timeTraceBegin("Inline", NULL);
+		inlineCalls(mod);
+		timeTraceEnd();
+	}
+
+	// Find the array indexes that loops keep within bounds, which need no bounds check
+	timeTraceBegin("RangeAnalysis", NULL);
+	rangeAnalysis(mod);
+	timeTraceEnd();
+
+	// Infer what each function may do, for generation's function attributes
+	timeTraceBegin("EffectAnalysis", NULL);
+	effectAnalysis(mod);
+	timeTraceEnd();
 }
\ No newline at end of file
@@ -60,8 +60,10 @@ enum AstType {
 	OpCodeNode,		// Alternative to fndcl block for internal operations (e.g., add)
 	ReturnNode,		// Return node
 	WhileNode,		// While node
+	ForNode,		// For node
 	BreakNode,		// Break node
 	ContinueNode,	// Continue node
+	GenericNode,	// Generic (type-parameterized) function or struct
 
 	// Name usage (we do not know what type of name it is until name resolution pass)
 	NameUseNode,	// Name use node
@@ -72,6 +74,7 @@ enum AstType {
 	ULitNode,		// Integer literal
 	FLitNode,		// Float literal
 	SLitNode,		// String literal
+	AggLitNode,		// Array or struct literal (computed at compile time)
 	AssignNode,		// Assignment expression
 	FnCallNode,		// Function call
 	SizeofNode,		// Sizeof a type (usize)
@@ -96,6 +99,7 @@ enum AstType {
 	FnSig,		// Also method, closure, behavior, co-routine, thread, ...
 	StructType,	// Also interface, trait, tuple, actor, etc.
 	ArrayType,	// Also dynamic arrays? SOA?
+	VectorType,	// SIMD vector of numbers (e.g., f32x4)
 	EnumType,	// Also sum type, etc.?
 	ModuleType,	// Modules, Generics ?
 
@@ -130,7 +134,19 @@ enum AstType {
 
 enum AstFlags {
 	FlagMangleParms = 0x0001,	// Should fn parm types be part of guname?
-	FlagExtern = 0x0002			// C ABI extern
+	FlagExtern = 0x0002,		// C ABI extern
+	FlagAddrTaken = 0x0004,		// Variable is borrowed from (&), so it must live in memory
+	FlagSsaVar = 0x0008,		// Variable is bound directly to its value (no alloca) by generation
+	FlagReadNone = 0x0010,		// Function accesses no caller-visible memory (effect analysis)
+	FlagReadOnly = 0x0020,		// Function may read, but never writes, caller-visible memory
+	FlagNoRecurse = 0x0040,		// Function never (indirectly) calls itself
+	FlagWillReturn = 0x0080,	// Function always returns (no loops, recursion or unknown calls)
+	FlagFastMath = 0x0100,		// Function's float math may be reassociated, contracted, etc. (@fastmath)
+	FlagIndex = 0x0200,			// Element node is owner[index], rather than owner.field
+	FlagInBounds = 0x0400,		// Index is always within bounds, so needs no check (range analysis)
+	FlagInBoundsIfGuard = 0x0800,	// Index needs no check when its loop's guard holds (range analysis)
+	FlagInline = 0x1000,		// Function's calls are replaced by a copy of its body (@inline)
+	FlagInstance = 0x2000		// Declaration is a generic's instance (e.g., 'max[i32]')
 };
 
 // AstNode is a castable struct for all AST nodes.
@@ -167,6 +183,7 @@ typedef struct OwnerAstNode {
   || (node)->asttype == VarNameDclNode \
   || (node)->asttype == AllocNameDclNode \
   || (node)->asttype == PermNameDclNode \
+  || (node)->asttype == GenericNode \
 )
 
 // Named Ast Node header, for variable and type declarations
@@ -207,6 +224,7 @@ typedef struct TypeAstNode {
 #include "../ast/copyexpr.h"
 #include "../ast/vardcl.h"
 #include "../ast/nameuse.h"
+#include "../ast/generic.h"
 #include "../ast/literal.h"
 #include "../types/type.h"
 #include "../types/fnsig.h"
@@ -214,6 +232,7 @@ typedef struct TypeAstNode {
 #include "../types/pointer.h"
 #include "../types/struct.h"
 #include "../types/array.h"
+#include "../types/vector.h"
 #include "../types/alloc.h"
 
 #include "../std/stdlib.h"
@@ -258,7 +277,12 @@ void astPrintIndent();
 void astPrintIncr();
 void astPrintDecr();
 
-void astPasses(ModuleAstNode *pgm);
+char *astPassName(int pass);
+void astPasses(ModuleAstNode *pgm, int inlining);
+void constEvaluate(ModuleAstNode *mod);
+void inlineCalls(ModuleAstNode *mod);
+void rangeAnalysis(ModuleAstNode *mod);
+void effectAnalysis(ModuleAstNode *mod);
 void astPass(PassState *pstate, AstNode *pgm);
 
 #endif
\ No newline at end of file
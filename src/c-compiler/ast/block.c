@@ -150,6 +150,9 @@ WhileAstNode *newWhileNode() {
 	WhileAstNode *node;
 	newAstNode(node, WhileAstNode, WhileNode);
 	node->blk = NULL;
+	node->hints.vectorize = node->hints.unroll = 0;
+	node->bound = NULL;
+	node->guards = NULL;
 	return node;
 }
 
@@ -175,6 +178,93 @@ void whilePass(PassState *pstate, WhileAstNode *node) {
 	pstate->flags = svflags;
 }
 
+// Create a new For node
+ForAstNode *newForNode() {
+	ForAstNode *node;
+	newAstNode(node, ForAstNode, ForNode);
+	node->var = NULL;
+	node->from = NULL;
+	node->to = NULL;
+	node->blk = NULL;
+	node->hints.vectorize = node->hints.unroll = 0;
+	node->bound = NULL;
+	node->guards = NULL;
+	return node;
+}
+
+// Serialize the AST for a for block
+void forPrint(ForAstNode *node) {
+	astFprint("for %s in ", &node->var->namesym->namestr);
+	if (node->from) {
+		astPrintNode(node->from);
+		astFprint("..");
+	}
+	astPrintNode(node->to);
+	astPrintNL();
+	astPrintNode(node->blk);
+}
+
+// Type check the for loop's range (or array), and infer its variable's type
+static void forTypeCheck(ForAstNode *node) {
+	NameDclAstNode *var = node->var;
+
+	// Counting over a range: the counter's type is declared, or else the end's (or start's, if the end is a literal)
+	if (node->from) {
+		AstNode *ctype;
+		if (var->vtype == voidType)
+			var->vtype = ((TypedAstNode *)(litIsLiteral(node->to) && !litIsLiteral(node->from) ? node->from : node->to))->vtype;
+		ctype = typeGetVtype(var->vtype);
+		if (!isNbr(ctype) || ctype->asttype == FloatNbrType || ctype == (AstNode*)boolType)
+			errorMsgNode((AstNode*)node, ErrorInvType, "A for loop's range must be of integers");
+		else if (!typeCoerces(var->vtype, &node->from) || !typeCoerces(var->vtype, &node->to))
+			errorMsgNode((AstNode*)node, ErrorInvType, "The range's start and end must be of the same integer type");
+	}
+
+	// Iterating over the elements of an array or slice
+	else {
+		AstNode *ownvtype = typeGetVtype(node->to);
+		ArrayAstNode *arrtype = arrayIndexable(ownvtype);
+		if (arrtype == NULL || (arrtype->size == 0 && !isSlice(ownvtype))) {
+			errorMsgNode(node->to, ErrorBadArray, "A for loop may only iterate over a range, or an array or slice");
+			return;
+		}
+		if (var->vtype == voidType)
+			var->vtype = arrtype->elemtype;
+		else if (!typeIsSame(var->vtype, arrtype->elemtype))
+			errorMsgNode((AstNode*)var, ErrorInvType, "The loop variable's type must be that of the array's elements");
+		// An array variable is iterated over in place, so generation must give it an address
+		if (node->to->asttype == NameUseNode && ((NameUseAstNode*)node->to)->dclnode->asttype == VarNameDclNode
+			&& ownvtype->asttype == ArrayType)
+			((NameUseAstNode*)node->to)->dclnode->flags |= FlagAddrTaken;
+	}
+}
+
+// Semantic pass on the for block
+void forPass(PassState *pstate, ForAstNode *node) {
+	uint16_t svflags = pstate->flags;
+
+	if (node->from)
+		astPass(pstate, node->from);
+	astPass(pstate, node->to);
+	if (node->var->vtype != voidType)
+		astPass(pstate, node->var->vtype);
+
+	switch (pstate->pass) {
+	case NameResolution:
+		// The loop's variable is local to its block
+		node->var->scope = pstate->scope + 1;
+		nameHook((OwnerAstNode *)node->blk, (NamedAstNode *)node->var, node->var->namesym);
+		break;
+	case TypeCheck:
+		forTypeCheck(node);
+		break;
+	}
+
+	pstate->flags |= PassWithinWhile;
+	astPass(pstate, node->blk);
+	pstate->flags = svflags;
+}
+
 // Semantic pass on break or continue
 void breakPass(PassState *pstate, AstNode *node) {
 	if (pstate->pass==NameResolution && !(pstate->flags & PassWithinWhile))
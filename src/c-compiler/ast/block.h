@@ -21,13 +21,34 @@ typedef struct IfAstNode {
 	Nodes *condblk;
 } IfAstNode;
 
+// Hints for optimizing a loop, from its attributes (e.g., @vectorize(8), @unroll(4))
+typedef struct LoopHints {
+	int16_t vectorize;	// 0: default, -1: never, 1: always, n > 1: always, n lanes wide
+	int16_t unroll;		// 0: default, -1: never, 1: always, n > 1: n times
+} LoopHints;
+
 // While statement
 typedef struct WhileAstNode {
 	BasicAstHdr;
 	AstNode *condexp;
 	AstNode *blk;
+	LoopHints hints;
+	AstNode *bound;		// Counter's bound, as usize, that guards checks against (range analysis)
+	Nodes *guards;		// Indexes in bounds when bound <= their array's len (NULL if none)
 } WhileAstNode;
 
+// For statement: for var in from..to, or for var in array (or slice)
+typedef struct ForAstNode {
+	BasicAstHdr;
+	struct NameDclAstNode *var;	// Loop variable: the counter, or each element's value
+	AstNode *from;			// Range's start (NULL when iterating over an array)
+	AstNode *to;			// Range's end (excluded), or the array (or slice) iterated over
+	AstNode *blk;
+	LoopHints hints;
+	AstNode *bound;		// 'to', as usize, that guards checks against (range analysis)
+	Nodes *guards;		// Indexes in bounds when bound <= their array's len (NULL if none)
+} ForAstNode;
+
 // Return/yield statement
 typedef struct ReturnAstNode {
 	BasicAstHdr;
@@ -61,7 +82,40 @@ enum OpCode {
 	ShrOpCode,
 
 	// Intrinsic functions
-	SqrtOpCode
+	SqrtOpCode,
+	AbsOpCode,
+	FloorOpCode,
+	CeilOpCode,
+	TruncOpCode,
+	RoundOpCode,
+	FmaOpCode,
+	CopysignOpCode,
+	MinOpCode,
+	MaxOpCode,
+	PopcountOpCode,
+	ClzOpCode,
+	CtzOpCode,
+	BswapOpCode,
+	RotlOpCode,
+	RotrOpCode,
+	AddSatOpCode,
+	SubSatOpCode,
+	AddCheckedOpCode,
+	SubCheckedOpCode,
+	MulCheckedOpCode,
+
+	// Vector operations (beyond lane-wise number op codes)
+	ExtractOpCode,
+	InsertOpCode,
+	ShuffleOpCode,
+	SelectOpCode,
+	SumOpCode,
+	ProductOpCode,
+	ReduceMinOpCode,
+	ReduceMaxOpCode,
+	ReduceAndOpCode,
+	ReduceOrOpCode,
+	ReduceXorOpCode
 };
 
 // An internal operation (e.g., add). 
@@ -83,6 +137,10 @@ WhileAstNode *newWhileNode();
 void whilePrint(WhileAstNode *wnode);
 void whilePass(PassState *pstate, WhileAstNode *wnode);
 
+ForAstNode *newForNode();
+void forPrint(ForAstNode *fnode);
+void forPass(PassState *pstate, ForAstNode *fnode);
+
 void breakPass(PassState *pstate, AstNode *node);
 
 OpCodeAstNode *newOpCodeNode(int16_t opcode);
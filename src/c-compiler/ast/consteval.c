@@ -0,0 +1,961 @@
+/** Compile-time evaluation of global initializers and const declarations
+ * @file
+ *
+ * After type checking, this interprets the program's AST to compute every global
+ * variable's initial value. That way, a computed table (e.g., of CRCs or sines)
+ * is built by the compiler and emitted as constant data, rather than at run time:
+ *
+ *     imm crcs [256] u32 = crcTable()
+ *
+ * It also folds the value of any local const declaration it is able to compute.
+ *
+ * It evaluates a pure subset of the language: numbers, arrays and structs (and references
+ * to them), local variables, if, while and for, and calls to program-defined functions
+ * that do only the same. Reading an immutable global computes its value (once).
+ * Anything else cannot be computed at compile time: reading a mutable global,
+ * calling an extern function, or a trap (e.g., an index out of bounds or a checked add
+ * that overflows). Neither can a computation that takes more than ConstStepLimit steps,
+ * so that a runaway loop cannot hang the compiler.
+ *
+ * Computed values replace the declarations' initial values as literal nodes.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "ast.h"
+#include "nametbl.h"
+#include "../shared/error.h"
+
+#include <string.h>
+#include <math.h>
+
+#define ConstStepLimit 10000000	// Most nodes evaluated to compute any one value
+#define ConstCallLimit 1000		// Deepest nesting of calls
+
+// A value computed at compile time
+typedef struct ConstVal {
+	AstNode *vtype;			// Its type (as from typeGetVtype)
+	uint64_t uint;			// Integer (sign-extended, if signed)
+	double flt;				// Float (rounded to f32 precision, if f32)
+	struct ConstVal *elems;	// An array's elements or a struct's fields
+	uint32_t nelems;
+	struct ConstVal *ref;	// What a reference (or slice) refers to
+} ConstVal;
+
+// A variable (or parameter) of the function being evaluated
+typedef struct ConstVar {
+	NameDclAstNode *dcl;
+	ConstVal val;
+	struct ConstVar *next;
+} ConstVar;
+
+// A variable that never changes (e.g., an immutable global), whose value is computed once
+typedef struct ConstFixed {
+	NameDclAstNode *dcl;
+	ConstVal val;
+	int state;				// 0: being computed, 1: computed, -1: cannot be computed
+	struct ConstFixed *next;
+} ConstFixed;
+
+// How evaluating a node ends
+enum ConstFlow {
+	ConstFail,		// It cannot be computed at compile time (see failnode)
+	ConstNext,		// Go on to the next node
+	ConstBreak,
+	ConstContinue,
+	ConstReturn		// The function returns retval
+};
+
+// The state of evaluation
+typedef struct ConstState {
+	ConstVar *vars;			// Variables of the function being evaluated
+	ConstFixed *fixed;		// Values of unchanging variables, once computed
+	ConstVal retval;		// Value given by a return
+	uint32_t steps;			// Nodes evaluated so far, for the value being computed
+	uint32_t calls;			// Depth of calls being evaluated
+	AstNode *failnode;		// The node that could not be computed
+	char *failmsg;			// Why not
+} ConstState;
+
+static int constExp(ConstState *cs, AstNode *node, ConstVal *val);
+static int constPlace(ConstState *cs, AstNode *node, ConstVal **place);
+
+// Note why a node cannot be computed. The innermost (first) reason is the one reported.
+static int constFail(ConstState *cs, AstNode *node, char *msg) {
+	if (cs->failnode == NULL) {
+		cs->failnode = node;
+		cs->failmsg = msg;
+	}
+	return ConstFail;
+}
+
+// Wrap an integer to its type's bits, sign-extending it if signed
+static uint64_t constWrap(uint64_t nbr, AstNode *vtype) {
+	NbrAstNode *type = (NbrAstNode *)vtype;
+	uint64_t mask;
+	if (type->bits >= 64)
+		return nbr;
+	mask = ((uint64_t)1 << type->bits) - 1;
+	nbr &= mask;
+	if (type->asttype == IntNbrType && nbr >> (type->bits - 1))
+		nbr |= ~mask;
+	return nbr;
+}
+
+// Set an integer (or Bool) value
+static void constInt(ConstVal *val, AstNode *vtype, uint64_t nbr) {
+	memset(val, 0, sizeof(ConstVal));
+	val->vtype = vtype;
+	val->uint = constWrap(nbr, vtype);
+}
+
+// Set a float value
+static void constFloat(ConstVal *val, AstNode *vtype, double nbr) {
+	memset(val, 0, sizeof(ConstVal));
+	val->vtype = vtype;
+	val->flt = ((NbrAstNode *)vtype)->bits == 32 ? (double)(float)nbr : nbr;
+}
+
+// Copy a value. An array or struct is copied element by element, as it is a value.
+static void constCopy(ConstVal *to, ConstVal *from) {
+	uint32_t i;
+	*to = *from;
+	if (from->elems) {
+		to->elems = (ConstVal *)memAllocBlk(from->nelems * sizeof(ConstVal));
+		for (i = 0; i < from->nelems; i++)
+			constCopy(&to->elems[i], &from->elems[i]);
+	}
+}
+
+// Give a value its type's zero, as for a variable declared with no initial value
+static void constZero(ConstVal *val, AstNode *vtype) {
+	uint32_t i;
+	memset(val, 0, sizeof(ConstVal));
+	val->vtype = vtype = typeGetVtype(vtype);
+	if (vtype->asttype == ArrayType) {
+		ArrayAstNode *arrtype = (ArrayAstNode *)vtype;
+		val->nelems = arrtype->size;
+		val->elems = (ConstVal *)memAllocBlk(arrtype->size * sizeof(ConstVal));
+		for (i = 0; i < arrtype->size; i++)
+			constZero(&val->elems[i], arrtype->elemtype);
+	}
+	else if (vtype->asttype == StructType) {
+		StructAstNode *strtype = (StructAstNode *)vtype;
+		SymNode *inodesp;
+		uint32_t cnt;
+		val->nelems = strtype->fields->used;
+		val->elems = (ConstVal *)memAllocBlk(val->nelems * sizeof(ConstVal));
+		i = 0;
+		for (inodesFor(strtype->fields, cnt, inodesp))
+			constZero(&val->elems[i++], ((NameDclAstNode *)inodesp->node)->vtype);
+	}
+}
+
+// Bind a variable to a value, in the function being evaluated.
+// A variable declared again (in a loop) reuses its binding.
+static void constBind(ConstState *cs, NameDclAstNode *dcl, ConstVal *val) {
+	ConstVar *var;
+	for (var = cs->vars; var; var = var->next) {
+		if (var->dcl == dcl)
+			break;
+	}
+	if (var == NULL) {
+		var = (ConstVar *)memAllocBlk(sizeof(ConstVar));
+		var->dcl = dcl;
+		var->next = cs->vars;
+		cs->vars = var;
+	}
+	var->val = *val;
+}
+
+// Find the value of a variable that is not the evaluated function's own:
+// an unchanging global (or outer local), computing its initial value the first time
+static int constFixed(ConstState *cs, AstNode *use, NameDclAstNode *dcl, ConstVal **place) {
+	ConstFixed *fixed;
+	ConstVar *svvars;
+	int flow;
+
+	for (fixed = cs->fixed; fixed; fixed = fixed->next) {
+		if (fixed->dcl == dcl)
+			break;
+	}
+	if (fixed) {
+		if (fixed->state == 0)
+			return constFail(cs, use, "its value depends on itself");
+		if (fixed->state < 0)
+			return constFail(cs, use, "it uses a value that cannot be computed");
+		*place = &fixed->val;
+		return ConstNext;
+	}
+	if (dcl->value == NULL)
+		return constFail(cs, use, "it uses a variable with no initial value");
+
+	fixed = (ConstFixed *)memAllocBlk(sizeof(ConstFixed));
+	fixed->dcl = dcl;
+	fixed->state = 0;
+	fixed->next = cs->fixed;
+	cs->fixed = fixed;
+
+	// Evaluated apart from whatever function is being evaluated
+	svvars = cs->vars;
+	cs->vars = NULL;
+	flow = constExp(cs, dcl->value, &fixed->val);
+	cs->vars = svvars;
+	fixed->state = flow == ConstFail ? -1 : 1;
+	if (flow == ConstFail)
+		return ConstFail;
+	*place = &fixed->val;
+	return ConstNext;
+}
+
+// Find a variable's value. Only a variable that can never change has a value
+// known at compile time, unless it belongs to the function being evaluated.
+static int constVar(ConstState *cs, NameUseAstNode *use, ConstVal **place) {
+	NameDclAstNode *dcl = use->dclnode;
+	ConstVar *var;
+	for (var = cs->vars; var; var = var->next) {
+		if (var->dcl == dcl) {
+			*place = &var->val;
+			return ConstNext;
+		}
+	}
+	if (dcl->asttype != VarNameDclNode || typeGetVtype(dcl->vtype)->asttype == FnSig)
+		return constFail(cs, (AstNode *)use, "it uses a function as a value");
+	if (dcl->perm->flags & MayWrite)
+		return constFail(cs, (AstNode *)use, "it reads a variable that may change");
+	return constFixed(cs, (AstNode *)use, dcl, place);
+}
+
+// Find the array (or struct) that an element's owner is, or refers to
+static int constOwner(ConstState *cs, AstNode *owner, ConstVal **agg) {
+	AstNode *ownvtype = typeGetVtype(owner);
+	if (ownvtype->asttype == RefType || ownvtype->asttype == PtrType) {
+		ConstVal ref;
+		int flow = constExp(cs, owner, &ref);
+		if (flow != ConstNext)
+			return flow;
+		if ((*agg = ref.ref) == NULL)
+			return constFail(cs, owner, "it uses a reference to nothing");
+		return ConstNext;
+	}
+	return constPlace(cs, owner, agg);
+}
+
+// Find where an lval's value is stored: a variable, an element (or field) within
+// one, or what a reference refers to. Any other expression's value is computed
+// into a new place of its own.
+static int constPlace(ConstState *cs, AstNode *node, ConstVal **place) {
+	int flow;
+	switch (node->asttype) {
+	case NameUseNode:
+		return constVar(cs, (NameUseAstNode *)node, place);
+
+	case ElementNode:
+	{
+		ElementAstNode *elem = (ElementAstNode *)node;
+		ConstVal *agg, index;
+		if (elem->element->asttype == MemberUseNode)
+			break;
+		if ((flow = constOwner(cs, elem->owner, &agg)) != ConstNext)
+			return flow;
+		if (elem->flags & FlagIndex) {
+			if ((flow = constExp(cs, elem->element, &index)) != ConstNext)
+				return flow;
+			if (index.uint >= agg->nelems)
+				return constFail(cs, node, "the index is out of bounds");
+			*place = &agg->elems[index.uint];
+		}
+		else
+			*place = &agg->elems[((NameUseAstNode *)elem->element)->dclnode->index];
+		return ConstNext;
+	}
+
+	case DerefNode:
+	{
+		ConstVal ref;
+		if ((flow = constExp(cs, ((DerefAstNode *)node)->exp, &ref)) != ConstNext)
+			return flow;
+		if ((*place = ref.ref) == NULL)
+			return constFail(cs, node, "it uses a reference to nothing");
+		return ConstNext;
+	}
+	}
+
+	*place = (ConstVal *)memAllocBlk(sizeof(ConstVal));
+	return constExp(cs, node, *place);
+}
+
+// Compute integer arithmetic, returning whether its true result does not fit in the type
+// (in which case the result wraps)
+static int constOverflows(int opcode, AstNode *vtype, uint64_t a, uint64_t b, uint64_t *result) {
+	NbrAstNode *type = (NbrAstNode *)vtype;
+	int issigned = type->asttype == IntNbrType;
+	uint64_t res;
+
+	switch (opcode) {
+	case AddOpCode: case AddSatOpCode: case AddCheckedOpCode: res = a + b; break;
+	case SubOpCode: case SubSatOpCode: case SubCheckedOpCode: res = a - b; break;
+	default: res = a * b; break;
+	}
+
+	// Narrower types' true results fit in 64 bits
+	if (type->bits <= 32) {
+		*result = constWrap(res, vtype);
+		if (!issigned && (opcode == SubOpCode || opcode == SubSatOpCode || opcode == SubCheckedOpCode))
+			return a < b;
+		return *result != res;
+	}
+
+	*result = res;
+	switch (opcode) {
+	case AddOpCode: case AddSatOpCode: case AddCheckedOpCode:
+		return issigned ? ((a ^ res) & (b ^ res)) >> 63 : res < a;
+	case SubOpCode: case SubSatOpCode: case SubCheckedOpCode:
+		return issigned ? ((a ^ b) & (a ^ res)) >> 63 : a < b;
+	default:
+		if (a == 0 || b == 0)
+			return 0;
+		if (!issigned)
+			return res / a != b;
+		if ((int64_t)a == -1 || (int64_t)b == -1)
+			return (a | b) == (uint64_t)1 << 63;
+		return (int64_t)res / (int64_t)a != (int64_t)b;
+	}
+}
+
+// Compute an integer op code
+static int constIntOp(ConstState *cs, FnCallAstNode *call, int opcode, ConstVal *args, ConstVal *val) {
+	AstNode *vtype = args[0].vtype;
+	AstNode *rettype = typeGetVtype(call->vtype);
+	int issigned = vtype->asttype == IntNbrType;
+	unsigned bits = ((NbrAstNode *)vtype)->bits;
+	uint64_t mask = bits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+	uint64_t a = args[0].uint;
+	uint64_t b = call->parms->used > 1 ? args[1].uint : 0;
+	uint64_t res = 0;
+	unsigned n;
+
+	switch (opcode) {
+	case NegOpCode: res = 0 - a; break;
+	case AddOpCode: res = a + b; break;
+	case SubOpCode: res = a - b; break;
+	case MulOpCode: res = a * b; break;
+	case DivOpCode:
+	case RemOpCode:
+		if (b == 0)
+			return constFail(cs, (AstNode *)call, "it divides by zero");
+		if (issigned) {
+			if ((int64_t)b == -1 && a == constWrap((uint64_t)1 << (bits - 1), vtype))
+				return constFail(cs, (AstNode *)call, "the division overflows");
+			res = opcode == DivOpCode ? (uint64_t)((int64_t)a / (int64_t)b) : (uint64_t)((int64_t)a % (int64_t)b);
+		}
+		else
+			res = opcode == DivOpCode ? a / b : a % b;
+		break;
+
+	// Comparison
+	case EqOpCode: constInt(val, rettype, a == b); return ConstNext;
+	case NeOpCode: constInt(val, rettype, a != b); return ConstNext;
+	case LtOpCode: constInt(val, rettype, issigned ? (int64_t)a < (int64_t)b : a < b); return ConstNext;
+	case LeOpCode: constInt(val, rettype, issigned ? (int64_t)a <= (int64_t)b : a <= b); return ConstNext;
+	case GtOpCode: constInt(val, rettype, issigned ? (int64_t)a > (int64_t)b : a > b); return ConstNext;
+	case GeOpCode: constInt(val, rettype, issigned ? (int64_t)a >= (int64_t)b : a >= b); return ConstNext;
+
+	// Bitwise
+	case NotOpCode: res = ~a; break;
+	case AndOpCode: res = a & b; break;
+	case OrOpCode: res = a | b; break;
+	case XorOpCode: res = a ^ b; break;
+	case ShlOpCode:
+	case ShrOpCode:
+		if ((b & mask) >= bits)
+			return constFail(cs, (AstNode *)call, "it shifts by more than the number's bits");
+		if (opcode == ShlOpCode)
+			res = a << b;
+		else
+			res = issigned ? (uint64_t)((int64_t)a >> b) : a >> b;
+		break;
+
+	// Minimum and maximum
+	case MinOpCode: res = (issigned ? (int64_t)a < (int64_t)b : a < b) ? a : b; break;
+	case MaxOpCode: res = (issigned ? (int64_t)a > (int64_t)b : a > b) ? a : b; break;
+
+	// Bit counting and shuffling, on the number's bits alone
+	case PopcountOpCode:
+		for (a &= mask; a; a &= a - 1)
+			res++;
+		break;
+	case ClzOpCode:
+		for (n = 0; n < bits && !((a >> (bits - 1 - n)) & 1); n++)
+			;
+		res = n;
+		break;
+	case CtzOpCode:
+		for (n = 0; n < bits && !((a >> n) & 1); n++)
+			;
+		res = n;
+		break;
+	case BswapOpCode:
+		for (n = 0; n < bits; n += 8)
+			res = (res << 8) | ((a >> n) & 0xFF);
+		break;
+	case RotlOpCode:
+	case RotrOpCode:
+		a &= mask;
+		n = (unsigned)((b & mask) % bits);
+		if (opcode == RotrOpCode)
+			n = (bits - n) % bits;
+		res = n ? (a << n) | (a >> (bits - n)) : a;
+		break;
+
+	// Saturating and checked arithmetic
+	case AddSatOpCode:
+	case SubSatOpCode:
+		if (constOverflows(opcode, vtype, a, b, &res)) {
+			uint64_t max = issigned ? mask >> 1 : mask;
+			if (!issigned)
+				res = opcode == AddSatOpCode ? max : 0;
+			else
+				res = (opcode == AddSatOpCode) == ((int64_t)b >= 0) ? max : ~max;
+		}
+		break;
+	case AddCheckedOpCode:
+	case SubCheckedOpCode:
+	case MulCheckedOpCode:
+		if (constOverflows(opcode, vtype, a, b, &res))
+			return constFail(cs, (AstNode *)call, "the checked arithmetic overflows");
+		break;
+
+	default:
+		return constFail(cs, (AstNode *)call, "the operation is not supported at compile time");
+	}
+	constInt(val, rettype, res);
+	return ConstNext;
+}
+
+// Compute a float op code
+static int constFloatOp(ConstState *cs, FnCallAstNode *call, int opcode, ConstVal *args, ConstVal *val) {
+	AstNode *rettype = typeGetVtype(call->vtype);
+	double a = args[0].flt;
+	double b = call->parms->used > 1 ? args[1].flt : 0.0;
+	double res;
+
+	switch (opcode) {
+	case NegOpCode: res = -a; break;
+	case AddOpCode: res = a + b; break;
+	case SubOpCode: res = a - b; break;
+	case MulOpCode: res = a * b; break;
+	case DivOpCode: res = a / b; break;
+	case RemOpCode: res = fmod(a, b); break;
+
+	// Comparison
+	case EqOpCode: constInt(val, rettype, a == b); return ConstNext;
+	case NeOpCode: constInt(val, rettype, a < b || a > b); return ConstNext;
+	case LtOpCode: constInt(val, rettype, a < b); return ConstNext;
+	case LeOpCode: constInt(val, rettype, a <= b); return ConstNext;
+	case GtOpCode: constInt(val, rettype, a > b); return ConstNext;
+	case GeOpCode: constInt(val, rettype, a >= b); return ConstNext;
+
+	case SqrtOpCode: res = sqrt(a); break;
+	case AbsOpCode: res = fabs(a); break;
+	case FloorOpCode: res = floor(a); break;
+	case CeilOpCode: res = ceil(a); break;
+	case TruncOpCode: res = trunc(a); break;
+	case RoundOpCode: res = round(a); break;
+	case CopysignOpCode: res = copysign(a, b); break;
+	case FmaOpCode:
+		res = ((NbrAstNode *)rettype)->bits == 32 ? (double)fmaf((float)a, (float)b, (float)args[2].flt) : fma(a, b, args[2].flt);
+		break;
+	case MinOpCode: res = fmin(a, b); break;
+	case MaxOpCode: res = fmax(a, b); break;
+
+	default:
+		return constFail(cs, (AstNode *)call, "the operation is not supported at compile time");
+	}
+	constFloat(val, rettype, res);
+	return ConstNext;
+}
+
+// Compute a function call: an op code, or a call to a program-defined function,
+// which is evaluated with variables of its own
+static int constCall(ConstState *cs, FnCallAstNode *call, ConstVal *val) {
+	NameDclAstNode *fndcl;
+	ConstVal *args = (ConstVal *)memAllocBlk(call->parms->used * sizeof(ConstVal));
+	ConstVar *svvars;
+	AstNode **nodesp;
+	SymNode *inodesp;
+	uint32_t cnt, i;
+	int flow;
+
+	if (call->fn->asttype != NameUseNode && call->fn->asttype != MemberUseNode)
+		return constFail(cs, (AstNode *)call, "it calls through a function pointer");
+	fndcl = ((NameUseAstNode *)call->fn)->dclnode;
+	if (fndcl->value == NULL)
+		return constFail(cs, (AstNode *)call, "it calls a function with no body (e.g., extern)");
+
+	i = 0;
+	for (nodesFor(call->parms, cnt, nodesp)) {
+		if ((flow = constExp(cs, *nodesp, &args[i++])) != ConstNext)
+			return flow;
+	}
+
+	if (fndcl->value->asttype == OpCodeNode) {
+		int opcode = ((OpCodeAstNode *)fndcl->value)->opcode;
+		if (args[0].vtype->asttype == FloatNbrType)
+			return constFloatOp(cs, call, opcode, args, val);
+		if (args[0].vtype->asttype == IntNbrType || args[0].vtype->asttype == UintNbrType)
+			return constIntOp(cs, call, opcode, args, val);
+		return constFail(cs, (AstNode *)call, "the operation is not supported at compile time");
+	}
+
+	if (cs->calls >= ConstCallLimit)
+		return constFail(cs, (AstNode *)call, "its calls nest too deeply");
+	svvars = cs->vars;
+	cs->vars = NULL;
+	i = 0;
+	for (inodesFor(((FnSigAstNode *)fndcl->vtype)->parms, cnt, inodesp))
+		constBind(cs, (NameDclAstNode *)inodesp->node, &args[i++]);
+	cs->calls++;
+	flow = constExp(cs, fndcl->value, val);
+	cs->calls--;
+	cs->vars = svvars;
+	if (flow == ConstFail)
+		return ConstFail;
+	if (flow == ConstReturn)
+		*val = cs->retval;
+	return ConstNext;
+}
+
+// Compute a cast, as generation's conversions do
+static int constCast(ConstState *cs, CastAstNode *node, ConstVal *val) {
+	AstNode *totype = typeGetVtype(node->vtype);
+	NbrAstNode *from, *to;
+	int flow;
+
+	if ((flow = constExp(cs, node->exp, val)) != ConstNext)
+		return flow;
+
+	// A reference to an array becomes a slice by knowing its length, which it does
+	if (totype->asttype == RefType || totype->asttype == PtrType) {
+		val->vtype = totype;
+		return ConstNext;
+	}
+	if (!isNbr(totype) || !isNbr(val->vtype))
+		return constFail(cs, (AstNode *)node, "the conversion is not supported at compile time");
+	from = (NbrAstNode *)val->vtype;
+	to = (NbrAstNode *)totype;
+
+	if (to == boolType) {
+		constInt(val, totype, from->asttype == FloatNbrType ? val->flt != 0.0 : val->uint != 0);
+		return ConstNext;
+	}
+
+	switch (to->asttype) {
+	case UintNbrType:
+	case IntNbrType:
+		if (from->asttype == FloatNbrType) {
+			double bound = ldexp(1.0, to->asttype == IntNbrType ? to->bits - 1 : to->bits);
+			double whole = trunc(val->flt);
+			if (!(whole < bound && (to->asttype == IntNbrType ? whole >= -bound : whole >= 0.0)))
+				return constFail(cs, (AstNode *)node, "the float is out of the integer's range");
+			constInt(val, totype, to->asttype == IntNbrType ? (uint64_t)(int64_t)whole : (uint64_t)whole);
+		}
+		// Widening only sign-extends from signed to signed
+		else if (to->bits > from->bits && !(from->asttype == IntNbrType && to->asttype == IntNbrType))
+			constInt(val, totype, from->bits >= 64 ? val->uint : val->uint & (((uint64_t)1 << from->bits) - 1));
+		else
+			constInt(val, totype, val->uint);
+		break;
+
+	case FloatNbrType:
+		if (from->asttype == IntNbrType)
+			constFloat(val, totype, to->bits == 32 ? (double)(float)(int64_t)val->uint : (double)(int64_t)val->uint);
+		else if (from->asttype == UintNbrType)
+			constFloat(val, totype, to->bits == 32 ? (double)(float)val->uint : (double)val->uint);
+		else
+			constFloat(val, totype, val->flt);
+		break;
+	}
+	return ConstNext;
+}
+
+// Compute a block's statements. Its value is that of its last statement.
+static int constBlock(ConstState *cs, BlockAstNode *blk, ConstVal *val) {
+	AstNode **nodesp;
+	uint32_t cnt;
+	int flow;
+
+	constInt(val, voidType, 0);
+	for (nodesFor(blk->stmts, cnt, nodesp)) {
+		switch ((*nodesp)->asttype) {
+		case ReturnNode:
+		{
+			AstNode *exp = ((ReturnAstNode *)*nodesp)->exp;
+			if (exp != voidType && (flow = constExp(cs, exp, &cs->retval)) != ConstNext)
+				return flow;
+			return ConstReturn;
+		}
+		case BreakNode:
+			return ConstBreak;
+		case ContinueNode:
+			return ConstContinue;
+		default:
+			if ((flow = constExp(cs, *nodesp, val)) != ConstNext)
+				return flow;
+		}
+	}
+	return ConstNext;
+}
+
+// Compute an if: the block of the first condition that holds
+static int constIf(ConstState *cs, IfAstNode *ifnode, ConstVal *val) {
+	AstNode **nodesp;
+	uint32_t cnt;
+	int flow;
+
+	constInt(val, voidType, 0);
+	for (nodesFor(ifnode->condblk, cnt, nodesp)) {
+		if (*nodesp != voidType) {
+			ConstVal cond;
+			if ((flow = constExp(cs, *nodesp, &cond)) != ConstNext)
+				return flow;
+			if (!cond.uint) {
+				cnt--; nodesp++;
+				continue;
+			}
+		}
+		return constExp(cs, *(nodesp + 1), val);
+	}
+	return ConstNext;
+}
+
+// Compute a while loop
+static int constWhile(ConstState *cs, WhileAstNode *wnode, ConstVal *val) {
+	ConstVal cond;
+	int flow;
+	while (1) {
+		if ((flow = constExp(cs, wnode->condexp, &cond)) != ConstNext)
+			return flow;
+		if (!cond.uint)
+			break;
+		flow = constExp(cs, wnode->blk, val);
+		if (flow == ConstBreak)
+			break;
+		if (flow == ConstFail || flow == ConstReturn)
+			return flow;
+	}
+	constInt(val, voidType, 0);
+	return ConstNext;
+}
+
+// Compute a for loop, over a range or an array's elements
+static int constFor(ConstState *cs, ForAstNode *fnode, ConstVal *val) {
+	ConstVal from, to, elem;
+	uint64_t i;
+	int flow;
+
+	if (fnode->from) {
+		int issigned;
+		if ((flow = constExp(cs, fnode->from, &from)) != ConstNext || (flow = constExp(cs, fnode->to, &to)) != ConstNext)
+			return flow;
+		issigned = from.vtype->asttype == IntNbrType;
+		for (i = from.uint; issigned ? (int64_t)i < (int64_t)to.uint : i < to.uint; i++) {
+			constInt(&elem, from.vtype, i);
+			constBind(cs, fnode->var, &elem);
+			flow = constExp(cs, fnode->blk, val);
+			if (flow == ConstBreak)
+				break;
+			if (flow == ConstFail || flow == ConstReturn)
+				return flow;
+		}
+	}
+	else {
+		ConstVal *agg;
+		if ((flow = constOwner(cs, fnode->to, &agg)) != ConstNext)
+			return flow;
+		for (i = 0; i < agg->nelems; i++) {
+			constCopy(&elem, &agg->elems[i]);
+			constBind(cs, fnode->var, &elem);
+			flow = constExp(cs, fnode->blk, val);
+			if (flow == ConstBreak)
+				break;
+			if (flow == ConstFail || flow == ConstReturn)
+				return flow;
+		}
+	}
+	constInt(val, voidType, 0);
+	return ConstNext;
+}
+
+// Compute a statement or expression's value
+static int constExp(ConstState *cs, AstNode *node, ConstVal *val) {
+	ConstVal *place;
+	int flow;
+
+	if (++cs->steps > ConstStepLimit)
+		return constFail(cs, node, "it takes too many steps to compute");
+
+	switch (node->asttype) {
+	case ULitNode:
+		constInt(val, typeGetVtype(((ULitAstNode *)node)->vtype), ((ULitAstNode *)node)->uintlit);
+		return ConstNext;
+	case FLitNode:
+		constFloat(val, typeGetVtype(((FLitAstNode *)node)->vtype), ((FLitAstNode *)node)->floatlit);
+		return ConstNext;
+	case AggLitNode:
+	{
+		AggLitAstNode *lit = (AggLitAstNode *)node;
+		AstNode **nodesp;
+		uint32_t cnt, i = 0;
+		memset(val, 0, sizeof(ConstVal));
+		val->vtype = typeGetVtype(lit->vtype);
+		val->nelems = lit->elems->used;
+		val->elems = (ConstVal *)memAllocBlk(val->nelems * sizeof(ConstVal));
+		for (nodesFor(lit->elems, cnt, nodesp))
+			constExp(cs, *nodesp, &val->elems[i++]);
+		return ConstNext;
+	}
+
+	case NameUseNode:
+	case DerefNode:
+		if ((flow = constPlace(cs, node, &place)) != ConstNext)
+			return flow;
+		constCopy(val, place);
+		return ConstNext;
+	case ElementNode:
+	{
+		ElementAstNode *elem = (ElementAstNode *)node;
+		// An unresolved member is an array's (or slice's) len
+		if (elem->element->asttype == MemberUseNode) {
+			if ((flow = constOwner(cs, elem->owner, &place)) != ConstNext)
+				return flow;
+			constInt(val, typeGetVtype(elem->vtype), place->nelems);
+			return ConstNext;
+		}
+		if ((flow = constPlace(cs, node, &place)) != ConstNext)
+			return flow;
+		constCopy(val, place);
+		return ConstNext;
+	}
+
+	case VarNameDclNode:
+	{
+		NameDclAstNode *dcl = (NameDclAstNode *)node;
+		if (dcl->value == NULL)
+			constZero(val, dcl->vtype);
+		else if ((flow = constExp(cs, dcl->value, val)) != ConstNext)
+			return flow;
+		constBind(cs, dcl, val);
+		return ConstNext;
+	}
+	case AssignNode:
+	{
+		AssignAstNode *assign = (AssignAstNode *)node;
+		if ((flow = constExp(cs, assign->rval, val)) != ConstNext)
+			return flow;
+		if ((flow = constPlace(cs, assign->lval, &place)) != ConstNext)
+			return flow;
+		constCopy(place, val);
+		return ConstNext;
+	}
+
+	case FnCallNode:
+		return constCall(cs, (FnCallAstNode *)node, val);
+	case CastNode:
+		return constCast(cs, (CastAstNode *)node, val);
+	case AddrNode:
+	{
+		AddrAstNode *addr = (AddrAstNode *)node;
+		if (((PtrAstNode *)addr->vtype)->alloc != voidType)
+			return constFail(cs, node, "it allocates memory");
+		if ((flow = constPlace(cs, addr->exp, &place)) != ConstNext)
+			return flow;
+		memset(val, 0, sizeof(ConstVal));
+		val->vtype = typeGetVtype(addr->vtype);
+		val->ref = place;
+		return ConstNext;
+	}
+
+	case NotLogicNode:
+		if ((flow = constExp(cs, ((LogicAstNode *)node)->lexp, val)) != ConstNext)
+			return flow;
+		constInt(val, (AstNode *)boolType, !val->uint);
+		return ConstNext;
+	case OrLogicNode:
+	case AndLogicNode:
+		if ((flow = constExp(cs, ((LogicAstNode *)node)->lexp, val)) != ConstNext)
+			return flow;
+		if ((val->uint != 0) == (node->asttype == OrLogicNode))
+			return ConstNext;
+		return constExp(cs, ((LogicAstNode *)node)->rexp, val);
+
+	case BlockNode:
+		return constBlock(cs, (BlockAstNode *)node, val);
+	case IfNode:
+		return constIf(cs, (IfAstNode *)node, val);
+	case WhileNode:
+		return constWhile(cs, (WhileAstNode *)node, val);
+	case ForNode:
+		return constFor(cs, (ForAstNode *)node, val);
+
+	case SizeofNode:
+		return constFail(cs, node, "a type's size depends on the target");
+	case SLitNode:
+		return constFail(cs, node, "a string's address is only known at run time");
+	default:
+		return constFail(cs, node, "it is not supported at compile time");
+	}
+}
+
+// Make a computed value into a literal of the declared (possibly named) type,
+// at the position of the node it replaces.
+// Return NULL if a value has no literal (e.g., a reference).
+static AstNode *constLiteral(ConstVal *val, AstNode *vtype, AstNode *at) {
+	AstNode *lit;
+	if (val->vtype->asttype == IntNbrType || val->vtype->asttype == UintNbrType)
+		lit = (AstNode *)newULitNode(val->uint, val->vtype);
+	else if (val->vtype->asttype == FloatNbrType)
+		lit = (AstNode *)newFLitNode(val->flt, val->vtype);
+	else if (val->vtype->asttype == ArrayType) {
+		AggLitAstNode *agg = newAggLitNode(vtype, val->nelems);
+		AstNode *elemtype = ((ArrayAstNode *)val->vtype)->elemtype;
+		uint32_t i;
+		for (i = 0; i < val->nelems; i++) {
+			AstNode *elem = constLiteral(&val->elems[i], elemtype, at);
+			if (elem == NULL)
+				return NULL;
+			nodesAdd(&agg->elems, elem);
+		}
+		lit = (AstNode *)agg;
+	}
+	else if (val->vtype->asttype == StructType) {
+		AggLitAstNode *agg = newAggLitNode(vtype, val->nelems);
+		SymNode *inodesp;
+		uint32_t cnt, i = 0;
+		for (inodesFor(((StructAstNode *)val->vtype)->fields, cnt, inodesp)) {
+			AstNode *elem = constLiteral(&val->elems[i++], ((NameDclAstNode *)inodesp->node)->vtype, at);
+			if (elem == NULL)
+				return NULL;
+			nodesAdd(&agg->elems, elem);
+		}
+		lit = (AstNode *)agg;
+	}
+	else
+		return NULL;
+	lit->lexer = at->lexer;
+	lit->srcp = at->srcp;
+	lit->linep = at->linep;
+	lit->linenbr = at->linenbr;
+	return lit;
+}
+
+// Compute a global variable's initial value, which must be known at compile time
+static void constGlobal(ConstState *cs, NameDclAstNode *dcl) {
+	ConstVal *val;
+	AstNode *lit;
+
+	cs->steps = 0;
+	cs->failnode = NULL;
+	if (constFixed(cs, (AstNode *)dcl, dcl, &val) == ConstFail) {
+		errorMsgNode(cs->failnode, ErrorNotConst, "%s's initial value cannot be computed at compile time: %s",
+			&dcl->namesym->namestr, cs->failmsg);
+		return;
+	}
+	if ((lit = constLiteral(val, dcl->vtype, dcl->value)) == NULL) {
+		errorMsgNode(dcl->value, ErrorNotConst, "A global variable's initial value may not hold a reference");
+		return;
+	}
+	dcl->value = lit;
+}
+
+// Fold the value of each local const declaration (within the node) that can be computed
+static void constFold(ConstState *cs, AstNode *node) {
+	AstNode **nodesp;
+	uint32_t cnt;
+
+	switch (node->asttype) {
+	case BlockNode:
+		for (nodesFor(((BlockAstNode *)node)->stmts, cnt, nodesp))
+			constFold(cs, *nodesp);
+		break;
+	case IfNode:
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			if (*nodesp != voidType)
+				constFold(cs, *nodesp);
+		break;
+	case WhileNode:
+		constFold(cs, ((WhileAstNode *)node)->blk);
+		break;
+	case ForNode:
+		constFold(cs, ((ForAstNode *)node)->blk);
+		break;
+	case VarNameDclNode:
+	{
+		NameDclAstNode *dcl = (NameDclAstNode *)node;
+		ConstVal val;
+		AstNode *lit;
+		if (dcl->perm != constPerm || dcl->value == NULL || litIsLiteral(dcl->value))
+			break;
+		cs->steps = 0;
+		cs->failnode = NULL;
+		cs->vars = NULL;
+		if (constExp(cs, dcl->value, &val) == ConstNext && (lit = constLiteral(&val, dcl->vtype, dcl->value)))
+			dcl->value = lit;
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+// Compute the global variables' initial values, and fold the local const declarations, of a module
+static void constModule(ConstState *cs, ModuleAstNode *mod) {
+	uint32_t cnt;
+	AstNode **nodesp;
+	for (nodesFor(mod->nodes, cnt, nodesp)) {
+		switch ((*nodesp)->asttype) {
+		case VarNameDclNode:
+		{
+			NameDclAstNode *dcl = (NameDclAstNode *)*nodesp;
+			if (dcl->value == NULL)
+				break;
+			if (dcl->vtype->asttype != FnSig)
+				constGlobal(cs, dcl);
+			else if (dcl->value->asttype == BlockNode)
+				constFold(cs, dcl->value);
+			break;
+		}
+
+		// A type's methods
+		case VtypeNameDclNode:
+		case AllocNameDclNode:
+		{
+			TypeAstNode *tnode = (TypeAstNode *)((NameDclAstNode *)*nodesp)->value;
+			uint32_t mcnt;
+			AstNode **methp;
+			if (tnode == NULL || tnode->methods == NULL)
+				break;
+			for (nodesFor(tnode->methods, mcnt, methp)) {
+				NameDclAstNode *meth = (NameDclAstNode *)*methp;
+				if (meth->value && meth->value->asttype == BlockNode)
+					constFold(cs, meth->value);
+			}
+			break;
+		}
+
+		case ModuleNode:
+			constModule(cs, (ModuleAstNode *)*nodesp);
+			break;
+		}
+	}
+}
+
+// Compute every global variable's initial value at compile time (after type checking)
+void constEvaluate(ModuleAstNode *mod) {
+	ConstState cs;
+	cs.vars = NULL;
+	cs.fixed = NULL;
+	cs.calls = 0;
+	constModule(&cs, mod);
+}
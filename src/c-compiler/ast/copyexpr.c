@@ -43,7 +43,6 @@ int isLval(AstNode *node) {
 	case DerefNode:
 	case ElementNode:
 		return 1;
-	// future:  [] indexing and .member
 	default: break;
 	}
 
@@ -128,6 +127,9 @@ void fnCallPass(PassState *pstate, FnCallAstNode *node) {
 	uint32_t cnt;
 	for (nodesFor(node->parms, cnt, argsp))
 astPass(pstate, *argsp);
+// A generic function's instance is inferred from the arguments' types
+if (pstate->pass == TypeCheck && !genericCall(pstate, node))
+	return;
 astPass(pstate, node->fn);
 
 switch (pstate->pass) {
@@ -222,6 +224,8 @@ void addrTypeCheckBorrow(AddrAstNode *node, PtrAstNode *ptype) {
 	}
 	if (!permMatches(ptype->perm, ((NameUseAstNode*)exp)->dclnode->perm))
 		errorMsgNode((AstNode *)node, ErrorBadPerm, "Borrowed reference cannot obtain this permission");
+	// The variable's value escapes into memory, so generation must give it an address
+	((NameUseAstNode*)exp)->dclnode->flags |= FlagAddrTaken;
 }
 
 // Analyze addr node
@@ -235,6 +239,8 @@ void addrPass(PassState *pstate, AddrAstNode *node) {
 		PtrAstNode *ptype = (PtrAstNode *)node->vtype;
 		if (ptype->pvtype == NULL)
 			ptype->pvtype = ((TypedAstNode *)node->exp)->vtype; // inferred
+		node->vtype = typeIntern((AstNode*)ptype);
+		ptype = (PtrAstNode *)node->vtype;
 		if (ptype->alloc == voidType)
 			addrTypeCheckBorrow(node, ptype);
 		else
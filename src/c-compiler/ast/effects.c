@@ -0,0 +1,473 @@
+/** Function effect analysis
+ * @file
+ *
+ * After type checking, every function the program defines is summarized by what
+ * it might do besides compute its return value: whether it reads or writes memory
+ * its callers can see (mutable globals, or anything reached through a reference
+ * or pointer), whether it contains a loop, whether it might trap (on a failed
+ * bounds check or arithmetic overflow check), and which functions it calls.
+ * Locals and parameters are not caller-visible memory.
+ *
+ * These summaries are then propagated across the call graph. Its strongly
+ * connected components (found using Tarjan's algorithm) identify the recursive
+ * functions, and are visited callees-first, so each component needs only one visit.
+ * A call to an extern function or through a function pointer is unknown code,
+ * which might do anything (including call back into the program).
+ *
+ * Results are marked as flags on each function's declaration node, which
+ * generation turns into LLVM function attributes.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "ast.h"
+#include "../shared/error.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// How much caller-visible memory a function may access, in increasing order
+enum EffectLevel {
+	EffectNone,
+	EffectRead,
+	EffectWrite
+};
+
+// Effect summary of a single program-defined function
+typedef struct EffectFn {
+	NameDclAstNode *fndcl;	// The function's declaration
+	uint32_t *callees;		// Indexes of the program-defined functions it calls
+	uint32_t calleesUsed;
+	uint32_t calleesAvail;
+	int effect;				// EffectLevel
+	int loops;				// It contains a loop, which might not end
+	int traps;				// It might trap, so not return
+	int unknown;			// It (or what it calls) calls unknown code
+	uint32_t visit;			// Tarjan: visit order (0 = not yet visited)
+	uint32_t lowlink;		// Tarjan: lowest visit order reachable
+	int onstack;			// Tarjan: is it on the component stack?
+} EffectFn;
+
+// A declaration known to the analysis: a function (index >= 0) or a mutable global (-1)
+typedef struct EffectSym {
+	NameDclAstNode *dcl;
+	int32_t index;
+} EffectSym;
+
+#define EffectGlobal -1
+
+// State used by the analysis
+typedef struct EffectState {
+	EffectFn *fns;
+	uint32_t fnsUsed;
+	uint32_t fnsAvail;
+	EffectSym *syms;		// Open addressing hash table of known declarations
+	size_t symsAvail;		// (power of 2)
+	size_t symsUsed;
+	uint32_t *stack;		// Tarjan's component stack
+	uint32_t stackUsed;
+	uint32_t visits;
+} EffectState;
+
+// Allocate or grow a malloc'ed array, exiting if out of memory
+static void *effectRealloc(void *ptr, size_t size) {
+	if (!(ptr = realloc(ptr, size)))
+		errorExit(ExitMem, "Error: Out of memory");
+	return ptr;
+}
+
+// Find the hash table slot holding the declaration (or the empty slot where it belongs)
+static EffectSym *effectFindSym(EffectState *state, NameDclAstNode *dcl) {
+	size_t slot, step;
+	for (slot = ((size_t)dcl >> 4) & (state->symsAvail - 1), step = 1;; ++step) {
+		EffectSym *sym = &state->syms[slot];
+		if (sym->dcl == NULL || sym->dcl == dcl)
+			return sym;
+		slot = (slot + step) & (state->symsAvail - 1);
+	}
+}
+
+// Add a declaration to the hash table, growing it when it gets too full
+static void effectAddSym(EffectState *state, NameDclAstNode *dcl, int32_t index) {
+	EffectSym *sym;
+	if (state->symsUsed * 10 >= state->symsAvail * 7) {
+		EffectSym *oldsyms = state->syms;
+		size_t oldavail = state->symsAvail;
+		size_t slot;
+		state->symsAvail = oldavail == 0 ? 256 : oldavail << 1;
+		state->syms = (EffectSym *)effectRealloc(NULL, state->symsAvail * sizeof(EffectSym));
+		memset(state->syms, 0, state->symsAvail * sizeof(EffectSym));
+		for (slot = 0; slot < oldavail; slot++) {
+			if (oldsyms[slot].dcl)
+				*effectFindSym(state, oldsyms[slot].dcl) = oldsyms[slot];
+		}
+		free(oldsyms);
+	}
+	sym = effectFindSym(state, dcl);
+	if (sym->dcl == NULL)
+		++state->symsUsed;
+	sym->dcl = dcl;
+	sym->index = index;
+}
+
+// Return the known declaration's symbol, or NULL if unknown
+static EffectSym *effectGetSym(EffectState *state, NameDclAstNode *dcl) {
+	EffectSym *sym;
+	if (state->symsAvail == 0 || dcl == NULL)
+		return NULL;
+	sym = effectFindSym(state, dcl);
+	return sym->dcl ? sym : NULL;
+}
+
+// Add a program-defined function to be analyzed
+static void effectAddFn(EffectState *state, NameDclAstNode *fndcl) {
+	EffectFn *fn;
+	if (state->fnsUsed >= state->fnsAvail) {
+		state->fnsAvail = state->fnsAvail == 0 ? 256 : state->fnsAvail << 1;
+		state->fns = (EffectFn *)effectRealloc(state->fns, state->fnsAvail * sizeof(EffectFn));
+	}
+	fn = &state->fns[state->fnsUsed];
+	memset(fn, 0, sizeof(EffectFn));
+	fn->fndcl = fndcl;
+	effectAddSym(state, fndcl, state->fnsUsed++);
+}
+
+// Find all program-defined functions and mutable globals in a module
+static void effectCollect(EffectState *state, ModuleAstNode *mod) {
+	uint32_t cnt;
+	AstNode **nodesp;
+	for (nodesFor(mod->nodes, cnt, nodesp)) {
+		switch ((*nodesp)->asttype) {
+		case VarNameDclNode:
+		{
+			NameDclAstNode *dcl = (NameDclAstNode *)*nodesp;
+			if (dcl->vtype->asttype == FnSig) {
+				if (dcl->value && dcl->value->asttype == BlockNode)
+					effectAddFn(state, dcl);
+			}
+			// An immutable global never changes, so reading it is not an effect
+			else if (dcl->perm != immPerm)
+				effectAddSym(state, dcl, EffectGlobal);
+			break;
+		}
+
+		// A type's methods
+		case VtypeNameDclNode:
+		case AllocNameDclNode:
+		{
+			TypeAstNode *tnode = (TypeAstNode *)((NameDclAstNode *)*nodesp)->value;
+			uint32_t mcnt;
+			AstNode **methp;
+			if (tnode == NULL || tnode->methods == NULL)
+				break;
+			for (nodesFor(tnode->methods, mcnt, methp)) {
+				NameDclAstNode *meth = (NameDclAstNode *)*methp;
+				if (meth->value && meth->value->asttype == BlockNode)
+					effectAddFn(state, meth);
+			}
+			break;
+		}
+
+		case ModuleNode:
+			effectCollect(state, (ModuleAstNode *)*nodesp);
+			break;
+		}
+	}
+}
+
+// Note that the function accesses caller-visible memory
+#define effectRaise(fn, level) if ((fn)->effect < (level)) (fn)->effect = (level)
+
+// Note that the function calls unknown code
+static void effectUnknown(EffectFn *fn) {
+	fn->unknown = 1;
+	effectRaise(fn, EffectWrite);
+}
+
+// Note that the function directly calls another
+static void effectAddCallee(EffectFn *fn, uint32_t callee) {
+	if (fn->calleesUsed >= fn->calleesAvail) {
+		fn->calleesAvail = fn->calleesAvail == 0 ? 8 : fn->calleesAvail << 1;
+		fn->callees = (uint32_t *)effectRealloc(fn->callees, fn->calleesAvail * sizeof(uint32_t));
+	}
+	fn->callees[fn->calleesUsed++] = callee;
+}
+
+static void effectExp(EffectState *state, EffectFn *fn, AstNode *node);
+
+// Summarize indexing an array or slice: evaluating its index and checking its bounds.
+// Return whether it is indexed through a reference (or slice).
+static int effectIndex(EffectState *state, EffectFn *fn, ElementAstNode *node) {
+	AstNode *ownvtype;
+	if (!(node->flags & FlagIndex))
+		return 0;
+	effectExp(state, fn, node->element);
+	if (!(node->flags & FlagInBounds))
+		fn->traps = 1;
+	ownvtype = typeGetVtype(node->owner);
+	return ownvtype->asttype == RefType || ownvtype->asttype == PtrType || isSlice(ownvtype);
+}
+
+// Summarize computing the address of an lval (which itself accesses no memory)
+static void effectAddr(EffectState *state, EffectFn *fn, AstNode *node) {
+	switch (node->asttype) {
+	case NameUseNode:
+		break;
+	case ElementNode:
+		effectIndex(state, fn, (ElementAstNode *)node);
+		effectAddr(state, fn, ((ElementAstNode *)node)->owner);
+		break;
+	case DerefNode:
+		effectExp(state, fn, ((DerefAstNode *)node)->exp);
+		break;
+	default:
+		effectExp(state, fn, node);
+	}
+}
+
+// Summarize storing into an lval
+static void effectStore(EffectState *state, EffectFn *fn, AstNode *node) {
+	switch (node->asttype) {
+	case NameUseNode:
+	{
+		EffectSym *sym = effectGetSym(state, ((NameUseAstNode *)node)->dclnode);
+		if (sym && sym->index == EffectGlobal)
+			effectRaise(fn, EffectWrite);
+		break;
+	}
+	case ElementNode:
+		if (effectIndex(state, fn, (ElementAstNode *)node)) {
+			effectRaise(fn, EffectWrite);
+			effectExp(state, fn, ((ElementAstNode *)node)->owner);
+		}
+		else
+			effectStore(state, fn, ((ElementAstNode *)node)->owner);
+		break;
+	case DerefNode:
+		effectRaise(fn, EffectWrite);
+		effectExp(state, fn, ((DerefAstNode *)node)->exp);
+		break;
+	default:
+		effectExp(state, fn, node);
+	}
+}
+
+// Summarize a function call
+static void effectCall(EffectState *state, EffectFn *fn, FnCallAstNode *node) {
+	uint32_t cnt;
+	AstNode **nodesp;
+	for (nodesFor(node->parms, cnt, nodesp))
+		effectExp(state, fn, *nodesp);
+
+	// Calling through a function pointer
+	if (node->fn->asttype == DerefNode) {
+		effectExp(state, fn, ((DerefAstNode *)node->fn)->exp);
+		effectUnknown(fn);
+	}
+	else if (node->fn->asttype == NameUseNode || node->fn->asttype == MemberUseNode) {
+		NameDclAstNode *dcl = ((NameUseAstNode *)node->fn)->dclnode;
+		EffectSym *sym = effectGetSym(state, dcl);
+		if (sym && sym->index >= 0)
+			effectAddCallee(fn, sym->index);
+		// Op codes are pure computations, though checked arithmetic may trap
+		else if (dcl && dcl->value && dcl->value->asttype == OpCodeNode) {
+			int16_t opcode = ((OpCodeAstNode *)dcl->value)->opcode;
+			if (opcode == AddCheckedOpCode || opcode == SubCheckedOpCode || opcode == MulCheckedOpCode)
+				fn->traps = 1;
+		}
+		else
+			effectUnknown(fn);
+	}
+	else
+		effectUnknown(fn);
+}
+
+// Summarize what evaluating a statement or expression node does
+static void effectExp(EffectState *state, EffectFn *fn, AstNode *node) {
+	uint32_t cnt;
+	AstNode **nodesp;
+
+	switch (node->asttype) {
+	case VarNameDclNode:
+		if (((NameDclAstNode *)node)->value)
+			effectExp(state, fn, ((NameDclAstNode *)node)->value);
+		break;
+	case NameUseNode:
+	{
+		EffectSym *sym = effectGetSym(state, ((NameUseAstNode *)node)->dclnode);
+		if (sym && sym->index == EffectGlobal)
+			effectRaise(fn, EffectRead);
+		break;
+	}
+	case BlockNode:
+		for (nodesFor(((BlockAstNode *)node)->stmts, cnt, nodesp))
+			effectExp(state, fn, *nodesp);
+		break;
+	case IfNode:
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			effectExp(state, fn, *nodesp);
+		break;
+	case WhileNode:
+		fn->loops = 1;
+		effectExp(state, fn, ((WhileAstNode *)node)->condexp);
+		effectExp(state, fn, ((WhileAstNode *)node)->blk);
+		break;
+	// A counted loop always ends, so it does not set loops
+	case ForNode:
+	{
+		ForAstNode *fnode = (ForAstNode *)node;
+		AstNode *tovtype = typeGetVtype(fnode->to);
+		if (fnode->from)
+			effectExp(state, fn, fnode->from);
+		effectExp(state, fn, fnode->to);
+		if (!fnode->from && (tovtype->asttype == RefType || tovtype->asttype == PtrType || isSlice(tovtype)))
+			effectRaise(fn, EffectRead);
+		effectExp(state, fn, fnode->blk);
+		break;
+	}
+	case ReturnNode:
+		effectExp(state, fn, ((ReturnAstNode *)node)->exp);
+		break;
+	case AssignNode:
+		effectExp(state, fn, ((AssignAstNode *)node)->rval);
+		effectStore(state, fn, ((AssignAstNode *)node)->lval);
+		break;
+	case FnCallNode:
+		effectCall(state, fn, (FnCallAstNode *)node);
+		break;
+	case CastNode:
+		effectExp(state, fn, ((CastAstNode *)node)->exp);
+		break;
+	case DerefNode:
+		effectRaise(fn, EffectRead);
+		effectExp(state, fn, ((DerefAstNode *)node)->exp);
+		break;
+	case ElementNode:
+		if (effectIndex(state, fn, (ElementAstNode *)node))
+			effectRaise(fn, EffectRead);
+		effectExp(state, fn, ((ElementAstNode *)node)->owner);
+		break;
+	case AddrNode:
+		effectAddr(state, fn, ((AddrAstNode *)node)->exp);
+		break;
+	case NotLogicNode:
+		effectExp(state, fn, ((LogicAstNode *)node)->lexp);
+		break;
+	case OrLogicNode: case AndLogicNode:
+		effectExp(state, fn, ((LogicAstNode *)node)->lexp);
+		effectExp(state, fn, ((LogicAstNode *)node)->rexp);
+		break;
+
+	// Literals, sizeof, break, continue and types do nothing at runtime
+	default:
+		break;
+	}
+}
+
+// Tarjan's algorithm: visit a function and everything it calls.
+// Once all of a strongly connected component's functions (and everything they call)
+// have been visited, combine their summaries and mark them.
+static void effectVisit(EffectState *state, uint32_t index) {
+	EffectFn *fn = &state->fns[index];
+	uint32_t i;
+
+	fn->visit = fn->lowlink = ++state->visits;
+	state->stack[state->stackUsed++] = index;
+	fn->onstack = 1;
+	for (i = 0; i < fn->calleesUsed; i++) {
+		EffectFn *callee = &state->fns[fn->callees[i]];
+		if (callee->visit == 0) {
+			effectVisit(state, fn->callees[i]);
+			if (callee->lowlink < fn->lowlink)
+				fn->lowlink = callee->lowlink;
+		}
+		else if (callee->onstack && callee->visit < fn->lowlink)
+			fn->lowlink = callee->visit;
+	}
+	if (fn->lowlink != fn->visit)
+		return;
+
+	// fn is the root of a component: its members are at the top of the stack
+	{
+		uint32_t first = state->stackUsed;
+		int effect = EffectNone;
+		int unknown = 0;
+		int recursive;
+		int mayloop = 0;		// It might loop forever (or trap), so not return
+		uint32_t member;
+
+		while (state->stack[--first] != index)
+			;
+		recursive = state->stackUsed - first > 1;
+
+		// Combine the members' own summaries with those of the (already marked) callees.
+		// Any callee still on the stack is a member of this component.
+		for (member = first; member < state->stackUsed; member++) {
+			EffectFn *mfn = &state->fns[state->stack[member]];
+			if (mfn->effect > effect)
+				effect = mfn->effect;
+			unknown |= mfn->unknown;
+			mayloop |= mfn->loops | mfn->traps;
+			for (i = 0; i < mfn->calleesUsed; i++) {
+				EffectFn *callee = &state->fns[mfn->callees[i]];
+				if (callee == mfn)
+					recursive = 1;
+				else if (!callee->onstack) {
+					if (callee->effect > effect)
+						effect = callee->effect;
+					unknown |= callee->unknown;
+					mayloop |= !(callee->fndcl->flags & FlagWillReturn);
+				}
+			}
+		}
+
+		// Mark every member with what is now known about it
+		for (member = first; member < state->stackUsed; member++) {
+			EffectFn *mfn = &state->fns[state->stack[member]];
+			mfn->onstack = 0;
+			mfn->effect = effect;
+			mfn->unknown = unknown;
+			if (effect == EffectNone)
+				mfn->fndcl->flags |= FlagReadNone;
+			else if (effect == EffectRead)
+				mfn->fndcl->flags |= FlagReadOnly;
+			// Unknown code might call back into this function
+			if (!recursive && !unknown)
+				mfn->fndcl->flags |= FlagNoRecurse;
+			if (!recursive && !unknown && !mayloop)
+				mfn->fndcl->flags |= FlagWillReturn;
+		}
+		state->stackUsed = first;
+	}
+}
+
+// Infer the effects of every program-defined function (after type checking)
+void effectAnalysis(ModuleAstNode *mod) {
+	EffectState state;
+	uint32_t index;
+
+	memset(&state, 0, sizeof(state));
+	effectCollect(&state, mod);
+	if (state.fnsUsed == 0) {
+		free(state.syms);
+		return;
+	}
+
+	// Summarize what each function does by itself
+	for (index = 0; index < state.fnsUsed; index++)
+		effectExp(&state, &state.fns[index], state.fns[index].fndcl->value);
+
+	// Propagate summaries across the call graph
+	state.stack = (uint32_t *)effectRealloc(NULL, state.fnsUsed * sizeof(uint32_t));
+	for (index = 0; index < state.fnsUsed; index++) {
+		if (state.fns[index].visit == 0)
+			effectVisit(&state, index);
+	}
+
+	for (index = 0; index < state.fnsUsed; index++)
+		free(state.fns[index].callees);
+	free(state.fns);
+	free(state.syms);
+	free(state.stack);
+}
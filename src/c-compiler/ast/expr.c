@@ -31,6 +31,8 @@ void sizeofPrint(SizeofAstNode *node) {
 // Analyze sizeof node
 void sizeofPass(PassState *pstate, SizeofAstNode *node) {
 	astPass(pstate, node->type);
+	if (pstate->pass == NameResolution)
+		node->type = typeIntern(node->type);
 }
 
 // Create a new cast node
@@ -55,8 +57,11 @@ void castPrint(CastAstNode *node) {
 void castPass(PassState *pstate, CastAstNode *node) {
 	astPass(pstate, node->exp);
 	astPass(pstate, node->vtype);
+	if (pstate->pass == NameResolution)
+		node->vtype = typeIntern(node->vtype);
+	// Report on the cast node, as its (interned) type may be shared with other code
 	if (pstate->pass == TypeCheck && 0 == typeMatches(node->vtype, ((TypedAstNode *)node->exp)->vtype))
-		errorMsgNode(node->vtype, ErrorInvType, "expression may not be type cast to this type");
+		errorMsgNode((AstNode*)node, ErrorInvType, "expression may not be type cast to this type");
 }
 
 // Create a new deref node
@@ -106,15 +111,55 @@ ElementAstNode *newElementAstNode() {
 // Serialize element
 void elementPrint(ElementAstNode *node) {
 	astPrintNode(node->owner);
+	if (node->flags & FlagIndex) {
+		astFprint("[");
+		astPrintNode(node->element);
+		astFprint("]");
+		return;
+	}
 	astFprint(".");
 	astPrintNode(node->element);
 }
 
+// Analyze indexing an array or slice: owner[index]
+static void elementIndexPass(PassState *pstate, ElementAstNode *node) {
+	AstNode *ownvtype = typeGetVtype(node->owner);
+	ArrayAstNode *arrtype = arrayIndexable(ownvtype);
+	AstNode *idxtype = typeGetVtype(node->element);
+
+	if (arrtype == NULL || (arrtype->size == 0 && !isSlice(ownvtype))) {
+		errorMsgNode((AstNode*)node, ErrorBadArray, "Only an array, or a reference or slice to one, may be indexed");
+		return;
+	}
+	node->vtype = arrtype->elemtype;
+
+	// The index is an unsigned offset, so a negative one is out of bounds
+	if (!isNbr(idxtype) || idxtype->asttype == FloatNbrType || !typeCoerces((AstNode*)usizeType, &node->element))
+		errorMsgNode(node->element, ErrorInvType, "An index must be an integer");
+
+	// An array variable is indexed in place, so generation must give it an address
+	if (node->owner->asttype == NameUseNode && ((NameUseAstNode*)node->owner)->dclnode->asttype == VarNameDclNode
+		&& ownvtype->asttype == ArrayType)
+		((NameUseAstNode*)node->owner)->dclnode->flags |= FlagAddrTaken;
+}
+
 // Analyze element node
 void elementPass(PassState *pstate, ElementAstNode *node) {
 	astPass(pstate, node->owner);
+	if (node->flags & FlagIndex) {
+		astPass(pstate, node->element);
+		if (pstate->pass == TypeCheck)
+			elementIndexPass(pstate, node);
+		return;
+	}
 	if (pstate->pass == TypeCheck) {
 		if (node->element->asttype == MemberUseNode) {
+			// The number of elements of an array or slice (the MemberUseNode is kept, to mark this)
+			ArrayAstNode *arrtype = arrayIndexable(typeGetVtype(node->owner));
+			if (arrtype && ((NameUseAstNode*)node->element)->namesym == nameFind("len", 3)) {
+				node->vtype = (AstNode*)usizeType;
+				return;
+			}
 			derefAuto(&node->owner);
 			AstNode *ownvtype = typeGetVtype(node->owner);
 			if (ownvtype->asttype == StructType) {
@@ -0,0 +1,698 @@
+/** Generic functions and structs
+ * @file
+ *
+ * A function or struct may be parameterized by types:
+ *
+ *     fn max[T](a T, b T) T
+ *       if a > b {a} else {b}
+ *
+ *     struct Box[T]
+ *       val T
+ *       fn get() T
+ *         val
+ *
+ * The generic's declaration is a template: it is name resolved (its type parameters
+ * bound to placeholder declarations), but never type checked or generated.
+ * Instead, every use of it asks for the instance for some type arguments: explicitly
+ * for a struct (Box[i32]), or inferred from the call's arguments for a function (max(a, 3)).
+ * An instance is a copy of the template, with each placeholder replaced by its type
+ * argument, that becomes one more declaration of the generic's module (e.g., 'Box[i32]').
+ *
+ * Instances are memoized by the canonical identity of their type arguments,
+ * so each distinct instance is copied, type checked and generated only once per package.
+ * An instance's name mangles its type arguments (see typeMangle), so it is unique too.
+ *
+ * Instances asked for during name resolution are copied once it is done (when all templates
+ * are resolved). Those asked for later are copied at once, then type checked.
+ * A template's uses of generics (e.g., Box[T]) are instantiated as it is copied.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "ast.h"
+#include "nametbl.h"
+#include "../parser/lexer.h"
+#include "../shared/error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A template's declaration, and its copy within the instance being copied
+typedef struct GenericDcl {
+	NameDclAstNode *dcl;
+	NameDclAstNode *copy;
+} GenericDcl;
+
+// State used while copying a template into an instance
+typedef struct GenericCopy {
+	GenericAstNode *generic;	// The generic whose template is copied
+	AstNode **args;				// Type arguments that replace its type parameters
+	NameDclAstNode *inst;		// The instance's declaration
+	GenericDcl *dcls;			// The template's declarations copied so far
+	uint32_t dclsUsed;
+	uint32_t dclsAvail;
+} GenericCopy;
+
+// An instance still to be copied (and perhaps type checked)
+typedef struct GenericWork {
+	GenericAstNode *generic;
+	uint32_t inst;			// Index of its instance
+} GenericWork;
+
+// Phases of instantiation, following the passes
+enum GenericPhase {
+	GenericNaming,		// Name resolution: instances are only named, copied later
+	GenericChecking		// Type check: instances are copied and type checked at once
+};
+
+// Private globals: the package's instances, in the order asked for
+static GenericWork *gGenericWork = NULL;
+static uint32_t gGenericWorkUsed = 0;
+static uint32_t gGenericWorkAvail = 0;
+static uint32_t gGenericCopied = 0;		// Instances before this have been copied
+static uint32_t gGenericChecked = 0;	// ... have been type checked (or will be by the pass)
+static uint32_t gGenericAdded = 0;		// ... have been added to their generic's module
+static int gGenericPhase = GenericNaming;
+static int gGenericCopying = 0;			// Are instances being copied?
+static int gGenericChecking = 0;		// Are instances being type checked?
+static GenericAstNode *gGenericTemplate = NULL;	// Generic whose template is being name resolved
+
+// Allocate or grow a malloc'ed array, exiting if out of memory
+static void *genericRealloc(void *ptr, size_t size) {
+	if (!(ptr = realloc(ptr, size)))
+		errorExit(ExitMem, "Error: Out of memory");
+	return ptr;
+}
+
+// Create a new generic for a parsed template and its type parameters
+GenericAstNode *newGenericNode(NameDclAstNode *dcl, Nodes *parms) {
+	GenericAstNode *node;
+	AstNode **nodesp;
+	uint32_t cnt;
+	newAstNode(node, GenericAstNode, GenericNode);
+	node->lexer = dcl->lexer;
+	node->srcp = dcl->srcp;
+	node->linep = dcl->linep;
+	node->linenbr = dcl->linenbr;
+	node->vtype = dcl->vtype;
+	node->owner = dcl->owner;
+	node->hooklinks = NULL;
+	node->namesym = dcl->namesym;
+	node->hooklink = NULL;
+	node->prevname = NULL;
+	node->perm = dcl->perm;
+	node->value = dcl->value;
+	node->dcl = dcl;
+	node->parms = parms;
+	node->insts = NULL;
+	node->instsUsed = node->instsAvail = 0;
+	for (nodesFor(parms, cnt, nodesp))
+		((NameDclAstNode *)*nodesp)->owner = (NamedAstNode *)node;
+	return node;
+}
+
+// Serialize a generic's template
+void genericPrint(GenericAstNode *node) {
+	AstNode **nodesp;
+	uint32_t cnt;
+	astFprint("generic [");
+	for (nodesFor(node->parms, cnt, nodesp)) {
+		astFprint("%s", &((NameDclAstNode *)*nodesp)->namesym->namestr);
+		if (cnt > 1)
+			astFprint(", ");
+	}
+	astFprint("] ");
+	astPrintNode((AstNode *)node->dcl);
+}
+
+// Name resolve the generic's template, with its type parameters in scope.
+// The template is never type checked: its instances are.
+void genericPass(PassState *pstate, GenericAstNode *node) {
+	GenericAstNode *svtemplate;
+	AstNode **nodesp;
+	uint32_t cnt;
+
+	if (pstate->pass != NameResolution)
+		return;
+	svtemplate = gGenericTemplate;
+	gGenericTemplate = node;
+	for (nodesFor(node->parms, cnt, nodesp))
+		nameHook((OwnerAstNode *)node, (NamedAstNode *)*nodesp, ((NameDclAstNode *)*nodesp)->namesym);
+	astPass(pstate, (AstNode *)node->dcl);
+	nameUnhook((OwnerAstNode *)node);
+	gGenericTemplate = svtemplate;
+}
+
+// Is the name a type parameter of the generic? If so, return its index, else -1.
+static int genericParm(GenericAstNode *generic, AstNode *type) {
+	NameDclAstNode *dcl;
+	if (type == NULL || type->asttype != NameUseNode)
+		return -1;
+	dcl = ((NameUseAstNode *)type)->dclnode;
+	if (dcl == NULL || dcl->asttype != VtypeNameDclNode || dcl->owner != (NamedAstNode *)generic)
+		return -1;
+	return dcl->index;
+}
+
+// Identity of a type argument: a type's name is identified by the type it names
+// (as for type interning, which makes identical anonymous types the same node)
+static AstNode *genericArgId(AstNode *type) {
+	if (type->asttype == NameUseNode && ((NameUseAstNode *)type)->dclnode)
+		return ((NameUseAstNode *)type)->dclnode->value;
+	return type;
+}
+
+static void genericFlush();
+
+// Return the generic's instance for the type arguments, asking for a new one if not yet made
+static NameDclAstNode *genericInstance(GenericAstNode *generic, AstNode **args) {
+	uint32_t nargs = generic->parms->used;
+	uint32_t i, j;
+	GenericInst *inst;
+	NameDclAstNode *dcl;
+	char workbuf[2048];
+	char *bufp;
+
+	// Has it already been made?
+	for (i = 0; i < generic->instsUsed; i++) {
+		inst = &generic->insts[i];
+		for (j = 0; j < nargs && genericArgId(inst->args[j]) == genericArgId(args[j]); j++);
+		if (j == nargs)
+			return inst->dcl;
+	}
+
+	// Mangle its name from the generic's and its type arguments'
+	bufp = workbuf + sprintf(workbuf, "%s[", &generic->namesym->namestr);
+	for (j = 0; j < nargs; j++) {
+		if (j > 0)
+			*bufp++ = ',';
+		bufp = typeMangle(bufp, args[j]);
+	}
+	*bufp++ = ']';
+	*bufp = '\0';
+
+	// Declare the instance. It is filled in (e.g., its function's body) when it is copied.
+	dcl = (NameDclAstNode *)memAllocBlk(sizeof(NameDclAstNode));
+	memcpy(dcl, generic->dcl, sizeof(NameDclAstNode));
+	dcl->namesym = nameFind(workbuf, strlen(workbuf));
+	dcl->flags |= FlagInstance;
+	dcl->owner = generic->owner;
+	dcl->hooklinks = dcl->hooklink = dcl->prevname = NULL;
+	dcl->llvmvar = NULL;
+	if (dcl->asttype == VarNameDclNode)
+		dcl->value = NULL;
+	else {
+		// A struct's type must exist now, as it identifies the instance's type
+		StructAstNode *strnode = (StructAstNode *)memAllocBlk(sizeof(StructAstNode));
+		memcpy(strnode, generic->dcl->value, sizeof(StructAstNode));
+		strnode->fields = newInodes(((StructAstNode *)generic->dcl->value)->fields->used + 1);
+		strnode->methods = newNodes(((StructAstNode *)generic->dcl->value)->methods->used + 1);
+		dcl->value = (AstNode *)strnode;
+	}
+
+	// Memoize it
+	if (generic->instsUsed >= generic->instsAvail) {
+		GenericInst *oldinsts = generic->insts;
+		generic->instsAvail = generic->instsAvail == 0 ? 4 : generic->instsAvail << 1;
+		generic->insts = (GenericInst *)memAllocBlk(generic->instsAvail * sizeof(GenericInst));
+		if (oldinsts)
+			memcpy(generic->insts, oldinsts, generic->instsUsed * sizeof(GenericInst));
+	}
+	inst = &generic->insts[generic->instsUsed];
+	inst->args = (AstNode **)memAllocBlk(nargs * sizeof(AstNode *));
+	memcpy(inst->args, args, nargs * sizeof(AstNode *));
+	inst->dcl = dcl;
+
+	// Ask for it to be copied
+	if (gGenericWorkUsed >= gGenericWorkAvail) {
+		gGenericWorkAvail = gGenericWorkAvail == 0 ? 64 : gGenericWorkAvail << 1;
+		gGenericWork = (GenericWork *)genericRealloc(gGenericWork, gGenericWorkAvail * sizeof(GenericWork));
+	}
+	gGenericWork[gGenericWorkUsed].generic = generic;
+	gGenericWork[gGenericWorkUsed++].inst = generic->instsUsed++;
+	genericFlush();
+	return dcl;
+}
+
+// Bind the name of a generic (with its type arguments) to its instance
+void genericNameUse(PassState *pstate, NameUseAstNode *name) {
+	GenericAstNode *generic = (GenericAstNode *)name->dclnode;
+	AstNode **nodesp;
+	uint32_t cnt;
+
+	if (generic->asttype != GenericNode) {
+		errorMsgNode((AstNode *)name, ErrorTypeArgs, "%s is not generic, so it takes no type arguments", &name->namesym->namestr);
+		return;
+	}
+
+	// A generic function's name is bound by its call (see genericCall).
+	// A generic struct's name needs type arguments, except within its own template.
+	if (generic->dcl->asttype == VarNameDclNode) {
+		if (name->typeargs)
+			errorMsgNode((AstNode *)name, ErrorTypeArgs, "A generic function's type arguments are inferred from its call's arguments");
+		return;
+	}
+	if (name->typeargs == NULL) {
+		if (generic != gGenericTemplate)
+			errorMsgNode((AstNode *)name, ErrorTypeArgs, "%s needs type arguments", &name->namesym->namestr);
+		return;
+	}
+	if (name->typeargs->used != generic->parms->used) {
+		errorMsgNode((AstNode *)name, ErrorTypeArgs, "%s expects %d type arguments", &name->namesym->namestr, generic->parms->used);
+		return;
+	}
+
+	for (nodesFor(name->typeargs, cnt, nodesp)) {
+		astPass(pstate, *nodesp);
+		*nodesp = typeIntern(*nodesp);
+	}
+
+	// Within a template, instantiation waits until the template is copied,
+	// when its own type arguments are known
+	if (gGenericTemplate == NULL)
+		name->dclnode = genericInstance(generic, nodesNodes(name->typeargs));
+}
+
+// Infer type arguments, by matching a parameter's type against its argument's type
+static void genericInfer(GenericAstNode *generic, AstNode **args, AstNode *parmtype, AstNode *argtype) {
+	int index;
+	if (parmtype == NULL || argtype == NULL)
+		return;
+
+	// A type parameter is bound to the first argument type matched against it
+	if ((index = genericParm(generic, parmtype)) >= 0) {
+		if (args[index] == NULL)
+			args[index] = argtype;
+		return;
+	}
+
+	switch (parmtype->asttype) {
+	case NameUseNode:
+	{
+		// Match a generic struct's type arguments against those its argument's instance was made from
+		NameUseAstNode *parmname = (NameUseAstNode *)parmtype;
+		GenericAstNode *parmgeneric = (GenericAstNode *)parmname->dclnode;
+		uint32_t i, j;
+		if (parmname->typeargs == NULL || parmgeneric == NULL || parmgeneric->asttype != GenericNode
+			|| argtype->asttype != NameUseNode)
+			return;
+		for (i = 0; i < parmgeneric->instsUsed; i++) {
+			if (parmgeneric->insts[i].dcl == ((NameUseAstNode *)argtype)->dclnode) {
+				for (j = 0; j < parmname->typeargs->used; j++)
+					genericInfer(generic, args, nodesGet(parmname->typeargs, j), parmgeneric->insts[i].args[j]);
+				return;
+			}
+		}
+		return;
+	}
+	case RefType: case PtrType:
+		if (argtype->asttype == RefType || argtype->asttype == PtrType)
+			genericInfer(generic, args, ((PtrAstNode *)parmtype)->pvtype, ((PtrAstNode *)argtype)->pvtype);
+		return;
+	case ArrayType:
+		// An array parameter of unknown size (a slice's) matches an array of any size
+		if (argtype->asttype == ArrayType)
+			genericInfer(generic, args, ((ArrayAstNode *)parmtype)->elemtype, ((ArrayAstNode *)argtype)->elemtype);
+		return;
+	default:
+		return;
+	}
+}
+
+// Bind a call to a generic function to its instance for the type arguments
+// inferred from the (already type checked) call's arguments.
+// Return 0 if they cannot be inferred.
+int genericCall(PassState *pstate, FnCallAstNode *call) {
+	NameUseAstNode *fnname = (NameUseAstNode *)call->fn;
+	GenericAstNode *generic;
+	FnSigAstNode *fnsig;
+	SymNode *parmp;
+	AstNode **args, **nodesp;
+	uint32_t cnt, i;
+
+	if (fnname->asttype != NameUseNode || fnname->dclnode == NULL || fnname->dclnode->asttype != GenericNode)
+		return 1;
+	generic = (GenericAstNode *)fnname->dclnode;
+	if (generic->dcl->asttype != VarNameDclNode)
+		return 1;
+
+	args = (AstNode **)memAllocBlk(generic->parms->used * sizeof(AstNode *));
+	memset(args, 0, generic->parms->used * sizeof(AstNode *));
+	fnsig = (FnSigAstNode *)generic->dcl->vtype;
+	parmp = inodesNodes(fnsig->parms);
+	for (nodesFor(call->parms, cnt, nodesp)) {
+		if (parmp >= inodesNodes(fnsig->parms) + fnsig->parms->used)
+			break;
+		genericInfer(generic, args, ((NameDclAstNode *)(parmp++)->node)->vtype, ((TypedAstNode *)*nodesp)->vtype);
+	}
+	for (i = 0; i < generic->parms->used; i++) {
+		if (args[i] == NULL) {
+			errorMsgNode((AstNode *)call, ErrorTypeArgs, "The type of %s cannot be inferred from the call's arguments",
+				&((NameDclAstNode *)nodesGet(generic->parms, i))->namesym->namestr);
+			return 0;
+		}
+	}
+	fnname->dclnode = genericInstance(generic, args);
+	return 1;
+}
+
+// Note the copy of a template's declaration, so its uses refer to the copy
+static void genericAddDcl(GenericCopy *copy, NameDclAstNode *dcl, NameDclAstNode *dclcopy) {
+	if (copy->dclsUsed >= copy->dclsAvail) {
+		copy->dclsAvail = copy->dclsAvail == 0 ? 32 : copy->dclsAvail << 1;
+		copy->dcls = (GenericDcl *)genericRealloc(copy->dcls, copy->dclsAvail * sizeof(GenericDcl));
+	}
+	copy->dcls[copy->dclsUsed].dcl = dcl;
+	copy->dcls[copy->dclsUsed++].copy = dclcopy;
+}
+
+// Make a shallow copy of a node
+static AstNode *genericCopyNode(AstNode *node, size_t size) {
+	AstNode *copy = (AstNode *)memAllocBlk(size);
+	memcpy(copy, node, size);
+	return copy;
+}
+
+static AstNode *genericCopy(GenericCopy *copy, AstNode *node);
+static FnSigAstNode *genericCopyFnSig(GenericCopy *copy, FnSigAstNode *fnsig);
+
+// Return the type with the type arguments substituted for the type parameters,
+// and with its uses of generics instantiated. An unchanged type is not copied.
+static AstNode *genericSubst(GenericCopy *copy, AstNode *type) {
+	int index;
+	if (type == NULL)
+		return NULL;
+	if ((index = genericParm(copy->generic, type)) >= 0)
+		return copy->args[index];
+
+	switch (type->asttype) {
+	case NameUseNode:
+	{
+		NameUseAstNode *name = (NameUseAstNode *)type;
+		GenericAstNode *generic = (GenericAstNode *)name->dclnode;
+		NameDclAstNode *dcl;
+		if (generic == NULL || generic->asttype != GenericNode)
+			return type;
+		// The struct's own name within its template (e.g., a method's self) names the instance
+		if (name->typeargs == NULL) {
+			if (generic != copy->generic || generic->dcl->asttype == VarNameDclNode)
+				return type;
+			dcl = copy->inst;
+		}
+		else {
+			AstNode **args = (AstNode **)memAllocBlk(name->typeargs->used * sizeof(AstNode *));
+			uint32_t i;
+			for (i = 0; i < name->typeargs->used; i++)
+				args[i] = typeIntern(genericSubst(copy, nodesGet(name->typeargs, i)));
+			dcl = genericInstance(generic, args);
+		}
+		name = (NameUseAstNode *)genericCopyNode(type, sizeof(NameUseAstNode));
+		name->dclnode = dcl;
+		name->typeargs = NULL;
+		return (AstNode *)name;
+	}
+	case RefType: case PtrType:
+	{
+		PtrAstNode *ptype;
+		AstNode *pvtype = genericSubst(copy, ((PtrAstNode *)type)->pvtype);
+		if (pvtype == ((PtrAstNode *)type)->pvtype)
+			return type;
+		ptype = (PtrAstNode *)genericCopyNode(type, sizeof(PtrAstNode));
+		ptype->pvtype = pvtype;
+		ptype->llvmtype = NULL;
+		return typeIntern((AstNode *)ptype);
+	}
+	case ArrayType:
+	{
+		ArrayAstNode *atype;
+		AstNode *elemtype = genericSubst(copy, ((ArrayAstNode *)type)->elemtype);
+		if (elemtype == ((ArrayAstNode *)type)->elemtype)
+			return type;
+		atype = (ArrayAstNode *)genericCopyNode(type, sizeof(ArrayAstNode));
+		atype->elemtype = elemtype;
+		atype->llvmtype = NULL;
+		return typeIntern((AstNode *)atype);
+	}
+	case FnSig:
+		return (AstNode *)genericCopyFnSig(copy, (FnSigAstNode *)type);
+	default:
+		return type;
+	}
+}
+
+// Copy a template's declaration (e.g., a local variable, parameter or field)
+static NameDclAstNode *genericCopyDcl(GenericCopy *copy, NameDclAstNode *dcl) {
+	NameDclAstNode *dclcopy = (NameDclAstNode *)genericCopyNode((AstNode *)dcl, sizeof(NameDclAstNode));
+	genericAddDcl(copy, dcl, dclcopy);
+	dclcopy->vtype = genericSubst(copy, dcl->vtype);
+	dclcopy->value = dcl->value ? genericCopy(copy, dcl->value) : NULL;
+	dclcopy->hooklinks = dclcopy->hooklink = dclcopy->prevname = NULL;
+	dclcopy->llvmvar = NULL;
+	return dclcopy;
+}
+
+// Copy a template's function signature
+static FnSigAstNode *genericCopyFnSig(GenericCopy *copy, FnSigAstNode *fnsig) {
+	FnSigAstNode *sigcopy = (FnSigAstNode *)genericCopyNode((AstNode *)fnsig, sizeof(FnSigAstNode));
+	SymNode *nodesp;
+	uint32_t cnt;
+	sigcopy->parms = newInodes(fnsig->parms->used + 1);
+	for (inodesFor(fnsig->parms, cnt, nodesp))
+		inodesAdd(&sigcopy->parms, nodesp->name, (AstNode *)genericCopyDcl(copy, (NameDclAstNode *)nodesp->node));
+	sigcopy->rettype = genericSubst(copy, fnsig->rettype);
+	return sigcopy;
+}
+
+// Copy a template's function (or method) into a declaration
+static void genericCopyFn(GenericCopy *copy, NameDclAstNode *fn, NameDclAstNode *fncopy) {
+	fncopy->vtype = (AstNode *)genericCopyFnSig(copy, (FnSigAstNode *)fn->vtype);
+	fncopy->value = fn->value ? genericCopy(copy, fn->value) : NULL;
+}
+
+// Copy a statement or expression of a template.
+// A use of one of its declarations refers to that declaration's copy.
+// Types are substituted, and expressions copied, as type checking will change them.
+static AstNode *genericCopy(GenericCopy *copy, AstNode *node) {
+	uint32_t cnt;
+	AstNode **nodesp;
+
+	switch (node->asttype) {
+	case VarNameDclNode:
+		return (AstNode *)genericCopyDcl(copy, (NameDclAstNode *)node);
+	case NameUseNode: case MemberUseNode:
+	{
+		NameUseAstNode *use = (NameUseAstNode *)genericCopyNode(node, sizeof(NameUseAstNode));
+		uint32_t i = copy->dclsUsed;
+		while (i--) {
+			if (copy->dcls[i].dcl == use->dclnode) {
+				use->dclnode = copy->dcls[i].copy;
+				break;
+			}
+		}
+		return (AstNode *)use;
+	}
+	case ULitNode:
+		return genericCopyNode(node, sizeof(ULitAstNode));
+	case FLitNode:
+		return genericCopyNode(node, sizeof(FLitAstNode));
+	case SLitNode:
+		return genericCopyNode(node, sizeof(SLitAstNode));
+	case BlockNode:
+	{
+		BlockAstNode *blk = (BlockAstNode *)genericCopyNode(node, sizeof(BlockAstNode));
+		blk->stmts = newNodes(((BlockAstNode *)node)->stmts->used + 1);
+		for (nodesFor(((BlockAstNode *)node)->stmts, cnt, nodesp))
+			nodesAdd(&blk->stmts, genericCopy(copy, *nodesp));
+		return (AstNode *)blk;
+	}
+	case IfNode:
+	{
+		IfAstNode *ifnode = (IfAstNode *)genericCopyNode(node, sizeof(IfAstNode));
+		ifnode->condblk = newNodes(((IfAstNode *)node)->condblk->used);
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			nodesAdd(&ifnode->condblk, *nodesp && *nodesp != voidType ? genericCopy(copy, *nodesp) : *nodesp);
+		return (AstNode *)ifnode;
+	}
+	case WhileNode:
+	{
+		WhileAstNode *wnode = (WhileAstNode *)genericCopyNode(node, sizeof(WhileAstNode));
+		wnode->condexp = genericCopy(copy, wnode->condexp);
+		wnode->blk = genericCopy(copy, wnode->blk);
+		return (AstNode *)wnode;
+	}
+	case ForNode:
+	{
+		ForAstNode *fnode = (ForAstNode *)genericCopyNode(node, sizeof(ForAstNode));
+		if (fnode->from)
+			fnode->from = genericCopy(copy, fnode->from);
+		fnode->to = genericCopy(copy, fnode->to);
+		fnode->var = genericCopyDcl(copy, fnode->var);
+		fnode->blk = genericCopy(copy, fnode->blk);
+		return (AstNode *)fnode;
+	}
+	case ReturnNode:
+	{
+		ReturnAstNode *ret = (ReturnAstNode *)genericCopyNode(node, sizeof(ReturnAstNode));
+		if (ret->exp != voidType)
+			ret->exp = genericCopy(copy, ret->exp);
+		return (AstNode *)ret;
+	}
+	case FnCallNode:
+	{
+		FnCallAstNode *call = (FnCallAstNode *)genericCopyNode(node, sizeof(FnCallAstNode));
+		call->parms = newNodes(((FnCallAstNode *)node)->parms->used + 1);
+		for (nodesFor(((FnCallAstNode *)node)->parms, cnt, nodesp))
+			nodesAdd(&call->parms, genericCopy(copy, *nodesp));
+		call->fn = genericCopy(copy, call->fn);
+		return (AstNode *)call;
+	}
+	case AssignNode:
+	{
+		AssignAstNode *assign = (AssignAstNode *)genericCopyNode(node, sizeof(AssignAstNode));
+		assign->lval = genericCopy(copy, assign->lval);
+		assign->rval = genericCopy(copy, assign->rval);
+		return (AstNode *)assign;
+	}
+	case SizeofNode:
+	{
+		SizeofAstNode *size = (SizeofAstNode *)genericCopyNode(node, sizeof(SizeofAstNode));
+		size->type = genericSubst(copy, size->type);
+		return (AstNode *)size;
+	}
+	case CastNode:
+	{
+		CastAstNode *cast = (CastAstNode *)genericCopyNode(node, sizeof(CastAstNode));
+		cast->exp = genericCopy(copy, cast->exp);
+		cast->vtype = genericSubst(copy, cast->vtype);
+		return (AstNode *)cast;
+	}
+	case DerefNode:
+	{
+		DerefAstNode *deref = (DerefAstNode *)genericCopyNode(node, sizeof(DerefAstNode));
+		deref->exp = genericCopy(copy, deref->exp);
+		return (AstNode *)deref;
+	}
+	case AddrNode:
+	{
+		// Its reference type is completed (its value type inferred) by type checking
+		AddrAstNode *addr = (AddrAstNode *)genericCopyNode(node, sizeof(AddrAstNode));
+		PtrAstNode *ptype = (PtrAstNode *)genericCopyNode(addr->vtype, sizeof(PtrAstNode));
+		ptype->pvtype = genericSubst(copy, ptype->pvtype);
+		addr->vtype = (AstNode *)ptype;
+		addr->exp = genericCopy(copy, addr->exp);
+		return (AstNode *)addr;
+	}
+	case ElementNode:
+	{
+		ElementAstNode *elem = (ElementAstNode *)genericCopyNode(node, sizeof(ElementAstNode));
+		elem->owner = genericCopy(copy, elem->owner);
+		elem->element = genericCopy(copy, elem->element);
+		return (AstNode *)elem;
+	}
+	case NotLogicNode: case OrLogicNode: case AndLogicNode:
+	{
+		LogicAstNode *logic = (LogicAstNode *)genericCopyNode(node, sizeof(LogicAstNode));
+		logic->lexp = genericCopy(copy, logic->lexp);
+		if (node->asttype != NotLogicNode)
+			logic->rexp = genericCopy(copy, logic->rexp);
+		return (AstNode *)logic;
+	}
+	default:
+		return node;
+	}
+}
+
+// Copy the generic's template into its instance, substituting its type arguments
+static void genericCopyInstance(GenericAstNode *generic, uint32_t index) {
+	GenericCopy copy;
+	NameDclAstNode *tmpl = generic->dcl;
+	copy.generic = generic;
+	copy.args = generic->insts[index].args;
+	copy.inst = generic->insts[index].dcl;
+	copy.dcls = NULL;
+	copy.dclsUsed = copy.dclsAvail = 0;
+
+	if (tmpl->asttype == VarNameDclNode)
+		genericCopyFn(&copy, tmpl, copy.inst);
+	else {
+		StructAstNode *tmplstr = (StructAstNode *)tmpl->value;
+		StructAstNode *strnode = (StructAstNode *)copy.inst->value;
+		SymNode *inodesp;
+		AstNode **nodesp;
+		uint32_t cnt;
+		for (inodesFor(tmplstr->fields, cnt, inodesp)) {
+			NameDclAstNode *field = genericCopyDcl(&copy, (NameDclAstNode *)inodesp->node);
+			field->owner = (NamedAstNode *)copy.inst;
+			inodesAdd(&strnode->fields, inodesp->name, (AstNode *)field);
+		}
+		for (nodesFor(tmplstr->methods, cnt, nodesp)) {
+			NameDclAstNode *method = (NameDclAstNode *)genericCopyNode(*nodesp, sizeof(NameDclAstNode));
+			method->owner = (NamedAstNode *)copy.inst;
+			method->llvmvar = NULL;
+			genericCopyFn(&copy, (NameDclAstNode *)*nodesp, method);
+			nodesAdd(&strnode->methods, (AstNode *)method);
+		}
+	}
+	free(copy.dcls);
+}
+
+// Copy the instances asked for, then (during type check) type check them.
+// Type checking an instance may ask for more, which are copied at once.
+static void genericFlush() {
+	if (gGenericPhase == GenericNaming)
+		return;
+
+	// Copying may ask for more instances. They are copied by this same loop.
+	if (!gGenericCopying) {
+		gGenericCopying = 1;
+		while (gGenericCopied < gGenericWorkUsed) {
+			GenericWork *work = &gGenericWork[gGenericCopied++];
+			genericCopyInstance(work->generic, work->inst);
+		}
+		gGenericCopying = 0;
+	}
+
+	// Only type check once all instances are copied (e.g., any struct's fields)
+	if (gGenericPhase == GenericChecking && !gGenericCopying && !gGenericChecking) {
+		gGenericChecking = 1;
+		while (gGenericChecked < gGenericWorkUsed) {
+			GenericWork *work = &gGenericWork[gGenericChecked++];
+			PassState pstate;
+			pstate.pass = TypeCheck;
+			pstate.mod = (ModuleAstNode *)work->generic->owner;
+			pstate.fnsig = NULL;
+			pstate.blk = NULL;
+			pstate.scope = 0;
+			pstate.flags = 0;
+			astPass(&pstate, (AstNode *)work->generic->insts[work->inst].dcl);
+		}
+		gGenericChecking = 0;
+	}
+}
+
+// Start instantiating a new package's generics
+void genericBegin() {
+	gGenericWorkUsed = gGenericCopied = gGenericChecked = gGenericAdded = 0;
+	gGenericPhase = GenericNaming;
+	gGenericCopying = gGenericChecking = 0;
+	gGenericTemplate = NULL;
+}
+
+// After a pass, add the instances it asked for to their generics' modules.
+// After name resolution, they must first be copied from their (now resolved) templates.
+// They are then type checked along with their modules. Later instances are checked at once.
+void genericInstances(int pass) {
+	if (pass == NameResolution) {
+		gGenericPhase = GenericChecking;
+		gGenericChecking = 1;
+		genericFlush();
+		gGenericChecking = 0;
+		gGenericChecked = gGenericWorkUsed;
+	}
+	while (gGenericAdded < gGenericWorkUsed) {
+		GenericWork *work = &gGenericWork[gGenericAdded++];
+		nodesAdd(&((ModuleAstNode *)work->generic->owner)->nodes, (AstNode *)work->generic->insts[work->inst].dcl);
+	}
+}
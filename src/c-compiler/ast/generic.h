@@ -0,0 +1,40 @@
+/** AST handling for generic functions and structs
+ * @file
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#ifndef generic_h
+#define generic_h
+
+// An instantiation of a generic, for the type arguments it was made from
+typedef struct GenericInst {
+	AstNode **args;				// Type arguments, one per type parameter
+	NameDclAstNode *dcl;		// The instance's declaration (e.g., 'max[i32]')
+} GenericInst;
+
+// Generic declaration: a function or struct parameterized by types (e.g., 'struct Box[T]')
+// It is laid out like a declaration, so that uses of its name may treat it as one.
+// Its template is name resolved, but never type checked or generated:
+// only the instances copied from it (with the type arguments substituted) are.
+typedef struct GenericAstNode {
+	NamedAstHdr;				// 'vtype': the template's type (e.g., its function signature)
+	PermAstNode *perm;			// Permission, as for the template
+	AstNode *value;				// The template's value (e.g., its struct type)
+	NameDclAstNode *dcl;		// The template: the parameterized function or struct declaration
+	Nodes *parms;				// Type parameters' declarations, in order
+	GenericInst *insts;			// Instances made so far, memoized by their type arguments
+	uint32_t instsUsed;
+	uint32_t instsAvail;
+} GenericAstNode;
+
+GenericAstNode *newGenericNode(NameDclAstNode *dcl, Nodes *parms);
+void genericPrint(GenericAstNode *node);
+void genericPass(PassState *pstate, GenericAstNode *node);
+void genericNameUse(PassState *pstate, NameUseAstNode *name);
+int genericCall(PassState *pstate, FnCallAstNode *call);
+void genericBegin();
+void genericInstances(int pass);
+
+#endif
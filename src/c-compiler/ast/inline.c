@@ -0,0 +1,462 @@
+/** Inlining of function calls
+ * @file
+ *
+ * After type checking, a call to an inline function is replaced by a copy of the
+ * function's body, so that generation emits no call (even when not optimizing):
+ *
+ *     @inline
+ *     fn dot(a &Point, b &Point) f32
+ *       a.x * b.x + a.y * b.y
+ *
+ * The copy is a block whose value is the function's return value. Each parameter
+ * becomes a local variable of the block, initialized by its argument, so every
+ * argument is still evaluated once, in order. Calls within the copy are inlined, too.
+ *
+ * A function marked @inline is inlined wherever it can be. So is a tiny function
+ * (e.g., a field accessor), whose body is a single expression of only a few nodes.
+ * A function cannot be inlined when it might return before its body's end,
+ * when it would be inlined into itself (recursion), or when it differs from its
+ * caller in @fastmath. A call to an @inline function that cannot be inlined warns.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "ast.h"
+#include "nametbl.h"
+#include "../shared/error.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Most nodes a function's body may have to be tiny, and so inlined without @inline
+#define InlineTinySize 8
+
+// A declaration within the function being inlined, and its copy within the call's block
+typedef struct InlineDcl {
+	NameDclAstNode *dcl;
+	NameDclAstNode *copy;
+} InlineDcl;
+
+// State used by the inliner
+typedef struct InlineState {
+	NameDclAstNode *fndcl;		// The function whose calls are being inlined
+	NameDclAstNode **inlining;	// The functions being inlined into it, innermost last
+	uint32_t inliningUsed;
+	uint32_t inliningAvail;
+	InlineDcl *dcls;			// The declarations copied by the inlining underway
+	uint32_t dclsUsed;
+	uint32_t dclsAvail;
+} InlineState;
+
+// Allocate or grow a malloc'ed array, exiting if out of memory
+static void *inlineRealloc(void *ptr, size_t size) {
+	if (!(ptr = realloc(ptr, size)))
+		errorExit(ExitMem, "Error: Out of memory");
+	return ptr;
+}
+
+// Count the nodes of a statement or expression within a function's body.
+// Return 0 if it cannot be copied: it returns (early) or holds an unexpected node.
+static int inlineCount(AstNode *node, uint32_t *size) {
+	uint32_t cnt;
+	AstNode **nodesp;
+
+	++*size;
+	switch (node->asttype) {
+	case VarNameDclNode:
+		return ((NameDclAstNode *)node)->value == NULL || inlineCount(((NameDclAstNode *)node)->value, size);
+	case BlockNode:
+		for (nodesFor(((BlockAstNode *)node)->stmts, cnt, nodesp))
+			if (!inlineCount(*nodesp, size))
+				return 0;
+		return 1;
+	case IfNode:
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			if (*nodesp && *nodesp != voidType && !inlineCount(*nodesp, size))
+				return 0;
+		return 1;
+	case WhileNode:
+		return inlineCount(((WhileAstNode *)node)->condexp, size) && inlineCount(((WhileAstNode *)node)->blk, size);
+	case ForNode:
+		return (((ForAstNode *)node)->from == NULL || inlineCount(((ForAstNode *)node)->from, size))
+			&& inlineCount(((ForAstNode *)node)->to, size) && inlineCount(((ForAstNode *)node)->blk, size);
+	case FnCallNode:
+		for (nodesFor(((FnCallAstNode *)node)->parms, cnt, nodesp))
+			if (!inlineCount(*nodesp, size))
+				return 0;
+		return inlineCount(((FnCallAstNode *)node)->fn, size);
+	case AssignNode:
+		return inlineCount(((AssignAstNode *)node)->lval, size) && inlineCount(((AssignAstNode *)node)->rval, size);
+	case CastNode:
+		return inlineCount(((CastAstNode *)node)->exp, size);
+	case DerefNode:
+		return inlineCount(((DerefAstNode *)node)->exp, size);
+	case AddrNode:
+		return inlineCount(((AddrAstNode *)node)->exp, size);
+	case ElementNode:
+		return inlineCount(((ElementAstNode *)node)->owner, size) && inlineCount(((ElementAstNode *)node)->element, size);
+	case NotLogicNode:
+		return inlineCount(((LogicAstNode *)node)->lexp, size);
+	case OrLogicNode: case AndLogicNode:
+		return inlineCount(((LogicAstNode *)node)->lexp, size) && inlineCount(((LogicAstNode *)node)->rexp, size);
+	case NameUseNode: case MemberUseNode:
+	case ULitNode: case FLitNode: case SLitNode: case AggLitNode:
+	case SizeofNode: case BreakNode: case ContinueNode:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+// Can the function's body be inlined (only its last statement returns)?
+// If so, also count its nodes.
+static int inlineBody(BlockAstNode *body, uint32_t *size) {
+	uint32_t cnt;
+	AstNode **nodesp;
+
+	*size = 0;
+	for (nodesFor(body->stmts, cnt, nodesp)) {
+		AstNode *stmt = *nodesp;
+		if (cnt == 1 && stmt->asttype == ReturnNode)
+			stmt = ((ReturnAstNode *)stmt)->exp;
+		if (stmt != voidType && !inlineCount(stmt, size))
+			return 0;
+	}
+	return 1;
+}
+
+// Make a shallow copy of a node
+static AstNode *inlineCopyNode(AstNode *node, size_t size) {
+	AstNode *copy = (AstNode *)memAllocBlk(size);
+	memcpy(copy, node, size);
+	return copy;
+}
+
+// Note the copy of a declaration, so its uses refer to the copy
+static void inlineAddDcl(InlineState *state, NameDclAstNode *dcl, NameDclAstNode *copy) {
+	if (state->dclsUsed >= state->dclsAvail) {
+		state->dclsAvail = state->dclsAvail == 0 ? 32 : state->dclsAvail << 1;
+		state->dcls = (InlineDcl *)inlineRealloc(state->dcls, state->dclsAvail * sizeof(InlineDcl));
+	}
+	state->dcls[state->dclsUsed].dcl = dcl;
+	state->dcls[state->dclsUsed++].copy = copy;
+}
+
+// Copy a declaration within the function being inlined (its initial value, if any, given)
+static NameDclAstNode *inlineCopyDcl(InlineState *state, NameDclAstNode *dcl, AstNode *value) {
+	NameDclAstNode *copy = (NameDclAstNode *)inlineCopyNode((AstNode *)dcl, sizeof(NameDclAstNode));
+	copy->value = value;
+	copy->llvmvar = NULL;
+	inlineAddDcl(state, dcl, copy);
+	return copy;
+}
+
+// Copy a statement or expression of the function being inlined.
+// A use of one of its declarations refers to that declaration's copy.
+// Literals, sizeof, break and continue are never changed, so they are shared.
+static AstNode *inlineCopy(InlineState *state, AstNode *node) {
+	uint32_t cnt;
+	AstNode **nodesp;
+
+	switch (node->asttype) {
+	case VarNameDclNode:
+	{
+		NameDclAstNode *dcl = (NameDclAstNode *)node;
+		return (AstNode *)inlineCopyDcl(state, dcl, dcl->value ? inlineCopy(state, dcl->value) : NULL);
+	}
+	case NameUseNode: case MemberUseNode:
+	{
+		NameUseAstNode *use = (NameUseAstNode *)inlineCopyNode(node, sizeof(NameUseAstNode));
+		uint32_t i = state->dclsUsed;
+		while (i--) {
+			if (state->dcls[i].dcl == use->dclnode) {
+				use->dclnode = state->dcls[i].copy;
+				break;
+			}
+		}
+		return (AstNode *)use;
+	}
+	case BlockNode:
+	{
+		BlockAstNode *blk = (BlockAstNode *)inlineCopyNode(node, sizeof(BlockAstNode));
+		blk->stmts = newNodes(((BlockAstNode *)node)->stmts->used);
+		for (nodesFor(((BlockAstNode *)node)->stmts, cnt, nodesp))
+			nodesAdd(&blk->stmts, inlineCopy(state, *nodesp));
+		return (AstNode *)blk;
+	}
+	case IfNode:
+	{
+		IfAstNode *ifnode = (IfAstNode *)inlineCopyNode(node, sizeof(IfAstNode));
+		ifnode->condblk = newNodes(((IfAstNode *)node)->condblk->used);
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			nodesAdd(&ifnode->condblk, *nodesp && *nodesp != voidType ? inlineCopy(state, *nodesp) : *nodesp);
+		return (AstNode *)ifnode;
+	}
+	case WhileNode:
+	{
+		WhileAstNode *wnode = (WhileAstNode *)inlineCopyNode(node, sizeof(WhileAstNode));
+		wnode->condexp = inlineCopy(state, wnode->condexp);
+		wnode->blk = inlineCopy(state, wnode->blk);
+		return (AstNode *)wnode;
+	}
+	case ForNode:
+	{
+		ForAstNode *fnode = (ForAstNode *)inlineCopyNode(node, sizeof(ForAstNode));
+		if (fnode->from)
+			fnode->from = inlineCopy(state, fnode->from);
+		fnode->to = inlineCopy(state, fnode->to);
+		fnode->var = inlineCopyDcl(state, fnode->var, fnode->var->value);
+		fnode->blk = inlineCopy(state, fnode->blk);
+		return (AstNode *)fnode;
+	}
+	case FnCallNode:
+	{
+		FnCallAstNode *call = (FnCallAstNode *)inlineCopyNode(node, sizeof(FnCallAstNode));
+		call->parms = newNodes(((FnCallAstNode *)node)->parms->used);
+		for (nodesFor(((FnCallAstNode *)node)->parms, cnt, nodesp))
+			nodesAdd(&call->parms, inlineCopy(state, *nodesp));
+		call->fn = inlineCopy(state, call->fn);
+		return (AstNode *)call;
+	}
+	case AssignNode:
+	{
+		AssignAstNode *assign = (AssignAstNode *)inlineCopyNode(node, sizeof(AssignAstNode));
+		assign->lval = inlineCopy(state, assign->lval);
+		assign->rval = inlineCopy(state, assign->rval);
+		return (AstNode *)assign;
+	}
+	case CastNode:
+	{
+		CastAstNode *cast = (CastAstNode *)inlineCopyNode(node, sizeof(CastAstNode));
+		cast->exp = inlineCopy(state, cast->exp);
+		return (AstNode *)cast;
+	}
+	case DerefNode:
+	{
+		DerefAstNode *deref = (DerefAstNode *)inlineCopyNode(node, sizeof(DerefAstNode));
+		deref->exp = inlineCopy(state, deref->exp);
+		return (AstNode *)deref;
+	}
+	case AddrNode:
+	{
+		AddrAstNode *addr = (AddrAstNode *)inlineCopyNode(node, sizeof(AddrAstNode));
+		addr->exp = inlineCopy(state, addr->exp);
+		return (AstNode *)addr;
+	}
+	case ElementNode:
+	{
+		ElementAstNode *elem = (ElementAstNode *)inlineCopyNode(node, sizeof(ElementAstNode));
+		elem->owner = inlineCopy(state, elem->owner);
+		elem->element = inlineCopy(state, elem->element);
+		return (AstNode *)elem;
+	}
+	case NotLogicNode: case OrLogicNode: case AndLogicNode:
+	{
+		LogicAstNode *logic = (LogicAstNode *)inlineCopyNode(node, sizeof(LogicAstNode));
+		logic->lexp = inlineCopy(state, logic->lexp);
+		if (node->asttype != NotLogicNode)
+			logic->rexp = inlineCopy(state, logic->rexp);
+		return (AstNode *)logic;
+	}
+	default:
+		return node;
+	}
+}
+
+static void inlineFind(InlineState *state, AstNode **nodep);
+
+// Replace a call with a copy of its function's body, if the function should and can be inlined
+static void inlineCall(InlineState *state, AstNode **nodep) {
+	FnCallAstNode *call = (FnCallAstNode *)*nodep;
+	NameDclAstNode *fndcl;
+	BlockAstNode *body, *blk;
+	SymNode *parmp;
+	AstNode **nodesp;
+	uint32_t cnt, size, i;
+	char *reason = NULL;
+
+	// Only a call to a program-defined function (or method) may be inlined
+	if (call->fn->asttype != NameUseNode)
+		return;
+	fndcl = ((NameUseAstNode *)call->fn)->dclnode;
+	if (fndcl == NULL || fndcl->vtype->asttype != FnSig || fndcl->value == NULL || fndcl->value->asttype != BlockNode)
+		return;
+	body = (BlockAstNode *)fndcl->value;
+
+	// Should it be inlined? Can it be?
+	if (!inlineBody(body, &size))
+		reason = "it may return before the end of its body";
+	else if (!(fndcl->flags & FlagInline) && size > InlineTinySize)
+		return;
+	else if ((fndcl->flags ^ state->fndcl->flags) & FlagFastMath)
+		reason = "it differs from its caller in @fastmath";
+	else {
+		if (fndcl == state->fndcl)
+			reason = "it calls itself";
+		for (i = 0; i < state->inliningUsed; i++)
+			if (state->inlining[i] == fndcl)
+				reason = "it calls itself";
+	}
+	if (reason) {
+		// A copied body's calls were already warned about, within the function it was copied from
+		if (fndcl->flags & FlagInline && state->inliningUsed == 0)
+			errorMsgNode((AstNode *)call, WarnInline, "The call to `%s` is not inlined: %s", &fndcl->namesym->namestr, reason);
+		return;
+	}
+
+	// The call's block: the copied parameters, set to their arguments, then the body's statements
+	blk = (BlockAstNode *)inlineCopyNode((AstNode *)body, sizeof(BlockAstNode));
+	blk->lexer = call->lexer;
+	blk->srcp = call->srcp;
+	blk->linep = call->linep;
+	blk->linenbr = call->linenbr;
+	blk->vtype = call->vtype;
+	blk->stmts = newNodes(call->parms->used + body->stmts->used);
+	state->dclsUsed = 0;
+	parmp = inodesNodes(((FnSigAstNode *)fndcl->vtype)->parms);
+	for (nodesFor(call->parms, cnt, nodesp)) {
+		NameDclAstNode *parm = inlineCopyDcl(state, (NameDclAstNode *)(parmp++)->node, *nodesp);
+		parm->scope = body->scope;
+		nodesAdd(&blk->stmts, (AstNode *)parm);
+	}
+	for (nodesFor(body->stmts, cnt, nodesp)) {
+		AstNode *stmt = *nodesp;
+		if (stmt->asttype == ReturnNode && (stmt = ((ReturnAstNode *)stmt)->exp) == voidType)
+			break;
+		nodesAdd(&blk->stmts, inlineCopy(state, stmt));
+	}
+	*nodep = (AstNode *)blk;
+
+	// Inline the calls within the copied body (its arguments already have been)
+	if (state->inliningUsed >= state->inliningAvail) {
+		state->inliningAvail = state->inliningAvail == 0 ? 16 : state->inliningAvail << 1;
+		state->inlining = (NameDclAstNode **)inlineRealloc(state->inlining, state->inliningAvail * sizeof(NameDclAstNode *));
+	}
+	state->inlining[state->inliningUsed++] = fndcl;
+	for (i = call->parms->used; i < blk->stmts->used; i++)
+		inlineFind(state, &nodesGet(blk->stmts, i));
+	--state->inliningUsed;
+}
+
+// Inline the calls within a statement or expression
+static void inlineFind(InlineState *state, AstNode **nodep) {
+	uint32_t cnt;
+	AstNode **nodesp;
+	AstNode *node = *nodep;
+
+	switch (node->asttype) {
+	case VarNameDclNode:
+		if (((NameDclAstNode *)node)->value)
+			inlineFind(state, &((NameDclAstNode *)node)->value);
+		break;
+	case BlockNode:
+		for (nodesFor(((BlockAstNode *)node)->stmts, cnt, nodesp))
+			inlineFind(state, nodesp);
+		break;
+	case IfNode:
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			if (*nodesp && *nodesp != voidType)
+				inlineFind(state, nodesp);
+		break;
+	case WhileNode:
+		inlineFind(state, &((WhileAstNode *)node)->condexp);
+		inlineFind(state, &((WhileAstNode *)node)->blk);
+		break;
+	case ForNode:
+		if (((ForAstNode *)node)->from)
+			inlineFind(state, &((ForAstNode *)node)->from);
+		inlineFind(state, &((ForAstNode *)node)->to);
+		inlineFind(state, &((ForAstNode *)node)->blk);
+		break;
+	case ReturnNode:
+		inlineFind(state, &((ReturnAstNode *)node)->exp);
+		break;
+	case FnCallNode:
+		for (nodesFor(((FnCallAstNode *)node)->parms, cnt, nodesp))
+			inlineFind(state, nodesp);
+		inlineFind(state, &((FnCallAstNode *)node)->fn);
+		inlineCall(state, nodep);
+		break;
+	case AssignNode:
+		inlineFind(state, &((AssignAstNode *)node)->lval);
+		inlineFind(state, &((AssignAstNode *)node)->rval);
+		break;
+	case CastNode:
+		inlineFind(state, &((CastAstNode *)node)->exp);
+		break;
+	case DerefNode:
+		inlineFind(state, &((DerefAstNode *)node)->exp);
+		break;
+	case AddrNode:
+		inlineFind(state, &((AddrAstNode *)node)->exp);
+		break;
+	case ElementNode:
+		inlineFind(state, &((ElementAstNode *)node)->owner);
+		if (node->flags & FlagIndex)
+			inlineFind(state, &((ElementAstNode *)node)->element);
+		break;
+	case NotLogicNode:
+		inlineFind(state, &((LogicAstNode *)node)->lexp);
+		break;
+	case OrLogicNode: case AndLogicNode:
+		inlineFind(state, &((LogicAstNode *)node)->lexp);
+		inlineFind(state, &((LogicAstNode *)node)->rexp);
+		break;
+	default:
+		break;
+	}
+}
+
+// Inline the calls within a program-defined function
+static void inlineFn(InlineState *state, NameDclAstNode *fndcl) {
+	state->fndcl = fndcl;
+	inlineFind(state, &fndcl->value);
+}
+
+// Inline the calls within every program-defined function of a module
+static void inlineModule(InlineState *state, ModuleAstNode *mod) {
+	uint32_t cnt;
+	AstNode **nodesp;
+	for (nodesFor(mod->nodes, cnt, nodesp)) {
+		switch ((*nodesp)->asttype) {
+		case VarNameDclNode:
+		{
+			NameDclAstNode *dcl = (NameDclAstNode *)*nodesp;
+			if (dcl->vtype->asttype == FnSig && dcl->value && dcl->value->asttype == BlockNode)
+				inlineFn(state, dcl);
+			break;
+		}
+
+		// A type's methods
+		case VtypeNameDclNode:
+		case AllocNameDclNode:
+		{
+			TypeAstNode *tnode = (TypeAstNode *)((NameDclAstNode *)*nodesp)->value;
+			uint32_t mcnt;
+			AstNode **methp;
+			if (tnode == NULL || tnode->methods == NULL)
+				break;
+			for (nodesFor(tnode->methods, mcnt, methp)) {
+				NameDclAstNode *meth = (NameDclAstNode *)*methp;
+				if (meth->value && meth->value->asttype == BlockNode)
+					inlineFn(state, meth);
+			}
+			break;
+		}
+
+		case ModuleNode:
+			inlineModule(state, (ModuleAstNode *)*nodesp);
+			break;
+		}
+	}
+}
+
+// Inline the calls to @inline and tiny functions, within every function (after type checking)
+void inlineCalls(ModuleAstNode *mod) {
+	InlineState state;
+	memset(&state, 0, sizeof(state));
+	inlineModule(&state, mod);
+	free(state.inlining);
+	free(state.dcls);
+}
@@ -59,6 +59,30 @@ void slitPrint(SLitAstNode *lit) {
 	astFprint("\"%s\"", lit->strlit);
 }
 
+// Create a new array or struct literal, with room for its elements
+AggLitAstNode *newAggLitNode(AstNode *type, uint32_t size) {
+	AggLitAstNode *lit;
+	newAstNode(lit, AggLitAstNode, AggLitNode);
+	lit->elems = newNodes(size ? size : 1);
+	lit->vtype = type;
+	return lit;
+}
+
+// Serialize the AST for an array or struct literal
+void aggLitPrint(AggLitAstNode *lit) {
+	AstNode **nodesp;
+	uint32_t cnt;
+	int first = 1;
+	astFprint("[");
+	for (nodesFor(lit->elems, cnt, nodesp)) {
+		if (!first)
+			astFprint(", ");
+		first = 0;
+		astPrintNode(*nodesp);
+	}
+	astFprint("]");
+}
+
 int litIsLiteral(AstNode* node) {
 	return (node->asttype == FLitNode || node->asttype == ULitNode);
 }
\ No newline at end of file
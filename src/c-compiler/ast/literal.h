@@ -35,6 +35,16 @@ void flitPrint(FLitAstNode *node);
 SLitAstNode *newSLitNode(char *str, AstNode *type);
 void slitPrint(SLitAstNode *node);
 
+// Array or struct literal, whose elements (or fields, in order) are literals.
+// Compile-time evaluation computes these, for generation to emit as constant data.
+typedef struct AggLitAstNode {
+	TypedAstHdr;
+	Nodes *elems;
+} AggLitAstNode;
+
+AggLitAstNode *newAggLitNode(AstNode *type, uint32_t size);
+void aggLitPrint(AggLitAstNode *node);
+
 int litIsLiteral(AstNode* node);
 
 #endif
\ No newline at end of file
@@ -20,6 +20,7 @@ NameUseAstNode *newNameUseNode(Name *namesym) {
 	newAstNode(name, NameUseAstNode, NameUseNode);
 	name->mod = NULL;
 	name->dclnode = NULL;
+	name->typeargs = NULL;
 	name->namesym = namesym;
 	return name;
 }
@@ -27,13 +28,30 @@ NameUseAstNode *newNameUseNode(Name *namesym) {
 NameUseAstNode *newMemberUseNode(Name *namesym) {
 	NameUseAstNode *name;
 	newAstNode(name, NameUseAstNode, MemberUseNode);
+	name->typeargs = NULL;
 	name->namesym = namesym;
 	return name;
 }
 
 // Serialize the AST for a name use
 void nameUsePrint(NameUseAstNode *name) {
-	astFprint("%s", &name->namesym->namestr);
+	// A generic's instance is known by its own name (e.g., Box[i32])
+	if (name->asttype == NameUseNode && name->dclnode && name->dclnode->asttype != GenericNode
+		&& name->typeargs == NULL && name->dclnode->namesym != name->namesym)
+		astFprint("%s", &name->dclnode->namesym->namestr);
+	else
+		astFprint("%s", &name->namesym->namestr);
+	if (name->typeargs) {
+		AstNode **nodesp;
+		uint32_t cnt;
+		astFprint("[");
+		for (nodesFor(name->typeargs, cnt, nodesp)) {
+			astPrintNode(*nodesp);
+			if (cnt > 1)
+				astFprint(", ");
+		}
+		astFprint("]");
+	}
 }
 
 // Check the name use's AST
@@ -50,8 +68,14 @@ void nameUsePass(PassState *pstate, NameUseAstNode *name) {
 		}
 		if (!name->dclnode)
 			errorMsgNode((AstNode*)name, ErrorUnkName, "The name %s does not refer to a declared name", &name->namesym->namestr);
+		// A generic's name is bound to the instance for its type arguments
+		else if (name->typeargs || name->dclnode->asttype == GenericNode)
+			genericNameUse(pstate, name);
 		break;
 	case TypeCheck:
+		// A call to a generic function has been bound to an instance by now (see genericCall)
+		if (name->dclnode->asttype == GenericNode)
+			errorMsgNode((AstNode*)name, ErrorTypeArgs, "The generic function %s may only be called", &name->namesym->namestr);
 		name->vtype = name->dclnode->vtype;
 		break;
 	}
@@ -13,6 +13,7 @@ typedef struct NameUseAstNode {
 	Name *namesym;			// Pointer to the global name table entry
 	ModuleAstNode *mod;		// Module this name belongs to
 	NameDclAstNode *dclnode;	// Declaration of this name (NULL until names are resolved)
+	Nodes *typeargs;		// Type arguments for a generic's name (e.g., Box[i32]), else NULL
 } NameUseAstNode;
 
 NameUseAstNode *newNameUseNode(Name *namesym);
@@ -0,0 +1,433 @@
+/** Range analysis, to eliminate array bounds checks
+ * @file
+ *
+ * Indexing an array or slice checks that its index is within bounds, trapping if not.
+ * After type checking, this finds the indexes that a counting loop keeps in bounds,
+ * so that generation may leave out their checks:
+ *
+ *     mut i usize = 0
+ *     while i < n
+ *       a[i] = a[i] * 2
+ *       i = i + 1
+ *
+ * a[i] is in bounds when i starts out non-negative, is only changed by the loop's
+ * increment, is used before the increment, and n is no more than a's length.
+ * That last is known at compile time when n is a.len or a literal no larger than a's size.
+ * When n is some other local the loop does not change, the loop is versioned:
+ * generation checks once (before the loop) that n is no more than a's length,
+ * and then runs either a copy of the loop without these bounds checks, or the original.
+ *
+ * A for loop over a range (for i in 0..n) is a counting loop by construction:
+ * nothing else may change i, and n is evaluated once, so any variable will do as n.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "ast.h"
+#include "nametbl.h"
+
+// What is known about the counting loop being analyzed
+typedef struct RangeLoop {
+	AstNode *blk;			// The loop's body
+	Nodes **guards;			// Where to list the indexes its guard must check
+	NameDclAstNode *index;	// The loop's counter (i)
+	AstNode *bound;			// The counter's upper bound (n), when a loop-invariant local
+	NameDclAstNode *lenof;	// The array or slice whose len is the bound, if any
+	uint64_t litbound;		// The bound's value, when a literal
+	int islit;
+} RangeLoop;
+
+// Strip away any number casts (e.g., of a coerced literal or index)
+static AstNode *rangePeel(AstNode *node) {
+	while (node->asttype == CastNode)
+		node = ((CastAstNode *)node)->exp;
+	return node;
+}
+
+// Return the op code that a call performs, or -1 if it is not an op code
+static int rangeOpCode(AstNode *node) {
+	NameDclAstNode *dcl;
+	if (node->asttype != FnCallNode || ((FnCallAstNode *)node)->fn->asttype != NameUseNode)
+		return -1;
+	dcl = ((NameUseAstNode *)((FnCallAstNode *)node)->fn)->dclnode;
+	if (dcl == NULL || dcl->value == NULL || dcl->value->asttype != OpCodeNode)
+		return -1;
+	return ((OpCodeAstNode *)dcl->value)->opcode;
+}
+
+// Return the local variable (or parameter) that the node names, if any.
+// Its address must never have been taken, so only its own assignments change it.
+static NameDclAstNode *rangeLocal(AstNode *node) {
+	NameDclAstNode *dcl;
+	if (node->asttype != NameUseNode)
+		return NULL;
+	dcl = ((NameUseAstNode *)node)->dclnode;
+	if (dcl == NULL || dcl->asttype != VarNameDclNode || dcl->scope == 0 || dcl->flags & FlagAddrTaken)
+		return NULL;
+	return dcl;
+}
+
+// Does evaluating the node assign to the variable anywhere within it?
+static int rangeAssigns(AstNode *node, NameDclAstNode *dcl) {
+	uint32_t cnt;
+	AstNode **nodesp;
+
+	switch (node->asttype) {
+	case AssignNode:
+	{
+		AssignAstNode *assign = (AssignAstNode *)node;
+		if (assign->lval->asttype == NameUseNode && ((NameUseAstNode *)assign->lval)->dclnode == dcl)
+			return 1;
+		return rangeAssigns(assign->lval, dcl) || rangeAssigns(assign->rval, dcl);
+	}
+	case VarNameDclNode:
+		return ((NameDclAstNode *)node)->value && rangeAssigns(((NameDclAstNode *)node)->value, dcl);
+	case BlockNode:
+		for (nodesFor(((BlockAstNode *)node)->stmts, cnt, nodesp))
+			if (rangeAssigns(*nodesp, dcl))
+				return 1;
+		return 0;
+	case IfNode:
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			if (*nodesp && rangeAssigns(*nodesp, dcl))
+				return 1;
+		return 0;
+	case WhileNode:
+		return rangeAssigns(((WhileAstNode *)node)->condexp, dcl) || rangeAssigns(((WhileAstNode *)node)->blk, dcl);
+	case ForNode:
+		return (((ForAstNode *)node)->from && rangeAssigns(((ForAstNode *)node)->from, dcl))
+			|| rangeAssigns(((ForAstNode *)node)->to, dcl) || rangeAssigns(((ForAstNode *)node)->blk, dcl);
+	case ReturnNode:
+		return rangeAssigns(((ReturnAstNode *)node)->exp, dcl);
+	case FnCallNode:
+		for (nodesFor(((FnCallAstNode *)node)->parms, cnt, nodesp))
+			if (rangeAssigns(*nodesp, dcl))
+				return 1;
+		return rangeAssigns(((FnCallAstNode *)node)->fn, dcl);
+	case CastNode:
+		return rangeAssigns(((CastAstNode *)node)->exp, dcl);
+	case DerefNode:
+		return rangeAssigns(((DerefAstNode *)node)->exp, dcl);
+	case AddrNode:
+		return rangeAssigns(((AddrAstNode *)node)->exp, dcl);
+	case ElementNode:
+		return rangeAssigns(((ElementAstNode *)node)->owner, dcl)
+			|| (node->flags & FlagIndex && rangeAssigns(((ElementAstNode *)node)->element, dcl));
+	case NotLogicNode:
+		return rangeAssigns(((LogicAstNode *)node)->lexp, dcl);
+	case OrLogicNode: case AndLogicNode:
+		return rangeAssigns(((LogicAstNode *)node)->lexp, dcl) || rangeAssigns(((LogicAstNode *)node)->rexp, dcl);
+	default:
+		return 0;
+	}
+}
+
+// Is the statement the counter's increment: i = i + 1?
+static int rangeIsIncrement(AstNode *stmt, NameDclAstNode *index) {
+	AssignAstNode *assign = (AssignAstNode *)stmt;
+	FnCallAstNode *add;
+	AstNode *one;
+	if (stmt->asttype != AssignNode || assign->lval->asttype != NameUseNode
+		|| ((NameUseAstNode *)assign->lval)->dclnode != index)
+		return 0;
+	add = (FnCallAstNode *)assign->rval;
+	if (rangeOpCode((AstNode *)add) != AddOpCode || add->parms->used != 2)
+		return 0;
+	one = rangePeel(nodesGet(add->parms, 1));
+	return rangeLocal(nodesGet(add->parms, 0)) == index && one->asttype == ULitNode && ((ULitAstNode *)one)->uintlit == 1;
+}
+
+// Is the counter non-negative when the loop (the block's statement at 'at') starts?
+// It is if unsigned, or if the last statement to set it before the loop gives it
+// a literal that its type holds as non-negative.
+static int rangeStartsNonNeg(BlockAstNode *blk, uint32_t at, NameDclAstNode *index) {
+	NbrAstNode *type = (NbrAstNode *)typeGetVtype(index->vtype);
+	if (type->asttype == UintNbrType)
+		return 1;
+	while (at--) {
+		AstNode *stmt = nodesGet(blk->stmts, at);
+		AstNode *value;
+		if (stmt == (AstNode *)index)
+			value = index->value;
+		else if (stmt->asttype == AssignNode && ((AssignAstNode *)stmt)->lval->asttype == NameUseNode
+			&& ((NameUseAstNode *)((AssignAstNode *)stmt)->lval)->dclnode == index)
+			value = ((AssignAstNode *)stmt)->rval;
+		else if (rangeAssigns(stmt, index))
+			return 0;
+		else
+			continue;
+		if (value == NULL || (value = rangePeel(value))->asttype != ULitNode)
+			return 0;
+		return (((ULitAstNode *)value)->uintlit >> (type->bits - 1)) == 0;
+	}
+	return 0;
+}
+
+// Mark the indexes of the node (and within it) that the loop keeps in bounds
+static void rangeMark(RangeLoop *loop, AstNode *node) {
+	uint32_t cnt;
+	AstNode **nodesp;
+
+	switch (node->asttype) {
+	case ElementNode:
+	{
+		ElementAstNode *elem = (ElementAstNode *)node;
+		rangeMark(loop, elem->owner);
+		if (!(elem->flags & FlagIndex))
+			break;
+		rangeMark(loop, elem->element);
+		if (rangeLocal(rangePeel(elem->element)) == loop->index) {
+			AstNode *ownvtype = typeGetVtype(elem->owner);
+			ArrayAstNode *arrtype = arrayIndexable(ownvtype);
+			NameDclAstNode *owner = elem->owner->asttype == NameUseNode ? ((NameUseAstNode *)elem->owner)->dclnode : NULL;
+
+			// A slice's length is only known not to change if the loop never changes the slice
+			if (isSlice(ownvtype)) {
+				owner = rangeLocal(elem->owner);
+				if (owner == NULL || rangeAssigns(loop->blk, owner))
+					break;
+			}
+			if ((owner && owner == loop->lenof) || (loop->islit && arrtype->size > 0 && loop->litbound <= arrtype->size))
+				elem->flags |= FlagInBounds;
+			else if (loop->bound) {
+				elem->flags |= FlagInBoundsIfGuard;
+				if (*loop->guards == NULL)
+					*loop->guards = newNodes(4);
+				nodesAdd(loop->guards, node);
+			}
+		}
+		break;
+	}
+	case VarNameDclNode:
+		if (((NameDclAstNode *)node)->value)
+			rangeMark(loop, ((NameDclAstNode *)node)->value);
+		break;
+	case BlockNode:
+		for (nodesFor(((BlockAstNode *)node)->stmts, cnt, nodesp))
+			rangeMark(loop, *nodesp);
+		break;
+	case IfNode:
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			if (*nodesp)
+				rangeMark(loop, *nodesp);
+		break;
+	case WhileNode:
+		rangeMark(loop, ((WhileAstNode *)node)->condexp);
+		rangeMark(loop, ((WhileAstNode *)node)->blk);
+		break;
+	case ForNode:
+		if (((ForAstNode *)node)->from)
+			rangeMark(loop, ((ForAstNode *)node)->from);
+		rangeMark(loop, ((ForAstNode *)node)->to);
+		rangeMark(loop, ((ForAstNode *)node)->blk);
+		break;
+	case ReturnNode:
+		rangeMark(loop, ((ReturnAstNode *)node)->exp);
+		break;
+	case AssignNode:
+		rangeMark(loop, ((AssignAstNode *)node)->lval);
+		rangeMark(loop, ((AssignAstNode *)node)->rval);
+		break;
+	case FnCallNode:
+		for (nodesFor(((FnCallAstNode *)node)->parms, cnt, nodesp))
+			rangeMark(loop, *nodesp);
+		break;
+	case CastNode:
+		rangeMark(loop, ((CastAstNode *)node)->exp);
+		break;
+	case DerefNode:
+		rangeMark(loop, ((DerefAstNode *)node)->exp);
+		break;
+	case AddrNode:
+		rangeMark(loop, ((AddrAstNode *)node)->exp);
+		break;
+	case NotLogicNode:
+		rangeMark(loop, ((LogicAstNode *)node)->lexp);
+		break;
+	case OrLogicNode: case AndLogicNode:
+		rangeMark(loop, ((LogicAstNode *)node)->lexp);
+		rangeMark(loop, ((LogicAstNode *)node)->rexp);
+		break;
+	default:
+		break;
+	}
+}
+
+// Analyze a while loop (the block's statement at 'at') that may be a counting loop
+static void rangeLoop(BlockAstNode *blk, uint32_t at, WhileAstNode *wnode) {
+	FnCallAstNode *cond = (FnCallAstNode *)wnode->condexp;
+	Nodes *stmts = ((BlockAstNode *)wnode->blk)->stmts;
+	RangeLoop loop;
+	AstNode *bound, *peeled;
+	uint32_t incr, stmt;
+
+	// The loop must be: while i < n
+	if (rangeOpCode((AstNode *)cond) != LtOpCode || cond->parms->used != 2)
+		return;
+	loop.blk = wnode->blk;
+	loop.guards = &wnode->guards;
+	loop.index = rangeLocal(nodesGet(cond->parms, 0));
+	if (loop.index == NULL || !isNbr(typeGetVtype(loop.index->vtype)) || typeGetVtype(loop.index->vtype)->asttype == FloatNbrType)
+		return;
+	if (rangeAssigns(wnode->condexp, loop.index) || !rangeStartsNonNeg(blk, at, loop.index))
+		return;
+
+	// Only an increment of i (as its own statement) may change it, and only indexes before it are in bounds
+	incr = stmts->used;
+	for (stmt = 0; stmt < stmts->used; stmt++) {
+		if (rangeIsIncrement(nodesGet(stmts, stmt), loop.index)) {
+			if (incr == stmts->used)
+				incr = stmt;
+		}
+		else if (rangeAssigns(nodesGet(stmts, stmt), loop.index))
+			return;
+	}
+
+	// What is n?
+	bound = nodesGet(cond->parms, 1);
+	peeled = rangePeel(bound);
+	loop.bound = NULL;
+	loop.lenof = NULL;
+	loop.islit = 0;
+	if (peeled->asttype == ULitNode) {
+		loop.islit = 1;
+		loop.litbound = ((ULitAstNode *)peeled)->uintlit;
+	}
+	else if (peeled->asttype == ElementNode && !(peeled->flags & FlagIndex)
+		&& ((ElementAstNode *)peeled)->element->asttype == MemberUseNode
+		&& ((ElementAstNode *)peeled)->owner->asttype == NameUseNode)
+		loop.lenof = ((NameUseAstNode *)((ElementAstNode *)peeled)->owner)->dclnode;
+	else if (rangeLocal(peeled) && !rangeAssigns(wnode->blk, rangeLocal(peeled)))
+		loop.bound = bound;
+
+	for (stmt = 0; stmt < incr; stmt++)
+		rangeMark(&loop, nodesGet(stmts, stmt));
+
+	// The guard compares n to each guarded array's length, as usize
+	if (wnode->guards)
+		wnode->bound = (AstNode *)newCastAstNode(bound, (AstNode *)usizeType);
+}
+
+// Analyze a for loop over a range: for i in m..n
+// Only the loop steps its counter, from m up to n (evaluated just once, before the loop),
+// so its indexes by i are in bounds when m is non-negative and n fits.
+static void rangeFor(ForAstNode *fnode) {
+	NbrAstNode *type = (NbrAstNode *)typeGetVtype(fnode->var->vtype);
+	AstNode *from = rangePeel(fnode->from);
+	AstNode *peeled = rangePeel(fnode->to);
+	RangeLoop loop;
+
+	if (type->asttype != UintNbrType
+		&& (from->asttype != ULitNode || ((ULitAstNode *)from)->uintlit >> (type->bits - 1)))
+		return;
+
+	loop.blk = fnode->blk;
+	loop.guards = &fnode->guards;
+	loop.index = fnode->var;
+	loop.bound = NULL;
+	loop.lenof = NULL;
+	loop.islit = 0;
+	if (peeled->asttype == ULitNode) {
+		loop.islit = 1;
+		loop.litbound = ((ULitAstNode *)peeled)->uintlit;
+	}
+	else if (peeled->asttype == ElementNode && !(peeled->flags & FlagIndex)
+		&& ((ElementAstNode *)peeled)->element->asttype == MemberUseNode
+		&& ((ElementAstNode *)peeled)->owner->asttype == NameUseNode)
+		loop.lenof = ((NameUseAstNode *)((ElementAstNode *)peeled)->owner)->dclnode;
+	else if (peeled->asttype == NameUseNode)
+		loop.bound = fnode->to;
+
+	rangeMark(&loop, fnode->blk);
+	if (fnode->guards)
+		fnode->bound = (AstNode *)newCastAstNode(fnode->to, (AstNode *)usizeType);
+}
+
+// Find and analyze the loops within a node
+static void rangeFind(AstNode *node) {
+	uint32_t cnt, at;
+	AstNode **nodesp;
+
+	switch (node->asttype) {
+	case BlockNode:
+	{
+		BlockAstNode *blk = (BlockAstNode *)node;
+		for (at = 0; at < blk->stmts->used; at++) {
+			AstNode *stmt = nodesGet(blk->stmts, at);
+			if (stmt->asttype == WhileNode && ((WhileAstNode *)stmt)->blk->asttype == BlockNode)
+				rangeLoop(blk, at, (WhileAstNode *)stmt);
+			else if (stmt->asttype == ForNode && ((ForAstNode *)stmt)->from)
+				rangeFor((ForAstNode *)stmt);
+			rangeFind(stmt);
+		}
+		break;
+	}
+	case IfNode:
+		for (nodesFor(((IfAstNode *)node)->condblk, cnt, nodesp))
+			if (*nodesp)
+				rangeFind(*nodesp);
+		break;
+	case WhileNode:
+		rangeFind(((WhileAstNode *)node)->blk);
+		break;
+	case ForNode:
+		rangeFind(((ForAstNode *)node)->blk);
+		break;
+	case VarNameDclNode:
+		if (((NameDclAstNode *)node)->value)
+			rangeFind(((NameDclAstNode *)node)->value);
+		break;
+	case ReturnNode:
+		rangeFind(((ReturnAstNode *)node)->exp);
+		break;
+	case AssignNode:
+		rangeFind(((AssignAstNode *)node)->rval);
+		break;
+	// An argument may hold the loops of an inlined function's body
+	case FnCallNode:
+		for (nodesFor(((FnCallAstNode *)node)->parms, cnt, nodesp))
+			rangeFind(*nodesp);
+		break;
+	default:
+		break;
+	}
+}
+
+// Analyze the loops of every program-defined function (after type checking)
+void rangeAnalysis(ModuleAstNode *mod) {
+	uint32_t cnt;
+	AstNode **nodesp;
+	for (nodesFor(mod->nodes, cnt, nodesp)) {
+		switch ((*nodesp)->asttype) {
+		case VarNameDclNode:
+		{
+			NameDclAstNode *dcl = (NameDclAstNode *)*nodesp;
+			if (dcl->vtype->asttype == FnSig && dcl->value && dcl->value->asttype == BlockNode)
+				rangeFind(dcl->value);
+			break;
+		}
+
+		// A type's methods
+		case VtypeNameDclNode:
+		case AllocNameDclNode:
+		{
+			TypeAstNode *tnode = (TypeAstNode *)((NameDclAstNode *)*nodesp)->value;
+			uint32_t mcnt;
+			AstNode **methp;
+			if (tnode == NULL || tnode->methods == NULL)
+				break;
+			for (nodesFor(tnode->methods, mcnt, methp)) {
+				NameDclAstNode *meth = (NameDclAstNode *)*methp;
+				if (meth->value && meth->value->asttype == BlockNode)
+					rangeFind(meth->value);
+			}
+			break;
+		}
+
+		case ModuleNode:
+			rangeAnalysis((ModuleAstNode *)*nodesp);
+			break;
+		}
+	}
+}
@@ -10,6 +10,7 @@
 #include "../parser/lexer.h"
 #include "../ast/nametbl.h"
 #include "../shared/error.h"
+#include "../shared/timetrace.h"
 
 #include <string.h>
 #include <assert.h>
@@ -119,8 +120,9 @@ void nameDclFnTypeCheck(PassState *pstate, NameDclAstNode *varnode) {
 // Type check variable against its initial value
 void nameDclVarTypeCheck(PassState *pstate, NameDclAstNode *name) {
 	astPass(pstate, name->value);
-	// Global variables and function parameters require literal initializers
-	if (name->scope <= 1 && !litIsLiteral(name->value))
+	// Function parameters require literal initializers.
+	// A global variable's initial value is computed at compile time (see consteval.c).
+	if (name->scope == 1 && !litIsLiteral(name->value))
 		errorMsgNode(name->value, ErrorNotLit, "Variable may only be initialized with a literal.");
 	// Infer the var's vtype from its value, if not provided
 	if (name->vtype == voidType)
@@ -134,9 +136,15 @@ void nameDclVarTypeCheck(PassState *pstate, NameDclAstNode *name) {
 void nameDclPass(PassState *pstate, NameDclAstNode *name) {
 	astPass(pstate, (AstNode*)name->perm);
 	astPass(pstate, name->vtype);
+	if (pstate->pass == NameResolution)
+		name->vtype = typeIntern(name->vtype);
 	AstNode *vtype = typeGetVtype(name->vtype);
 
 	// Process nodes in name's initial value/code block
+	// Trace time spent on each function, nested within the pass
+	if (vtype->asttype == FnSig && name->value)
+		timeTraceBegin(astPassName(pstate->pass), &name->namesym->namestr);
+
 	switch (pstate->pass) {
 	case NameResolution:
 		// Hook into global name table if not a global owner by module
@@ -166,6 +174,9 @@ void nameDclPass(PassState *pstate, NameDclAstNode *name) {
 			errorMsgNode((AstNode*)name, ErrorNoType, "Name must specify a type");
 		break;
 	}
+
+	if (vtype->asttype == FnSig && name->value)
+		timeTraceEnd();
 }
 
 // Check the value type declaration's AST
@@ -8,23 +8,133 @@
 #include "conec.h"
 #include "coneopts.h"
 #include "shared/fileio.h"
+#include "shared/memory.h"
 #include "ast/nametbl.h"
 #include "ast/ast.h"
 #include "shared/error.h"
+#include "shared/timetrace.h"
 #include "parser/lexer.h"
 #include "parser/parser.h"
 #include "genllvm/genllvm.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <assert.h>
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
 
 clock_t startTime;
 
+// Compile one source file, returning its number of errors (its warnings are counted in warnings).
+// The name table, std library and target machine are shared by all compiles,
+// but all other state (lexer, AST, type table, LLVM module) is per-file.
+int conecCompile(ConeOptions *opt, char *srcfn) {
+	ModuleAstNode *modnode;
+	char *src, *fn;
+	size_t fnlen = strlen(srcfn);
+	errors = warnings = 0;
+	typeTblReset();
+
+	// With link-time optimization, a package may already have been compiled to bitcode
+	if (opt->lto && fnlen > 3 && strcmp(srcfn + fnlen - 3, ".bc") == 0) {
+		genlLtoAddBitcode(srcfn);
+		return errors;
+	}
+
+	// Load source file. Unlike an included file, one that is missing
+	// only fails its own compile, so that a batch can continue
+	timeTraceBegin("Compile", srcfn);
+	timeTraceBegin("Load", srcfn);
+	src = fileLoadSrc(lex->url, srcfn, &fn);
+	timeTraceEnd();
+	if (!src) {
+		errorMsg(ErrorNoFile, "Cannot find or read source file %s", srcfn);
+		timeTraceEnd();
+		return errors;
+	}
+
+	// Parse source file, do semantic analysis, and generate code
+	lexInject(fn, src);
+	modnode = parsePgm();
+	if (errors == 0) {
+		// An instrumented program counts each function's entries and branches,
+		// so its calls are left for LLVM to inline after instrumenting them
+		astPasses(modnode, !opt->profgen);
+		if (errors == 0) {
+			if (opt->print_ast)
+				astPrint(opt->output, srcfn, (AstNode*)modnode);
+			genllvm(opt, modnode);
+		}
+	}
+	timeTraceEnd();
+
+	// Return to the std library's lexer, ready for the next source file
+	lexPop();
+	return errors;
+}
+
+// Read the next source file name from a batch request stream (one per line)
+// Returns NULL at end of stream
+char *conecBatchNext(FILE *in) {
+	char line[4096];
+	size_t len;
+	while (fgets(line, sizeof(line), in)) {
+		len = strlen(line);
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' '))
+			line[--len] = '\0';
+		if (len == 0)
+			continue;
+		return memAllocStr(line, len);
+	}
+	return NULL;
+}
+
+// Compile and run one batch source file, replying with its status.
+// A program run in-process (--run) prints to the same stdout as the replies,
+// so its output is captured, and follows its reply: 'ok <file> <result> <bytes>'
+// is followed by exactly that many bytes of the program's output.
+int conecBatchRun(ConeOptions *opt, char *srcfn) {
+	char buf[4096];
+	FILE *out;
+	int stdoutfd, fileerrors;
+	long len;
+	size_t n;
+
+	fflush(stdout);
+	if (!(out = tmpfile()) || (stdoutfd = dup(fileno(stdout))) < 0)
+		errorExit(ExitError, "Error: Cannot capture the output of programs run in batch mode");
+	dup2(fileno(out), fileno(stdout));
+	fileerrors = conecCompile(opt, srcfn);
+	fflush(stdout);
+	dup2(stdoutfd, fileno(stdout));
+	close(stdoutfd);
+
+	len = ftell(out);
+	rewind(out);
+	if (fileerrors)
+		printf("error %s %d\n", srcfn, fileerrors);
+	else
+		printf("ok %s %d %ld\n", srcfn, genlRunResult, len);
+	while ((n = fread(buf, 1, sizeof(buf), out)) > 0)
+		fwrite(buf, 1, n, stdout);
+	fclose(out);
+	fflush(stdout);
+	return fileerrors;
+}
+
 int main(int argc, char **argv) {
 	ConeOptions coneopt;
-	ModuleAstNode *modnode;
 	int ok;
+	int argi;
+	int totalerrors = 0;
+	int totalwarnings;
 	char *srcfn;
 
 	// Start measuring processing time for compilation
@@ -34,29 +144,71 @@ int main(int argc, char **argv) {
 	ok = coneOptSet(&coneopt, &argc, argv);
 	if (ok <= 0)
 		exit(ok == 0 ? 0 : ExitOpts);
-	if (argc < 2)
+	if (argc < 2 && !coneopt.batch)
 		errorExit(ExitOpts, "Specify a Cone program to compile.");
-	srcfn = argv[1];
+	if (coneopt.time_trace)
+		timeTraceInit();
 
 	// Initialize name table and populate with std library names
 	nameInit();
 	stdlibInit();
 
-	// Parse source file, do semantic analysis, and generate code
-	lexInjectFile(srcfn);
-	modnode = parsePgm();
-	if (errors == 0) {
-		astPasses(modnode);
-		if (errors == 0) {
-			if (coneopt.print_ast)
-				astPrint(coneopt.output, srcfn, (AstNode*)modnode);
-			genllvm(&coneopt, modnode);
+	// Create the target machine once, for use by all compiles
+	genlSetup(&coneopt);
+	totalwarnings = warnings;
+
+	// Compile every source file named on the command line
+	for (argi = 1; argi < argc; argi++) {
+		totalerrors += conecCompile(&coneopt, argv[argi]);
+		totalwarnings += warnings;
+	}
+
+	// In batch mode, compile each source file requested on stdin,
+	// replying with one status line per file
+	if (coneopt.batch) {
+		while ((srcfn = conecBatchNext(stdin))) {
+			int fileerrors;
+			if (coneopt.run) {
+				totalerrors += conecBatchRun(&coneopt, srcfn);
+				totalwarnings += warnings;
+				continue;
+			}
+			fileerrors = conecCompile(&coneopt, srcfn);
+			totalerrors += fileerrors;
+			totalwarnings += warnings;
+			if (fileerrors)
+				printf("error %s %d\n", srcfn, fileerrors);
+			else
+				printf("ok %s\n", srcfn);
+			fflush(stdout);
 		}
 	}
 
+	// Optimize and emit all packages together as one program
+	if (coneopt.lto) {
+		errors = warnings = 0;
+		if (totalerrors == 0)
+			genlLinkProgram(&coneopt);
+		totalerrors += errors;
+		totalwarnings += warnings;
+	}
+
+	if (coneopt.print_stats)
+		fprintf(stderr, "Types: %lu interned, %lu duplicate type nodes shared. LLVM types built: %lu\n",
+			(unsigned long)gTypeTblUsed, (unsigned long)gTypeTblHits, (unsigned long)genlTypeCount);
+	if (coneopt.print_stats && coneopt.cachedir)
+		fprintf(stderr, "Object cache: %lu hits, %lu misses, %lu evicted\n",
+			(unsigned long)genlCacheHits, (unsigned long)genlCacheMisses, (unsigned long)genlCacheEvictions);
+
 	// Close up everything necessary
+	genlClose();
+	if (coneopt.time_trace)
+		timeTraceWrite(fileMakePath(coneopt.output, argc == 2 && !coneopt.batch? fileName(argv[1]) : "batch", "time-trace.json"));
+	errors = totalerrors;
+	warnings = totalwarnings;
 	errorSummary();
 #ifdef _DEBUG
 	getchar();	// Hack for VS debugging
 #endif
+	return coneopt.run? genlRunResult : 0;
 }
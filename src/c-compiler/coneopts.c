@@ -19,12 +19,27 @@ enum
 	OPT_VERSION,
 	OPT_HELP,
 	OPT_DEBUG,
+	OPT_OPTLEVEL,
+	OPT_CODEGEN_UNITS,
+	OPT_JOBS,
 	OPT_BUILDFLAG,
 	OPT_STRIP,
 	OPT_PATHS,
 	OPT_OUTPUT,
 	OPT_LIBRARY,
+	OPT_EXPORT,
+	OPT_CACHE,
+	OPT_CACHESIZE,
+	OPT_RUN,
+	OPT_ENTRY,
 	OPT_RUNTIMEBC,
+	OPT_BITCODE,
+	OPT_LTO,
+	OPT_PROFILEGEN,
+	OPT_PROFILEUSE,
+	OPT_MULTIVERSION,
+	OPT_FASTMATH,
+	OPT_FPCONTRACT,
 	OPT_PIC,
 	OPT_NOPIC,
 	OPT_DOCS,
@@ -36,6 +51,8 @@ enum
 	OPT_WASM,
 	OPT_TRIPLE,
 	OPT_STATS,
+	OPT_TIMETRACE,
+	OPT_BATCH,
 	OPT_LINK_ARCH,
 	OPT_LINKER,
 
@@ -63,12 +80,27 @@ static opt_arg_t args[] =
 	{ "version", 'v', OPT_ARG_NONE, OPT_VERSION },
 	{ "help", 'h', OPT_ARG_NONE, OPT_HELP },
 	{ "debug", 'd', OPT_ARG_NONE, OPT_DEBUG },
+	{ "opt-level", 'O', OPT_ARG_REQUIRED, OPT_OPTLEVEL },
+	{ "codegen-units", '\0', OPT_ARG_REQUIRED, OPT_CODEGEN_UNITS },
+	{ "jobs", 'j', OPT_ARG_REQUIRED, OPT_JOBS },
 	{ "define", 'D', OPT_ARG_REQUIRED, OPT_BUILDFLAG },
 	{ "strip", 's', OPT_ARG_NONE, OPT_STRIP },
 	{ "path", 'p', OPT_ARG_REQUIRED, OPT_PATHS },
 	{ "output", 'o', OPT_ARG_REQUIRED, OPT_OUTPUT },
 	{ "library", 'l', OPT_ARG_NONE, OPT_LIBRARY },
+	{ "export", '\0', OPT_ARG_REQUIRED, OPT_EXPORT },
+	{ "cache", '\0', OPT_ARG_REQUIRED, OPT_CACHE },
+	{ "cache-size", '\0', OPT_ARG_REQUIRED, OPT_CACHESIZE },
+	{ "run", 'r', OPT_ARG_NONE, OPT_RUN },
+	{ "entry", '\0', OPT_ARG_REQUIRED, OPT_ENTRY },
 	{ "runtimebc", '\0', OPT_ARG_NONE, OPT_RUNTIMEBC },
+	{ "bitcode", '\0', OPT_ARG_NONE, OPT_BITCODE },
+	{ "lto", '\0', OPT_ARG_NONE, OPT_LTO },
+	{ "profile-generate", '\0', OPT_ARG_NONE, OPT_PROFILEGEN },
+	{ "profile-use", '\0', OPT_ARG_REQUIRED, OPT_PROFILEUSE },
+	{ "multiversion", '\0', OPT_ARG_REQUIRED, OPT_MULTIVERSION },
+	{ "fast-math", '\0', OPT_ARG_NONE, OPT_FASTMATH },
+	{ "fp-contract", '\0', OPT_ARG_NONE, OPT_FPCONTRACT },
 	{ "pic", '\0', OPT_ARG_NONE, OPT_PIC },
 	{ "nopic", '\0', OPT_ARG_NONE, OPT_NOPIC },
 	{ "docs", 'g', OPT_ARG_NONE, OPT_DOCS },
@@ -80,6 +112,8 @@ static opt_arg_t args[] =
 	{ "wasm", '\0', OPT_ARG_NONE, OPT_WASM },
 	{ "triple", '\0', OPT_ARG_REQUIRED, OPT_TRIPLE },
 	{ "stats", '\0', OPT_ARG_NONE, OPT_STATS },
+	{ "time-trace", '\0', OPT_ARG_NONE, OPT_TIMETRACE },
+	{ "batch", '\0', OPT_ARG_NONE, OPT_BATCH },
 	{ "link-arch", '\0', OPT_ARG_REQUIRED, OPT_LINK_ARCH },
 	{ "linker", '\0', OPT_ARG_REQUIRED, OPT_LINKER },
 
@@ -103,14 +137,26 @@ static opt_arg_t args[] =
 static void usage()
 {
 	printf("%s\n%s\n%s\n%s\n%s\n%s", // for complying with -Woverlength-strings
-		"cone [OPTIONS] <source_file>\n"
+		"cone [OPTIONS] <source_file> ...\n"
 		,
 		"The source directory defaults to the current directory.\n"
 		,
 		"Options:\n"
 		"  --version, -v   Print the version of the compiler and exit.\n"
 		"  --help, -h      Print this help text and exit.\n"
-		"  --debug, -d     Don't optimise the output.\n"
+		"  --debug, -d     Don't optimise the output (same as -O0).\n"
+		"  --opt-level, -O Optimization level.\n"
+		"    =0            No optimization.\n"
+		"    =1            Light optimization.\n"
+		"    =2            Standard optimization, with vectorization (default).\n"
+		"    =3            Aggressive optimization.\n"
+		"    =s            Optimize for size.\n"
+		"    =z            Optimize aggressively for size.\n"
+		"  --codegen-units Split code generation into this many units.\n"
+		"    =n            Each is optimized and emitted in parallel. Default is 1.\n"
+		"                  Their objects are combined by --linker (default ld) -r.\n"
+		"  --jobs, -j      Number of threads generating codegen units.\n"
+		"    =n            Defaults to one per unit. Output does not depend on it.\n"
 		"  --define, -D    Define the specified build flag.\n"
 		"    =name\n"
 		"  --strip, -s     Strip debug info.\n"
@@ -119,7 +165,28 @@ static void usage()
 		"  --output, -o    Write output to this directory.\n"
 		"    =path         Defaults to the current directory.\n"
 		"  --library, -l   Generate a C-API compatible static library.\n"
+		"  --export        Keep only these symbols (and main) externally visible.\n"
+		"    =name,name    Defaults to the main module's top-level functions and globals.\n"
+		"  --cache         Reuse object files generated from identical IR.\n"
+		"    =path         Directory to store cached object files in.\n"
+		"  --cache-size    Evict least recently used cached objects beyond this size.\n"
+		"    =MB           Default is 1024.\n"
+		"  --run, -r       JIT-compile and run the program, instead of emitting it.\n"
+		"                  The entry function's integer result is the exit status.\n"
+		"  --entry         Entry function for --run to call.\n"
+		"    =name         Default is main.\n"
 		"  --runtimebc     Compile with the LLVM bitcode file for the runtime.\n"
+		"                  With --lto, links in conestd.bc from the output directory.\n"
+		"  --bitcode       Emit each package as LLVM bitcode (.bc), for --lto.\n"
+		"  --lto           Optimize and emit all packages (.cone or .bc) as one program.\n"
+		"  --profile-generate\n"
+		"                  Instrument the program to count its function entries and branches.\n"
+		"                  Running it adds to CONE_PROFILE_FILE (default.profraw).\n"
+		"  --profile-use   Optimize using the counts in this profile.\n"
+		"    =file\n"
+		"  --fast-math     Let float math be reassociated and contracted, use reciprocals,\n"
+		"                  and assume no NaNs or infinities (as @fastmath does for a function).\n"
+		"  --fp-contract   Fuse float a*b+c into a multiply-add (implied by fast math).\n"
 		"  --wasm          Compile for WebAssembly target.\n"
 		"  --pic           Compile using position independent code.\n"
 		"  --nopic         Don't compile using position independent code.\n"
@@ -130,13 +197,21 @@ static void usage()
 		"  --safe          Allow only the listed packages to use C FFI.\n"
 		"    =package      With no packages listed, only builtin is allowed.\n"
 		"  --cpu           Set the target CPU.\n"
-		"    =name         Default is the host CPU.\n"
+		"    =name         Default is generic. native is the host CPU, with all its features.\n"
+		"  --multiversion  Also generate functions with loops for these x86-64 feature levels.\n"
+		"    =x86-64-v3,x86-64-v4\n"
+		"                  The running CPU's best supported level is chosen at load time.\n"
 		"  --features      CPU features to enable or disable.\n"
 		"    =+this,-that  Use + to enable, - to disable.\n"
-		"                  Defaults to detecting all CPU features from the host.\n"
+		"                  Defaults to none, or with --cpu=native, all the host CPU's.\n"
 		"  --triple        Set the target triple.\n"
 		"    =name         Defaults to the host triple.\n"
 		"  --stats         Print some compiler stats.\n"
+		"  --time-trace    Write a Chrome trace-event JSON file of compile phase times.\n"
+		"  --batch         Also compile each source file named on stdin (one per line),\n"
+		"                  replying on stdout with 'ok <file>' or 'error <file> <count>'.\n"
+		"                  With --run, each 'ok' also gives the program's result and\n"
+		"                  output size: 'ok <file> <result> <bytes>', then its output.\n"
 		"  --link-arch     Set the linking architecture.\n"
 		"    =name         Default is the host architecture.\n"
 		"  --linker        Set the linker command to use.\n"
@@ -158,7 +233,7 @@ static void usage()
 		"  --immerr        Report errors immediately rather than deferring.\n"
 		"  --checktree     Verify AST well-formedness.\n"
 		"  --verify        Verify LLVM IR.\n"
-		"  --extfun        Set function default linkage to external.\n"
+		"  --extfun        Keep all functions externally visible.\n"
 		"  --simplebuiltin Use a minimal builtin package.\n"
 		"  --files         Print source file names as each is processed.\n"
 		"  --lint-llvm     Run the LLVM linting pass on generated IR.\n"
@@ -179,6 +254,11 @@ int coneOptSet(ConeOptions *opt, int *argc, char **argv) {
 	// options->verbosity = VERBOSITY_INFO;
 	// options->check.errors = errors_alloc();
 
+	opt->release = 1;
+	opt->optlevel = 2;
+	opt->cachesize = 1024;
+	opt->entry = "main";
+
 	optInit(args, &s, argc, argv);
 #if CONE_DEFAULT_PIC
 	opt.pic = 1;
@@ -194,11 +274,43 @@ int coneOptSet(ConeOptions *opt, int *argc, char **argv) {
 			usage();
 			return 0;
 
-		case OPT_DEBUG: opt->release = 0; break;
+		case OPT_DEBUG: opt->release = 0; opt->optlevel = 0; opt->sizelevel = 0; break;
+		case OPT_CODEGEN_UNITS: opt->codegen_units = atoi(s.arg_val); break;
+		case OPT_JOBS: opt->jobs = atoi(s.arg_val); break;
+		case OPT_OPTLEVEL:
+		{
+			char *lvl = s.arg_val;
+			opt->sizelevel = 0;
+			if (lvl[0] >= '0' && lvl[0] <= '3' && lvl[1] == '\0')
+				opt->optlevel = lvl[0] - '0';
+			else if ((lvl[0] == 's' || lvl[0] == 'z') && lvl[1] == '\0') {
+				opt->optlevel = 2;
+				opt->sizelevel = lvl[0] == 's'? 1 : 2;
+			}
+			else {
+				printf("Unrecognised optimization level: %s\n", lvl);
+				ok = 0;
+				print_usage = 1;
+			}
+			opt->release = opt->optlevel > 0;
+		}
+		break;
 		case OPT_STRIP: opt->strip_debug = 1; break;
 		case OPT_OUTPUT: opt->output = s.arg_val; break;
 		case OPT_LIBRARY: opt->library = 1; break;
+		case OPT_EXPORT: opt->exports = s.arg_val; break;
+		case OPT_CACHE: opt->cachedir = s.arg_val; break;
+		case OPT_CACHESIZE: opt->cachesize = atoi(s.arg_val); break;
+		case OPT_RUN: opt->run = 1; break;
+		case OPT_ENTRY: opt->entry = s.arg_val; break;
 		case OPT_RUNTIMEBC: opt->runtimebc = 1; break;
+		case OPT_BITCODE: opt->bitcode = 1; break;
+		case OPT_LTO: opt->lto = 1; break;
+		case OPT_PROFILEGEN: opt->profgen = 1; break;
+		case OPT_PROFILEUSE: opt->profuse = s.arg_val; break;
+		case OPT_MULTIVERSION: opt->multiversion = s.arg_val; break;
+		case OPT_FASTMATH: opt->fastmath = 1; break;
+		case OPT_FPCONTRACT: opt->fpcontract = 1; break;
 		case OPT_PIC: opt->pic = 1; break;
 		case OPT_NOPIC: opt->pic = 0; break;
 		case OPT_DOCS:
@@ -229,6 +341,8 @@ int coneOptSet(ConeOptions *opt, int *argc, char **argv) {
 		case OPT_FEATURES: opt->features = s.arg_val; break;
 		case OPT_TRIPLE: opt->triple = s.arg_val; break;
 		case OPT_STATS: opt->print_stats = 1; break;
+		case OPT_TIMETRACE: opt->time_trace = 1; break;
+		case OPT_BATCH: opt->batch = 1; break;
 		case OPT_LINK_ARCH: opt->link_arch = s.arg_val; break;
 		case OPT_LINKER: opt->linker = s.arg_val; break;
 
@@ -25,12 +25,22 @@ typedef struct ConeOptions {
 	char* triple;
 	char* cpu;
 	char* features;
+	char* exports;	// Comma-separated names of the only symbols to keep external
+	char* cachedir;	// Object file cache directory (NULL = no cache)
+	char* entry;	// Entry function called by --run
+	char* profuse;	// Profile to optimize with (--profile-use), or NULL
+	char* multiversion;	// Comma-separated x86-64 feature levels to also generate looping functions for
 
 	//typecheck_t check;
 
 	void* data; // User-defined data for unit test callbacks
 
 	int ptrsize;	// Size of a pointer (in bits)
+	int optlevel;	// Optimization level: 0-3 (-O0..-O3)
+	int sizelevel;	// Optimize for size: 0=no, 1=-Os, 2=-Oz
+	int codegen_units;	// Number of units to split code generation into (>1 = in parallel)
+	int jobs;		// Number of threads generating codegen units (0 = one per unit)
+	int cachesize;	// Object file cache size limit, in MB
 
 	// Boolean flags
 	int wasm;		// 1=WebAssembly
@@ -39,8 +49,16 @@ typedef struct ConeOptions {
 	int runtimebc;	// Compile with the LLVM bitcode file for the runtime
 	int pic;		// Compile using position independent code
 	int print_stats;	// Print some compiler statistics
+	int time_trace;		// Write Chrome trace-event JSON of compile phase timings
+	int batch;		// Compile source files named on stdin, one per line
+	int run;		// JIT-compile and run the program in-process, instead of emitting it
+	int bitcode;	// Emit each package as bitcode, for link-time optimization
+	int lto;		// Link all packages into one program before optimizing and emitting it
+	int profgen;	// Instrument the program to write a profile (--profile-generate)
+	int fastmath;	// Let all float math be reassociated, contracted, etc. (--fast-math)
+	int fpcontract;	// Fuse float multiply-adds (--fp-contract)
 	int verify;		// Verify LLVM IR
-	int extfun;		// Set function default linkage to external
+	int extfun;		// Keep all functions externally visible (not internal)
 	int simple_builtin;	// Use a minimal builtin package
 	int strip_debug;	// Strip debug info
 	int print_filenames;	// Print source file names as each is processed
@@ -0,0 +1,284 @@
+/** Object file cache
+ * @file
+ *
+ * With --cache=dir, each object file the compiler emits is also stored in dir,
+ * keyed by a hash of the verified, unoptimized LLVM IR it was generated from,
+ * together with everything else that shapes the object: the target triple,
+ * CPU, features, optimization level, relocation model, codegen units and
+ * compiler and LLVM versions. When a later compile generates the same IR,
+ * the stored object is copied out instead, skipping optimization and emission.
+ *
+ * The cache is limited in size (--cache-size, in MB). When a newly stored object
+ * takes it over the limit, the least recently used objects are evicted.
+ * A hit marks its object as recently used by touching its modification time.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "../shared/error.h"
+#include "../shared/memory.h"
+#include "../shared/timetrace.h"
+#include "../coneopts.h"
+#include "../conec.h"
+#include "genllvm.h"
+
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Core.h>
+#include <llvm/Config/llvm-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <sys/utime.h>
+#define genlCacheMkdir(dir) _mkdir(dir)
+#define genlCacheObjext ".obj"
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#define genlCacheMkdir(dir) mkdir(dir, 0777)
+#define genlCacheObjext ".o"
+#endif
+
+// Bump whenever what is stored, or how it is keyed, changes
+#define GenlCacheFormat 1
+
+// Hex digits in a cache key (two 64-bit hashes)
+#define GenlCacheKeyLen 32
+
+size_t genlCacheHits = 0;
+size_t genlCacheMisses = 0;
+size_t genlCacheEvictions = 0;
+
+// Running hash state: two independent 64-bit FNV-1a style hashes
+typedef struct GenlCacheHash {
+	uint64_t h1;
+	uint64_t h2;
+} GenlCacheHash;
+
+// Add bytes to the running hash
+static void genlCacheHashBytes(GenlCacheHash *hash, const char *bytes, size_t len) {
+	const unsigned char *p = (const unsigned char *)bytes;
+	const unsigned char *end = p + len;
+	uint64_t h1 = hash->h1, h2 = hash->h2;
+	for (; p < end; p++) {
+		h1 = (h1 ^ *p) * 0x100000001b3ull;
+		h2 = (h2 ^ *p) * 0x9e3779b97f4a7c15ull;
+		h2 ^= h2 >> 29;
+	}
+	hash->h1 = h1;
+	hash->h2 = h2;
+}
+
+// Add a string (with its terminator, so adjacent strings cannot run together)
+static void genlCacheHashStr(GenlCacheHash *hash, const char *str) {
+	if (str == NULL)
+		str = "";
+	genlCacheHashBytes(hash, str, strlen(str) + 1);
+}
+
+// Add an integer option
+static void genlCacheHashInt(GenlCacheHash *hash, int val) {
+	char buf[16];
+	sprintf(buf, "%d", val);
+	genlCacheHashStr(hash, buf);
+}
+
+// Return the cache key for a generated module, as a string of hex digits
+char *genlCacheKey(LLVMModuleRef module, ConeOptions *opt) {
+	GenlCacheHash hash = { 0xcbf29ce484222325ull, 0x84222325cbf29ce4ull };
+	LLVMMemoryBufferRef bitcode;
+	char key[GenlCacheKeyLen + 1];
+
+	timeTraceBegin("CacheKey", NULL);
+	genlCacheHashInt(&hash, GenlCacheFormat);
+	genlCacheHashStr(&hash, CONE_RELEASE);
+	genlCacheHashStr(&hash, LLVM_VERSION_STRING);
+	genlCacheHashStr(&hash, opt->triple);
+	genlCacheHashStr(&hash, opt->cpu);
+	genlCacheHashStr(&hash, opt->features);
+	genlCacheHashInt(&hash, opt->optlevel);
+	genlCacheHashInt(&hash, opt->sizelevel);
+	genlCacheHashInt(&hash, genlIsPic(opt));
+	genlCacheHashInt(&hash, opt->wasm);
+	genlCacheHashInt(&hash, opt->codegen_units > 1 ? opt->codegen_units : 1);
+
+	bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+	genlCacheHashBytes(&hash, LLVMGetBufferStart(bitcode), LLVMGetBufferSize(bitcode));
+	LLVMDisposeMemoryBuffer(bitcode);
+	timeTraceEnd();
+
+	sprintf(key, "%016llx%016llx", (unsigned long long)hash.h1, (unsigned long long)hash.h2);
+	return memAllocStr(key, GenlCacheKeyLen);
+}
+
+// Return the path of the cached object for a key
+static char *genlCachePath(ConeOptions *opt, char *key, char *suffix) {
+	char *path = memAllocBlk(strlen(opt->cachedir) + strlen(key) + strlen(suffix) + 2);
+	sprintf(path, "%s/%s%s", opt->cachedir, key, suffix);
+	return path;
+}
+
+// Copy a file. Return 1 if successful.
+static int genlCacheCopy(char *frompath, char *topath) {
+	char buf[65536];
+	size_t len;
+	int ok = 1;
+	FILE *from, *to;
+
+	if (!(from = fopen(frompath, "rb")))
+		return 0;
+	if (!(to = fopen(topath, "wb"))) {
+		fclose(from);
+		return 0;
+	}
+	while ((len = fread(buf, 1, sizeof(buf), from)) > 0) {
+		if (fwrite(buf, 1, len, to) != len) {
+			ok = 0;
+			break;
+		}
+	}
+	if (ferror(from))
+		ok = 0;
+	fclose(from);
+	if (fclose(to) != 0)
+		ok = 0;
+	return ok;
+}
+
+// Copy the cached object for key to objpath, if there is one.
+// Return 1 on a hit, or 0 on a miss.
+int genlCacheFetch(ConeOptions *opt, char *key, char *objpath) {
+	char *path = genlCachePath(opt, key, genlCacheObjext);
+	int hit;
+
+	timeTraceBegin("CacheFetch", objpath);
+	hit = genlCacheCopy(path, objpath);
+	if (hit) {
+		utime(path, NULL);	// Now the most recently used
+		++genlCacheHits;
+	}
+	else {
+		remove(objpath);
+		++genlCacheMisses;
+	}
+	timeTraceEnd();
+	return hit;
+}
+
+// A cached object, as considered for eviction
+typedef struct GenlCacheEntry {
+	char *path;
+	time_t used;
+	size_t size;
+} GenlCacheEntry;
+
+// Order cache entries, least recently used first
+static int genlCacheEntryCmp(const void *a, const void *b) {
+	time_t ua = ((GenlCacheEntry *)a)->used;
+	time_t ub = ((GenlCacheEntry *)b)->used;
+	return ua < ub ? -1 : ua > ub ? 1 : 0;
+}
+
+// Is this file name one of the cache's objects?
+static int genlCacheIsEntry(char *name) {
+	return strlen(name) == GenlCacheKeyLen + strlen(genlCacheObjext)
+		&& strcmp(name + GenlCacheKeyLen, genlCacheObjext) == 0;
+}
+
+// Add a cache entry to the list being built
+static void genlCacheAddEntry(GenlCacheEntry **entries, size_t *used, size_t *avail, ConeOptions *opt, char *name) {
+	struct stat st;
+	char *path = genlCachePath(opt, name, "");
+	if (stat(path, &st) != 0)
+		return;
+	if (*used >= *avail) {
+		*avail = *avail == 0 ? 256 : *avail << 1;
+		if (!(*entries = (GenlCacheEntry *)realloc(*entries, *avail * sizeof(GenlCacheEntry))))
+			errorExit(ExitMem, "Error: Out of memory");
+	}
+	(*entries)[*used].path = path;
+	(*entries)[*used].used = st.st_mtime;
+	(*entries)[*used].size = (size_t)st.st_size;
+	++*used;
+}
+
+// Evict least recently used objects until the cache is within its size limit
+static void genlCacheEvict(ConeOptions *opt) {
+	GenlCacheEntry *entries = NULL;
+	size_t used = 0, avail = 0, total = 0, i;
+	size_t limit = (size_t)opt->cachesize << 20;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA found;
+	HANDLE dir = FindFirstFileA(genlCachePath(opt, "*", genlCacheObjext), &found);
+	if (dir == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		if (genlCacheIsEntry(found.cFileName))
+			genlCacheAddEntry(&entries, &used, &avail, opt, found.cFileName);
+	} while (FindNextFileA(dir, &found));
+	FindClose(dir);
+#else
+	struct dirent *found;
+	DIR *dir = opendir(opt->cachedir);
+	if (dir == NULL)
+		return;
+	while ((found = readdir(dir))) {
+		if (genlCacheIsEntry(found->d_name))
+			genlCacheAddEntry(&entries, &used, &avail, opt, found->d_name);
+	}
+	closedir(dir);
+#endif
+
+	for (i = 0; i < used; i++)
+		total += entries[i].size;
+	if (total > limit) {
+		qsort(entries, used, sizeof(GenlCacheEntry), genlCacheEntryCmp);
+		for (i = 0; i < used && total > limit; i++) {
+			if (remove(entries[i].path) == 0) {
+				total -= entries[i].size;
+				++genlCacheEvictions;
+			}
+		}
+	}
+	free(entries);
+}
+
+// Store the newly emitted object at objpath in the cache, under key
+void genlCacheStore(ConeOptions *opt, char *key, char *objpath) {
+	char *path = genlCachePath(opt, key, genlCacheObjext);
+	char *tmppath;
+
+	timeTraceBegin("CacheStore", objpath);
+	genlCacheMkdir(opt->cachedir);
+
+	// Write a private temporary file first, so no other compile ever sees a partial object
+	tmppath = memAllocBlk(strlen(path) + 24);
+#ifdef _WIN32
+	sprintf(tmppath, "%s.%lu.tmp", path, (unsigned long)GetCurrentProcessId());
+#else
+	sprintf(tmppath, "%s.%lu.tmp", path, (unsigned long)getpid());
+#endif
+	if (!genlCacheCopy(objpath, tmppath)) {
+		remove(tmppath);
+		errorMsg(WarnCache, "Could not store object in cache directory %s", opt->cachedir);
+		timeTraceEnd();
+		return;
+	}
+	remove(path);
+	if (rename(tmppath, path) != 0)
+		remove(tmppath);
+
+	genlCacheEvict(opt);
+	timeTraceEnd();
+}
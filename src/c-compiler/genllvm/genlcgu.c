@@ -0,0 +1,413 @@
+/** Parallel generation of codegen units
+ * @file
+ *
+ * With --codegen-units=n, a package's generated module is split into n modules
+ * (codegen units), each of which is optimized and emitted to an object file on
+ * its own thread, using its own LLVM context and target machine.
+ * The unit objects are then combined into the package's single relocatable object.
+ *
+ * Every function definition is assigned to one unit, balancing units by
+ * instruction count. Global variables are defined in unit 0. Each unit
+ * declares whatever else it refers to. So that units can refer to each other's
+ * definitions, module-local symbols are first promoted to hidden (package-private)
+ * symbols with a prefix unique to the source file.
+ *
+ * The split depends only on the generated IR and the number of units,
+ * never on the number of threads (--jobs), so output is deterministic.
+ *
+ * The host's linker (--linker, or ld) combines the unit objects, so a package
+ * compiled for another architecture or object format (--triple), or on Windows,
+ * is generated as a single unit.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "../shared/error.h"
+#include "../shared/memory.h"
+#include "../shared/fileio.h"
+#include "../shared/timetrace.h"
+#include "../coneopts.h"
+#include "genllvm.h"
+
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define objext "obj"
+#define asmext "asm"
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#define objext "o"
+#define asmext "s"
+#endif
+
+// The work and results of one codegen unit
+typedef struct GenlUnit {
+	int index;
+	LLVMTargetMachineRef machine;	// Each thread needs its own target machine
+	char *objpath;
+	char *asmpath;	// NULL, unless assembly is requested
+	char *irpath;	// NULL, unless LLVM IR is requested
+	char *errmsg;	// Set (malloc'ed) if generation failed
+} GenlUnit;
+
+// State shared by all threads
+typedef struct GenlUnits {
+	ConeOptions *opt;
+	LLVMMemoryBufferRef bitcode;	// The whole (unoptimized) module
+	int *fnunit;		// The unit that defines each function, in module order (-1 for declarations)
+	int nunits;
+	int njobs;
+	GenlUnit *units;
+} GenlUnits;
+
+// A worker thread's parameters
+typedef struct GenlWorker {
+	GenlUnits *cgus;
+	int job;
+} GenlWorker;
+
+// A function definition's size, for assigning it to a unit
+typedef struct GenlFnSize {
+	size_t size;
+	size_t index;	// Position in module's function list
+} GenlFnSize;
+
+// Order functions largest first, then by module order
+static int genlCguFnCmp(const void *a, const void *b) {
+	const GenlFnSize *fa = (const GenlFnSize *)a;
+	const GenlFnSize *fb = (const GenlFnSize *)b;
+	if (fa->size != fb->size)
+		return fa->size > fb->size? -1 : 1;
+	return fa->index < fb->index? -1 : fa->index > fb->index? 1 : 0;
+}
+
+// Count a function's instructions, as an estimate of its code generation cost
+static size_t genlCguFnSize(LLVMValueRef fn) {
+	LLVMBasicBlockRef blk;
+	LLVMValueRef inst;
+	size_t size = 0;
+	for (blk = LLVMGetFirstBasicBlock(fn); blk; blk = LLVMGetNextBasicBlock(blk))
+		for (inst = LLVMGetFirstInstruction(blk); inst; inst = LLVMGetNextInstruction(inst))
+			++size;
+	return size;
+}
+
+// Promote a module-local symbol to a hidden one, uniquely named for this source file
+static void genlCguPromote(GenState *gen, LLVMValueRef glo, size_t *anon) {
+	LLVMLinkage linkage = LLVMGetLinkage(glo);
+	const char *name;
+	char *newname;
+	if (linkage != LLVMInternalLinkage && linkage != LLVMPrivateLinkage)
+		return;
+	name = LLVMGetValueName(glo);
+	newname = memAllocBlk(strlen(gen->srcname) + strlen(name) + 24);
+	if (*name)
+		sprintf(newname, "%s.%s", gen->srcname, name);
+	else
+		sprintf(newname, "%s.anon.%lu", gen->srcname, (unsigned long)(*anon)++);
+	LLVMSetValueName(glo, newname);
+	LLVMSetLinkage(glo, LLVMExternalLinkage);
+	LLVMSetVisibility(glo, LLVMHiddenVisibility);
+}
+
+// Remove a function's body, leaving only its declaration
+static void genlCguDropBody(LLVMValueRef fn) {
+	LLVMBasicBlockRef blk;
+	LLVMValueRef inst;
+
+	// Detach all uses of the body's values, then erase its instructions and blocks
+	for (blk = LLVMGetFirstBasicBlock(fn); blk; blk = LLVMGetNextBasicBlock(blk))
+		for (inst = LLVMGetFirstInstruction(blk); inst; inst = LLVMGetNextInstruction(inst))
+			if (LLVMGetTypeKind(LLVMTypeOf(inst)) != LLVMVoidTypeKind)
+				LLVMReplaceAllUsesWith(inst, LLVMGetUndef(LLVMTypeOf(inst)));
+	for (blk = LLVMGetFirstBasicBlock(fn); blk; blk = LLVMGetNextBasicBlock(blk))
+		while ((inst = LLVMGetFirstInstruction(blk)))
+			LLVMInstructionEraseFromParent(inst);
+	while ((blk = LLVMGetFirstBasicBlock(fn)))
+		LLVMDeleteBasicBlock(blk);
+	LLVMSetLinkage(fn, LLVMExternalLinkage);
+}
+
+// Replace a global variable's definition with a declaration of it
+static void genlCguDeclareGlobal(LLVMModuleRef mod, LLVMValueRef glo) {
+	LLVMValueRef decl;
+	char *name;
+#if LLVM_VERSION_MAJOR >= 8
+	LLVMTypeRef type = LLVMGlobalGetValueType(glo);
+#else
+	LLVMTypeRef type = LLVMGetElementType(LLVMTypeOf(glo));
+#endif
+	name = strdup(LLVMGetValueName(glo));
+	decl = LLVMAddGlobalInAddressSpace(mod, type, "", LLVMGetPointerAddressSpace(LLVMTypeOf(glo)));
+	LLVMSetGlobalConstant(decl, LLVMIsGlobalConstant(glo));
+	LLVMSetThreadLocal(decl, LLVMIsThreadLocal(glo));
+	LLVMSetVisibility(decl, LLVMGetVisibility(glo));
+	LLVMSetAlignment(decl, LLVMGetAlignment(glo));
+	LLVMReplaceAllUsesWith(glo, decl);
+	LLVMDeleteGlobal(glo);
+	LLVMSetValueName(decl, name);
+	free(name);
+}
+
+// Build, optimize and emit one codegen unit. Returns an error message or NULL.
+static char *genlCguGen(GenlUnits *cgus, GenlUnit *unit) {
+	LLVMContextRef context;
+	LLVMMemoryBufferRef buf;
+	LLVMModuleRef mod;
+	LLVMValueRef fn, glo, next;
+	char *err = NULL;
+	char *errmsg = NULL;
+	int fni;
+
+	// Load a private copy of the whole module into the unit's own context
+	context = LLVMContextCreate();
+	buf = LLVMCreateMemoryBufferWithMemoryRange(LLVMGetBufferStart(cgus->bitcode),
+		LLVMGetBufferSize(cgus->bitcode), "", 0);
+	if (LLVMParseBitcodeInContext2(context, buf, &mod)) {
+		LLVMDisposeMemoryBuffer(buf);
+		LLVMContextDispose(context);
+		return strdup("Could not load module bitcode");
+	}
+	LLVMDisposeMemoryBuffer(buf);
+
+	// Keep only this unit's definitions
+	for (fni = 0, fn = LLVMGetFirstFunction(mod); fn; fn = LLVMGetNextFunction(fn), fni++)
+		if (cgus->fnunit[fni] >= 0 && cgus->fnunit[fni] != unit->index)
+			genlCguDropBody(fn);
+	if (unit->index != 0) {
+		for (glo = LLVMGetFirstGlobal(mod); glo; glo = next) {
+			next = LLVMGetNextGlobal(glo);
+			if (LLVMGetInitializer(glo))
+				genlCguDeclareGlobal(mod, glo);
+		}
+	}
+
+	// Optimize and emit it
+	errmsg = genlRunPasses(mod, cgus->opt, unit->machine, GenlPassDefault);
+	if (!errmsg && unit->irpath && LLVMPrintModuleToFile(mod, unit->irpath, &err) != 0) {
+		errmsg = strdup(err);
+		LLVMDisposeMessage(err);
+	}
+	if (!errmsg && unit->asmpath && LLVMTargetMachineEmitToFile(unit->machine, mod, unit->asmpath, LLVMAssemblyFile, &err) != 0) {
+		errmsg = strdup(err);
+		LLVMDisposeMessage(err);
+	}
+	if (!errmsg && LLVMTargetMachineEmitToFile(unit->machine, mod, unit->objpath, LLVMObjectFile, &err) != 0) {
+		errmsg = strdup(err);
+		LLVMDisposeMessage(err);
+	}
+
+	LLVMDisposeModule(mod);
+	LLVMContextDispose(context);
+	return errmsg;
+}
+
+// Can the host's linker combine objects for the target? Only if its architecture
+// (the triple's first part) and object format (Mach-O on Apple) are the host's own.
+static int genlCguHostObjects(char *triple) {
+	char *host = LLVMGetDefaultTargetTriple();
+	size_t archlen = strcspn(host, "-");
+	int same = strncmp(host, triple, archlen) == 0 && (triple[archlen] == '-' || triple[archlen] == '\0')
+		&& !strstr(host, "apple") == !strstr(triple, "apple");
+	LLVMDisposeMessage(host);
+	return same;
+}
+
+// Check --codegen-units against the target. Units cannot be combined
+// into one object for a foreign target, so it is then compiled as one unit.
+// Nor (yet) on Windows, which has no 'ld -r' for relocatable objects.
+void genlCguSetup(ConeOptions *opt) {
+	if (opt->codegen_units <= 1)
+		return;
+#ifdef _WIN32
+	errorMsg(WarnTarget, "Codegen unit objects cannot be combined into one object on Windows; --codegen-units is ignored");
+	opt->codegen_units = 1;
+#else
+	if (!opt->wasm && !genlCguHostObjects(opt->triple)) {
+		errorMsg(WarnTarget, "Codegen units are combined by the host's linker, which cannot link for %s; --codegen-units is ignored", opt->triple);
+		opt->codegen_units = 1;
+	}
+#endif
+}
+
+// A worker thread generates every njobs'th unit, starting with its own job number
+#ifdef _WIN32
+static DWORD WINAPI genlCguWorker(LPVOID parm) {
+#else
+static void *genlCguWorker(void *parm) {
+#endif
+	GenlWorker *worker = (GenlWorker *)parm;
+	GenlUnits *cgus = worker->cgus;
+	int unit;
+	for (unit = worker->job; unit < cgus->nunits; unit += cgus->njobs) {
+		// A unit without a target machine has already failed
+		if (cgus->units[unit].machine)
+			cgus->units[unit].errmsg = genlCguGen(cgus, &cgus->units[unit]);
+	}
+	return 0;
+}
+
+// Run the workers, each on its own thread, and wait for them all to finish
+static void genlCguRun(GenlUnits *cgus) {
+	GenlWorker *workers = (GenlWorker *)memAllocBlk(cgus->njobs * sizeof(GenlWorker));
+	int job;
+#ifdef _WIN32
+	HANDLE *threads = (HANDLE *)memAllocBlk(cgus->njobs * sizeof(HANDLE));
+	for (job = 0; job < cgus->njobs; job++) {
+		workers[job].cgus = cgus;
+		workers[job].job = job;
+		threads[job] = CreateThread(NULL, 0, genlCguWorker, &workers[job], 0, NULL);
+		if (threads[job] == NULL)
+			genlCguWorker(&workers[job]);
+	}
+	for (job = 0; job < cgus->njobs; job++) {
+		if (threads[job]) {
+			WaitForSingleObject(threads[job], INFINITE);
+			CloseHandle(threads[job]);
+		}
+	}
+#else
+	pthread_t *threads = (pthread_t *)memAllocBlk(cgus->njobs * sizeof(pthread_t));
+	int *started = (int *)memAllocBlk(cgus->njobs * sizeof(int));
+	for (job = 0; job < cgus->njobs; job++) {
+		workers[job].cgus = cgus;
+		workers[job].job = job;
+		started[job] = pthread_create(&threads[job], NULL, genlCguWorker, &workers[job]) == 0;
+		if (!started[job])
+			genlCguWorker(&workers[job]);
+	}
+	for (job = 0; job < cgus->njobs; job++)
+		if (started[job])
+			pthread_join(threads[job], NULL);
+#endif
+}
+
+// Combine the units' objects into one relocatable object, in unit order, using the
+// linker (--linker, or ld) as 'linker -r -o objpath units...'. The linker is run
+// directly (not through a shell), so paths are passed to it exactly as they are.
+static int genlCguCombine(GenlUnits *cgus, char *objpath) {
+#ifdef _WIN32
+	return 0;	// genlCguSetup never splits a Windows package into units
+#else
+	char *linker = cgus->opt->linker? cgus->opt->linker : "ld";
+	char **argv = (char **)memAllocBlk((cgus->nunits + 5) * sizeof(char *));
+	int argc = 0, status, unit;
+	pid_t pid;
+
+	argv[argc++] = linker;
+	argv[argc++] = "-r";
+	argv[argc++] = "-o";
+	argv[argc++] = objpath;
+	for (unit = 0; unit < cgus->nunits; unit++)
+		argv[argc++] = cgus->units[unit].objpath;
+	argv[argc] = NULL;
+
+	if ((pid = fork()) == 0) {
+		execvp(linker, argv);
+		_exit(127);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return 0;
+	for (unit = 0; unit < cgus->nunits; unit++)
+		remove(cgus->units[unit].objpath);
+	return 1;
+#endif
+}
+
+// Split the generated module into codegen units, then optimize and emit them in parallel
+void genlCodegenUnits(GenState *gen, ConeOptions *opt, LLVMTargetMachineRef machine, char *objpath) {
+	GenlUnits cgus;
+	LLVMValueRef fn, glo;
+	GenlFnSize *fnsizes;
+	size_t *unitsize;
+	size_t nfns, fni, anon = 0;
+	int unit;
+	char *unitname;
+	char *layout;
+
+	cgus.opt = opt;
+	cgus.nunits = opt->codegen_units;
+	cgus.njobs = opt->jobs > 0 && opt->jobs < cgus.nunits? opt->jobs : cgus.nunits;
+
+	timeTraceBegin("CodegenUnits", gen->srcname);
+
+	// Make every definition visible to the other units
+	for (fn = LLVMGetFirstFunction(gen->module); fn; fn = LLVMGetNextFunction(fn))
+		genlCguPromote(gen, fn, &anon);
+	for (glo = LLVMGetFirstGlobal(gen->module); glo; glo = LLVMGetNextGlobal(glo))
+		genlCguPromote(gen, glo, &anon);
+
+	// Assign functions to units, largest first, each to the least loaded unit.
+	// Ties are broken by module order, so the assignment is deterministic.
+	for (nfns = 0, fn = LLVMGetFirstFunction(gen->module); fn; fn = LLVMGetNextFunction(fn))
+		++nfns;
+	cgus.fnunit = (int *)memAllocBlk((nfns + 1) * sizeof(int));
+	fnsizes = (GenlFnSize *)memAllocBlk((nfns + 1) * sizeof(GenlFnSize));
+	for (fni = 0, fn = LLVMGetFirstFunction(gen->module); fn; fn = LLVMGetNextFunction(fn), fni++) {
+		fnsizes[fni].size = genlCguFnSize(fn);
+		fnsizes[fni].index = fni;
+		cgus.fnunit[fni] = -1;
+	}
+	qsort(fnsizes, nfns, sizeof(GenlFnSize), genlCguFnCmp);
+	unitsize = (size_t *)memAllocBlk(cgus.nunits * sizeof(size_t));
+	memset(unitsize, 0, cgus.nunits * sizeof(size_t));
+	for (fni = 0; fni < nfns && fnsizes[fni].size > 0; fni++) {
+		int least = 0;
+		for (unit = 1; unit < cgus.nunits; unit++)
+			if (unitsize[unit] < unitsize[least])
+				least = unit;
+		cgus.fnunit[fnsizes[fni].index] = least;
+		unitsize[least] += fnsizes[fni].size;
+	}
+
+	// Serialize the whole module, for each unit to load into its own context
+	LLVMSetTarget(gen->module, opt->triple);
+	layout = LLVMCopyStringRepOfTargetData(gen->datalayout);
+	LLVMSetDataLayout(gen->module, layout);
+	LLVMDisposeMessage(layout);
+	cgus.bitcode = LLVMWriteBitcodeToMemoryBuffer(gen->module);
+
+	// Create each unit's target machine and output paths
+	cgus.units = (GenlUnit *)memAllocBlk(cgus.nunits * sizeof(GenlUnit));
+	unitname = memAllocBlk(strlen(gen->srcname) + 16);
+	for (unit = 0; unit < cgus.nunits; unit++) {
+		GenlUnit *u = &cgus.units[unit];
+		sprintf(unitname, "%s.%d", gen->srcname, unit);
+		u->index = unit;
+		u->machine = genlCreateMachine(opt);
+		u->objpath = fileMakePath(opt->output, unitname, objext);
+		u->asmpath = opt->print_asm? fileMakePath(opt->output, unitname, asmext) : NULL;
+		u->irpath = opt->print_llvmir? fileMakePath(opt->output, unitname, "ir") : NULL;
+		u->errmsg = u->machine? NULL : strdup("Could not create target machine");
+	}
+
+	genlCguRun(&cgus);
+
+	// Report failures, or combine the units' objects
+	for (unit = 0; unit < cgus.nunits; unit++) {
+		GenlUnit *u = &cgus.units[unit];
+		if (u->errmsg) {
+			errorMsg(ErrorGenErr, "Could not generate codegen unit %d: %s", unit, u->errmsg);
+			free(u->errmsg);
+		}
+		if (u->machine)
+			LLVMDisposeTargetMachine(u->machine);
+	}
+	if (errors == 0 && !genlCguCombine(&cgus, objpath))
+		errorMsg(ErrorGenErr, "Could not combine codegen unit objects into %s. They remain as separate objects.", objpath);
+
+	LLVMDisposeMemoryBuffer(cgus.bitcode);
+	timeTraceEnd();
+}
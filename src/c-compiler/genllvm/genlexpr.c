@@ -11,8 +11,10 @@
 #include "../coneopts.h"
 #include "../ast/nametbl.h"
 #include "../shared/fileio.h"
+#include "../shared/memory.h"
 #include "genllvm.h"
 
+#include <llvm/Config/llvm-config.h>
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
 #include <llvm-c/Analysis.h>
@@ -23,8 +25,135 @@
 #include <string.h>
 #include <assert.h>
 
+// Number of LLVM types built from type nodes (reported by --stats)
+size_t genlTypeCount = 0;
+
+// Find the pool slot that is either empty or holds the string
+static GenlStrLit *genlStrLitSlot(GenState *gen, char *strlit, size_t hash) {
+	size_t slot, step;
+	for (slot = hash & (gen->strlitsAvail - 1), step = 1;; ++step) {
+		GenlStrLit *lit = &gen->strlits[slot];
+		if (lit->str == NULL || (lit->hash == hash && strcmp(lit->str, strlit) == 0))
+			return lit;
+		slot = (slot + step) & (gen->strlitsAvail - 1);
+	}
+}
+
+// Grow the module's string literal pool, by either creating it or doubling its size
+static void genlStrLitGrow(GenState *gen) {
+	GenlStrLit *oldlits = gen->strlits;
+	size_t oldavail = gen->strlitsAvail;
+	size_t slot;
+
+	gen->strlitsAvail = oldavail == 0 ? 64 : oldavail << 1;
+	gen->strlits = (GenlStrLit *)memAllocBlk(gen->strlitsAvail * sizeof(GenlStrLit));
+	memset(gen->strlits, 0, gen->strlitsAvail * sizeof(GenlStrLit));
+	for (slot = 0; slot < oldavail; slot++)
+		if (oldlits[slot].str)
+			*genlStrLitSlot(gen, oldlits[slot].str, oldlits[slot].hash) = oldlits[slot];
+}
+
+// Is this lval (or deref) reached through a safe reference?
+int genlIsThruRef(AstNode *lval) {
+	switch (lval->asttype) {
+	case DerefNode:
+		return typeGetVtype(((DerefAstNode *)lval)->exp)->asttype == RefType;
+	case ElementNode:
+	{
+		ElementAstNode *elem = (ElementAstNode *)lval;
+		if (elem->flags & FlagIndex && typeGetVtype(elem->owner)->asttype == RefType)
+			return 1;
+		return genlIsThruRef(elem->owner);
+	}
+	default:
+		return 0;
+	}
+}
+
+// Which TBAA tag a scalar LLVM type uses, or -1 if none.
+// Signed and unsigned integers of the same size share a tag.
+static int genlTbaaIndex(LLVMTypeRef type) {
+	switch (LLVMGetTypeKind(type)) {
+	case LLVMIntegerTypeKind:
+		switch (LLVMGetIntTypeWidth(type)) {
+		case 1: return 0;
+		case 8: return 1;
+		case 16: return 2;
+		case 32: return 3;
+		case 64: return 4;
+		default: return -1;
+		}
+	case LLVMFloatTypeKind: return 5;
+	case LLVMDoubleTypeKind: return 6;
+	case LLVMPointerTypeKind: return 7;
+	default: return -1;
+	}
+}
+
+// Attach type-based alias analysis metadata to a scalar load or store through a reference.
+// Cone's type system never lets a reference view memory as some other type,
+// so accesses of different scalar types through references never alias.
+void genlTbaa(GenState *gen, LLVMValueRef access, LLVMTypeRef type) {
+	static char *tbaanames[GenlTbaaTags] = { "bool", "i8", "i16", "i32", "i64", "f32", "f64", "ref" };
+	LLVMValueRef mds[3];
+	int index = genlTbaaIndex(type);
+	if (index < 0)
+		return;
+
+	if (!gen->tbaaroot) {
+		mds[0] = LLVMMDStringInContext(gen->context, "Cone TBAA", 9);
+		gen->tbaaroot = LLVMMDNodeInContext(gen->context, mds, 1);
+	}
+	if (!gen->tbaatags[index]) {
+		LLVMValueRef typenode;
+		mds[0] = LLVMMDStringInContext(gen->context, tbaanames[index], strlen(tbaanames[index]));
+		mds[1] = gen->tbaaroot;
+		mds[2] = LLVMConstInt(LLVMInt64TypeInContext(gen->context), 0, 0);
+		typenode = LLVMMDNodeInContext(gen->context, mds, 3);
+		mds[0] = mds[1] = typenode;
+		gen->tbaatags[index] = LLVMMDNodeInContext(gen->context, mds, 3);
+	}
+	LLVMSetMetadata(access, LLVMGetMDKindIDInContext(gen->context, "tbaa", 4), gen->tbaatags[index]);
+}
+
+// Return a constant pointer to a string literal's characters.
+// Each distinct string is pooled into a single private, unnamed_addr global per module,
+// so that identical literals (in loops, across functions or across modules) share it.
+LLVMValueRef genlStrLit(GenState *gen, char *strlit) {
+	GenlStrLit *lit;
+	LLVMValueRef sglobal;
+	LLVMValueRef zeros[2];
+	size_t hash = 2166136261u;	// FNV-1a
+	uint32_t size;
+	char *strp;
+
+	for (strp = strlit; *strp; strp++)
+		hash = (hash ^ (unsigned char)*strp) * 16777619u;
+	if (gen->strlitsUsed >= (gen->strlitsAvail * 3) / 4)
+		genlStrLitGrow(gen);
+	lit = genlStrLitSlot(gen, strlit, hash);
+	if (lit->str)
+		return lit->ptr;
+
+	size = strlen(strlit) + 1;
+	sglobal = LLVMAddGlobal(gen->module, LLVMArrayType(LLVMInt8TypeInContext(gen->context), size), "string");
+	LLVMSetLinkage(sglobal, LLVMPrivateLinkage);
+	LLVMSetGlobalConstant(sglobal, 1);
+	LLVMSetUnnamedAddr(sglobal, 1);
+	LLVMSetAlignment(sglobal, 1);
+	LLVMSetInitializer(sglobal, LLVMConstStringInContext(gen->context, strlit, size, 1));
+	zeros[0] = zeros[1] = LLVMConstInt(LLVMInt32TypeInContext(gen->context), 0, 0);
+
+	lit->str = strlit;
+	lit->hash = hash;
+	lit->ptr = LLVMConstInBoundsGEP(sglobal, zeros, 2);
+	++gen->strlitsUsed;
+	return lit->ptr;
+}
+
 // Generate a LLVMTypeRef from a basic type definition node
 LLVMTypeRef _genlType(GenState *gen, char *name, AstNode *typ) {
+	++genlTypeCount;
 	switch (typ->asttype) {
 	case IntNbrType: case UintNbrType:
 	{
@@ -49,6 +178,14 @@ LLVMTypeRef _genlType(GenState *gen, char *name, AstNode *typ) {
 
 	case RefType: case PtrType:
 	{
+		// A slice is a fat pointer: the address of its first element and its length
+		if (isSlice(typ)) {
+			LLVMTypeRef fields[2];
+			ArrayAstNode *anode = (ArrayAstNode*)typeGetVtype(((PtrAstNode *)typ)->pvtype);
+			fields[0] = LLVMPointerType(genlType(gen, anode->elemtype), 0);
+			fields[1] = genlType(gen, (AstNode*)usizeType);
+			return LLVMStructTypeInContext(gen->context, fields, 2, 0);
+		}
 		LLVMTypeRef pvtype = genlType(gen, ((PtrAstNode *)typ)->pvtype);
 		return LLVMPointerType(pvtype, 0);
 	}
@@ -92,6 +229,12 @@ LLVMTypeRef _genlType(GenState *gen, char *name, AstNode *typ) {
 		return LLVMArrayType(genlType(gen, anode->elemtype), anode->size);
 	}
 
+	case VectorType:
+	{
+		VectorAstNode *vnode = (VectorAstNode*)typ;
+		return LLVMVectorType(genlType(gen, (AstNode*)vnode->elemtype), vnode->lanes);
+	}
+
 	default:
 		assert(0 && "Invalid vtype to generate");
 		return NULL;
@@ -129,6 +272,19 @@ LLVMTypeRef genlType(GenState *gen, AstNode *typ) {
 		}
 		return typeref;
 	}
+	// Anonymous types are interned, so we can memoize their type value on the node
+	else if (typ->asttype == RefType || typ->asttype == PtrType) {
+		PtrAstNode *ptype = (PtrAstNode *)typ;
+		if (ptype->llvmtype == NULL)
+			ptype->llvmtype = _genlType(gen, "", typ);
+		return ptype->llvmtype;
+	}
+	else if (typ->asttype == ArrayType) {
+		ArrayAstNode *atype = (ArrayAstNode *)typ;
+		if (atype->llvmtype == NULL)
+			atype->llvmtype = _genlType(gen, "", typ);
+		return atype->llvmtype;
+	}
 	else
 		return _genlType(gen, "", typ);
 }
@@ -178,7 +334,7 @@ LLVMValueRef genlIf(GenState *gen, IfAstNode *ifnode) {
 		LLVMBasicBlockRef ablk;
 		if (*nodesp != voidType) {
 			ablk = LLVMInsertBasicBlockInContext(gen->context, nextif, "ifblk");
-			LLVMBuildCondBr(gen->builder, genlExpr(gen, *nodesp), ablk, nextif);
+			genlProfCondBr(gen, genlExpr(gen, *nodesp), ablk, nextif);
 			LLVMPositionBuilderAtEnd(gen->builder, ablk);
 		}
 		else
@@ -210,16 +366,138 @@ LLVMValueRef genlIf(GenState *gen, IfAstNode *ifnode) {
 	return NULL;
 }
 
-// Obtain value ref for a specific named intrinsic function
-LLVMValueRef genlGetIntrinsicFn(GenState *gen, char *fnname, NameUseAstNode *fnuse) {
-	LLVMValueRef fn = LLVMGetNamedFunction(gen->module, fnname);
-	if (!fn)
-		fn = LLVMAddFunction(gen->module, fnname, genlType(gen, typeGetVtype((AstNode*)fnuse->dclnode)));
-	return fn;
+// Call an LLVM intrinsic (e.g., "llvm.ctpop") overloaded on the type of its first argument,
+// a number or vector. Its return type is that type, except for *.with.overflow's {type, i1}.
+LLVMValueRef genlIntrinsic(GenState *gen, char *name, LLVMValueRef *args, unsigned nargs) {
+	char fnname[64];
+	char *suffix = fnname + sprintf(fnname, "%s.", name);
+	LLVMTypeRef type = LLVMTypeOf(args[0]);
+	LLVMTypeRef elemtype = type;
+	LLVMValueRef fn;
+
+	// e.g., llvm.ctpop.i32 or llvm.ctpop.v4i32
+	if (LLVMGetTypeKind(type) == LLVMVectorTypeKind) {
+		elemtype = LLVMGetElementType(type);
+		suffix += sprintf(suffix, "v%u", LLVMGetVectorSize(type));
+	}
+	if (LLVMGetTypeKind(elemtype) == LLVMIntegerTypeKind)
+		sprintf(suffix, "i%u", LLVMGetIntTypeWidth(elemtype));
+	else
+		strcpy(suffix, LLVMGetTypeKind(elemtype) == LLVMFloatTypeKind ? "f32" : "f64");
+	if (!(fn = LLVMGetNamedFunction(gen->module, fnname))) {
+		LLVMTypeRef parms[3];
+		LLVMTypeRef rettype = type;
+		unsigned i;
+		for (i = 0; i < nargs; i++)
+			parms[i] = LLVMTypeOf(args[i]);
+		// The *.with.overflow intrinsics also return whether they overflowed
+		if (strstr(name, "with.overflow")) {
+			LLVMTypeRef fields[2] = { type, LLVMInt1TypeInContext(gen->context) };
+			rettype = LLVMStructTypeInContext(gen->context, fields, 2, 0);
+		}
+		fn = LLVMAddFunction(gen->module, fnname, LLVMFunctionType(rettype, parms, nargs, 0));
+	}
+	return LLVMBuildCall(gen->builder, fn, args, nargs, "");
+}
+
+// Trap if the condition is true. Otherwise, continue generating code after the check.
+static void genlTrapIf(GenState *gen, LLVMValueRef cond, char *trapname, char *okname) {
+	LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(gen->builder));
+	LLVMBasicBlockRef trapblk = LLVMAppendBasicBlockInContext(gen->context, fn, trapname);
+	LLVMBasicBlockRef okblk = LLVMAppendBasicBlockInContext(gen->context, fn, okname);
+	LLVMValueRef trap;
+
+	LLVMBuildCondBr(gen->builder, cond, trapblk, okblk);
+	LLVMPositionBuilderAtEnd(gen->builder, trapblk);
+	if (!(trap = LLVMGetNamedFunction(gen->module, "llvm.trap")))
+		trap = LLVMAddFunction(gen->module, "llvm.trap", LLVMFunctionType(LLVMVoidTypeInContext(gen->context), NULL, 0, 0));
+	LLVMBuildCall(gen->builder, trap, NULL, 0, "");
+	LLVMBuildUnreachable(gen->builder);
+	LLVMPositionBuilderAtEnd(gen->builder, okblk);
+}
+
+// Generate integer arithmetic that traps (rather than wraps) if it overflows
+static LLVMValueRef genlCheckedOp(GenState *gen, char *name, LLVMValueRef *args) {
+	LLVMValueRef result = genlIntrinsic(gen, name, args, 2);
+	genlTrapIf(gen, LLVMBuildExtractValue(gen->builder, result, 1, ""), "overflow", "nooverflow");
+	return LLVMBuildExtractValue(gen->builder, result, 0, "");
+}
+
+// Mark a float operation as one that may be reassociated, contracted,
+// computed using reciprocals, and assume no NaN or infinite values (fast math).
+// The LLVM C API can only do so from LLVM 18. Before that, fast math functions
+// rely on their function attributes and loop hints (see genlWhile).
+LLVMValueRef genlFastMath(GenState *gen, LLVMValueRef inst) {
+#if LLVM_VERSION_MAJOR >= 18
+	if (gen->fastmath && LLVMCanValueUseFastMathFlags(inst))
+		LLVMSetFastMathFlags(inst, LLVMFastMathAllowReassoc | LLVMFastMathAllowContract
+			| LLVMFastMathNoNaNs | LLVMFastMathNoInfs | LLVMFastMathAllowReciprocal);
+#endif
+	return inst;
+}
+
+// Return the op code a call invokes on floats, or -1 if it is not a float op code
+static int genlFloatOpCode(AstNode *node) {
+	FnCallAstNode *fncall = (FnCallAstNode *)node;
+	NameUseAstNode *fnuse;
+	if (node->asttype != FnCallNode || fncall->fn->asttype == DerefNode || fncall->parms->used == 0)
+		return -1;
+	fnuse = (NameUseAstNode *)fncall->fn;
+	if (!fnuse->dclnode->value || fnuse->dclnode->value->asttype != OpCodeNode
+		|| typeGetVtype(*nodesNodes(fncall->parms))->asttype != FloatNbrType)
+		return -1;
+	return ((OpCodeAstNode *)fnuse->dclnode->value)->opcode;
+}
+
+// Contract a float a*b+c, c+a*b, a*b-c or c-a*b into a fused multiply-add (as clang's -ffp-contract=on does).
+// Return NULL if the call is not one of these.
+static LLVMValueRef genlFMulAdd(GenState *gen, FnCallAstNode *fncall) {
+	LLVMValueRef args[3];
+	FnCallAstNode *mul;
+	AstNode *addend;
+	int opcode = genlFloatOpCode((AstNode *)fncall);
+	int mulfirst;
+	char *fnname;
+
+	if ((opcode != AddOpCode && opcode != SubOpCode) || fncall->parms->used != 2)
+		return NULL;
+	mulfirst = genlFloatOpCode(nodesNodes(fncall->parms)[0]) == MulOpCode;
+	if (!mulfirst && genlFloatOpCode(nodesNodes(fncall->parms)[1]) != MulOpCode)
+		return NULL;
+	mul = (FnCallAstNode *)nodesNodes(fncall->parms)[mulfirst? 0 : 1];
+	addend = nodesNodes(fncall->parms)[mulfirst? 1 : 0];
+
+	// In source order, then negate what a subtraction subtracts
+	if (mulfirst) {
+		args[0] = genlExpr(gen, nodesNodes(mul->parms)[0]);
+		args[1] = genlExpr(gen, nodesNodes(mul->parms)[1]);
+		args[2] = genlExpr(gen, addend);
+		if (opcode == SubOpCode)
+			args[2] = genlFastMath(gen, LLVMBuildFNeg(gen->builder, args[2], ""));
+	}
+	else {
+		args[2] = genlExpr(gen, addend);
+		args[0] = genlExpr(gen, nodesNodes(mul->parms)[0]);
+		args[1] = genlExpr(gen, nodesNodes(mul->parms)[1]);
+		if (opcode == SubOpCode)
+			args[0] = genlFastMath(gen, LLVMBuildFNeg(gen->builder, args[0], ""));
+	}
+	fnname = ((NbrAstNode *)typeGetVtype(addend))->bits == 32 ? "llvm.fmuladd.f32" : "llvm.fmuladd.f64";
+	if (!LLVMGetNamedFunction(gen->module, fnname)) {
+		LLVMTypeRef ftype = LLVMTypeOf(args[2]);
+		LLVMTypeRef parms[3] = { ftype, ftype, ftype };
+		LLVMAddFunction(gen->module, fnname, LLVMFunctionType(ftype, parms, 3, 0));
+	}
+	return genlFastMath(gen, LLVMBuildCall(gen->builder, LLVMGetNamedFunction(gen->module, fnname), args, 3, ""));
 }
 
 // Generate a function call, including special op codes
 LLVMValueRef genlFnCall(GenState *gen, FnCallAstNode *fncall) {
+	LLVMValueRef fused;
+
+	// With FMA contraction, a multiply feeding an add or subtract becomes one fused operation
+	if (gen->fpcontract && (fused = genlFMulAdd(gen, fncall)))
+		return fused;
 
 	// Get Valuerefs for all the parameters to pass to the function
 	LLVMValueRef *fnargs = (LLVMValueRef*)memAllocBlk(fncall->parms->used * sizeof(LLVMValueRef*));
@@ -238,34 +516,51 @@ LLVMValueRef genlFnCall(GenState *gen, FnCallAstNode *fncall) {
 	NameUseAstNode *fnuse = (NameUseAstNode *)fncall->fn;
 	switch (fnuse->dclnode->value? fnuse->dclnode->value->asttype : BlockNode) {
 	case BlockNode: {
+		// A type's methods are generated with the type, perhaps before the module declares its callee
+		if (fnuse->dclnode->llvmvar == NULL)
+			genlGloVarName(gen, fnuse->dclnode);
 		return LLVMBuildCall(gen->builder, fnuse->dclnode->llvmvar, fnargs, fncall->parms->used, "");
 	}
 	case OpCodeNode: {
-		NbrAstNode *nbrtype = (NbrAstNode *)typeGetVtype(*nodesNodes(fncall->parms));
+		AstNode *opndtype = typeGetVtype(*nodesNodes(fncall->parms));
+		LLVMValueRef vecval;
+
+		// A vector has operations of its own. Otherwise, number op codes apply to each lane.
+		if (opndtype->asttype == VectorType) {
+			if ((vecval = genlVectorOp(gen, ((OpCodeAstNode *)fnuse->dclnode->value)->opcode, (VectorAstNode *)opndtype, fnargs)))
+				return vecval;
+			opndtype = (AstNode *)((VectorAstNode *)opndtype)->elemtype;
+		}
+		NbrAstNode *nbrtype = (NbrAstNode *)opndtype;
 		int16_t nbrasttype = nbrtype->asttype;
 
 		// Floating point op codes
 		if (nbrasttype == FloatNbrType) {
 			switch (((OpCodeAstNode *)fnuse->dclnode->value)->opcode) {
-			case NegOpCode: return LLVMBuildFNeg(gen->builder, fnargs[0], "");
-			case AddOpCode: return LLVMBuildFAdd(gen->builder, fnargs[0], fnargs[1], "");
-			case SubOpCode: return LLVMBuildFSub(gen->builder, fnargs[0], fnargs[1], "");
-			case MulOpCode: return LLVMBuildFMul(gen->builder, fnargs[0], fnargs[1], "");
-			case DivOpCode: return LLVMBuildFDiv(gen->builder, fnargs[0], fnargs[1], "");
-			case RemOpCode: return LLVMBuildFRem(gen->builder, fnargs[0], fnargs[1], "");
+			case NegOpCode: return genlFastMath(gen, LLVMBuildFNeg(gen->builder, fnargs[0], ""));
+			case AddOpCode: return genlFastMath(gen, LLVMBuildFAdd(gen->builder, fnargs[0], fnargs[1], ""));
+			case SubOpCode: return genlFastMath(gen, LLVMBuildFSub(gen->builder, fnargs[0], fnargs[1], ""));
+			case MulOpCode: return genlFastMath(gen, LLVMBuildFMul(gen->builder, fnargs[0], fnargs[1], ""));
+			case DivOpCode: return genlFastMath(gen, LLVMBuildFDiv(gen->builder, fnargs[0], fnargs[1], ""));
+			case RemOpCode: return genlFastMath(gen, LLVMBuildFRem(gen->builder, fnargs[0], fnargs[1], ""));
 			// Comparison
-			case EqOpCode: return LLVMBuildFCmp(gen->builder, LLVMRealOEQ, fnargs[0], fnargs[1], "");
-			case NeOpCode: return LLVMBuildFCmp(gen->builder, LLVMRealONE, fnargs[0], fnargs[1], "");
-			case LtOpCode: return LLVMBuildFCmp(gen->builder, LLVMRealOLT, fnargs[0], fnargs[1], "");
-			case LeOpCode: return LLVMBuildFCmp(gen->builder, LLVMRealOLE, fnargs[0], fnargs[1], "");
-			case GtOpCode: return LLVMBuildFCmp(gen->builder, LLVMRealOGT, fnargs[0], fnargs[1], "");
-			case GeOpCode: return LLVMBuildFCmp(gen->builder, LLVMRealOGE, fnargs[0], fnargs[1], "");
+			case EqOpCode: return genlFastMath(gen, LLVMBuildFCmp(gen->builder, LLVMRealOEQ, fnargs[0], fnargs[1], ""));
+			case NeOpCode: return genlFastMath(gen, LLVMBuildFCmp(gen->builder, LLVMRealONE, fnargs[0], fnargs[1], ""));
+			case LtOpCode: return genlFastMath(gen, LLVMBuildFCmp(gen->builder, LLVMRealOLT, fnargs[0], fnargs[1], ""));
+			case LeOpCode: return genlFastMath(gen, LLVMBuildFCmp(gen->builder, LLVMRealOLE, fnargs[0], fnargs[1], ""));
+			case GtOpCode: return genlFastMath(gen, LLVMBuildFCmp(gen->builder, LLVMRealOGT, fnargs[0], fnargs[1], ""));
+			case GeOpCode: return genlFastMath(gen, LLVMBuildFCmp(gen->builder, LLVMRealOGE, fnargs[0], fnargs[1], ""));
 			// Intrinsic functions
-			case SqrtOpCode: 
-			{
-				char *fnname = nbrtype->bits == 32 ? "llvm.sqrt.f32" : "llvm.sqrt.f64";
-				return LLVMBuildCall(gen->builder, genlGetIntrinsicFn(gen, fnname, fnuse), fnargs, fncall->parms->used, "");
-			}
+			case SqrtOpCode: return genlFastMath(gen, genlIntrinsic(gen, "llvm.sqrt", fnargs, 1));
+			case AbsOpCode: return genlIntrinsic(gen, "llvm.fabs", fnargs, 1);
+			case FloorOpCode: return genlIntrinsic(gen, "llvm.floor", fnargs, 1);
+			case CeilOpCode: return genlIntrinsic(gen, "llvm.ceil", fnargs, 1);
+			case TruncOpCode: return genlIntrinsic(gen, "llvm.trunc", fnargs, 1);
+			case RoundOpCode: return genlIntrinsic(gen, "llvm.round", fnargs, 1);
+			case CopysignOpCode: return genlIntrinsic(gen, "llvm.copysign", fnargs, 2);
+			case FmaOpCode: return genlIntrinsic(gen, "llvm.fma", fnargs, 3);
+			case MinOpCode: return genlFastMath(gen, genlIntrinsic(gen, "llvm.minnum", fnargs, 2));
+			case MaxOpCode: return genlFastMath(gen, genlIntrinsic(gen, "llvm.maxnum", fnargs, 2));
 			}
 		}
 		// Integer op codes
@@ -323,6 +618,35 @@ LLVMValueRef genlFnCall(GenState *gen, FnCallAstNode *fncall) {
 					return LLVMBuildAShr(gen->builder, fnargs[0], fnargs[1], "");
 				else
 					return LLVMBuildLShr(gen->builder, fnargs[0], fnargs[1], "");
+
+			// Minimum and maximum
+			case MinOpCode:
+				return LLVMBuildSelect(gen->builder, LLVMBuildICmp(gen->builder, nbrasttype == IntNbrType ? LLVMIntSLT : LLVMIntULT,
+					fnargs[0], fnargs[1], ""), fnargs[0], fnargs[1], "");
+			case MaxOpCode:
+				return LLVMBuildSelect(gen->builder, LLVMBuildICmp(gen->builder, nbrasttype == IntNbrType ? LLVMIntSGT : LLVMIntUGT,
+					fnargs[0], fnargs[1], ""), fnargs[0], fnargs[1], "");
+
+			// Intrinsic functions
+			case PopcountOpCode: return genlIntrinsic(gen, "llvm.ctpop", fnargs, 1);
+			case ClzOpCode:
+			case CtzOpCode: {
+				// A zero argument gives the number of bits, rather than poison
+				LLVMValueRef args[2] = { fnargs[0], LLVMConstInt(LLVMInt1TypeInContext(gen->context), 0, 0) };
+				return genlIntrinsic(gen, ((OpCodeAstNode *)fnuse->dclnode->value)->opcode == ClzOpCode ? "llvm.ctlz" : "llvm.cttz", args, 2);
+			}
+			case BswapOpCode: return genlIntrinsic(gen, "llvm.bswap", fnargs, 1);
+			// A rotate is a funnel shift of a value with itself
+			case RotlOpCode:
+			case RotrOpCode: {
+				LLVMValueRef args[3] = { fnargs[0], fnargs[0], fnargs[1] };
+				return genlIntrinsic(gen, ((OpCodeAstNode *)fnuse->dclnode->value)->opcode == RotlOpCode ? "llvm.fshl" : "llvm.fshr", args, 3);
+			}
+			case AddSatOpCode: return genlIntrinsic(gen, nbrasttype == IntNbrType ? "llvm.sadd.sat" : "llvm.uadd.sat", fnargs, 2);
+			case SubSatOpCode: return genlIntrinsic(gen, nbrasttype == IntNbrType ? "llvm.ssub.sat" : "llvm.usub.sat", fnargs, 2);
+			case AddCheckedOpCode: return genlCheckedOp(gen, nbrasttype == IntNbrType ? "llvm.sadd.with.overflow" : "llvm.uadd.with.overflow", fnargs);
+			case SubCheckedOpCode: return genlCheckedOp(gen, nbrasttype == IntNbrType ? "llvm.ssub.with.overflow" : "llvm.usub.with.overflow", fnargs);
+			case MulCheckedOpCode: return genlCheckedOp(gen, nbrasttype == IntNbrType ? "llvm.smul.with.overflow" : "llvm.umul.with.overflow", fnargs);
 			}
 		}
 	}
@@ -332,18 +656,15 @@ LLVMValueRef genlFnCall(GenState *gen, FnCallAstNode *fncall) {
 	}
 }
 
-// Generate a cast (value conversion)
-LLVMValueRef genlCast(GenState *gen, CastAstNode* node) {
-	NbrAstNode *fromtype = (NbrAstNode *)typeGetVtype(node->exp);
-	NbrAstNode *totype = (NbrAstNode *)typeGetVtype(node->vtype);
-
+// Convert a value from one number type to another, giving it the LLVM type totyperef.
+// For vectors, the number types are those of their lanes.
+static LLVMValueRef genlConvert(GenState *gen, LLVMValueRef val, NbrAstNode *fromtype, NbrAstNode *totype, LLVMTypeRef totyperef) {
 	// Casting a number to Bool means false if zero and true otherwise
 	if (totype == boolType) {
-		AstNode *vtype = typeGetVtype(node->exp);
 		if (fromtype->asttype == FloatNbrType)
-			return LLVMBuildFCmp(gen->builder, LLVMRealONE, genlExpr(gen, node->exp), LLVMConstNull(genlType(gen, vtype)), "");
+			return LLVMBuildFCmp(gen->builder, LLVMRealONE, val, LLVMConstNull(LLVMTypeOf(val)), "");
 		else
-			return LLVMBuildICmp(gen->builder, LLVMIntNE, genlExpr(gen, node->exp), LLVMConstNull(genlType(gen, vtype)), "");
+			return LLVMBuildICmp(gen->builder, LLVMIntNE, val, LLVMConstNull(LLVMTypeOf(val)), "");
 	}
 
 	// Handle number to number casts, depending on relative size and encoding format
@@ -351,42 +672,42 @@ LLVMValueRef genlCast(GenState *gen, CastAstNode* node) {
 
 	case UintNbrType:
 		if (fromtype->asttype == FloatNbrType)
-			return LLVMBuildFPToUI(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildFPToUI(gen->builder, val, totyperef, "");
 		else if (totype->bits < fromtype->bits)
-			return LLVMBuildTrunc(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildTrunc(gen->builder, val, totyperef, "");
 		else if (totype->bits > fromtype->bits)
-			return LLVMBuildZExt(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildZExt(gen->builder, val, totyperef, "");
 		else
-			return LLVMBuildBitCast(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildBitCast(gen->builder, val, totyperef, "");
 
 	case IntNbrType:
 		if (fromtype->asttype == FloatNbrType)
-			return LLVMBuildFPToSI(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildFPToSI(gen->builder, val, totyperef, "");
 		else if (totype->bits < fromtype->bits)
-			return LLVMBuildTrunc(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildTrunc(gen->builder, val, totyperef, "");
 		else if (totype->bits > fromtype->bits) {
 			if (fromtype->asttype == IntNbrType)
-				return LLVMBuildSExt(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+				return LLVMBuildSExt(gen->builder, val, totyperef, "");
 			else
-				return LLVMBuildZExt(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+				return LLVMBuildZExt(gen->builder, val, totyperef, "");
 		}
 		else
-			return LLVMBuildBitCast(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildBitCast(gen->builder, val, totyperef, "");
 
 	case FloatNbrType:
 		if (fromtype->asttype == IntNbrType)
-			return LLVMBuildSIToFP(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildSIToFP(gen->builder, val, totyperef, "");
 		else if (fromtype->asttype == UintNbrType)
-			return LLVMBuildUIToFP(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildUIToFP(gen->builder, val, totyperef, "");
 		else if (totype->bits < fromtype->bits)
-			return LLVMBuildFPTrunc(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildFPTrunc(gen->builder, val, totyperef, "");
 		else if (totype->bits > fromtype->bits)
-			return LLVMBuildFPExt(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+			return LLVMBuildFPExt(gen->builder, val, totyperef, "");
 		else
-			return genlExpr(gen, node->exp);
+			return val;
 
 	case RefType: case PtrType:
-		return LLVMBuildBitCast(gen->builder, genlExpr(gen, node->exp), genlType(gen, (AstNode*)totype), "");
+		return LLVMBuildBitCast(gen->builder, val, totyperef, "");
 
 	default:
 		assert(0 && "Unknown type to cast to");
@@ -394,6 +715,32 @@ LLVMValueRef genlCast(GenState *gen, CastAstNode* node) {
 	}
 }
 
+// Generate a cast (value conversion)
+LLVMValueRef genlCast(GenState *gen, CastAstNode* node) {
+	AstNode *fromtype = typeGetVtype(node->exp);
+	AstNode *totype = typeGetVtype(node->vtype);
+
+	// A reference to an array becomes a slice by adding its length
+	if (isSlice(totype)) {
+		LLVMValueRef slice, len;
+		if (isSlice(fromtype))
+			return genlExpr(gen, node->exp);
+		slice = LLVMBuildInsertValue(gen->builder, LLVMGetUndef(genlType(gen, totype)), genlArrayElems(gen, node->exp, &len), 0, "");
+		return LLVMBuildInsertValue(gen->builder, slice, len, 1, "slice");
+	}
+
+	if (totype->asttype == VectorType) {
+		VectorAstNode *vectype = (VectorAstNode *)totype;
+		// Convert a vector lane by lane
+		if (fromtype->asttype == VectorType)
+			return genlConvert(gen, genlExpr(gen, node->exp), ((VectorAstNode *)fromtype)->elemtype, vectype->elemtype, genlType(gen, totype));
+		// Copy a number into every lane (splat)
+		return genlSplat(gen, genlConvert(gen, genlExpr(gen, node->exp), (NbrAstNode *)fromtype, vectype->elemtype,
+			genlType(gen, (AstNode *)vectype->elemtype)), vectype->lanes);
+	}
+	return genlConvert(gen, genlExpr(gen, node->exp), (NbrAstNode *)fromtype, (NbrAstNode *)totype, genlType(gen, totype));
+}
+
 // Generate not
 LLVMValueRef genlNot(GenState *gen, LogicAstNode* node) {
 	return LLVMBuildXor(gen->builder, genlExpr(gen, node->lexp), LLVMConstInt(LLVMInt1TypeInContext(gen->context), 1, 0), "not");
@@ -412,9 +759,9 @@ LLVMValueRef genlLogic(GenState *gen, LogicAstNode* node) {
 	// Generate left-hand condition and conditional branch
 	logicvals[0] = genlExpr(gen, node->lexp);
 	if (node->asttype==OrLogicNode)
-		LLVMBuildCondBr(gen->builder, logicvals[0], logicphi, logicblks[1]);
+		genlProfCondBr(gen, logicvals[0], logicphi, logicblks[1]);
 	else
-		LLVMBuildCondBr(gen->builder, logicvals[0], logicblks[1], logicphi);
+		genlProfCondBr(gen, logicvals[0], logicblks[1], logicphi);
 
 	// Generate right-hand condition and branch to phi
 	LLVMPositionBuilderAtEnd(gen->builder, logicblks[1]);
@@ -432,12 +779,74 @@ LLVMValueRef genlLogic(GenState *gen, LogicAstNode* node) {
 LLVMValueRef genlLocalVar(GenState *gen, NameDclAstNode *var) {
 	assert(var->asttype == VarNameDclNode);
 	LLVMValueRef val = NULL;
+
+	// An initialized immutable variable that is never borrowed from is just its value
+	if (var->value && genlIsSsaVar(var)) {
+		var->llvmvar = val = genlExpr(gen, var->value);
+		var->flags |= FlagSsaVar;
+		return val;
+	}
 	var->llvmvar = LLVMBuildAlloca(gen->builder, genlType(gen, var->vtype), &var->namesym->namestr);
 	if (var->value)
 		LLVMBuildStore(gen->builder, (val = genlExpr(gen, var->value)), var->llvmvar);
 	return val;
 }
 
+// Can a local variable or parameter be bound directly to its value, with no memory?
+// Only if it can never be changed (no MayWrite) and its address is never taken.
+int genlIsSsaVar(NameDclAstNode *var) {
+	return !(var->perm->flags & MayWrite) && !(var->flags & FlagAddrTaken);
+}
+
+// Generate the number of elements in an array, or in the array a reference (or slice) refers to
+LLVMValueRef genlArrayLen(GenState *gen, AstNode *owner) {
+	AstNode *ownvtype = typeGetVtype(owner);
+	if (isSlice(ownvtype))
+		return LLVMBuildExtractValue(gen->builder, genlExpr(gen, owner), 1, "len");
+	return LLVMConstInt(genlType(gen, (AstNode*)usizeType), arrayIndexable(ownvtype)->size, 0);
+}
+
+LLVMValueRef genlLval(GenState *gen, AstNode *lval);
+
+// Generate a pointer to the first element of an array (or of the array a reference
+// or slice refers to), and its number of elements
+LLVMValueRef genlArrayElems(GenState *gen, AstNode *owner, LLVMValueRef *len) {
+	AstNode *ownvtype = typeGetVtype(owner);
+	LLVMValueRef base, zeros[2];
+
+	if (isSlice(ownvtype)) {
+		LLVMValueRef slice = genlExpr(gen, owner);
+		*len = LLVMBuildExtractValue(gen->builder, slice, 1, "len");
+		return LLVMBuildExtractValue(gen->builder, slice, 0, "");
+	}
+
+	if (ownvtype->asttype == RefType || ownvtype->asttype == PtrType)
+		base = genlExpr(gen, owner);
+	else if (owner->asttype == NameUseNode || owner->asttype == DerefNode || owner->asttype == ElementNode)
+		base = genlLval(gen, owner);
+	// An array value with no address (e.g., returned by a function) is spilled to memory
+	else {
+		LLVMValueRef val = genlExpr(gen, owner);
+		base = LLVMBuildAlloca(gen->builder, LLVMTypeOf(val), "");
+		LLVMBuildStore(gen->builder, val, base);
+	}
+	*len = LLVMConstInt(genlType(gen, (AstNode*)usizeType), arrayIndexable(ownvtype)->size, 0);
+	zeros[0] = zeros[1] = LLVMConstInt(LLVMInt32TypeInContext(gen->context), 0, 0);
+	return LLVMBuildInBoundsGEP(gen->builder, base, zeros, 2, "");
+}
+
+// Generate a pointer to an array's (or slice's) indexed element.
+// Unless range analysis has proven the index in bounds, trap if it is not.
+static LLVMValueRef genlIndexPtr(GenState *gen, ElementAstNode *elem) {
+	LLVMValueRef len, index;
+	LLVMValueRef base = genlArrayElems(gen, elem->owner, &len);
+
+	index = genlExpr(gen, elem->element);
+	if (!(elem->flags & FlagInBounds))
+		genlTrapIf(gen, LLVMBuildICmp(gen->builder, LLVMIntUGE, index, len, ""), "outofbounds", "inbounds");
+	return LLVMBuildInBoundsGEP(gen->builder, base, &index, 1, "");
+}
+
 // Generate an lval pointer
 LLVMValueRef genlLval(GenState *gen, AstNode *lval) {
 	switch (lval->asttype) {
@@ -448,13 +857,30 @@ LLVMValueRef genlLval(GenState *gen, AstNode *lval) {
 	case ElementNode:
 	{
 		ElementAstNode *elem = (ElementAstNode *)lval;
-		NameDclAstNode *flddcl = ((NameUseAstNode*)elem->element)->dclnode;
+		NameDclAstNode *flddcl;
+		if (elem->flags & FlagIndex)
+			return genlIndexPtr(gen, elem);
+		flddcl = ((NameUseAstNode*)elem->element)->dclnode;
 		return LLVMBuildStructGEP(gen->builder, genlLval(gen, elem->owner), flddcl->index, &flddcl->namesym->namestr);
 	}
 	}
 	return NULL;
 }
 
+// Generate an array or struct literal, as a constant
+static LLVMValueRef genlAggLit(GenState *gen, AggLitAstNode *lit) {
+	AstNode *vtype = typeGetVtype(lit->vtype);
+	LLVMValueRef *elems = (LLVMValueRef *)memAllocBlk(lit->elems->used * sizeof(LLVMValueRef));
+	LLVMValueRef *elem = elems;
+	AstNode **nodesp;
+	uint32_t cnt;
+	for (nodesFor(lit->elems, cnt, nodesp))
+		*elem++ = genlExpr(gen, *nodesp);
+	if (vtype->asttype == ArrayType)
+		return LLVMConstArray(genlType(gen, ((ArrayAstNode *)vtype)->elemtype), elems, lit->elems->used);
+	return LLVMConstNamedStruct(genlType(gen, lit->vtype), elems, lit->elems->used);
+}
+
 // Generate a term
 LLVMValueRef genlExpr(GenState *gen, AstNode *termnode) {
 	switch (termnode->asttype) {
@@ -463,18 +889,14 @@ LLVMValueRef genlExpr(GenState *gen, AstNode *termnode) {
 	case FLitNode:
 		return LLVMConstReal(genlType(gen, ((ULitAstNode*)termnode)->vtype), ((FLitAstNode*)termnode)->floatlit);
 	case SLitNode:
-	{
-		char *strlit = ((SLitAstNode *)termnode)->strlit;
-		uint32_t size = strlen(strlit)+1;
-		LLVMValueRef sglobal = LLVMAddGlobal(gen->module, LLVMArrayType(LLVMInt8TypeInContext(gen->context), size), "string");
-		LLVMSetLinkage(sglobal, LLVMInternalLinkage);
-		LLVMSetGlobalConstant(sglobal, 1);
-		LLVMSetInitializer(sglobal, LLVMConstStringInContext(gen->context, strlit, size, 1));
-		return LLVMBuildStructGEP(gen->builder, sglobal, 0, "");
-	}
+		return genlStrLit(gen, ((SLitAstNode *)termnode)->strlit);
+	case AggLitNode:
+		return genlAggLit(gen, (AggLitAstNode *)termnode);
 	case NameUseNode:
 	{
 		NameDclAstNode *vardcl = ((NameUseAstNode *)termnode)->dclnode;
+		if (vardcl->flags & FlagSsaVar)
+			return vardcl->llvmvar;
 		return LLVMBuildLoad(gen->builder, vardcl->llvmvar, &vardcl->namesym->namestr);
 	}
 	case FnCallNode:
@@ -483,7 +905,9 @@ LLVMValueRef genlExpr(GenState *gen, AstNode *termnode) {
 	{
 		LLVMValueRef val;
 		AssignAstNode *node = (AssignAstNode*)termnode;
-		LLVMBuildStore(gen->builder, (val = genlExpr(gen, node->rval)), genlLval(gen, node->lval));
+		LLVMValueRef store = LLVMBuildStore(gen->builder, (val = genlExpr(gen, node->rval)), genlLval(gen, node->lval));
+		if (genlIsThruRef(node->lval))
+			genlTbaa(gen, store, LLVMTypeOf(val));
 		return val;
 	}
 	case SizeofNode:
@@ -503,11 +927,26 @@ LLVMValueRef genlExpr(GenState *gen, AstNode *termnode) {
 			return genlExpr(gen, anode->exp);
 	}
 	case DerefNode:
-		return LLVMBuildLoad(gen->builder, genlExpr(gen, ((DerefAstNode*)termnode)->exp), "deref");
+	{
+		LLVMValueRef load = LLVMBuildLoad(gen->builder, genlExpr(gen, ((DerefAstNode*)termnode)->exp), "deref");
+		if (genlIsThruRef(termnode))
+			genlTbaa(gen, load, LLVMTypeOf(load));
+		return load;
+	}
 	case ElementNode:
 	{
 		ElementAstNode *elem = (ElementAstNode*)termnode;
-		NameDclAstNode *flddcl = ((NameUseAstNode*)elem->element)->dclnode;
+		NameDclAstNode *flddcl;
+		if (elem->flags & FlagIndex) {
+			LLVMValueRef load = LLVMBuildLoad(gen->builder, genlIndexPtr(gen, elem), "");
+			if (genlIsThruRef(termnode))
+				genlTbaa(gen, load, LLVMTypeOf(load));
+			return load;
+		}
+		// An unresolved member is an array's (or slice's) len
+		if (elem->element->asttype == MemberUseNode)
+			return genlArrayLen(gen, elem->owner);
+		flddcl = ((NameUseAstNode*)elem->element)->dclnode;
 		return LLVMBuildExtractValue(gen->builder, genlExpr(gen, elem->owner), flddcl->index, &flddcl->namesym->namestr);
 	}
 	case OrLogicNode: case AndLogicNode:
@@ -0,0 +1,240 @@
+/** Function multiversioning
+ * @file
+ *
+ * With --multiversion=x86-64-v3,x86-64-v4 (for example), each function containing
+ * a loop (where wider vectors pay off) is generated once more for each listed
+ * x86-64 feature level, besides the default version built for --cpu/--features.
+ * Which version runs is chosen once, at load time, by asking the conestd runtime
+ * (coneCpuLevel) which feature level the running CPU supports. So one shipped
+ * binary runs everywhere, but uses AVX2 or AVX-512 loops where it can.
+ *
+ * On ELF targets, the function's symbol becomes a GNU ifunc whose resolver picks the version.
+ * Elsewhere (and when run in-process), the function becomes a stub that calls
+ * the version through a pointer, which a static constructor sets.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "../shared/error.h"
+#include "../shared/memory.h"
+#include "../coneopts.h"
+#include "genllvm.h"
+
+#include <llvm/Config/llvm-config.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// An x86-64 feature level (as defined by the x86-64 psABI)
+typedef struct GenlFmvLevel {
+	char *name;
+	char *features;		// Target features it adds
+	int level;			// What coneCpuLevel returns for a CPU that has them
+} GenlFmvLevel;
+
+#define GenlFmvV2 "+cx16,+sahf,+popcnt,+sse3,+sse4.1,+sse4.2,+ssse3"
+#define GenlFmvV3 GenlFmvV2 ",+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+xsave"
+#define GenlFmvV4 GenlFmvV3 ",+avx512f,+avx512bw,+avx512cd,+avx512dq,+avx512vl"
+
+static GenlFmvLevel genlFmvLevels[] = {
+	{ "x86-64-v2", GenlFmvV2, 2 },
+	{ "x86-64-v3", GenlFmvV3, 3 },
+	{ "x86-64-v4", GenlFmvV4, 4 },
+	{ NULL, NULL, 0 }
+};
+
+// The feature levels to generate, best first
+#define GenlFmvMax 3
+static GenlFmvLevel *genlFmvUse[GenlFmvMax];
+static int genlFmvUsed = 0;
+
+// Check and remember the --multiversion feature levels.
+// They are ignored (with a warning) unless targeting x86-64.
+void genlFmvSetup(ConeOptions *opt) {
+	char *names = opt->multiversion;
+	GenlFmvLevel *lvl;
+	int i, j;
+
+	genlFmvUsed = 0;
+	while (names && *names) {
+		char *end = strchr(names, ',');
+		size_t len = end? (size_t)(end - names) : strlen(names);
+		for (lvl = genlFmvLevels; lvl->name; lvl++) {
+			if (strlen(lvl->name) == len && strncmp(lvl->name, names, len) == 0)
+				break;
+		}
+		if (!lvl->name)
+			errorExit(ExitOpts, "Error: Unknown multiversion feature level %.*s (use x86-64-v2, -v3 or -v4)", (int)len, names);
+		for (i = 0; i < genlFmvUsed && genlFmvUse[i] != lvl; i++)
+			;
+		if (i == genlFmvUsed)
+			genlFmvUse[genlFmvUsed++] = lvl;
+		names = end? end + 1 : NULL;
+	}
+
+	// Best level first, as the resolver tries them in order
+	for (i = 1; i < genlFmvUsed; i++) {
+		for (j = i; j > 0 && genlFmvUse[j]->level > genlFmvUse[j - 1]->level; j--) {
+			lvl = genlFmvUse[j];
+			genlFmvUse[j] = genlFmvUse[j - 1];
+			genlFmvUse[j - 1] = lvl;
+		}
+	}
+
+	if (genlFmvUsed && strncmp(opt->triple, "x86_64", 6) != 0 && strncmp(opt->triple, "amd64", 5) != 0) {
+		errorMsg(WarnTarget, "Function multiversioning needs an x86-64 target; --multiversion is ignored");
+		genlFmvUsed = 0;
+	}
+}
+
+// Should this just-generated function (with a loop, if fnloops) get versions for other feature levels?
+int genlFmvWanted(GenState *gen, int fnloops) {
+	return genlFmvUsed > 0 && fnloops && !gen->opt->profgen && gen->opt->codegen_units <= 1;
+}
+
+// Give a version the attributes of the function it is a version of
+static void genlFmvCopyAttrs(LLVMValueRef from, LLVMValueRef to) {
+	LLVMAttributeRef attrs[64];
+	unsigned index, nparms = LLVMCountParams(from);
+	unsigned i, n;
+	for (index = LLVMAttributeFunctionIndex; ; index = index == LLVMAttributeFunctionIndex? LLVMAttributeReturnIndex : index + 1) {
+		if (index != LLVMAttributeFunctionIndex && index > nparms)
+			break;
+		n = LLVMGetAttributeCountAtIndex(from, index);
+		if (n > 64)
+			n = 64;
+		LLVMGetAttributesAtIndex(from, index, attrs);
+		for (i = 0; i < n; i++)
+			LLVMAddAttributeAtIndex(to, index, attrs[i]);
+	}
+}
+
+// Set a version's target features: the default version's, plus the level's
+static void genlFmvSetFeatures(GenState *gen, LLVMValueRef fn, GenlFmvLevel *lvl) {
+	char *features = lvl->features;
+	LLVMAttributeRef attr;
+	if (gen->opt->features && *gen->opt->features) {
+		features = memAllocBlk(strlen(gen->opt->features) + strlen(lvl->features) + 2);
+		sprintf(features, "%s,%s", gen->opt->features, lvl->features);
+	}
+	attr = LLVMCreateStringAttribute(gen->context, "target-features", 15, features, strlen(features));
+	LLVMAddAttributeAtIndex(fn, LLVMAttributeFunctionIndex, attr);
+}
+
+// Build the resolver, which returns the version for the running CPU's feature level
+static LLVMValueRef genlFmvResolver(GenState *gen, char *name, LLVMValueRef *versions, LLVMValueRef dflt) {
+	LLVMTypeRef i32type = LLVMInt32TypeInContext(gen->context);
+	LLVMTypeRef fnptrtype = LLVMTypeOf(dflt);
+	LLVMValueRef resolver, levelfn, level, choice;
+	LLVMBuilderRef builder;
+	char *rname;
+	int i;
+
+	if (!(levelfn = LLVMGetNamedFunction(gen->module, "coneCpuLevel")))
+		levelfn = LLVMAddFunction(gen->module, "coneCpuLevel", LLVMFunctionType(i32type, NULL, 0, 0));
+	rname = memAllocBlk(strlen(name) + 10);
+	sprintf(rname, "%s.resolver", name);
+	resolver = LLVMAddFunction(gen->module, rname, LLVMFunctionType(fnptrtype, NULL, 0, 0));
+	LLVMSetLinkage(resolver, LLVMInternalLinkage);
+
+	// Worst level first, so the best supported level's select wins
+	builder = LLVMCreateBuilderInContext(gen->context);
+	LLVMPositionBuilderAtEnd(builder, LLVMAppendBasicBlockInContext(gen->context, resolver, "entry"));
+	level = LLVMBuildCall(builder, levelfn, NULL, 0, "level");
+	choice = dflt;
+	for (i = genlFmvUsed - 1; i >= 0; i--) {
+		LLVMValueRef ok = LLVMBuildICmp(builder, LLVMIntSGE, level, LLVMConstInt(i32type, genlFmvUse[i]->level, 0), "");
+		choice = LLVMBuildSelect(builder, ok, versions[i], choice, "version");
+	}
+	LLVMBuildRet(builder, choice);
+	LLVMDisposeBuilder(builder);
+	return resolver;
+}
+
+// Replace a function with a stub that calls the version chosen at load time (without ifunc)
+static void genlFmvStub(GenState *gen, NameDclAstNode *fnnode, char *name, LLVMValueRef *versions, LLVMValueRef dflt) {
+	LLVMValueRef stub, ptr, resolver, initfn, args[64], call;
+	LLVMTypeRef fntype = LLVMGetElementType(LLVMTypeOf(dflt));
+	LLVMBuilderRef builder;
+	unsigned i, nparms = LLVMCountParams(dflt);
+	char *pname;
+
+	stub = LLVMAddFunction(gen->module, name, fntype);
+	LLVMSetLinkage(stub, LLVMGetLinkage(dflt));
+	LLVMSetLinkage(dflt, LLVMInternalLinkage);
+	LLVMReplaceAllUsesWith(dflt, stub);
+	fnnode->llvmvar = stub;
+
+	// The pointer starts at the default version, until the constructor resolves it
+	pname = memAllocBlk(strlen(name) + 5);
+	sprintf(pname, "%s.ptr", name);
+	ptr = LLVMAddGlobal(gen->module, LLVMTypeOf(dflt), pname);
+	LLVMSetLinkage(ptr, LLVMInternalLinkage);
+	LLVMSetInitializer(ptr, dflt);
+	resolver = genlFmvResolver(gen, name, versions, dflt);
+
+	builder = LLVMCreateBuilderInContext(gen->context);
+	LLVMPositionBuilderAtEnd(builder, LLVMAppendBasicBlockInContext(gen->context, stub, "entry"));
+	for (i = 0; i < nparms && i < 64; i++)
+		args[i] = LLVMGetParam(stub, i);
+	call = LLVMBuildCall(builder, LLVMBuildLoad(builder, ptr, "version"), args, nparms, "");
+	LLVMSetTailCall(call, 1);
+	if (LLVMGetTypeKind(LLVMGetReturnType(fntype)) == LLVMVoidTypeKind)
+		LLVMBuildRetVoid(builder);
+	else
+		LLVMBuildRet(builder, call);
+
+	initfn = LLVMAddFunction(gen->module, "coneFmvInit", LLVMFunctionType(LLVMVoidTypeInContext(gen->context), NULL, 0, 0));
+	LLVMSetLinkage(initfn, LLVMInternalLinkage);
+	LLVMPositionBuilderAtEnd(builder, LLVMAppendBasicBlockInContext(gen->context, initfn, "entry"));
+	LLVMBuildStore(builder, LLVMBuildCall(builder, resolver, NULL, 0, "version"), ptr);
+	LLVMBuildRetVoid(builder);
+	LLVMDisposeBuilder(builder);
+	genlAddCtor(gen, initfn);
+}
+
+// Generate the function's versions for each feature level, and dispatch to them.
+// Calls to it, from here on and already generated, go through the dispatch.
+void genlFmv(GenState *gen, NameDclAstNode *fnnode) {
+	LLVMValueRef dflt = fnnode->llvmvar;
+	LLVMValueRef versions[GenlFmvMax];
+	char *name = memAllocStr((char *)LLVMGetValueName(dflt), strlen(LLVMGetValueName(dflt)));
+	char *vname;
+	int i;
+
+	for (i = 0; i < genlFmvUsed; i++) {
+		vname = memAllocBlk(strlen(name) + strlen(genlFmvUse[i]->name) + 2);
+		sprintf(vname, "%s.%s", name, genlFmvUse[i]->name);
+		versions[i] = LLVMAddFunction(gen->module, vname, LLVMGetElementType(LLVMTypeOf(dflt)));
+		LLVMSetLinkage(versions[i], LLVMInternalLinkage);
+		genlFmvCopyAttrs(dflt, versions[i]);
+		genlFmvSetFeatures(gen, versions[i], genlFmvUse[i]);
+		genlFnBody(gen, fnnode, versions[i]);
+	}
+
+	vname = memAllocBlk(strlen(name) + 9);
+	sprintf(vname, "%s.default", name);
+	LLVMSetValueName(dflt, vname);
+
+	// Without ifunc support, dispatch through a pointer
+	if (gen->opt->run || strstr(gen->opt->triple, "apple") || strstr(gen->opt->triple, "windows")) {
+		genlFmvStub(gen, fnnode, name, versions, dflt);
+		return;
+	}
+
+#if LLVM_VERSION_MAJOR >= 9
+	{
+		LLVMValueRef ifunc = LLVMAddGlobalIFunc(gen->module, name, strlen(name), LLVMGetElementType(LLVMTypeOf(dflt)), 0,
+			LLVMConstNull(LLVMPointerType(LLVMFunctionType(LLVMTypeOf(dflt), NULL, 0, 0), 0)));
+		LLVMSetLinkage(ifunc, LLVMGetLinkage(dflt));
+		LLVMSetLinkage(dflt, LLVMInternalLinkage);
+		LLVMReplaceAllUsesWith(dflt, ifunc);
+		LLVMSetGlobalIFuncResolver(ifunc, genlFmvResolver(gen, name, versions, dflt));
+		fnnode->llvmvar = ifunc;
+	}
+#else
+	genlFmvStub(gen, fnnode, name, versions, dflt);
+#endif
+}
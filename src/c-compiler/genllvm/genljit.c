@@ -0,0 +1,278 @@
+/** In-process execution of a generated module
+ * @file
+ *
+ * With --run, the compiler does not emit an object file. Instead, it JIT-compiles
+ * the optimized module into its own process and calls the module's entry function
+ * (main, unless --entry names another). This spares small programs (such as tests)
+ * the cost of linking and starting a new process.
+ *
+ * Extern functions resolve first against the compiler's own built-in copy of
+ * the conestd runtime (e.g., print), then against the libraries already loaded
+ * into the compiler's process (e.g., libc's malloc).
+ *
+ * ORC's LLJIT (LLVM 13+) only compiles the module once the entry is looked up.
+ * With older LLVMs, MCJIT is used instead. Either way, the module's static
+ * constructors (e.g., those registering profile counters or choosing a function's
+ * version) are run before the entry, as they would be by a program's loader.
+ * With --profile-generate, the profile is written once the entry returns,
+ * while the program's counters are still in memory.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "../shared/error.h"
+#include "../shared/memory.h"
+#include "../shared/timetrace.h"
+#include "../coneopts.h"
+#include "genllvm.h"
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm-c/ExecutionEngine.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#if LLVM_VERSION_MAJOR >= 13
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Orc.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+int genlRunResult = 0;
+
+// The built-in copy of the conestd runtime (src/conestd)
+void print(char *p);
+void printInt(int64_t nbr);
+void printFloat(double nbr);
+void printChar(uint64_t code);
+int coneCpuLevel(void);
+void coneProfRegister(void *fns, uint32_t nfns);
+void coneProfFlush(void);
+
+// A conestd function that JIT-compiled code may call
+typedef struct GenlRuntimeFn {
+	char *name;
+	void *addr;
+} GenlRuntimeFn;
+
+static GenlRuntimeFn genlRuntimeFns[] = {
+	{ "print", (void *)print },
+	{ "printInt", (void *)printInt },
+	{ "printFloat", (void *)printFloat },
+	{ "printChar", (void *)printChar },
+	{ "coneCpuLevel", (void *)coneCpuLevel },
+	{ "coneProfRegister", (void *)coneProfRegister },
+};
+
+#define genlRuntimeFnCount (sizeof(genlRuntimeFns) / sizeof(GenlRuntimeFn))
+
+// Call the JIT-compiled entry function, returning its integer result (or 0)
+static int genlCallEntry(void *addr, LLVMTypeRef rettype) {
+	int result = 0;
+	if (LLVMGetTypeKind(rettype) != LLVMIntegerTypeKind)
+		((void (*)(void))addr)();
+	else if (LLVMGetIntTypeWidth(rettype) <= 8)
+		result = ((int8_t (*)(void))addr)();
+	else if (LLVMGetIntTypeWidth(rettype) <= 16)
+		result = ((int16_t (*)(void))addr)();
+	else if (LLVMGetIntTypeWidth(rettype) <= 32)
+		result = ((int32_t (*)(void))addr)();
+	else
+		result = (int)((int64_t (*)(void))addr)();
+	fflush(stdout);
+	return result;
+}
+
+// Run the JIT-compiled program: its static constructors, then its entry function.
+// Write its profile, if instrumented, before its code and counters are freed.
+static int genlRunProgram(ConeOptions *opt, void **ctors, uint32_t nctors, void *addr, LLVMTypeRef rettype) {
+	int result;
+	uint32_t i;
+	timeTraceBegin("Run", opt->entry);
+	for (i = 0; i < nctors; i++)
+		((void (*)(void))ctors[i])();
+	result = genlCallEntry(addr, rettype);
+	if (opt->profgen)
+		coneProfFlush();
+	timeTraceEnd();
+	return result;
+}
+
+#if LLVM_VERSION_MAJOR >= 13
+// LLJIT does not run a module's static constructors (llvm.global_ctors) itself.
+// So give them external names to look up, and drop the module's list of them.
+// Return their names, in the order they are to be run.
+static char **genlJitCtors(LLVMModuleRef module, uint32_t *nctors) {
+	LLVMValueRef ctors = LLVMGetNamedGlobal(module, "llvm.global_ctors");
+	LLVMValueRef list;
+	char **names;
+	uint32_t i;
+
+	*nctors = 0;
+	if (ctors == NULL || (list = LLVMGetInitializer(ctors)) == NULL || LLVMGetNumOperands(list) == 0)
+		return NULL;
+	*nctors = LLVMGetNumOperands(list);
+	names = (char **)memAllocBlk(*nctors * sizeof(char *));
+	for (i = 0; i < *nctors; i++) {
+		LLVMValueRef fn = LLVMGetOperand(LLVMGetOperand(list, i), 1);
+		const char *name = LLVMGetValueName(fn);
+		LLVMSetLinkage(fn, LLVMExternalLinkage);
+		names[i] = memAllocStr((char *)name, strlen(name));
+	}
+	LLVMDeleteGlobal(ctors);
+	return names;
+}
+
+// Report an LLVM error, consuming it
+static void genlJitError(LLVMErrorRef err, char *what) {
+	char *msg = LLVMGetErrorMessage(err);
+	errorMsg(ErrorGenErr, "Could not %s: %s", what, msg);
+	LLVMDisposeErrorMessage(msg);
+}
+
+// JIT-compile the module using ORC, returning the entry function's address (or NULL)
+// and its static constructors' addresses. The module is copied into the JIT's own context, via bitcode.
+static void *genlJitOrc(GenState *gen, char *entry, LLVMOrcLLJITRef *jitp, void ***ctorsp, uint32_t *nctorsp) {
+	LLVMOrcThreadSafeContextRef tsc;
+	LLVMOrcDefinitionGeneratorRef procsyms;
+	LLVMJITCSymbolMapPair syms[genlRuntimeFnCount];
+	LLVMMemoryBufferRef bitcode;
+	LLVMOrcJITDylibRef dylib;
+	LLVMOrcJITTargetAddress addr;
+	LLVMModuleRef module;
+	LLVMErrorRef err;
+	char **ctornames;
+	size_t i;
+
+	*nctorsp = 0;
+	if ((err = LLVMOrcCreateLLJIT(jitp, NULL))) {
+		genlJitError(err, "create JIT");
+		return NULL;
+	}
+	dylib = LLVMOrcLLJITGetMainJITDylib(*jitp);
+
+	// Resolve extern functions against the built-in runtime, then the compiler's process
+	for (i = 0; i < genlRuntimeFnCount; i++) {
+		syms[i].Name = LLVMOrcLLJITMangleAndIntern(*jitp, genlRuntimeFns[i].name);
+		syms[i].Sym.Address = (LLVMOrcJITTargetAddress)(uintptr_t)genlRuntimeFns[i].addr;
+		syms[i].Sym.Flags.GenericFlags = LLVMJITSymbolGenericFlagsExported | LLVMJITSymbolGenericFlagsCallable;
+		syms[i].Sym.Flags.TargetFlags = 0;
+	}
+	if ((err = LLVMOrcJITDylibDefine(dylib, LLVMOrcAbsoluteSymbols(syms, genlRuntimeFnCount)))) {
+		genlJitError(err, "define runtime symbols");
+		return NULL;
+	}
+	if ((err = LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(&procsyms, LLVMOrcLLJITGetGlobalPrefix(*jitp), NULL, NULL))) {
+		genlJitError(err, "search process symbols");
+		return NULL;
+	}
+	LLVMOrcJITDylibAddGenerator(dylib, procsyms);
+
+	// Hand over a copy of the module, in the JIT's context
+	ctornames = genlJitCtors(gen->module, nctorsp);
+	tsc = LLVMOrcCreateNewThreadSafeContext();
+	bitcode = LLVMWriteBitcodeToMemoryBuffer(gen->module);
+	if (LLVMParseBitcodeInContext2(LLVMOrcThreadSafeContextGetContext(tsc), bitcode, &module)) {
+		LLVMDisposeMemoryBuffer(bitcode);
+		LLVMOrcDisposeThreadSafeContext(tsc);
+		errorMsg(ErrorGenErr, "Could not copy module for JIT");
+		return NULL;
+	}
+	LLVMDisposeMemoryBuffer(bitcode);
+	err = LLVMOrcLLJITAddLLVMIRModule(*jitp, dylib, LLVMOrcCreateNewThreadSafeModule(module, tsc));
+	LLVMOrcDisposeThreadSafeContext(tsc);
+	if (err) {
+		genlJitError(err, "add module to JIT");
+		return NULL;
+	}
+
+	// Looking up the entry is what compiles the module
+	timeTraceBegin("JitCompile", gen->srcname);
+	err = LLVMOrcLLJITLookup(*jitp, &addr, entry);
+	*ctorsp = *nctorsp ? (void **)memAllocBlk(*nctorsp * sizeof(void *)) : NULL;
+	for (i = 0; !err && i < *nctorsp; i++) {
+		LLVMOrcJITTargetAddress ctoraddr;
+		if (!(err = LLVMOrcLLJITLookup(*jitp, &ctoraddr, ctornames[i])))
+			(*ctorsp)[i] = (void *)(uintptr_t)ctoraddr;
+	}
+	timeTraceEnd();
+	if (err) {
+		genlJitError(err, "JIT compile");
+		return NULL;
+	}
+	return (void *)(uintptr_t)addr;
+}
+#endif
+
+// JIT-compile the module and run its entry function, placing its result in genlRunResult.
+// Takes ownership of the module.
+void genlJitRun(GenState *gen, ConeOptions *opt) {
+	LLVMValueRef entryfn = LLVMGetNamedFunction(gen->module, opt->entry);
+	LLVMTypeRef rettype;
+	void *addr;
+
+	genlRunResult = 0;
+	if (entryfn == NULL || LLVMCountBasicBlocks(entryfn) == 0) {
+		errorMsg(ErrorGenErr, "Cannot run program: no entry function %s is defined", opt->entry);
+		LLVMDisposeModule(gen->module);
+		return;
+	}
+	if (LLVMCountParams(entryfn) != 0) {
+		errorMsg(ErrorGenErr, "Cannot run program: entry function %s must have no parameters", opt->entry);
+		LLVMDisposeModule(gen->module);
+		return;
+	}
+#if LLVM_VERSION_MAJOR >= 8
+	rettype = LLVMGetReturnType(LLVMGlobalGetValueType(entryfn));
+#else
+	rettype = LLVMGetReturnType(LLVMGetElementType(LLVMTypeOf(entryfn)));
+#endif
+
+#if LLVM_VERSION_MAJOR >= 13
+	{
+		LLVMOrcLLJITRef jit = NULL;
+		void **ctors;
+		uint32_t nctors;
+		addr = genlJitOrc(gen, opt->entry, &jit, &ctors, &nctors);
+		LLVMDisposeModule(gen->module);
+		if (addr)
+			genlRunResult = genlRunProgram(opt, ctors, nctors, addr, rettype);
+		if (jit)
+			LLVMOrcDisposeLLJIT(jit);
+	}
+#else
+	{
+		LLVMExecutionEngineRef engine;
+		struct LLVMMCJITCompilerOptions mcopts;
+		char *err;
+		size_t i;
+
+		LLVMLinkInMCJIT();
+		LLVMInitializeMCJITCompilerOptions(&mcopts, sizeof(mcopts));
+		if (LLVMCreateMCJITCompilerForModule(&engine, gen->module, &mcopts, sizeof(mcopts), &err)) {
+			errorMsg(ErrorGenErr, "Could not create JIT: %s", err);
+			LLVMDisposeMessage(err);
+			LLVMDisposeModule(gen->module);
+			return;
+		}
+		for (i = 0; i < genlRuntimeFnCount; i++) {
+			LLVMValueRef fn = LLVMGetNamedFunction(gen->module, genlRuntimeFns[i].name);
+			if (fn)
+				LLVMAddGlobalMapping(engine, fn, genlRuntimeFns[i].addr);
+		}
+		timeTraceBegin("JitCompile", gen->srcname);
+		addr = (void *)(uintptr_t)LLVMGetFunctionAddress(engine, opt->entry);
+		timeTraceEnd();
+		if (addr) {
+			LLVMRunStaticConstructors(engine);
+			genlRunResult = genlRunProgram(opt, NULL, 0, addr, rettype);
+		}
+		else
+			errorMsg(ErrorGenErr, "Could not JIT compile %s", opt->entry);
+		LLVMDisposeExecutionEngine(engine);	// Also disposes of the module
+	}
+#endif
+}
@@ -0,0 +1,142 @@
+/** Link-time optimization
+ * @file
+ *
+ * Normally, each package is optimized on its own and emitted as an object file,
+ * so no optimization (e.g., inlining a small accessor) ever crosses packages.
+ *
+ * With --bitcode, a package is instead emitted as LLVM bitcode (.bc), having run
+ * only the pre-link part of the optimization pipeline.
+ *
+ * With --lto, every package compiled (from source) or named (as .bc files)
+ * is linked into one whole-program module, along with (given --runtimebc)
+ * the conestd runtime's bitcode. All but main and any --export symbols are
+ * then made internal, so the link-time pipeline can inline, specialize and
+ * delete across package boundaries, before one object file is emitted.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "../shared/error.h"
+#include "../shared/fileio.h"
+#include "../shared/timetrace.h"
+#include "../coneopts.h"
+#include "genllvm.h"
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define asmext "asm"
+#define objext "obj"
+#else
+#define asmext "s"
+#define objext "o"
+#endif
+
+// The whole-program module, and the name of the first package linked into it
+static LLVMModuleRef genlLtoModule = NULL;
+static char *genlLtoName = NULL;
+
+// Emit a package's optimized module as bitcode, for later link-time optimization
+void genlBitcode(GenState *gen, ConeOptions *opt, LLVMTargetMachineRef machine, char *bcpath) {
+	char *errmsg;
+	timeTraceBegin("Optimize", gen->srcname);
+	if ((errmsg = genlRunPasses(gen->module, opt, machine, GenlPassPreLink))) {
+		errorMsg(ErrorGenErr, "Could not optimize: %s", errmsg);
+		free(errmsg);
+	}
+	timeTraceEnd();
+	timeTraceBegin("EmitBitcode", bcpath);
+	if (LLVMWriteBitcodeToFile(gen->module, bcpath) != 0)
+		errorMsg(ErrorGenErr, "Could not emit bitcode file %s", bcpath);
+	timeTraceEnd();
+}
+
+// Link a package's module into the whole-program module, consuming it
+void genlLtoLink(LLVMModuleRef module, char *name) {
+	timeTraceBegin("LtoLink", name);
+	if (genlLtoModule == NULL) {
+		genlLtoModule = module;
+		genlLtoName = name;
+	}
+	else if (LLVMLinkModules2(genlLtoModule, module))
+		errorMsg(ErrorGenErr, "Could not link %s into the program", name);
+	timeTraceEnd();
+}
+
+// Link a package (or runtime) previously emitted as bitcode into the whole-program module
+void genlLtoAddBitcode(char *path) {
+	LLVMMemoryBufferRef buf;
+	LLVMModuleRef module;
+	char *err;
+
+	if (LLVMCreateMemoryBufferWithContentsOfFile(path, &buf, &err)) {
+		errorMsg(ErrorNoFile, "Cannot read bitcode file %s: %s", path, err);
+		LLVMDisposeMessage(err);
+		return;
+	}
+	if (LLVMParseBitcodeInContext2(LLVMGetGlobalContext(), buf, &module)) {
+		errorMsg(ErrorGenErr, "Invalid bitcode file %s", path);
+		LLVMDisposeMemoryBuffer(buf);
+		return;
+	}
+	LLVMDisposeMemoryBuffer(buf);
+	genlLtoLink(module, fileName(path));
+}
+
+// Internalize a definition, unless it is main or exported
+static void genlLtoInternalize(ConeOptions *opt, LLVMValueRef glo) {
+	const char *name = LLVMGetValueName(glo);
+	if (strcmp(name, "main") == 0 || (opt->exports && genlInExports(opt->exports, (char *)name)))
+		return;
+	LLVMSetLinkage(glo, LLVMInternalLinkage);
+}
+
+// Optimize the whole program, now that all its packages are linked, and emit its object
+void genlLtoFinish(ConeOptions *opt, LLVMTargetMachineRef machine) {
+	LLVMValueRef glo;
+	char *errmsg, *err;
+
+	if (opt->runtimebc && genlLtoModule)
+		genlLtoAddBitcode(fileMakePath(opt->output, "conestd", "bc"));
+	if (genlLtoModule == NULL || errors) {
+		if (genlLtoModule)
+			LLVMDisposeModule(genlLtoModule);
+		genlLtoModule = NULL;
+		return;
+	}
+
+	// Nothing outside the program can call into it, except through main or an export
+	for (glo = LLVMGetFirstFunction(genlLtoModule); glo; glo = LLVMGetNextFunction(glo)) {
+		if (LLVMCountBasicBlocks(glo) > 0)
+			genlLtoInternalize(opt, glo);
+	}
+	for (glo = LLVMGetFirstGlobal(genlLtoModule); glo; glo = LLVMGetNextGlobal(glo)) {
+		if (LLVMGetInitializer(glo))
+			genlLtoInternalize(opt, glo);
+	}
+
+	timeTraceBegin("LtoOptimize", genlLtoName);
+	if ((errmsg = genlRunPasses(genlLtoModule, opt, machine, GenlPassLto))) {
+		errorMsg(ErrorGenErr, "Could not optimize: %s", errmsg);
+		free(errmsg);
+	}
+	timeTraceEnd();
+
+	if (opt->print_llvmir && LLVMPrintModuleToFile(genlLtoModule, fileMakePath(opt->output, genlLtoName, "ir"), &err) != 0) {
+		errorMsg(ErrorGenErr, "Could not emit ir file: %s", err);
+		LLVMDisposeMessage(err);
+	}
+	genlOut(fileMakePath(opt->output, genlLtoName, opt->wasm? "wasm" : objext),
+		opt->print_asm? fileMakePath(opt->output, genlLtoName, opt->wasm? "wat" : asmext) : NULL,
+		genlLtoModule, opt->triple, machine);
+
+	LLVMDisposeModule(genlLtoModule);
+	genlLtoModule = NULL;
+}
@@ -11,6 +11,7 @@
 #include "../coneopts.h"
 #include "../ast/nametbl.h"
 #include "../shared/fileio.h"
+#include "../shared/timetrace.h"
 #include "genllvm.h"
 
 #include <llvm-c/ExecutionEngine.h>
@@ -19,11 +20,17 @@
 #include <llvm-c/BitWriter.h>
 #include <llvm-c/Transforms/Scalar.h>
 #include <llvm-c/Transforms/IPO.h>
+#include <llvm-c/Transforms/PassManagerBuilder.h>
+#include <llvm-c/Transforms/Vectorize.h>
+#if LLVM_VERSION_MAJOR >= 13
+#include <llvm-c/Transforms/PassBuilder.h>
+#endif
 #if LLVM_VERSION_MAJOR >= 7
 #include "llvm/Transforms/Utils.h"
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 
@@ -38,24 +45,50 @@
 // Generate parameter variable
 void genlParmVar(GenState *gen, NameDclAstNode *var) {
 	assert(var->asttype == VarNameDclNode);
-	// We always alloca in case variable is mutable or we want to take address of its value
+	// An immutable parameter that is never borrowed from is just its value
+	if (genlIsSsaVar(var)) {
+		var->llvmvar = LLVMGetParam(gen->fn, var->index);
+		LLVMSetValueName(var->llvmvar, &var->namesym->namestr);
+		var->flags |= FlagSsaVar;
+		return;
+	}
+	// Otherwise, alloca as variable is mutable or we take the address of its value
 	var->llvmvar = LLVMBuildAlloca(gen->builder, genlType(gen, var->vtype), &var->namesym->namestr);
 	LLVMBuildStore(gen->builder, LLVMGetParam(gen->fn, var->index), var->llvmvar);
 }
 
-// Generate a function
-void genlFn(GenState *gen, NameDclAstNode *fnnode) {
+// Generate a function's code into an LLVM function: the function itself, or one of its versions.
+// Return whether it has a loop.
+int genlFnBody(GenState *gen, NameDclAstNode *fnnode, LLVMValueRef fn) {
+	// genlType may generate a struct's methods in the middle of another function's body,
+	// so save that function's state, and restore it once this function is done
 	LLVMValueRef svfn = gen->fn;
 	LLVMBuilderRef svbuilder = gen->builder;
+	int svfnloops = gen->fnloops;
+	int svfastmath = gen->fastmath;
+	int svfpcontract = gen->fpcontract;
+	int fnloops;
+	LLVMValueRef *svprofslots = gen->profslots;
+	uint32_t svprofslotsAvail = gen->profslotsAvail;
+	uint32_t svprofnext = gen->profnext;
 	FnSigAstNode *fnsig = (FnSigAstNode*)fnnode->vtype;
+	char *name = memAllocStr((char *)LLVMGetValueName(fnnode->llvmvar), strlen(LLVMGetValueName(fnnode->llvmvar)));
 
-	assert(fnnode->value->asttype == BlockNode);
-	gen->fn = fnnode->llvmvar;
+	// A nested function's counters must not overwrite the outer function's
+	if (svfn) {
+		gen->profslots = NULL;
+		gen->profslotsAvail = 0;
+	}
+	gen->fn = fn;
+	gen->fnloops = 0;
+	gen->fastmath = gen->opt->fastmath || (fnnode->flags & FlagFastMath);
+	gen->fpcontract = gen->fastmath || gen->opt->fpcontract;
 
 	// Attach block and builder to function
 	LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(gen->context, gen->fn, "entry");
 	gen->builder = LLVMCreateBuilder();
 	LLVMPositionBuilderAtEnd(gen->builder, entry);
+	genlProfFnBegin(gen, name);
 
 	// Generate LLVMValueRef's for all parameters, so we can use them as local vars in code
 	uint32_t cnt;
@@ -65,11 +98,29 @@ void genlFn(GenState *gen, NameDclAstNode *fnnode) {
 
 	// Generate the function's code (always a block)
 	genlBlock(gen, (BlockAstNode *)fnnode->value);
+	genlProfFnEnd(gen, name);
 
 	LLVMDisposeBuilder(gen->builder);
-
+	fnloops = gen->fnloops;
+
+	gen->fnloops = svfnloops;
+	gen->fastmath = svfastmath;
+	gen->fpcontract = svfpcontract;
+	gen->profslots = svprofslots;
+	gen->profslotsAvail = svprofslotsAvail;
+	gen->profnext = svprofnext;
 	gen->builder = svbuilder;
 	gen->fn = svfn;
+	return fnloops;
+}
+
+// Generate a function
+void genlFn(GenState *gen, NameDclAstNode *fnnode) {
+	assert(fnnode->value->asttype == BlockNode);
+	timeTraceBegin("GenFn", &fnnode->namesym->namestr);
+	if (genlFmvWanted(gen, genlFnBody(gen, fnnode, fnnode->llvmvar)))
+		genlFmv(gen, fnnode);
+	timeTraceEnd();
 }
 
 // Generate global variable
@@ -108,19 +159,147 @@ char *genlGlobalName(NamedAstNode *name) {
 	return memAllocStr(workbuf, strlen(workbuf));
 }
 
+// Add a named enum attribute to a function (index 0 = return value, else parameter number)
+static void genlAddAttr(GenState *gen, LLVMValueRef fn, unsigned index, char *name, uint64_t val) {
+	unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+	if (kind == 0)	// Not known to this version of LLVM
+		return;
+	LLVMAddAttributeAtIndex(fn, index, LLVMCreateEnumAttribute(gen->context, kind, val));
+}
+
+// Add a string attribute (e.g., "unsafe-fp-math"="true") to a function
+static void genlAddStrAttr(GenState *gen, LLVMValueRef fn, char *name, char *val) {
+	LLVMAddAttributeAtIndex(fn, LLVMAttributeFunctionIndex,
+		LLVMCreateStringAttribute(gen->context, name, strlen(name), val, strlen(val)));
+}
+
+// Describe to LLVM what a reference's permission guarantees about its target.
+// Every reference is non-null and points to a valid value of its type.
+// A uni reference is the only live path to its value (noalias).
+// Values reached by imm (immutable, race-safe) references cannot change while
+// they are live, so such a reference is also noalias and readonly.
+// A const reference may not write its value, though others may (readonly).
+static void genlRefAttrs(GenState *gen, LLVMValueRef fn, unsigned index, AstNode *type) {
+	PtrAstNode *reftype = (PtrAstNode *)typeGetVtype(type);
+	LLVMTypeRef pvtype;
+	uint16_t flags;
+
+	// A slice is passed as a value (its address and length)
+	if (reftype->asttype != RefType || isSlice((AstNode *)reftype))
+		return;
+	genlAddAttr(gen, fn, index, "nonnull", 0);
+	pvtype = genlType(gen, reftype->pvtype);
+	if (LLVMTypeIsSized(pvtype) && LLVMABISizeOfType(gen->datalayout, pvtype) > 0)
+		genlAddAttr(gen, fn, index, "dereferenceable", LLVMABISizeOfType(gen->datalayout, pvtype));
+
+	// Aliasing facts only apply to parameters
+	if (index == LLVMAttributeReturnIndex)
+		return;
+	flags = reftype->perm->flags;
+	if (!(flags & MayRead))
+		return;
+	if (!(flags & MayAlias) || (!(flags & MayWrite) && (flags & RaceSafe)))
+		genlAddAttr(gen, fn, index, "noalias", 0);
+	if (!(flags & MayWrite))
+		genlAddAttr(gen, fn, index, "readonly", 0);
+}
+
+// Mark a program-defined function with what effect analysis has proven about it.
+// Cone has no exceptions, so no Cone function ever unwinds.
+// With --profile-generate, every function updates its counters, so none may
+// claim to leave memory alone (or LLVM would drop or merge calls and their counts).
+static void genlFnAttrs(GenState *gen, NameDclAstNode *fndcl) {
+	LLVMValueRef fn = fndcl->llvmvar;
+	uint16_t flags = fndcl->flags;
+	if (gen->opt->profgen)
+		flags &= ~(FlagReadNone | FlagReadOnly | FlagWillReturn);
+	genlAddAttr(gen, fn, LLVMAttributeFunctionIndex, "nounwind", 0);
+#if LLVM_VERSION_MAJOR >= 16
+	// memory(none) or memory(read)
+	if (flags & FlagReadNone)
+		genlAddAttr(gen, fn, LLVMAttributeFunctionIndex, "memory", 0);
+	else if (flags & FlagReadOnly)
+		genlAddAttr(gen, fn, LLVMAttributeFunctionIndex, "memory", 0x15);
+#else
+	if (flags & FlagReadNone)
+		genlAddAttr(gen, fn, LLVMAttributeFunctionIndex, "readnone", 0);
+	else if (flags & FlagReadOnly)
+		genlAddAttr(gen, fn, LLVMAttributeFunctionIndex, "readonly", 0);
+#endif
+	if (flags & FlagNoRecurse)
+		genlAddAttr(gen, fn, LLVMAttributeFunctionIndex, "norecurse", 0);
+	if (flags & FlagWillReturn)
+		genlAddAttr(gen, fn, LLVMAttributeFunctionIndex, "willreturn", 0);
+
+	// Fast math also relaxes what code generation may assume about float values
+	if (gen->opt->fastmath || (fndcl->flags & FlagFastMath)) {
+		genlAddStrAttr(gen, fn, "unsafe-fp-math", "true");
+		genlAddStrAttr(gen, fn, "no-nans-fp-math", "true");
+		genlAddStrAttr(gen, fn, "no-infs-fp-math", "true");
+	}
+}
+
+// Is the symbol in the comma-separated export list?
+int genlInExports(char *exports, char *name) {
+	size_t len = strlen(name);
+	while (exports) {
+		char *end = strchr(exports, ',');
+		size_t explen = end? (size_t)(end - exports) : strlen(exports);
+		if (explen == len && strncmp(exports, name, len) == 0)
+			return 1;
+		exports = end? end + 1 : NULL;
+	}
+	return 0;
+}
+
+// Should a program-defined global or function be visible outside its object file?
+// main (and the --run entry) always is. A generic's instance never is, as every package
+// that uses it makes its own. With an export list, only the symbols it names are.
+// Otherwise the main module's top-level functions and globals are its public API,
+// and everything else (e.g., in submodules or type methods) is private.
+static int genlIsExported(GenState *gen, NameDclAstNode *glovar, char *name) {
+	if (strcmp(name, "main") == 0 || (gen->opt->run && strcmp(name, gen->opt->entry) == 0))
+		return 1;
+	if (glovar->flags & FlagInstance)
+		return 0;
+	if (gen->opt->extfun && glovar->vtype->asttype == FnSig)
+		return 1;
+	if (gen->opt->exports)
+		return genlInExports(gen->opt->exports, name);
+	return glovar->owner == NULL || glovar->owner->namesym == NULL;
+}
+
 // Generate LLVMValueRef for a global variable or function
 void genlGloVarName(GenState *gen, NameDclAstNode *glovar) {
+	FnSigAstNode *fnsig;
+	SymNode *inodesp;
+	uint32_t cnt;
+	unsigned index = 1;
+
+	char *name = genlGlobalName((NamedAstNode*)glovar);
 
 	// Handle when it is just a global variable
 	if (glovar->vtype->asttype != FnSig) {
-		glovar->llvmvar = LLVMAddGlobal(gen->module, genlType(gen, glovar->vtype), genlGlobalName((NamedAstNode*)glovar));
+		glovar->llvmvar = LLVMAddGlobal(gen->module, genlType(gen, glovar->vtype), name);
 		if (glovar->perm == immPerm)
 			LLVMSetGlobalConstant(glovar->llvmvar, 1);
+		if (glovar->value && !genlIsExported(gen, glovar, name))
+			LLVMSetLinkage(glovar->llvmvar, LLVMInternalLinkage);
 		return;
 	}
 
-	// Add function to the module
-	glovar->llvmvar = LLVMAddFunction(gen->module, genlGlobalName((NamedAstNode*)glovar), genlType(gen, glovar->vtype));
+	// Add function to the module. Only a defined function may be made internal.
+	glovar->llvmvar = LLVMAddFunction(gen->module, name, genlType(gen, glovar->vtype));
+	if (glovar->value && !genlIsExported(gen, glovar, name))
+		LLVMSetLinkage(glovar->llvmvar, LLVMInternalLinkage);
+
+	// Mark reference parameters and return value with what their permissions guarantee
+	fnsig = (FnSigAstNode *)glovar->vtype;
+	for (inodesFor(fnsig->parms, cnt, inodesp))
+		genlRefAttrs(gen, glovar->llvmvar, index++, ((NameDclAstNode *)inodesp->node)->vtype);
+	genlRefAttrs(gen, glovar->llvmvar, LLVMAttributeReturnIndex, fnsig->rettype);
+	if (glovar->value)
+		genlFnAttrs(gen, glovar);
 }
 
 // Generate module's nodes
@@ -132,7 +311,7 @@ void genlModule(GenState *gen, ModuleAstNode *mod) {
 	// This way forward references to global variables will work correctly
 	for (nodesFor(mod->nodes, cnt, nodesp)) {
 		AstNode *nodep = *nodesp;
-		if (nodep->asttype == VarNameDclNode)
+		if (nodep->asttype == VarNameDclNode && ((NameDclAstNode *)nodep)->llvmvar == NULL)
 			genlGloVarName(gen, (NameDclAstNode *)nodep);
 	}
 
@@ -153,6 +332,10 @@ void genlModule(GenState *gen, ModuleAstNode *mod) {
 		case VtypeNameDclNode:
 			break;
 
+		// A generic is only a template: its instances (also in the module) are generated
+		case GenericNode:
+			break;
+
 		// Generate allocator definition
 		case AllocNameDclNode:
 			genlType(gen, nodep);
@@ -168,19 +351,155 @@ void genlModule(GenState *gen, ModuleAstNode *mod) {
 	}
 }
 
+// Run a function as the program starts (or, with --run, before its entry function).
+// The module's static constructors are all collected into its one llvm.global_ctors.
+void genlAddCtor(GenState *gen, LLVMValueRef fn) {
+	if (gen->ctorsUsed >= gen->ctorsAvail) {
+		LLVMValueRef *ctors;
+		gen->ctorsAvail = gen->ctorsAvail ? gen->ctorsAvail << 1 : 8;
+		ctors = (LLVMValueRef *)memAllocBlk(gen->ctorsAvail * sizeof(LLVMValueRef));
+		if (gen->ctorsUsed)
+			memcpy(ctors, gen->ctors, gen->ctorsUsed * sizeof(LLVMValueRef));
+		gen->ctors = ctors;
+	}
+	gen->ctors[gen->ctorsUsed++] = fn;
+}
+
+// Emit the module's static constructors, in the order they were added
+static void genlCtors(GenState *gen) {
+	LLVMTypeRef i32type = LLVMInt32TypeInContext(gen->context);
+	LLVMTypeRef fntype = LLVMPointerType(LLVMFunctionType(LLVMVoidTypeInContext(gen->context), NULL, 0, 0), 0);
+	LLVMTypeRef i8ptrtype = LLVMPointerType(LLVMInt8TypeInContext(gen->context), 0);
+	LLVMTypeRef ctortypes[3], ctortype;
+	LLVMValueRef ctor[3], *entries, ctors;
+	uint32_t i;
+
+	if (gen->ctorsUsed == 0)
+		return;
+	ctortypes[0] = i32type;
+	ctortypes[1] = fntype;
+	ctortypes[2] = i8ptrtype;
+	ctortype = LLVMStructTypeInContext(gen->context, ctortypes, 3, 0);
+	entries = (LLVMValueRef *)memAllocBlk(gen->ctorsUsed * sizeof(LLVMValueRef));
+	for (i = 0; i < gen->ctorsUsed; i++) {
+		ctor[0] = LLVMConstInt(i32type, 65535, 0);
+		ctor[1] = gen->ctors[i];
+		ctor[2] = LLVMConstNull(i8ptrtype);
+		entries[i] = LLVMConstStructInContext(gen->context, ctor, 3, 0);
+	}
+	ctors = LLVMAddGlobal(gen->module, LLVMArrayType(ctortype, gen->ctorsUsed), "llvm.global_ctors");
+	LLVMSetLinkage(ctors, LLVMAppendingLinkage);
+	LLVMSetInitializer(ctors, LLVMConstArray(ctortype, entries, gen->ctorsUsed));
+}
+
 void genlPackage(GenState *gen, ModuleAstNode *mod) {
 	char *error = NULL;
 
 	assert(mod->asttype == ModuleNode);
+	timeTraceBegin("GenIR", gen->srcname);
 	gen->module = LLVMModuleCreateWithNameInContext(gen->srcname, gen->context);
+	gen->fn = NULL;
+	gen->strlits = NULL;
+	gen->strlitsAvail = gen->strlitsUsed = 0;
+	gen->tbaaroot = NULL;
+	memset(gen->tbaatags, 0, sizeof(gen->tbaatags));
+	gen->profslots = gen->profrecs = NULL;
+	gen->profslotsAvail = gen->profrecsUsed = gen->profrecsAvail = 0;
+	gen->ctors = NULL;
+	gen->ctorsUsed = gen->ctorsAvail = 0;
 	genlModule(gen, mod);
+	genlProfModule(gen);
+	genlCtors(gen);
+	timeTraceEnd();
+
 	// Verify generated IR
+	timeTraceBegin("Verify", gen->srcname);
 	LLVMVerifyModule(gen->module, LLVMReturnStatusAction, &error);
 	if (error) {
 		if (*error)
 			errorMsg(ErrorGenErr, "Module verification failed:\n%s", error);
 		LLVMDisposeMessage(error);
 	}
+	timeTraceEnd();
+}
+
+// Maps a triple's architecture (by prefix) to the name of the LLVM target that generates it
+typedef struct GenlTargetArch {
+	char *arch;
+	char *target;
+} GenlTargetArch;
+
+static GenlTargetArch genlTargetArchs[] = {
+	{ "x86_64", "X86" }, { "amd64", "X86" }, { "i386", "X86" }, { "i486", "X86" },
+	{ "i586", "X86" }, { "i686", "X86" }, { "x86", "X86" },
+	{ "aarch64", "AArch64" }, { "arm64", "AArch64" }, { "arm", "ARM" }, { "thumb", "ARM" },
+	{ "wasm", "WebAssembly" },
+	{ "riscv", "RISCV" },
+	{ "powerpc", "PowerPC" }, { "ppc", "PowerPC" },
+	{ "mips", "Mips" },
+	{ "sparc", "Sparc" },
+	{ "s390x", "SystemZ" },
+	{ "avr", "AVR" },
+	{ "msp430", "MSP430" },
+	{ "nvptx", "NVPTX" },
+	{ "amdgcn", "AMDGPU" }, { "r600", "AMDGPU" },
+	{ "hexagon", "Hexagon" },
+	{ "bpf", "BPF" },
+	{ "lanai", "Lanai" },
+	{ "xcore", "XCore" },
+	{ NULL, NULL }
+};
+
+// Initialize the named LLVM target, if it was built into LLVM. Returns 0 if not.
+// LLVM's .def lists ensure we only refer to initializers that actually exist.
+static int genlInitTarget(char *name) {
+	int found = 0;
+#define LLVM_TARGET(TargetName) \
+	if (strcmp(name, #TargetName) == 0) { \
+		LLVMInitialize##TargetName##TargetInfo(); \
+		LLVMInitialize##TargetName##Target(); \
+		LLVMInitialize##TargetName##TargetMC(); \
+		found = 1; \
+	}
+#include <llvm/Config/Targets.def>
+#define LLVM_ASM_PRINTER(TargetName) \
+	if (found && strcmp(name, #TargetName) == 0) \
+		LLVMInitialize##TargetName##AsmPrinter();
+#include <llvm/Config/AsmPrinters.def>
+	return found;
+}
+
+// Initialize only the LLVM target needed to generate code for the triple.
+// With no triple specified, that is the native target. An architecture
+// we do not recognize falls back to initializing every target.
+void genlInitTargets(char *triple) {
+	GenlTargetArch *arch;
+
+	timeTraceBegin("InitTargets", triple);
+	if (!triple) {
+		LLVMInitializeNativeTarget();
+		LLVMInitializeNativeAsmPrinter();
+		timeTraceEnd();
+		return;
+	}
+
+	for (arch = genlTargetArchs; arch->arch; arch++) {
+		if (strncmp(triple, arch->arch, strlen(arch->arch)) == 0 && genlInitTarget(arch->target)) {
+			timeTraceEnd();
+			return;
+		}
+	}
+
+	LLVMInitializeAllTargetInfos();
+	LLVMInitializeAllTargetMCs();
+	LLVMInitializeAllTargets();
+	LLVMInitializeAllAsmPrinters();
+	timeTraceEnd();
+}
+
+// Is code generated position-independent? Libraries always are.
+int genlIsPic(ConeOptions *opt) {
+	return opt->pic || opt->library;
 }
 
 // Use provided options (triple, etc.) to creation a machine
@@ -191,13 +510,7 @@ LLVMTargetMachineRef genlCreateMachine(ConeOptions *opt) {
 	LLVMRelocMode reloc;
 	LLVMTargetMachineRef machine;
 
-	LLVMInitializeAllTargetInfos();
-	LLVMInitializeAllTargetMCs();
-	LLVMInitializeAllTargets();
-	LLVMInitializeAllAsmPrinters();
-	LLVMInitializeAllAsmParsers();
-
-	// Find target for the specified triple
+	// Find target for the specified triple (already initialized by genlInitTargets)
 	if (!opt->triple)
 		opt->triple = LLVMGetDefaultTargetTriple();
 	if (LLVMGetTargetFromTriple(opt->triple, &target, &err) != 0) {
@@ -207,8 +520,25 @@ LLVMTargetMachineRef genlCreateMachine(ConeOptions *opt) {
 	}
 
 	// Create a specific target machine
-	opt_level = opt->release? LLVMCodeGenLevelAggressive : LLVMCodeGenLevelNone;
-	reloc = (opt->pic || opt->library)? LLVMRelocPIC : LLVMRelocDefault;
+	switch (opt->optlevel) {
+	case 0: opt_level = LLVMCodeGenLevelNone; break;
+	case 1: opt_level = LLVMCodeGenLevelLess; break;
+	case 2: opt_level = LLVMCodeGenLevelDefault; break;
+	default: opt_level = LLVMCodeGenLevelAggressive; break;
+	}
+	reloc = genlIsPic(opt)? LLVMRelocPIC : LLVMRelocDefault;
+
+	// --cpu=native targets the host's CPU, with all its features (unless --features says otherwise)
+	if (opt->cpu && strcmp(opt->cpu, "native") == 0) {
+#if LLVM_VERSION_MAJOR >= 7
+		opt->cpu = LLVMGetHostCPUName();
+		if (!opt->features)
+			opt->features = LLVMGetHostCPUFeatures();
+#else
+		errorMsg(ErrorGenErr, "--cpu=native needs LLVM 7 or later");
+		return NULL;
+#endif
+	}
 	if (!opt->cpu)
 		opt->cpu = "generic";
 	if (!opt->features)
@@ -234,32 +564,186 @@ void genlOut(char *objpath, char *asmpath, LLVMModuleRef mod, char *triple, LLVM
 	LLVMDisposeMessage(layout);
 
 	// Generate assembly file if requested
-	if (asmpath && LLVMTargetMachineEmitToFile(machine, mod, asmpath, LLVMAssemblyFile, &err) != 0) {
-		errorMsg(ErrorGenErr, "Could not emit asm file: %s", err);
-		LLVMDisposeMessage(err);
+	if (asmpath) {
+		timeTraceBegin("EmitAsm", asmpath);
+		if (LLVMTargetMachineEmitToFile(machine, mod, asmpath, LLVMAssemblyFile, &err) != 0) {
+			errorMsg(ErrorGenErr, "Could not emit asm file: %s", err);
+			LLVMDisposeMessage(err);
+		}
+		timeTraceEnd();
 	}
 
 	// Generate .o or .obj file
+	timeTraceBegin("EmitObj", objpath);
 	if (LLVMTargetMachineEmitToFile(machine, mod, objpath, LLVMObjectFile, &err) != 0) {
 		errorMsg(ErrorGenErr, "Could not emit obj file: %s", err);
 		LLVMDisposeMessage(err);
 	}
+	timeTraceEnd();
 }
 
-// Generate AST into LLVM IR using LLVM
-void genllvm(ConeOptions *opt, ModuleAstNode *mod) {
-	char *err;
-	GenState gen;
+// Optimize a module, using LLVM's standard function and module pipelines
+// for the optimization level (-O0..-O3) and size level (-Os, -Oz).
+// As clang does, the loop and SLP vectorizers run at -O2 and above (and -Os),
+// and loops are unrolled at -O2 and above, unless optimizing for size.
+// A package being emitted as bitcode gets only the pipeline's pre-link part
+// (GenlPassPreLink), leaving the rest for when the whole program is linked (GenlPassLto).
+// This is thread-safe, given a module and machine used by no other thread.
+char *genlRunPasses(LLVMModuleRef module, ConeOptions *opt, LLVMTargetMachineRef machine, int phase) {
+	char *errmsg = NULL;
+	int vectorize = opt->optlevel >= 2 && opt->sizelevel < 2;
+	int unroll = opt->optlevel >= 2 && opt->sizelevel == 0;
+#if LLVM_VERSION_MAJOR >= 13
+	// New pass manager, with its "default<On>" (or LTO) pipelines
+	char pipeline[32];
+	LLVMErrorRef err;
+	LLVMPassBuilderOptionsRef pbopts = LLVMCreatePassBuilderOptions();
+	LLVMPassBuilderOptionsSetLoopVectorization(pbopts, vectorize);
+	LLVMPassBuilderOptionsSetLoopInterleaving(pbopts, vectorize);
+	LLVMPassBuilderOptionsSetSLPVectorization(pbopts, vectorize);
+	LLVMPassBuilderOptionsSetLoopUnrolling(pbopts, unroll);
+	sprintf(pipeline, "%s<O%c>", phase == GenlPassPreLink? "lto-pre-link" : phase == GenlPassLto? "lto" : "default",
+		opt->sizelevel? "sz"[opt->sizelevel - 1] : '0' + opt->optlevel);
+
+	if ((err = LLVMRunPasses(module, pipeline, machine, pbopts))) {
+		char *msg = LLVMGetErrorMessage(err);
+		errmsg = strdup(msg);
+		LLVMDisposeErrorMessage(msg);
+	}
+	LLVMDisposePassBuilderOptions(pbopts);
+#else
+	// Legacy pass manager, populated by the PassManagerBuilder
+	LLVMValueRef fn;
+	LLVMPassManagerRef fnpasses = LLVMCreateFunctionPassManagerForModule(module);
+	LLVMPassManagerRef modpasses = LLVMCreatePassManager();
+	LLVMPassManagerBuilderRef pmb = LLVMPassManagerBuilderCreate();
+	LLVMPassManagerBuilderSetOptLevel(pmb, opt->optlevel);
+	LLVMPassManagerBuilderSetSizeLevel(pmb, opt->sizelevel);
+	LLVMPassManagerBuilderSetDisableUnrollLoops(pmb, !unroll);
+	if (opt->optlevel > 0)
+		LLVMPassManagerBuilderUseInlinerWithThreshold(pmb,
+			opt->sizelevel == 2? 25 : opt->sizelevel == 1? 75 : opt->optlevel == 3? 250 : 225);
+
+	// Target-specific cost models inform inlining, unrolling and vectorization
+	LLVMAddAnalysisPasses(machine, fnpasses);
+	LLVMAddAnalysisPasses(machine, modpasses);
+	LLVMPassManagerBuilderPopulateFunctionPassManager(pmb, fnpasses);
+	if (phase == GenlPassLto)
+		LLVMPassManagerBuilderPopulateLTOPassManager(pmb, modpasses, 0, opt->optlevel > 0);
+	else
+		LLVMPassManagerBuilderPopulateModulePassManager(pmb, modpasses);
+	if (vectorize) {
+		LLVMAddSLPVectorizePass(modpasses);
+		LLVMAddInstructionCombiningPass(modpasses);
+		LLVMAddCFGSimplificationPass(modpasses);
+	}
+	LLVMPassManagerBuilderDispose(pmb);
+
+	LLVMInitializeFunctionPassManager(fnpasses);
+	for (fn = LLVMGetFirstFunction(module); fn; fn = LLVMGetNextFunction(fn))
+		LLVMRunFunctionPassManager(fnpasses, fn);
+	LLVMFinalizeFunctionPassManager(fnpasses);
+	LLVMRunPassManager(modpasses, module);
+
+	LLVMDisposePassManager(fnpasses);
+	LLVMDisposePassManager(modpasses);
+#endif
+	return errmsg;
+}
+
+// Remove internal functions and globals that nothing uses.
+// Codegen units need this done before splitting, as that makes internal symbols hidden.
+static void genlGlobalDce(GenState *gen, ConeOptions *opt, LLVMTargetMachineRef machine) {
+	size_t before = 0, after = 0;
+	LLVMValueRef fn;
+
+	if (opt->optlevel == 0)
+		return;
+	timeTraceBegin("GlobalDCE", gen->srcname);
+	for (fn = LLVMGetFirstFunction(gen->module); fn; fn = LLVMGetNextFunction(fn))
+		++before;
+#if LLVM_VERSION_MAJOR >= 13
+	{
+		LLVMErrorRef err;
+		LLVMPassBuilderOptionsRef pbopts = LLVMCreatePassBuilderOptions();
+		if ((err = LLVMRunPasses(gen->module, "globaldce", machine, pbopts)))
+			LLVMConsumeError(err);
+		LLVMDisposePassBuilderOptions(pbopts);
+	}
+#else
+	{
+		LLVMPassManagerRef modpasses = LLVMCreatePassManager();
+		LLVMAddGlobalDCEPass(modpasses);
+		LLVMRunPassManager(modpasses, gen->module);
+		LLVMDisposePassManager(modpasses);
+	}
+#endif
+	for (fn = LLVMGetFirstFunction(gen->module); fn; fn = LLVMGetNextFunction(fn))
+		++after;
+	if (opt->print_stats)
+		fprintf(stderr, "GlobalDCE removed %lu of %lu functions\n", (unsigned long)(before - after), (unsigned long)before);
+	timeTraceEnd();
+}
+
+// Optimize the generated LLVM IR
+void genlOptimize(GenState *gen, ConeOptions *opt, LLVMTargetMachineRef machine) {
+	char *errmsg;
+	timeTraceBegin("Optimize", gen->srcname);
+	if ((errmsg = genlRunPasses(gen->module, opt, machine, GenlPassDefault))) {
+		errorMsg(ErrorGenErr, "Could not optimize: %s", errmsg);
+		free(errmsg);
+	}
+	timeTraceEnd();
+}
+
+// The target machine and its data layout, created once and shared by every compile
+static LLVMTargetMachineRef genlMachine = NULL;
+static LLVMTargetDataRef genlDataLayout = NULL;
 
-	LLVMTargetMachineRef machine = genlCreateMachine(opt);
-	if (!machine)
+// Create the target machine for all compiles to use
+void genlSetup(ConeOptions *opt) {
+	genlInitTargets(opt->triple);
+	if (!(genlMachine = genlCreateMachine(opt)))
 		exit(ExitOpts);
 
 	// Obtain data layout info, particularly pointer sizes
-	gen.datalayout = LLVMCreateTargetDataLayout(machine);
-	opt->ptrsize = LLVMPointerSize(gen.datalayout) << 3;
+	genlDataLayout = LLVMCreateTargetDataLayout(genlMachine);
+	opt->ptrsize = LLVMPointerSize(genlDataLayout) << 3;
 	usizeType->bits = isizeType->bits = opt->ptrsize;
 
+	genlFmvSetup(opt);
+	genlCguSetup(opt);
+	if (opt->profuse)
+		genlProfLoad(opt->profuse);
+}
+
+// Optimize and emit the whole program, once all its packages are compiled (--lto)
+void genlLinkProgram(ConeOptions *opt) {
+	genlLtoFinish(opt, genlMachine);
+}
+
+// Dispose of the target machine, once all compiles are done
+void genlClose() {
+	if (genlDataLayout)
+		LLVMDisposeTargetData(genlDataLayout);
+	if (genlMachine)
+		LLVMDisposeTargetMachine(genlMachine);
+	genlDataLayout = NULL;
+	genlMachine = NULL;
+}
+
+// Generate AST into LLVM IR using LLVM
+void genllvm(ConeOptions *opt, ModuleAstNode *mod) {
+	char *err;
+	char *objpath;
+	char *cachekey = NULL;
+	GenState gen;
+
+	if (!genlMachine)
+		genlSetup(opt);
+	gen.opt = opt;
+	gen.datalayout = genlDataLayout;
+
 	gen.srcname = mod->lexer->fname;
 	gen.context = LLVMGetGlobalContext(); // LLVM inlining bugs prevent use of LLVMContextCreate();
 
@@ -272,16 +756,52 @@ void genllvm(ConeOptions *opt, ModuleAstNode *mod) {
 		LLVMDisposeMessage(err);
 	}
 
+	// With link-time optimization, the whole program is optimized and emitted together
+	if (opt->lto) {
+		genlLtoLink(gen.module, gen.srcname);
+		return;
+	}
+
+	// Emit bitcode, for the program's link-time optimization
+	if (opt->bitcode) {
+		genlGlobalDce(&gen, opt, genlMachine);
+		genlBitcode(&gen, opt, genlMachine, fileMakePath(opt->output, mod->lexer->fname, "bc"));
+		LLVMDisposeModule(gen.module);
+		return;
+	}
+
+	// Run the program in-process, instead of emitting it
+	if (opt->run) {
+		genlGlobalDce(&gen, opt, genlMachine);
+		genlOptimize(&gen, opt, genlMachine);
+		genlJitRun(&gen, opt);
+		return;
+	}
+
+	// Reuse the object from the cache, when the same IR has been compiled before.
+	// Asking for the optimized IR or assembly requires doing the work.
+	objpath = fileMakePath(opt->output, mod->lexer->fname, opt->wasm? "wasm" : objext);
+	if (opt->cachedir && !errors && !opt->print_llvmir && !opt->print_asm) {
+		cachekey = genlCacheKey(gen.module, opt);
+		if (genlCacheFetch(opt, cachekey, objpath)) {
+			LLVMDisposeModule(gen.module);
+			return;
+		}
+	}
+
+	genlGlobalDce(&gen, opt, genlMachine);
+
+	// Optimize and emit in parallel codegen units, if requested
+	if (opt->codegen_units > 1 && !opt->wasm) {
+		genlCodegenUnits(&gen, opt, genlMachine, objpath);
+		LLVMDisposeModule(gen.module);
+		if (cachekey && !errors)
+			genlCacheStore(opt, cachekey, objpath);
+		return;
+	}
+
 	// Optimize the generated LLVM IR
-	LLVMPassManagerRef passmgr = LLVMCreatePassManager();
-	LLVMAddPromoteMemoryToRegisterPass(passmgr);	// Promote allocas to registers.
-	LLVMAddInstructionCombiningPass(passmgr);		// Do simple "peephole" and bit-twiddling optimizations
-	LLVMAddReassociatePass(passmgr);				// Reassociate expressions.
-	LLVMAddGVNPass(passmgr);						// Eliminate common subexpressions.
-	LLVMAddCFGSimplificationPass(passmgr);			// Simplify the control flow graph
-	LLVMAddFunctionInliningPass(passmgr);			// Function inlining
-	LLVMRunPassManager(passmgr, gen.module);
-	LLVMDisposePassManager(passmgr);
+	genlOptimize(&gen, opt, genlMachine);
 
 	// Serialize the LLVM IR, if requested
 	if (opt->print_llvmir && LLVMPrintModuleToFile(gen.module, fileMakePath(opt->output, mod->lexer->fname, "ir"), &err) != 0) {
@@ -290,12 +810,12 @@ void genllvm(ConeOptions *opt, ModuleAstNode *mod) {
 	}
 
 	// Transform IR to target's ASM and OBJ
-	if (machine)
-		genlOut(fileMakePath(opt->output, mod->lexer->fname, opt->wasm? "wasm" : objext),
-			opt->print_asm? fileMakePath(opt->output, mod->lexer->fname, opt->wasm? "wat" : asmext) : NULL,
-			gen.module, opt->triple, machine);
+	genlOut(objpath,
+		opt->print_asm? fileMakePath(opt->output, mod->lexer->fname, opt->wasm? "wat" : asmext) : NULL,
+		gen.module, opt->triple, genlMachine);
+	if (cachekey && !errors)
+		genlCacheStore(opt, cachekey, objpath);
 
 	LLVMDisposeModule(gen.module);
 	// LLVMContextDispose(gen.context);  // Only need if we created a new context
-	LLVMDisposeTargetMachine(machine);
 }
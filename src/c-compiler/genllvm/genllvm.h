@@ -13,8 +13,20 @@
 
 #include <llvm-c/Core.h>
 #include <llvm-c/ExecutionEngine.h>
+#include <llvm-c/TargetMachine.h>
+
+// Number of distinct scalar kinds given TBAA access tags
+#define GenlTbaaTags 8
+
+// A pooled string literal, and the constant pointer to its global
+typedef struct GenlStrLit {
+	char *str;
+	size_t hash;
+	LLVMValueRef ptr;
+} GenlStrLit;
 
 typedef struct GenState {
+	ConeOptions *opt;
 	LLVMTargetDataRef datalayout;
 	LLVMContextRef context;
 	LLVMModuleRef module;
@@ -22,20 +34,105 @@ typedef struct GenState {
 	LLVMBuilderRef builder;
 	LLVMBasicBlockRef whilebeg;
 	LLVMBasicBlockRef whileend;
+	int fnloops;		// The function being generated has a loop
+	int fastmath;		// Its float ops may be reassociated, etc. (--fast-math or @fastmath)
+	int fpcontract;		// Its float a*b+c may be fused (--fp-contract, or fast math)
+
+	GenlStrLit *strlits;	// Module's string literal pool (open addressing, power of 2)
+	size_t strlitsAvail;
+	size_t strlitsUsed;
+
+	LLVMValueRef tbaaroot;		// Module's TBAA type tree root
+	LLVMValueRef tbaatags[GenlTbaaTags];	// Access tags, by genlTbaaIndex
+
+	uint32_t profnext;			// Function's next counter number (PGO)
+	LLVMValueRef *profslots;	// Function's counter placeholders, or branches (--profile-use)
+	uint32_t profslotsAvail;
+	LLVMValueRef *profrecs;		// Module's table of function counters (--profile-generate)
+	uint32_t profrecsUsed;
+	uint32_t profrecsAvail;
+
+	LLVMValueRef *ctors;		// Module's static constructors (see genlAddCtor)
+	uint32_t ctorsUsed;
+	uint32_t ctorsAvail;
 
 	char *srcname;
 } GenState;
 
+void genlSetup(ConeOptions *opt);
+void genlClose();
+void genlLinkProgram(ConeOptions *opt);
+int genlInExports(char *exports, char *name);
+void genlOut(char *objpath, char *asmpath, LLVMModuleRef mod, char *triple, LLVMTargetMachineRef machine);
 void genllvm(ConeOptions *opt, ModuleAstNode *mod);
+int genlIsPic(ConeOptions *opt);
+LLVMTargetMachineRef genlCreateMachine(ConeOptions *opt);
+// Which part of the optimization pipeline genlRunPasses runs
+enum GenlPassPhase {
+	GenlPassDefault,	// Everything, for a package emitted as an object
+	GenlPassPreLink,	// For a package emitted as bitcode, to be link-time optimized
+	GenlPassLto			// For the whole program, linked together as one module
+};
+char *genlRunPasses(LLVMModuleRef module, ConeOptions *opt, LLVMTargetMachineRef machine, int phase);
+int genlFnBody(GenState *gen, NameDclAstNode *fnnode, LLVMValueRef fn);
 void genlFn(GenState *gen, NameDclAstNode *fnnode);
+void genlAddCtor(GenState *gen, LLVMValueRef fn);
 void genlGloVarName(GenState *gen, NameDclAstNode *glovar);
 
 // genlstmt.c
 LLVMBasicBlockRef genlInsertBlock(GenState *gen, char *name);
+void genlLoopHints(GenState *gen, LLVMValueRef latch, LLVMValueRef *hints, unsigned nhints);
 LLVMValueRef genlBlock(GenState *gen, BlockAstNode *blk);
 
+// genlcache.c
+size_t genlCacheHits;		// Objects reused from the object file cache
+size_t genlCacheMisses;		// Objects not found in the cache
+size_t genlCacheEvictions;	// Objects evicted to keep the cache within its size limit
+char *genlCacheKey(LLVMModuleRef module, ConeOptions *opt);
+int genlCacheFetch(ConeOptions *opt, char *key, char *objpath);
+void genlCacheStore(ConeOptions *opt, char *key, char *objpath);
+
+// genljit.c
+int genlRunResult;	// Result returned by the program's entry function (--run)
+void genlJitRun(GenState *gen, ConeOptions *opt);
+
+// genllto.c
+void genlBitcode(GenState *gen, ConeOptions *opt, LLVMTargetMachineRef machine, char *bcpath);
+void genlLtoLink(LLVMModuleRef module, char *name);
+void genlLtoAddBitcode(char *path);
+void genlLtoFinish(ConeOptions *opt, LLVMTargetMachineRef machine);
+
+// genlprof.c
+void genlProfLoad(char *path);
+void genlProfFnBegin(GenState *gen, char *name);
+void genlProfFnEnd(GenState *gen, char *name);
+LLVMValueRef genlProfCondBr(GenState *gen, LLVMValueRef cond, LLVMBasicBlockRef thenblk, LLVMBasicBlockRef elseblk);
+void genlProfModule(GenState *gen);
+
+// genlfmv.c
+void genlFmvSetup(ConeOptions *opt);
+int genlFmvWanted(GenState *gen, int fnloops);
+void genlFmv(GenState *gen, NameDclAstNode *fnnode);
+
+// genlcgu.c
+void genlCguSetup(ConeOptions *opt);
+void genlCodegenUnits(GenState *gen, ConeOptions *opt, LLVMTargetMachineRef machine, char *objpath);
+
+// genlvector.c
+LLVMValueRef genlSplat(GenState *gen, LLVMValueRef val, uint32_t lanes);
+LLVMValueRef genlVectorOp(GenState *gen, int16_t opcode, VectorAstNode *vectype, LLVMValueRef *args);
+
 // genlexpr.c
+size_t genlTypeCount;	// Number of LLVM types built from type nodes
 LLVMTypeRef genlType(GenState *gen, AstNode *typ);
+LLVMValueRef genlIntrinsic(GenState *gen, char *name, LLVMValueRef *args, unsigned nargs);
+LLVMValueRef genlStrLit(GenState *gen, char *strlit);
+int genlIsSsaVar(NameDclAstNode *var);
+int genlIsThruRef(AstNode *lval);
+LLVMValueRef genlArrayLen(GenState *gen, AstNode *owner);
+LLVMValueRef genlArrayElems(GenState *gen, AstNode *owner, LLVMValueRef *len);
+void genlTbaa(GenState *gen, LLVMValueRef access, LLVMTypeRef type);
+LLVMValueRef genlFastMath(GenState *gen, LLVMValueRef inst);
 LLVMValueRef genlExpr(GenState *gen, AstNode *termnode);
 
 #endif
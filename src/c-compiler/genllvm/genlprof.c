@@ -0,0 +1,379 @@
+/** Profile-guided optimization
+ * @file
+ *
+ * With --profile-generate, every function counts how often it is entered, and
+ * every conditional branch (if, while, and, or) counts which way it goes.
+ * Each function's counters are a private array, and each module registers a
+ * table of them with the conestd runtime (coneProfRegister) as the program starts.
+ * The runtime adds them to the profile file (default.profraw) as the program exits.
+ *
+ * With --profile-use=file, the same counters are numbered the same way as the
+ * code is generated, but their counts are read from the profile. They become
+ * function entry counts and branch weights, and the profile's summary becomes
+ * the module's ProfileSummary. So LLVM's block placement, inlining and hot/cold
+ * splitting follow what the program actually did.
+ *
+ * A function's counts are found by its name and its number of counters, which is
+ * only known once it is generated. So its branches are weighted once it is done.
+ * A function whose counters no longer match its code is compiled without its profile.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "../shared/error.h"
+#include "../shared/memory.h"
+#include "../coneopts.h"
+#include "genllvm.h"
+
+#include <llvm/Config/llvm-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A function's counts, as read from the profile
+typedef struct GenlProfFn {
+	char *name;
+	uint64_t *counts;
+	uint32_t ncounts;
+} GenlProfFn;
+
+static GenlProfFn *genlProfFns = NULL;
+static uint32_t genlProfFnsUsed = 0;
+
+// The profile's summary, as LLVM's ProfileSummaryInfo expects it
+#define GenlProfCutoffs 16
+static uint32_t genlProfCutoff[GenlProfCutoffs] = { 10000, 100000, 200000, 300000, 400000, 500000,
+	600000, 700000, 800000, 900000, 950000, 990000, 999000, 999900, 999990, 999999 };
+static uint64_t genlProfCutoffMin[GenlProfCutoffs];
+static uint64_t genlProfCutoffNum[GenlProfCutoffs];
+static uint64_t genlProfTotal, genlProfMax, genlProfMaxInternal, genlProfMaxFn, genlProfNumCounts;
+
+// Order profiled functions by name, then number of counters
+static int genlProfFnCmp(const void *a, const void *b) {
+	GenlProfFn *fa = (GenlProfFn *)a, *fb = (GenlProfFn *)b;
+	int cmp = strcmp(fa->name, fb->name);
+	if (cmp != 0)
+		return cmp;
+	return fa->ncounts < fb->ncounts ? -1 : fa->ncounts > fb->ncounts ? 1 : 0;
+}
+
+// Compare profiled functions by name only
+static int genlProfNameCmp(const void *a, const void *b) {
+	return strcmp(((GenlProfFn *)a)->name, ((GenlProfFn *)b)->name);
+}
+
+// Order counts, largest first
+static int genlProfCountCmp(const void *a, const void *b) {
+	uint64_t ca = *(uint64_t *)a, cb = *(uint64_t *)b;
+	return ca > cb ? -1 : ca < cb ? 1 : 0;
+}
+
+// Read one line's function name (up to the tab). Return NULL at end of file.
+static char *genlProfReadName(FILE *file) {
+	char buf[2048];
+	size_t len = 0;
+	int c;
+	while ((c = getc(file)) != EOF && c != '\t' && c != '\n') {
+		if (len + 1 < sizeof(buf))
+			buf[len++] = (char)c;
+	}
+	if (c != '\t')
+		return NULL;
+	return memAllocStr(buf, len);
+}
+
+// Summarize the profile's counts: their total, maximums and, for each cutoff
+// (in millionths of the total), the smallest count among the largest counts making it up
+static void genlProfSummarize() {
+	uint64_t *all, sum = 0;
+	uint32_t f, i, cut = 0;
+	size_t n = 0;
+
+	genlProfTotal = genlProfMax = genlProfMaxInternal = genlProfMaxFn = genlProfNumCounts = 0;
+	for (f = 0; f < genlProfFnsUsed; f++)
+		genlProfNumCounts += genlProfFns[f].ncounts;
+	all = (uint64_t *)memAllocBlk((genlProfNumCounts + 1) * sizeof(uint64_t));
+	for (f = 0; f < genlProfFnsUsed; f++) {
+		for (i = 0; i < genlProfFns[f].ncounts; i++) {
+			uint64_t count = genlProfFns[f].counts[i];
+			all[n++] = count;
+			genlProfTotal += count;
+			if (i == 0 && count > genlProfMaxFn)
+				genlProfMaxFn = count;
+			if (i > 0 && count > genlProfMaxInternal)
+				genlProfMaxInternal = count;
+		}
+	}
+	genlProfMax = genlProfMaxFn > genlProfMaxInternal ? genlProfMaxFn : genlProfMaxInternal;
+
+	qsort(all, n, sizeof(uint64_t), genlProfCountCmp);
+	for (i = 0; i < n && cut < GenlProfCutoffs; i++) {
+		sum += all[i];
+		while (cut < GenlProfCutoffs && (double)sum >= (double)genlProfTotal * genlProfCutoff[cut] / 1000000.0) {
+			genlProfCutoffMin[cut] = all[i];
+			genlProfCutoffNum[cut++] = i + 1;
+		}
+	}
+	for (; cut < GenlProfCutoffs; cut++) {
+		genlProfCutoffMin[cut] = n ? all[n - 1] : 0;
+		genlProfCutoffNum[cut] = n;
+	}
+}
+
+// Load the profile written by a program compiled with --profile-generate
+void genlProfLoad(char *path) {
+	uint32_t avail = 256, ncounts, i;
+	FILE *file;
+	char *name;
+	int c;
+
+	if (!(file = fopen(path, "r")))
+		errorExit(ExitNF, "Error: Cannot read profile file %s", path);
+	genlProfFns = (GenlProfFn *)memAllocBlk(avail * sizeof(GenlProfFn));
+	while ((name = genlProfReadName(file)) && fscanf(file, "%u", &ncounts) == 1) {
+		GenlProfFn *fn;
+		if (genlProfFnsUsed >= avail) {
+			GenlProfFn *fns = (GenlProfFn *)memAllocBlk((avail << 1) * sizeof(GenlProfFn));
+			memcpy(fns, genlProfFns, avail * sizeof(GenlProfFn));
+			genlProfFns = fns;
+			avail <<= 1;
+		}
+		fn = &genlProfFns[genlProfFnsUsed++];
+		fn->name = name;
+		fn->ncounts = ncounts;
+		fn->counts = (uint64_t *)memAllocBlk((ncounts + 1) * sizeof(uint64_t));
+		for (i = 0; i < ncounts; i++) {
+			unsigned long long count = 0;
+			if (fscanf(file, "%llu", &count) != 1)
+				fn->ncounts = 0;
+			fn->counts[i] = count;
+		}
+		while ((c = getc(file)) != '\n' && c != EOF)
+			;
+	}
+	fclose(file);
+	qsort(genlProfFns, genlProfFnsUsed, sizeof(GenlProfFn), genlProfFnCmp);
+	genlProfSummarize();
+}
+
+// Find a function's counts in the profile, by its name and number of counters
+// (or, if ncounts is 0, whether the profile has counts for any function of that name)
+static GenlProfFn *genlProfFind(char *name, uint32_t ncounts) {
+	GenlProfFn key;
+	if (!genlProfFns)
+		return NULL;
+	key.name = name;
+	key.ncounts = ncounts;
+	return (GenlProfFn *)bsearch(&key, genlProfFns, genlProfFnsUsed, sizeof(GenlProfFn),
+		ncounts ? genlProfFnCmp : genlProfNameCmp);
+}
+
+// Return a metadata node of a name followed by integer values
+static LLVMValueRef genlProfMd(GenState *gen, char *name, LLVMTypeRef type, uint64_t *vals, unsigned nvals) {
+	LLVMValueRef mds[4];
+	unsigned i;
+	mds[0] = LLVMMDStringInContext(gen->context, name, strlen(name));
+	for (i = 0; i < nvals; i++)
+		mds[i + 1] = LLVMConstInt(type, vals[i], 0);
+	return LLVMMDNodeInContext(gen->context, mds, nvals + 1);
+}
+
+// Add one to a counter
+static void genlProfIncr(GenState *gen, LLVMValueRef counter) {
+	LLVMValueRef count = LLVMBuildLoad(gen->builder, counter, "profcount");
+	count = LLVMBuildAdd(gen->builder, count, LLVMConstInt(LLVMInt64TypeInContext(gen->context), 1, 0), "profcount");
+	LLVMBuildStore(gen->builder, count, counter);
+}
+
+// Remember the function's next counter: a placeholder for it (--profile-generate),
+// or the branch it counts (--profile-use). Only once the function is generated
+// do we know how big its counter array is, and which of the profile's counts are its.
+static LLVMValueRef genlProfSlot(GenState *gen, LLVMValueRef slot) {
+	if (gen->profnext >= gen->profslotsAvail) {
+		LLVMValueRef *slots = (LLVMValueRef *)memAllocBlk((gen->profslotsAvail << 1) * sizeof(LLVMValueRef));
+		memcpy(slots, gen->profslots, gen->profslotsAvail * sizeof(LLVMValueRef));
+		gen->profslots = slots;
+		gen->profslotsAvail <<= 1;
+	}
+	return gen->profslots[gen->profnext++] = slot;
+}
+
+// Count the function's entry
+void genlProfFnBegin(GenState *gen, char *name) {
+	gen->profnext = 0;
+	if (!gen->opt->profgen && !gen->opt->profuse)
+		return;
+	if (!gen->profslots) {
+		gen->profslotsAvail = 64;
+		gen->profslots = (LLVMValueRef *)memAllocBlk(gen->profslotsAvail * sizeof(LLVMValueRef));
+	}
+	if (gen->opt->profgen)
+		genlProfIncr(gen, genlProfSlot(gen, LLVMAddGlobal(gen->module, LLVMInt64TypeInContext(gen->context), "profslot")));
+	else
+		genlProfSlot(gen, NULL);
+}
+
+// Give the function its entry count and its branches' weights from the profile.
+// A function's versions (see genlfmv.c) all share its name's counts.
+static void genlProfUse(GenState *gen, char *name) {
+	GenlProfFn *fn = genlProfFind(name, gen->profnext);
+	uint64_t weights[2], scale;
+	uint32_t i;
+
+	if (!fn) {
+		if (genlProfFind(name, 0))
+			errorMsg(WarnProfile, "Profile for %s does not match its code and was ignored", name);
+		return;
+	}
+#if LLVM_VERSION_MAJOR >= 8
+	LLVMGlobalSetMetadata(gen->fn, LLVMGetMDKindIDInContext(gen->context, "prof", 4),
+		LLVMValueAsMetadata(genlProfMd(gen, "function_entry_count", LLVMInt64TypeInContext(gen->context), fn->counts, 1)));
+#endif
+
+	// Branch weights are 32-bit, so scale large counts down (as clang does)
+	for (i = 1; i + 1 < fn->ncounts; i += 2) {
+		weights[0] = fn->counts[i];
+		weights[1] = fn->counts[i + 1];
+		scale = (weights[0] > weights[1] ? weights[0] : weights[1]) / UINT32_MAX + 1;
+		weights[0] = weights[0] / scale + 1;
+		weights[1] = weights[1] / scale + 1;
+		LLVMSetMetadata(gen->profslots[i], LLVMGetMDKindIDInContext(gen->context, "prof", 4),
+			genlProfMd(gen, "branch_weights", LLVMInt32TypeInContext(gen->context), weights, 2));
+	}
+}
+
+// Finish the function's counters: allocate its counter array,
+// point the placeholders at their elements, and add it to the module's table
+void genlProfFnEnd(GenState *gen, char *name) {
+	LLVMTypeRef i64type = LLVMInt64TypeInContext(gen->context);
+	LLVMValueRef counters, idx[2], rec[3];
+	uint32_t i;
+
+	if (!gen->opt->profgen) {
+		if (gen->opt->profuse)
+			genlProfUse(gen, name);
+		return;
+	}
+
+	counters = LLVMAddGlobal(gen->module, LLVMArrayType(i64type, gen->profnext), "profcounts");
+	LLVMSetLinkage(counters, LLVMPrivateLinkage);
+	LLVMSetInitializer(counters, LLVMConstNull(LLVMArrayType(i64type, gen->profnext)));
+	idx[0] = LLVMConstInt(LLVMInt32TypeInContext(gen->context), 0, 0);
+	for (i = 0; i < gen->profnext; i++) {
+		idx[1] = LLVMConstInt(LLVMInt32TypeInContext(gen->context), i, 0);
+		LLVMReplaceAllUsesWith(gen->profslots[i], LLVMConstInBoundsGEP(counters, idx, 2));
+		LLVMDeleteGlobal(gen->profslots[i]);
+	}
+
+	idx[1] = idx[0];
+	rec[0] = genlStrLit(gen, name);
+	rec[1] = LLVMConstInBoundsGEP(counters, idx, 2);
+	rec[2] = LLVMConstInt(LLVMInt32TypeInContext(gen->context), gen->profnext, 0);
+	if (gen->profrecsUsed >= gen->profrecsAvail) {
+		LLVMValueRef *recs;
+		gen->profrecsAvail = gen->profrecsAvail ? gen->profrecsAvail << 1 : 64;
+		recs = (LLVMValueRef *)memAllocBlk(gen->profrecsAvail * sizeof(LLVMValueRef));
+		if (gen->profrecsUsed)
+			memcpy(recs, gen->profrecs, gen->profrecsUsed * sizeof(LLVMValueRef));
+		gen->profrecs = recs;
+	}
+	gen->profrecs[gen->profrecsUsed++] = LLVMConstStructInContext(gen->context, rec, 3, 0);
+}
+
+// Generate a conditional branch, counting which way it goes
+// or (once the function is done) weighting its ways by how often the profile says each was taken
+LLVMValueRef genlProfCondBr(GenState *gen, LLVMValueRef cond, LLVMBasicBlockRef thenblk, LLVMBasicBlockRef elseblk) {
+	LLVMTypeRef i64type = LLVMInt64TypeInContext(gen->context);
+	LLVMValueRef br;
+
+	if (gen->opt->profgen) {
+		LLVMValueRef taken = genlProfSlot(gen, LLVMAddGlobal(gen->module, i64type, "profslot"));
+		LLVMValueRef nottaken = genlProfSlot(gen, LLVMAddGlobal(gen->module, i64type, "profslot"));
+		genlProfIncr(gen, LLVMBuildSelect(gen->builder, cond, taken, nottaken, "profslot"));
+		return LLVMBuildCondBr(gen->builder, cond, thenblk, elseblk);
+	}
+
+	br = LLVMBuildCondBr(gen->builder, cond, thenblk, elseblk);
+	if (gen->opt->profuse) {
+		genlProfSlot(gen, br);
+		genlProfSlot(gen, NULL);
+	}
+	return br;
+}
+
+// Register the module's counter table with the runtime as the program starts
+static void genlProfRegister(GenState *gen) {
+	LLVMTypeRef rectype = LLVMTypeOf(gen->profrecs[0]);
+	LLVMTypeRef i32type = LLVMInt32TypeInContext(gen->context);
+	LLVMTypeRef voidtype = LLVMVoidTypeInContext(gen->context);
+	LLVMTypeRef parmtypes[2];
+	LLVMValueRef table, regfn, initfn, args[2], idx[2];
+	LLVMBuilderRef builder;
+
+	table = LLVMAddGlobal(gen->module, LLVMArrayType(rectype, gen->profrecsUsed), "proftable");
+	LLVMSetLinkage(table, LLVMPrivateLinkage);
+	LLVMSetInitializer(table, LLVMConstArray(rectype, gen->profrecs, gen->profrecsUsed));
+
+	parmtypes[0] = LLVMPointerType(rectype, 0);
+	parmtypes[1] = i32type;
+	if (!(regfn = LLVMGetNamedFunction(gen->module, "coneProfRegister")))
+		regfn = LLVMAddFunction(gen->module, "coneProfRegister", LLVMFunctionType(voidtype, parmtypes, 2, 0));
+	initfn = LLVMAddFunction(gen->module, "coneProfInit", LLVMFunctionType(voidtype, NULL, 0, 0));
+	LLVMSetLinkage(initfn, LLVMInternalLinkage);
+	builder = LLVMCreateBuilderInContext(gen->context);
+	LLVMPositionBuilderAtEnd(builder, LLVMAppendBasicBlockInContext(gen->context, initfn, "entry"));
+	idx[0] = idx[1] = LLVMConstInt(i32type, 0, 0);
+	args[0] = LLVMConstInBoundsGEP(table, idx, 2);
+	args[1] = LLVMConstInt(i32type, gen->profrecsUsed, 0);
+	LLVMBuildCall(builder, regfn, args, 2, "");
+	LLVMBuildRetVoid(builder);
+	LLVMDisposeBuilder(builder);
+
+	// Run it as a static constructor
+	genlAddCtor(gen, initfn);
+}
+
+// Give the module the profile's summary, so LLVM can tell hot code from cold
+static void genlProfSummary(GenState *gen) {
+#if LLVM_VERSION_MAJOR >= 8
+	LLVMTypeRef i32type = LLVMInt32TypeInContext(gen->context);
+	LLVMTypeRef i64type = LLVMInt64TypeInContext(gen->context);
+	LLVMValueRef fields[8], cutoffs[GenlProfCutoffs], entry[3], mds[2];
+	uint32_t i;
+
+	mds[0] = LLVMMDStringInContext(gen->context, "ProfileFormat", 13);
+	mds[1] = LLVMMDStringInContext(gen->context, "InstrProf", 9);
+	fields[0] = LLVMMDNodeInContext(gen->context, mds, 2);
+	fields[1] = genlProfMd(gen, "TotalCount", i64type, &genlProfTotal, 1);
+	fields[2] = genlProfMd(gen, "MaxCount", i64type, &genlProfMax, 1);
+	fields[3] = genlProfMd(gen, "MaxInternalCount", i64type, &genlProfMaxInternal, 1);
+	fields[4] = genlProfMd(gen, "MaxFunctionCount", i64type, &genlProfMaxFn, 1);
+	fields[5] = genlProfMd(gen, "NumCounts", i64type, &genlProfNumCounts, 1);
+	{
+		uint64_t nfns = genlProfFnsUsed;
+		fields[6] = genlProfMd(gen, "NumFunctions", i64type, &nfns, 1);
+	}
+	for (i = 0; i < GenlProfCutoffs; i++) {
+		entry[0] = LLVMConstInt(i32type, genlProfCutoff[i], 0);
+		entry[1] = LLVMConstInt(i64type, genlProfCutoffMin[i], 0);
+		entry[2] = LLVMConstInt(i32type, genlProfCutoffNum[i], 0);
+		cutoffs[i] = LLVMMDNodeInContext(gen->context, entry, 3);
+	}
+	mds[0] = LLVMMDStringInContext(gen->context, "DetailedSummary", 15);
+	mds[1] = LLVMMDNodeInContext(gen->context, cutoffs, GenlProfCutoffs);
+	fields[7] = LLVMMDNodeInContext(gen->context, mds, 2);
+	LLVMAddModuleFlag(gen->module, LLVMModuleFlagBehaviorError, "ProfileSummary", 14,
+		LLVMValueAsMetadata(LLVMMDNodeInContext(gen->context, fields, 8)));
+#endif
+}
+
+// Finish the module's profiling: register its counters, or summarize the profile it uses
+void genlProfModule(GenState *gen) {
+	if (gen->opt->profgen && gen->profrecsUsed)
+		genlProfRegister(gen);
+	else if (gen->opt->profuse && genlProfFns)
+		genlProfSummary(gen);
+}
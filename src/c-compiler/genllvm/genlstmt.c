@@ -13,13 +13,16 @@
 #include "../shared/fileio.h"
 #include "genllvm.h"
 
+#include <llvm/Config/llvm-config.h>
 #include <llvm-c/ExecutionEngine.h>
+#include <llvm-c/DebugInfo.h>
 #include <llvm-c/Target.h>
 #include <llvm-c/Analysis.h>
 #include <llvm-c/BitWriter.h>
 #include <llvm-c/Transforms/Scalar.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 // Create a new basic block after the current one
@@ -32,26 +35,266 @@ LLVMBasicBlockRef genlInsertBlock(GenState *gen, char *name) {
 
 }
 
-// Generate a while block
-void genlWhile(GenState *gen, WhileAstNode *wnode) {
-	LLVMBasicBlockRef whilebeg, whileblk, whileend;
-	LLVMBasicBlockRef svwhilebeg, svwhileend;
+// Attach loop hints (e.g., !{!"llvm.loop.vectorize.enable", i1 true}) to a loop's latch branch.
+// They are gathered into the loop's self-referencing llvm.loop metadata node.
+void genlLoopHints(GenState *gen, LLVMValueRef latch, LLVMValueRef *hints, unsigned nhints) {
+#if LLVM_VERSION_MAJOR >= 9
+	LLVMMetadataRef mds[8];
+	LLVMMetadataRef loopid;
+	unsigned i;
 
-	// Push and pop for break and continue statements
-	svwhilebeg = gen->whilebeg;
-	svwhileend = gen->whileend;
+	mds[0] = LLVMTemporaryMDNode(gen->context, NULL, 0);
+	for (i = 0; i < nhints && i < 7; i++)
+		mds[i + 1] = LLVMValueAsMetadata(hints[i]);
+	loopid = LLVMMDNodeInContext2(gen->context, mds, i + 1);
+	LLVMMetadataReplaceAllUsesWith(mds[0], loopid);
+	LLVMSetMetadata(latch, LLVMGetMDKindIDInContext(gen->context, "llvm.loop", 9), LLVMMetadataAsValue(gen->context, loopid));
+#endif
+}
+
+// Build one loop hint: !{!"name", value}, where the value may be omitted
+static LLVMValueRef genlLoopHint(GenState *gen, char *name, LLVMValueRef val) {
+	LLVMValueRef hint[2];
+	hint[0] = LLVMMDStringInContext(gen->context, name, strlen(name));
+	hint[1] = val;
+	return LLVMMDNodeInContext(gen->context, hint, val ? 2 : 1);
+}
+
+// Attach a loop's vectorize and unroll hints (from its attributes) to its latch branch
+static void genlLoopHintsMd(GenState *gen, LLVMValueRef latch, LoopHints *hints) {
+	LLVMTypeRef i1 = LLVMInt1TypeInContext(gen->context);
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(gen->context);
+	LLVMValueRef mds[4];
+	unsigned nmds = 0;
+	int vectorize = hints->vectorize;
+
+#if LLVM_VERSION_MAJOR < 18
+	// Without fast math flags on its float ops, only an explicit hint
+	// lets the vectorizer reorder a fast math loop's float reductions
+	if (gen->fastmath && vectorize == 0)
+		vectorize = 1;
+#endif
+
+	if (vectorize)
+		mds[nmds++] = genlLoopHint(gen, "llvm.loop.vectorize.enable", LLVMConstInt(i1, vectorize > 0, 0));
+	if (vectorize > 1)
+		mds[nmds++] = genlLoopHint(gen, "llvm.loop.vectorize.width", LLVMConstInt(i32, vectorize, 0));
+	if (hints->unroll < 0)
+		mds[nmds++] = genlLoopHint(gen, "llvm.loop.unroll.disable", NULL);
+	else if (hints->unroll == 1)
+		mds[nmds++] = genlLoopHint(gen, "llvm.loop.unroll.enable", NULL);
+	else if (hints->unroll > 1)
+		mds[nmds++] = genlLoopHint(gen, "llvm.loop.unroll.count", LLVMConstInt(i32, hints->unroll, 0));
+	if (nmds)
+		genlLoopHints(gen, latch, mds, nmds);
+}
+
+// Generate whether all of a loop's guarded indexes (see range analysis) are in bounds:
+// whether its bound is no more than each of their arrays' lengths
+static LLVMValueRef genlGuardsHold(GenState *gen, AstNode *boundexp, Nodes *guards) {
+	LLVMValueRef bound, inbounds = NULL;
+	AstNode **nodesp;
+	uint32_t cnt;
+
+	bound = genlExpr(gen, boundexp);
+	for (nodesFor(guards, cnt, nodesp)) {
+		LLVMValueRef fits = LLVMBuildICmp(gen->builder, LLVMIntULE, bound, genlArrayLen(gen, ((ElementAstNode *)*nodesp)->owner), "");
+		inbounds = inbounds ? LLVMBuildAnd(gen->builder, inbounds, fits, "") : fits;
+	}
+	return inbounds;
+}
+
+// Hints for the checked copy of a guarded loop. It only runs when some index might be
+// out of bounds, and its checks keep it from being vectorized anyway.
+static LoopHints genlCheckedHints(LoopHints *hints) {
+	LoopHints checked = *hints;
+	checked.vectorize = -1;
+	return checked;
+}
+
+// Mark a loop's guarded indexes as in bounds, for generating its guarded copy.
+// Only mark those not already in bounds, as an outer loop's copy may have marked some.
+static char *genlGuardsMark(Nodes *guards) {
+	AstNode **nodesp;
+	uint32_t cnt, i;
+	char *marked = (char *)memAllocBlk(guards->used);
+	for (i = 0, nodesFor(guards, cnt, nodesp), i++) {
+		if ((marked[i] = !((*nodesp)->flags & FlagInBounds)))
+			(*nodesp)->flags |= FlagInBounds;
+	}
+	return marked;
+}
+
+// Unmark the guarded indexes that genlGuardsMark marked
+static void genlGuardsUnmark(Nodes *guards, char *marked) {
+	AstNode **nodesp;
+	uint32_t cnt, i;
+	for (i = 0, nodesFor(guards, cnt, nodesp), i++) {
+		if (marked[i])
+			(*nodesp)->flags &= ~FlagInBounds;
+	}
+}
+
+// Generate one copy of a while loop, which exits to whileend
+static void genlWhileLoop(GenState *gen, WhileAstNode *wnode, LoopHints *hints, LLVMBasicBlockRef whileend) {
+	LLVMBasicBlockRef whilebeg, whileblk;
+	LLVMValueRef latch;
 
-	gen->whileend = whileend = genlInsertBlock(gen, "whileend");
 	whileblk = genlInsertBlock(gen, "whileblk");
 	gen->whilebeg = whilebeg = genlInsertBlock(gen, "whilebeg");
 
 	LLVMBuildBr(gen->builder, whilebeg);
 	LLVMPositionBuilderAtEnd(gen->builder, whilebeg);
-	LLVMBuildCondBr(gen->builder, genlExpr(gen, wnode->condexp), whileblk, whileend);
+	genlProfCondBr(gen, genlExpr(gen, wnode->condexp), whileblk, whileend);
 	LLVMPositionBuilderAtEnd(gen->builder, whileblk);
 	genlBlock(gen, (BlockAstNode*)wnode->blk);
-	LLVMBuildBr(gen->builder, whilebeg);
-	LLVMPositionBuilderAtEnd(gen->builder, whileend);
+	latch = LLVMBuildBr(gen->builder, whilebeg);
+	genlLoopHintsMd(gen, latch, hints);
+}
+
+// Generate a while loop whose guarded indexes (see range analysis) are in bounds
+// when its bound is no more than each of their arrays' lengths.
+// If that holds when it starts, run a copy of the loop that skips their bounds checks.
+static void genlWhileGuarded(GenState *gen, WhileAstNode *wnode, LLVMBasicBlockRef whileend) {
+	LLVMBasicBlockRef fastblk, checkedblk;
+	LLVMValueRef inbounds;
+	LoopHints checked = genlCheckedHints(&wnode->hints);
+	char *marked;
+
+	inbounds = genlGuardsHold(gen, wnode->bound, wnode->guards);
+	checkedblk = genlInsertBlock(gen, "whilechecked");
+	fastblk = genlInsertBlock(gen, "whileguarded");
+	LLVMBuildCondBr(gen->builder, inbounds, fastblk, checkedblk);
+
+	LLVMPositionBuilderAtEnd(gen->builder, fastblk);
+	marked = genlGuardsMark(wnode->guards);
+	genlWhileLoop(gen, wnode, &wnode->hints, whileend);
+	genlGuardsUnmark(wnode->guards, marked);
+
+	LLVMPositionBuilderAtEnd(gen->builder, checkedblk);
+	genlWhileLoop(gen, wnode, &checked, whileend);
+}
+
+// Generate a while block
+void genlWhile(GenState *gen, WhileAstNode *wnode) {
+	LLVMBasicBlockRef svwhilebeg, svwhileend;
+
+	gen->fnloops = 1;
+
+	// Push and pop for break and continue statements
+	svwhilebeg = gen->whilebeg;
+	svwhileend = gen->whileend;
+
+	gen->whileend = genlInsertBlock(gen, "whileend");
+	if (wnode->guards)
+		genlWhileGuarded(gen, wnode, gen->whileend);
+	else
+		genlWhileLoop(gen, wnode, &wnode->hints, gen->whileend);
+	LLVMPositionBuilderAtEnd(gen->builder, gen->whileend);
+
+	gen->whilebeg = svwhilebeg;
+	gen->whileend = svwhileend;
+}
+
+// Generate one copy of a for loop, which exits to forend.
+// It counts from 'from' up to (but not including) 'to', with a single latch
+// that steps the counter and tests it, the canonical form the vectorizer expects.
+// Over an array, the counter indexes elems, and the loop variable is each element.
+static void genlForLoop(GenState *gen, ForAstNode *fnode, LLVMValueRef from, LLVMValueRef to,
+	LLVMValueRef elems, LoopHints *hints, LLVMBasicBlockRef forend) {
+	LLVMBasicBlockRef forblk, forlatch, entryblk;
+	LLVMValueRef counter, next, latch;
+	NameDclAstNode *var = fnode->var;
+	AstNode *vtype = typeGetVtype(elems ? (AstNode*)usizeType : var->vtype);
+	int issigned = vtype->asttype == IntNbrType;
+	Nodes *stmts = ((BlockAstNode*)fnode->blk)->stmts;
+	int16_t lastStmtAsttype;
+
+	forblk = genlInsertBlock(gen, "forblk");
+	forlatch = genlInsertBlock(gen, "forlatch");
+	entryblk = LLVMGetInsertBlock(gen->builder);
+	genlProfCondBr(gen, LLVMBuildICmp(gen->builder, issigned ? LLVMIntSLT : LLVMIntULT, from, to, ""), forblk, forend);
+
+	// Bind the loop variable to the counter, or to the element it indexes
+	LLVMPositionBuilderAtEnd(gen->builder, forblk);
+	counter = LLVMBuildPhi(gen->builder, LLVMTypeOf(from), "forcount");
+	if (elems) {
+		LLVMValueRef val = LLVMBuildLoad(gen->builder, LLVMBuildInBoundsGEP(gen->builder, elems, &counter, 1, ""), "");
+		if (typeGetVtype(fnode->to)->asttype == RefType)
+			genlTbaa(gen, val, LLVMTypeOf(val));
+		if (var->flags & FlagSsaVar)
+			var->llvmvar = val;
+		else
+			LLVMBuildStore(gen->builder, val, var->llvmvar);
+	}
+	else if (var->flags & FlagSsaVar)
+		var->llvmvar = counter;
+	else
+		LLVMBuildStore(gen->builder, counter, var->llvmvar);
+
+	gen->whilebeg = forlatch;
+	genlBlock(gen, (BlockAstNode*)fnode->blk);
+	lastStmtAsttype = stmts->used ? nodesLast(stmts)->asttype : BlockNode;
+	if (lastStmtAsttype != ReturnNode && lastStmtAsttype != BreakNode && lastStmtAsttype != ContinueNode)
+		LLVMBuildBr(gen->builder, forlatch);
+
+	// The counter cannot overflow, as it stays below 'to'
+	LLVMPositionBuilderAtEnd(gen->builder, forlatch);
+	next = issigned ? LLVMBuildNSWAdd(gen->builder, counter, LLVMConstInt(LLVMTypeOf(from), 1, 0), "fornext")
+		: LLVMBuildNUWAdd(gen->builder, counter, LLVMConstInt(LLVMTypeOf(from), 1, 0), "fornext");
+	latch = LLVMBuildCondBr(gen->builder, LLVMBuildICmp(gen->builder, issigned ? LLVMIntSLT : LLVMIntULT, next, to, ""), forblk, forend);
+	genlLoopHintsMd(gen, latch, hints);
+
+	LLVMAddIncoming(counter, &from, &entryblk, 1);
+	LLVMAddIncoming(counter, &next, &forlatch, 1);
+}
+
+// Generate a for block. Its range (or array) is evaluated once, before it starts.
+void genlFor(GenState *gen, ForAstNode *fnode) {
+	LLVMBasicBlockRef svwhilebeg, svwhileend;
+	LLVMValueRef from, to, elems = NULL;
+	NameDclAstNode *var = fnode->var;
+
+	gen->fnloops = 1;
+
+	if (fnode->from) {
+		from = genlExpr(gen, fnode->from);
+		to = genlExpr(gen, fnode->to);
+	}
+	else {
+		elems = genlArrayElems(gen, fnode->to, &to);
+		from = LLVMConstInt(genlType(gen, (AstNode*)usizeType), 0, 0);
+	}
+	if (genlIsSsaVar(var))
+		var->flags |= FlagSsaVar;
+	else
+		var->llvmvar = LLVMBuildAlloca(gen->builder, genlType(gen, var->vtype), &var->namesym->namestr);
+
+	// Push and pop for break and continue statements
+	svwhilebeg = gen->whilebeg;
+	svwhileend = gen->whileend;
+
+	gen->whileend = genlInsertBlock(gen, "forend");
+	if (fnode->guards) {
+		LLVMBasicBlockRef fastblk, checkedblk;
+		LoopHints checked = genlCheckedHints(&fnode->hints);
+		char *marked;
+		LLVMValueRef inbounds = genlGuardsHold(gen, fnode->bound, fnode->guards);
+		checkedblk = genlInsertBlock(gen, "forchecked");
+		fastblk = genlInsertBlock(gen, "forguarded");
+		LLVMBuildCondBr(gen->builder, inbounds, fastblk, checkedblk);
+
+		LLVMPositionBuilderAtEnd(gen->builder, fastblk);
+		marked = genlGuardsMark(fnode->guards);
+		genlForLoop(gen, fnode, from, to, elems, &fnode->hints, gen->whileend);
+		genlGuardsUnmark(fnode->guards, marked);
+
+		LLVMPositionBuilderAtEnd(gen->builder, checkedblk);
+		genlForLoop(gen, fnode, from, to, elems, &checked, gen->whileend);
+	}
+	else
+		genlForLoop(gen, fnode, from, to, elems, &fnode->hints, gen->whileend);
+	LLVMPositionBuilderAtEnd(gen->builder, gen->whileend);
 
 	gen->whilebeg = svwhilebeg;
 	gen->whileend = svwhileend;
@@ -74,6 +317,8 @@ LLVMValueRef genlBlock(GenState *gen, BlockAstNode *blk) {
 		switch ((*nodesp)->asttype) {
 		case WhileNode:
 			genlWhile(gen, (WhileAstNode *)*nodesp); break;
+		case ForNode:
+			genlFor(gen, (ForAstNode *)*nodesp); break;
 		case BreakNode:
 			LLVMBuildBr(gen->builder, gen->whileend); break;
 		case ContinueNode:
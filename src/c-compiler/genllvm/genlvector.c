@@ -0,0 +1,142 @@
+/** Generation of SIMD vector operations
+ * @file
+ *
+ * A vector's number operations (e.g., +, <, sqrt) are generated lane by lane,
+ * just as genlFnCall generates them for numbers, as LLVM's arithmetic,
+ * comparison, conversion and intrinsic instructions all accept vectors.
+ *
+ * This generates what only vectors do: splat, lane extract/insert,
+ * shuffles, mask selects, and horizontal reductions.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "genllvm.h"
+
+#include <assert.h>
+
+// Return a constant vector of i32 lane indices: first, first+1, ...
+static LLVMValueRef genlLaneIndices(GenState *gen, uint32_t first, uint32_t lanes) {
+	LLVMValueRef idx[32];
+	uint32_t lane;
+	assert(lanes <= 32);
+	for (lane = 0; lane < lanes; lane++)
+		idx[lane] = LLVMConstInt(LLVMInt32TypeInContext(gen->context), first + lane, 0);
+	return LLVMConstVector(idx, lanes);
+}
+
+// Copy a number into every lane of a vector
+LLVMValueRef genlSplat(GenState *gen, LLVMValueRef val, uint32_t lanes) {
+	LLVMTypeRef vectype = LLVMVectorType(LLVMTypeOf(val), lanes);
+	LLVMValueRef lane0 = LLVMBuildInsertElement(gen->builder, LLVMGetUndef(vectype), val,
+		LLVMConstInt(LLVMInt32TypeInContext(gen->context), 0, 0), "");
+	return LLVMBuildShuffleVector(gen->builder, lane0, LLVMGetUndef(vectype),
+		LLVMConstNull(LLVMVectorType(LLVMInt32TypeInContext(gen->context), lanes)), "");
+}
+
+// Wrap a lane index (or vector of them) to fewer than lanes, so that it is never out of range
+static LLVMValueRef genlLaneWrap(GenState *gen, LLVMValueRef idx, uint32_t lanes) {
+	LLVMTypeRef type = LLVMTypeOf(idx);
+	LLVMValueRef mask;
+	if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+		mask = genlSplat(gen, LLVMConstInt(LLVMGetElementType(type), lanes - 1, 0), LLVMGetVectorSize(type));
+	else
+		mask = LLVMConstInt(type, lanes - 1, 0);
+	return LLVMBuildAnd(gen->builder, idx, mask, "");
+}
+
+// Rearrange the lanes of a and b. Lane i of the result is lane idx[i] of a
+// (or of b, for idx[i] from lanes to 2*lanes-1). Indices wrap around.
+static LLVMValueRef genlShuffle(GenState *gen, VectorAstNode *vectype, LLVMValueRef a, LLVMValueRef b, LLVMValueRef idx) {
+	LLVMValueRef both, result;
+	uint32_t lane;
+
+	// A constant shuffle is a single instruction
+	idx = genlLaneWrap(gen, idx, 2 * vectype->lanes);
+	if (LLVMIsConstant(idx))
+		return LLVMBuildShuffleVector(gen->builder, a, b, idx, "");
+
+	// Otherwise, pick each lane from both vectors laid end to end
+	both = LLVMBuildShuffleVector(gen->builder, a, b, genlLaneIndices(gen, 0, 2 * vectype->lanes), "");
+	result = LLVMGetUndef(LLVMTypeOf(a));
+	for (lane = 0; lane < vectype->lanes; lane++) {
+		LLVMValueRef lanenbr = LLVMConstInt(LLVMInt32TypeInContext(gen->context), lane, 0);
+		LLVMValueRef from = LLVMBuildExtractElement(gen->builder, idx, lanenbr, "");
+		result = LLVMBuildInsertElement(gen->builder, result, LLVMBuildExtractElement(gen->builder, both, from, ""), lanenbr, "");
+	}
+	return result;
+}
+
+// Combine two vectors lane by lane, as one step of a reduction
+static LLVMValueRef genlReduceStep(GenState *gen, int16_t opcode, NbrAstNode *elemtype, LLVMValueRef a, LLVMValueRef b) {
+	LLVMValueRef args[2] = { a, b };
+	int isfloat = elemtype->asttype == FloatNbrType;
+	switch (opcode) {
+	case SumOpCode:
+		return isfloat ? genlFastMath(gen, LLVMBuildFAdd(gen->builder, a, b, "")) : LLVMBuildAdd(gen->builder, a, b, "");
+	case ProductOpCode:
+		return isfloat ? genlFastMath(gen, LLVMBuildFMul(gen->builder, a, b, "")) : LLVMBuildMul(gen->builder, a, b, "");
+	case ReduceMinOpCode:
+		if (isfloat)
+			return genlIntrinsic(gen, "llvm.minnum", args, 2);
+		return LLVMBuildSelect(gen->builder, LLVMBuildICmp(gen->builder, elemtype->asttype == IntNbrType ? LLVMIntSLT : LLVMIntULT, a, b, ""), a, b, "");
+	case ReduceMaxOpCode:
+		if (isfloat)
+			return genlIntrinsic(gen, "llvm.maxnum", args, 2);
+		return LLVMBuildSelect(gen->builder, LLVMBuildICmp(gen->builder, elemtype->asttype == IntNbrType ? LLVMIntSGT : LLVMIntUGT, a, b, ""), a, b, "");
+	case ReduceAndOpCode: return LLVMBuildAnd(gen->builder, a, b, "");
+	case ReduceOrOpCode: return LLVMBuildOr(gen->builder, a, b, "");
+	case ReduceXorOpCode: return LLVMBuildXor(gen->builder, a, b, "");
+	default:
+		assert(0 && "invalid vector reduction");
+		return NULL;
+	}
+}
+
+// Combine all of a vector's lanes into one number. The lanes are combined pairwise,
+// halving the vector each step, so a float sum or product is not in lane order.
+static LLVMValueRef genlReduce(GenState *gen, int16_t opcode, VectorAstNode *vectype, LLVMValueRef vec) {
+	uint32_t lanes = vectype->lanes;
+
+	// Whether any or all of a mask's lanes are set is one test of its bits
+	if (vectype->elemtype == boolType) {
+		LLVMTypeRef bitstype = LLVMIntTypeInContext(gen->context, lanes);
+		LLVMValueRef bits = LLVMBuildBitCast(gen->builder, vec, bitstype, "");
+		if (opcode == ReduceOrOpCode)
+			return LLVMBuildICmp(gen->builder, LLVMIntNE, bits, LLVMConstNull(bitstype), "");
+		if (opcode == ReduceAndOpCode)
+			return LLVMBuildICmp(gen->builder, LLVMIntEQ, bits, LLVMConstAllOnes(bitstype), "");
+	}
+
+	while (lanes > 1) {
+		LLVMValueRef undef = LLVMGetUndef(LLVMTypeOf(vec));
+		LLVMValueRef lo = LLVMBuildShuffleVector(gen->builder, vec, undef, genlLaneIndices(gen, 0, lanes / 2), "");
+		LLVMValueRef hi = LLVMBuildShuffleVector(gen->builder, vec, undef, genlLaneIndices(gen, lanes / 2, lanes / 2), "");
+		vec = genlReduceStep(gen, opcode, vectype->elemtype, lo, hi);
+		lanes /= 2;
+	}
+	return LLVMBuildExtractElement(gen->builder, vec, LLVMConstInt(LLVMInt32TypeInContext(gen->context), 0, 0), "");
+}
+
+// Generate an operation only vectors have. Return NULL for a number op code,
+// which the caller generates for all lanes at once.
+LLVMValueRef genlVectorOp(GenState *gen, int16_t opcode, VectorAstNode *vectype, LLVMValueRef *args) {
+	switch (opcode) {
+	case ExtractOpCode:
+		return LLVMBuildExtractElement(gen->builder, args[0], genlLaneWrap(gen, args[1], vectype->lanes), "");
+	case InsertOpCode:
+		return LLVMBuildInsertElement(gen->builder, args[0], args[2], genlLaneWrap(gen, args[1], vectype->lanes), "");
+	case ShuffleOpCode:
+		return genlShuffle(gen, vectype, args[0], args[1], args[2]);
+	case SelectOpCode:
+		return LLVMBuildSelect(gen->builder, args[0], args[1], args[2], "");
+	case SumOpCode: case ProductOpCode:
+	case ReduceMinOpCode: case ReduceMaxOpCode:
+	case ReduceAndOpCode: case ReduceOrOpCode: case ReduceXorOpCode:
+		return genlReduce(gen, opcode, vectype, args[0]);
+	default:
+		return NULL;
+	}
+}
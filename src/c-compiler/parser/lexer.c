@@ -15,6 +15,7 @@
 #include "../shared/error.h"
 #include "../shared/utf8.h"
 #include "../shared/fileio.h"
+#include "../shared/timetrace.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -69,7 +70,9 @@ void lexInjectFile(char *url) {
 	char *src;
 	char *fn;
 	// Load specified source file
+	timeTraceBegin("Load", url);
 	src = fileLoadSrc(lex? lex->url : NULL, url, &fn);
+	timeTraceEnd();
 	if (!src)
 		errorExit(ExitNF, "Cannot find or read source file %s", url);
 
@@ -442,7 +445,7 @@ int lexInjectToken() {
 }
 
 // Decode next token from the source into new lex->token
-void lexNextToken() {
+void lexScanToken() {
 	// Inject tokens, if needed based on current line's indentation
 	if (lex->inject && lexInjectToken())
 		return;
@@ -499,7 +502,15 @@ void lexNextToken() {
 			lexScanTickedIdent(srcp);
 			return;
 
-		case '.': lexReturnPuncTok(DotToken, 1);
+		// '.' and '..'
+		case '.':
+			if (*(srcp + 1) == '.') {
+				lexReturnPuncTok(DblDotToken, 2);
+			}
+			else {
+				lexReturnPuncTok(DotToken, 1);
+			}
+
 		case ',': lexReturnPuncTok(CommaToken, 1);
 		case '-': lexReturnPuncTok(DashToken, 1);
 		case '*': lexReturnPuncTok(StarToken, 1);
@@ -507,6 +518,7 @@ void lexNextToken() {
 		case '%': lexReturnPuncTok(PercentToken, 1);
 		case '~': lexReturnPuncTok(TildeToken, 1);
 		case '^': lexReturnPuncTok(CaretToken, 1);
+		case '@': lexReturnPuncTok(AtToken, 1);
 
 		case '&': 
 			if (*(srcp + 1) == '&') {
@@ -690,3 +702,15 @@ void lexNextToken() {
 		}
 	}
 }
+
+// Decode next token from the source into new lex->token
+// Lexing is interleaved with parsing, so its time is traced as a running total
+void lexNextToken() {
+	if (timeTraceOn) {
+		uint64_t begin = timeTraceNow();
+		lexScanToken();
+		timeTraceTotal("Lex", begin);
+	}
+	else
+		lexScanToken();
+}
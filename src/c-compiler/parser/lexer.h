@@ -78,6 +78,7 @@ enum TokenTypes {
 	RParenToken,		// ')'
 	CommaToken,			// ','
 	DotToken,			// '.'
+	DblDotToken,		// '..'
 	PlusToken,			// '+'
 	DashToken,			// '-'
 	StarToken,			// '*'
@@ -90,6 +91,7 @@ enum TokenTypes {
 	CaretToken,			// '^'
 	NotToken,			// '!'
 	TildeToken,			// '~'
+	AtToken,			// '@'
 	UnderscoreToken,	// '_'
 	AssgnToken,			// '='
 	EqToken,			// '=='
@@ -111,6 +113,8 @@ enum TokenTypes {
 	ElifToken,		// 'elif'
 	ElseToken,		// 'else'
 	WhileToken,		// 'while'
+	ForToken,		// 'for'
+	InToken,		// 'in'
 	BreakToken,		// 'break'
 	ContinueToken,	// 'continue'
 	AsToken,		// 'as'
@@ -106,7 +106,7 @@ AstNode *parseTerm(ParseState *parse) {
 	}
 }
 
-// Parse the postfix operators: '.', '::', '()'
+// Parse the postfix operators: '.', '::', '()', '[]'
 AstNode *parsePostfix(ParseState *parse) {
 	AstNode *node = parseTerm(parse);
 	while (1) {
@@ -130,6 +130,22 @@ AstNode *parsePostfix(ParseState *parse) {
 			break;
 		}
 
+		// Indexing an array or slice
+		case LBracketToken:
+		{
+			ElementAstNode *elem = newElementAstNode();
+			elem->flags |= FlagIndex;
+			elem->owner = node;
+			lexNextToken();
+			elem->element = parseExpr(parse);
+			if (lexIsToken(RBracketToken))
+				lexNextToken();
+			else
+				errorMsgLex(ErrorBadArray, "Expected ']' after the index");
+			node = (AstNode *)elem;
+			break;
+		}
+
 		// Object call with possible parameters
 		case DotToken:
 		{
@@ -15,6 +15,7 @@
 #include "lexer.h"
 
 #include <stdio.h>
+#include <string.h>
 
 // Parse control flow suffixes
 AstNode *parseSuffix(ParseState *parse, AstNode *node) {
@@ -84,6 +85,93 @@ AstNode *parseWhile(ParseState *parse) {
 	return (AstNode *)wnode;
 }
 
+// Parse for block: for var in from..to, or for var in array (or slice).
+// The variable's type may be given after its name.
+AstNode *parseFor(ParseState *parse) {
+	ForAstNode *fnode = newForNode();
+	lexNextToken();
+	if (lexIsToken(IdentToken)) {
+		fnode->var = newNameDclNode(lex->val.ident, VarNameDclNode, voidType, immPerm, NULL);
+		lexNextToken();
+		if (!lexIsToken(InToken))
+			fnode->var->vtype = parseVtype(parse);
+	}
+	else
+		errorMsgLex(ErrorNoVar, "Expected a name for the for loop's variable");
+	if (lexIsToken(InToken))
+		lexNextToken();
+	else
+		errorMsgLex(ErrorNoIn, "Expected 'in' after the for loop's variable");
+	fnode->to = parseExpr(parse);
+	if (lexIsToken(DblDotToken)) {
+		lexNextToken();
+		fnode->from = fnode->to;
+		fnode->to = parseExpr(parse);
+	}
+	fnode->blk = parseBlock(parse);
+	if (fnode->var == NULL)
+		return fnode->blk;
+	return (AstNode *)fnode;
+}
+
+// Parse a loop's attributes, which precede it: @vectorize, @novectorize, @unroll, @nounroll.
+// @vectorize(n) also gives how many lanes wide, and @unroll(n) how many times.
+AstNode *parseLoopAttrs(ParseState *parse) {
+	LoopHints hints;
+	AstNode *loop;
+	hints.vectorize = hints.unroll = 0;
+	while (lexIsToken(AtToken)) {
+		int16_t *hint = NULL;
+		lexNextToken();
+		if (!lexIsToken(IdentToken)) {
+			errorMsgLex(ErrorNoIdent, "Expected attribute name after '@'");
+			continue;
+		}
+		if (strcmp(&lex->val.ident->namestr, "vectorize") == 0)
+			*(hint = &hints.vectorize) = 1;
+		else if (strcmp(&lex->val.ident->namestr, "novectorize") == 0)
+			hints.vectorize = -1;
+		else if (strcmp(&lex->val.ident->namestr, "unroll") == 0)
+			*(hint = &hints.unroll) = 1;
+		else if (strcmp(&lex->val.ident->namestr, "nounroll") == 0)
+			hints.unroll = -1;
+		else
+			errorMsgLex(WarnAttr, "Unknown attribute is ignored");
+		lexNextToken();
+		// How many lanes or times. Just one means never.
+		if (hint && lexIsToken(LParenToken)) {
+			lexNextToken();
+			if (lexIsToken(IntLitToken) && lex->val.uintlit > 0 && lex->val.uintlit <= 0x7FFF) {
+				*hint = lex->val.uintlit == 1 ? -1 : (int16_t)lex->val.uintlit;
+				lexNextToken();
+			}
+			else
+				errorMsgLex(ErrorBadTerm, "Expected a count between 1 and 32767");
+			if (lexIsToken(RParenToken))
+				lexNextToken();
+			else
+				errorMsgLex(ErrorNoRParen, "Expected ')'");
+		}
+		// Attributes may sit on the line before the loop
+		if (lexIsToken(SemiToken))
+			lexNextToken();
+	}
+
+	if (lexIsToken(WhileToken)) {
+		loop = parseWhile(parse);
+		((WhileAstNode *)loop)->hints = hints;
+	}
+	else if (lexIsToken(ForToken)) {
+		loop = parseFor(parse);
+		((ForAstNode *)loop)->hints = hints;
+	}
+	else {
+		errorMsgLex(ErrorNotLoop, "Only a while or for loop may have these attributes");
+		loop = parseExpStmt(parse);
+	}
+	return loop;
+}
+
 // Parse a block of statements/expressions
 AstNode *parseBlock(ParseState *parse) {
 	BlockAstNode *blk = newBlockNode();
@@ -113,6 +201,14 @@ AstNode *parseBlock(ParseState *parse) {
 			nodesAdd(&blk->stmts, parseWhile(parse));
 			break;
 
+		case ForToken:
+			nodesAdd(&blk->stmts, parseFor(parse));
+			break;
+
+		case AtToken:
+			nodesAdd(&blk->stmts, parseLoopAttrs(parse));
+			break;
+
 		case BreakToken:
 		{
 			AstNode *node;
@@ -12,6 +12,7 @@
 #include "../shared/memory.h"
 #include "../shared/error.h"
 #include "../shared/fileio.h"
+#include "../shared/timetrace.h"
 #include "../ast/nametbl.h"
 #include "lexer.h"
 
@@ -67,9 +68,62 @@ void parseRParen() {
 	lexNextToken();
 }
 
+// Parse a function's attributes (e.g., @fastmath), which precede it.
+// Return them as flags for the function's declaration node.
+uint16_t parseFnAttrs() {
+	uint16_t attrs = 0;
+	while (lexIsToken(AtToken)) {
+		lexNextToken();
+		if (!lexIsToken(IdentToken)) {
+			errorMsgLex(ErrorNoIdent, "Expected attribute name after '@'");
+			continue;
+		}
+		if (strcmp(&lex->val.ident->namestr, "fastmath") == 0)
+			attrs |= FlagFastMath;
+		else if (strcmp(&lex->val.ident->namestr, "inline") == 0)
+			attrs |= FlagInline;
+		else
+			errorMsgLex(WarnAttr, "Unknown attribute is ignored");
+		lexNextToken();
+		// Attributes may sit on the line before the function
+		if (lexIsToken(SemiToken))
+			lexNextToken();
+	}
+	if (attrs && !lexIsToken(FnToken) && !lexIsToken(ExternToken))
+		errorMsgLex(ErrorNotFn, "Only functions may have attributes");
+	return attrs;
+}
+
+// Parse a generic's type parameters, e.g.: [T, U]
+// Only a module's functions and structs may have them.
+Nodes *parseGenericParms(ParseState *parse) {
+	Nodes *parms = newNodes(4);
+	if (parse->owner->asttype != ModuleNode)
+		errorMsgLex(ErrorTypeArgs, "Only a module's functions and structs may have type parameters");
+	lexNextToken();
+	while (lexIsToken(IdentToken)) {
+		// Name resolution binds the parameter's uses to this declaration of a placeholder type
+		NameDclAstNode *parm = newNameDclNode(lex->val.ident, VtypeNameDclNode, voidType, immPerm, (AstNode*)newVoidNode());
+		parm->index = (uint16_t)parms->used;
+		nodesAdd(&parms, (AstNode*)parm);
+		lexNextToken();
+		if (!lexIsToken(CommaToken))
+			break;
+		lexNextToken();
+	}
+	if (parms->used == 0)
+		errorMsgLex(ErrorNoIdent, "Expected the name of a type parameter");
+	if (lexIsToken(RBracketToken))
+		lexNextToken();
+	else
+		errorMsgLex(ErrorTypeArgs, "Expected ']' after the type parameters");
+	return parse->owner->asttype == ModuleNode ? parms : NULL;
+}
+
 // Parse a function block
 AstNode *parseFn(ParseState *parse, int16_t flags) {
 	NameDclAstNode *fnnode;
+	Nodes *typeparms = NULL;
 
 	fnnode = newNameDclNode(NULL, VarNameDclNode, NULL, immPerm, NULL);
 	fnnode->owner = parse->owner;
@@ -89,6 +143,10 @@ AstNode *parseFn(ParseState *parse, int16_t flags) {
 			errorMsgLex(ErrorNoName, "Functions declarations must be named");
 	}
 
+	// Process type parameters, if a generic function
+	if (lexIsToken(LBracketToken))
+		typeparms = parseGenericParms(parse);
+
 	// Process the function's signature info. I
 	fnnode->vtype = parseFnSig(parse);
 
@@ -106,6 +164,8 @@ AstNode *parseFn(ParseState *parse, int16_t flags) {
 		parseSemi();
 	}
 
+	if (typeparms)
+		return (AstNode*)newGenericNode(fnnode, typeparms);
 	return (AstNode*) fnnode;
 }
 
@@ -149,7 +209,7 @@ void parseInclude(ParseState *parse) {
 // Return NULL if not either
 AstNode *parseFnOrVar(ParseState *parse) {
 	AstNode *node;
-	int16_t flags = 0;
+	int16_t flags = parseFnAttrs();
 
 	// extern keyword
 	if (lexIsToken(ExternToken)) {
@@ -169,7 +229,11 @@ AstNode *parseFnOrVar(ParseState *parse) {
 	else
 		return NULL;
 
-	node->flags |= flags;
+	// A generic function's attributes belong to its template (and so to every instance)
+	if (node->asttype == GenericNode)
+		((GenericAstNode *)node)->dcl->flags |= flags;
+	else
+		node->flags |= flags;
 	return node;
 }
 
@@ -200,6 +264,7 @@ void parseStmts(ParseState *parse, ModuleAstNode *mod) {
 			node = parseStruct(parse);
 			break;
 
+		case AtToken:
 		case ExternToken:
 		case FnToken:
 		case PermToken:
@@ -229,10 +294,12 @@ void parseStmts(ParseState *parse, ModuleAstNode *mod) {
 
 // Parse a module's global statement block
 ModuleAstNode *parseModuleBlk(ParseState *parse, ModuleAstNode *mod) {
+	timeTraceBegin("Parse", mod->namesym? &mod->namesym->namestr : lex->url);
 	parse->mod = mod;
 	modHook((ModuleAstNode*)mod->owner, mod);
 	parseStmts(parse, mod);
 	modHook(mod, (ModuleAstNode*)mod->owner);
+	timeTraceEnd();
 	parse->mod = (ModuleAstNode*)mod->owner;
 	return mod;
 }
@@ -27,6 +27,8 @@ enum ParseFlags {
 // parser.c
 ModuleAstNode *parsePgm();
 ModuleAstNode *parseModuleBlk(ParseState *parse, ModuleAstNode *mod);
+uint16_t parseFnAttrs();
+Nodes *parseGenericParms(ParseState *parse);
 AstNode *parseFn(ParseState *parse, int16_t flags);
 void parseSemi();
 void parseRCurly();
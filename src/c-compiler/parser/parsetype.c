@@ -123,6 +123,7 @@ AstNode *parseStruct(ParseState *parse) {
 	NamedAstNode *svowner = parse->owner;
 	NameDclAstNode *strdclnode;
 	StructAstNode *strnode;
+	Nodes *typeparms = NULL;
 	int16_t fieldnbr = 0;
 
 	strnode = newStructNode();
@@ -143,13 +144,24 @@ AstNode *parseStruct(ParseState *parse) {
 		lexNextToken();
 	}
 
+	// Process type parameters, if a generic struct
+	if (lexIsToken(LBracketToken)) {
+		parse->owner = svowner;
+		typeparms = parseGenericParms(parse);
+		parse->owner = (NamedAstNode *)strdclnode;
+	}
+
 	// Process field or method definitions
 	if (lexIsToken(LCurlyToken)) {
 		lexNextToken();
 		while (1) {
-			if (lexIsToken(FnToken)) {
-				NameDclAstNode *fn = (NameDclAstNode *)parseFn(parse, ParseMayName | ParseMayImpl);
-				fn->flags |= FlagMangleParms;
+			if (lexIsToken(FnToken) || lexIsToken(AtToken)) {
+				uint16_t attrs = parseFnAttrs();
+				NameDclAstNode *fn;
+				if (!lexIsToken(FnToken))
+					break;
+				fn = (NameDclAstNode *)parseFn(parse, ParseMayName | ParseMayImpl);
+				fn->flags |= FlagMangleParms | attrs;
 				nodesAdd(&strnode->methods, (AstNode*)fn);
 			}
 			else if (lexIsToken(PermToken) || lexIsToken(IdentToken)) {
@@ -170,6 +182,8 @@ AstNode *parseStruct(ParseState *parse) {
 		errorMsgLex(ErrorNoLCurly, "Expected left curly bracket enclosing fields or methods");
 
 	parse->owner = svowner;
+	if (typeparms)
+		return (AstNode*)newGenericNode(strdclnode, typeparms);
 	return (AstNode*)strdclnode;
 }
 
@@ -239,13 +253,23 @@ AstNode *parseFnSig(ParseState *parse) {
 	return (AstNode*)fnsig;
 }
 
-// Parse an array type
+// Parse an array type: [size] elemtype, or [] elemtype for an array of unknown size
+// (only referenced through a slice)
 AstNode *parseArrayType(ParseState *parse) {
 	ArrayAstNode *atype = newArrayNode();
 	lexNextToken();
 
 	atype->size = 0;
-	lexNextToken(); // closing bracket - assume no size for now
+	if (lexIsToken(IntLitToken)) {
+		if (lex->val.uintlit == 0 || lex->val.uintlit > 0xFFFFFFFF)
+			errorMsgLex(ErrorBadArray, "Array size must be between 1 and 4294967295");
+		atype->size = (uint32_t)lex->val.uintlit;
+		lexNextToken();
+	}
+	if (lexIsToken(RBracketToken))
+		lexNextToken();
+	else
+		errorMsgLex(ErrorBadArray, "Expected ']' after the array's size");
 
 	if ((atype->elemtype = parseVtype(parse)) == NULL) {
 		errorMsgLex(ErrorNoVtype, "Missing value type for the array element");
@@ -266,6 +290,27 @@ AstNode* parseVtype(ParseState *parse) {
 	case IdentToken:
 		vtype = (AstNode*)newNameUseNode(lex->val.ident);
 		lexNextToken();
+		// A generic's type arguments, e.g.: Box[i32]
+		if (lexIsToken(LBracketToken)) {
+			NameUseAstNode *name = (NameUseAstNode *)vtype;
+			name->typeargs = newNodes(4);
+			lexNextToken();
+			while (!lexIsToken(RBracketToken)) {
+				AstNode *arg = parseVtype(parse);
+				if (arg == voidType) {
+					errorMsgLex(ErrorNoVtype, "Expected a type argument");
+					break;
+				}
+				nodesAdd(&name->typeargs, arg);
+				if (!lexIsToken(CommaToken))
+					break;
+				lexNextToken();
+			}
+			if (lexIsToken(RBracketToken))
+				lexNextToken();
+			else
+				errorMsgLex(ErrorTypeArgs, "Expected ']' after the type arguments");
+		}
 		return vtype;
 	default:
 		return voidType;
@@ -50,7 +50,7 @@ enum ErrorCode {
 	ErrorRetNotLast, // Return was found not at the end of the block
 	ErrorNoRet,		// Return value expected but not given
 	ErrorNoElse,	// Missing 'else' branch
-	ErrorNoWhile,	// 'break' or 'continue' allowed only in while/each loop
+	ErrorNoWhile,	// 'break' or 'continue' allowed only in while/for loop
 	ErrorNoVtype,	// Missing value type
 	ErrorNotPtr,	// Not a pointer
 	ErrorNotLval,	// Not an lval
@@ -63,14 +63,26 @@ enum ErrorCode {
 	ErrorNoEof,		// Missing end-of-file
 	ErrorNoImpl,	// Function must be implemented
 	ErrorBadImpl,	// Function must not be implemented
+	ErrorNoFile,	// Could not find or read a source file (non-terminating in batch mode)
+	ErrorBadArray,	// Invalid array type or index
+	ErrorNoIn,		// Missing 'in' in a for loop
+	ErrorNotLoop,	// Loop attributes must precede a loop
+	ErrorNotConst,	// Value cannot be computed at compile time
+	ErrorTypeArgs,	// Generic's type arguments are missing, wrong or cannot be inferred
 
 	// Warnings
 	WarnCode = 3000,
 	WarnName,		// Unnecessary name
 	WarnIndent,		// Inconsistent indent character
+	WarnCache,		// Could not store an object in the object cache
+	WarnProfile,	// Profile does not match a function's code
+	WarnTarget,		// Option does not apply to the target
+	WarnAttr,		// Unknown attribute
+	WarnInline,		// Function call cannot be inlined
 };
 
 int errors;
+int warnings;
 
 // Send an error message to stderr
 void errorExit(int exitcode, const char *msg, ...);
@@ -0,0 +1,185 @@
+/** Compile-phase timing trace
+ * @file
+ *
+ * When --time-trace is specified, the compiler records nested, wall-clock timed spans
+ * for each phase of compilation (file load, parse, AST passes, IR generation,
+ * optimization and emission). Very frequent work interleaved with other phases
+ * (e.g., lexing, which the parser pulls one token at a time) is instead accumulated
+ * into named running totals.
+ *
+ * The trace is written out in Chrome's trace-event JSON format, viewable with
+ * chrome://tracing, Perfetto, or Speedscope. Totals are shown (as LLVM does)
+ * as "Total <name>" spans, each on its own thread row.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "timetrace.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define TimeTraceMaxDepth 256
+#define TimeTraceMaxTotals 16
+
+// A timed span
+typedef struct TimeTraceSpan {
+	char *name;
+	char *detail;
+	uint64_t start;	// nanoseconds since trace began
+	uint64_t dur;	// nanoseconds
+} TimeTraceSpan;
+
+// A running total
+typedef struct TimeTraceTotal {
+	char *name;
+	uint64_t dur;	// nanoseconds
+	uint32_t count;
+} TimeTraceTotal;
+
+int timeTraceOn = 0;
+
+// Private globals
+static uint64_t timeTraceStart;
+static TimeTraceSpan *timeTraceSpans = NULL;	// Closed spans, in order of closing
+static size_t timeTraceSpansUsed = 0;
+static size_t timeTraceSpansAvail = 0;
+static TimeTraceSpan timeTraceStack[TimeTraceMaxDepth];	// Open spans
+static int timeTraceDepth = 0;
+static TimeTraceTotal timeTraceTotals[TimeTraceMaxTotals];
+static int timeTraceTotalsUsed = 0;
+
+// Return a monotonic wall-clock time, in nanoseconds
+uint64_t timeTraceNow() {
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64_t)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Start recording a time trace
+void timeTraceInit() {
+	timeTraceOn = 1;
+	timeTraceStart = timeTraceNow();
+}
+
+// Open a new span, nested within any span already open
+void timeTraceBegin(char *name, char *detail) {
+	TimeTraceSpan *span;
+	if (!timeTraceOn)
+		return;
+	if (timeTraceDepth >= TimeTraceMaxDepth)
+		errorExit(ExitMem, "Time trace spans are nested too deeply");
+	span = &timeTraceStack[timeTraceDepth++];
+	span->name = name;
+	span->detail = detail;
+	span->start = timeTraceNow() - timeTraceStart;
+}
+
+// Close the most recently opened span
+void timeTraceEnd() {
+	TimeTraceSpan *span;
+	if (!timeTraceOn || timeTraceDepth == 0)
+		return;
+	span = &timeTraceStack[--timeTraceDepth];
+	span->dur = timeTraceNow() - timeTraceStart - span->start;
+
+	if (timeTraceSpansUsed >= timeTraceSpansAvail) {
+		timeTraceSpansAvail = timeTraceSpansAvail == 0 ? 1024 : timeTraceSpansAvail << 1;
+		timeTraceSpans = (TimeTraceSpan *)realloc(timeTraceSpans, timeTraceSpansAvail * sizeof(TimeTraceSpan));
+		if (timeTraceSpans == NULL)
+			errorExit(ExitMem, "Error: Out of memory");
+	}
+	timeTraceSpans[timeTraceSpansUsed++] = *span;
+}
+
+// Add time since begin to the named running total
+void timeTraceTotal(char *name, uint64_t begin) {
+	int i;
+	uint64_t dur = timeTraceNow() - begin;
+	for (i = 0; i < timeTraceTotalsUsed; i++) {
+		if (timeTraceTotals[i].name == name || strcmp(timeTraceTotals[i].name, name) == 0)
+			break;
+	}
+	if (i == timeTraceTotalsUsed) {
+		if (i >= TimeTraceMaxTotals)
+			return;
+		timeTraceTotals[i].name = name;
+		timeTraceTotals[i].dur = 0;
+		timeTraceTotals[i].count = 0;
+		++timeTraceTotalsUsed;
+	}
+	timeTraceTotals[i].dur += dur;
+	timeTraceTotals[i].count++;
+}
+
+// Write a JSON string value, escaping as needed
+static void timeTraceJsonStr(FILE *file, char *str) {
+	fputc('"', file);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(file, "\\%c", *str);
+		else if ((unsigned char)*str < ' ')
+			fprintf(file, "\\u%04x", (unsigned char)*str);
+		else
+			fputc(*str, file);
+	}
+	fputc('"', file);
+}
+
+// Write one complete ("X") event. Times are in microseconds
+static void timeTraceJsonEvent(FILE *file, char *name, char *detail, int tid, uint64_t start, uint64_t dur) {
+	fprintf(file, ",\n{\"pid\":1,\"tid\":%d,\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"name\":", tid, start / 1000.0, dur / 1000.0);
+	timeTraceJsonStr(file, name);
+	if (detail) {
+		fputs(",\"args\":{\"detail\":", file);
+		timeTraceJsonStr(file, detail);
+		fputc('}', file);
+	}
+	fputc('}', file);
+}
+
+// Write all closed spans and totals out as Chrome trace-event JSON
+void timeTraceWrite(char *path) {
+	FILE *file;
+	size_t i;
+	char namebuf[64];
+
+	if (!timeTraceOn)
+		return;
+	if (!(file = fopen(path, "wb"))) {
+		errorMsg(ErrorGenErr, "Could not write time trace file %s", path);
+		return;
+	}
+
+	fputs("{\"traceEvents\":[\n", file);
+	fputs("{\"pid\":1,\"tid\":0,\"ph\":\"M\",\"name\":\"process_name\",\"args\":{\"name\":\"conec\"}}", file);
+	for (i = 0; i < timeTraceSpansUsed; i++) {
+		TimeTraceSpan *span = &timeTraceSpans[i];
+		timeTraceJsonEvent(file, span->name, span->detail, 0, span->start, span->dur);
+	}
+	for (i = 0; i < (size_t)timeTraceTotalsUsed; i++) {
+		char countbuf[32];
+		TimeTraceTotal *total = &timeTraceTotals[i];
+		snprintf(namebuf, sizeof(namebuf), "Total %s", total->name);
+		snprintf(countbuf, sizeof(countbuf), "%u calls", (unsigned)total->count);
+		timeTraceJsonEvent(file, namebuf, countbuf, (int)i + 1, 0, total->dur);
+	}
+	fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+	fclose(file);
+}
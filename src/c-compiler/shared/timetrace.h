@@ -0,0 +1,35 @@
+/** Compile-phase timing trace
+ * @file
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#ifndef timetrace_h
+#define timetrace_h
+
+#include <stdint.h>
+
+// Non-zero when a time trace is being recorded (--time-trace)
+int timeTraceOn;
+
+// Start recording a time trace
+void timeTraceInit();
+
+// Return a monotonic wall-clock time, in nanoseconds
+uint64_t timeTraceNow();
+
+// Open a new span, nested within any span already open.
+// detail (which may be NULL) is shown as the span's argument (e.g., a function name)
+void timeTraceBegin(char *name, char *detail);
+
+// Close the most recently opened span
+void timeTraceEnd();
+
+// Add time since begin to the named running total (for very frequent, interleaved work)
+void timeTraceTotal(char *name, uint64_t begin);
+
+// Write all closed spans and totals out as Chrome trace-event JSON
+void timeTraceWrite(char *path);
+
+#endif
@@ -33,6 +33,8 @@ void keywordInit() {
 	keyAdd("elif", ElifToken);
 	keyAdd("else", ElseToken);
 	keyAdd("while", WhileToken);
+	keyAdd("for", ForToken);
+	keyAdd("in", InToken);
 	keyAdd("break", BreakToken);
 	keyAdd("continue", ContinueToken);
 	keyAdd("not", NotToken);
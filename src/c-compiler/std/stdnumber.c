@@ -10,6 +10,9 @@
 #include "../parser/lexer.h"
 #include "../ast/nametbl.h"
 
+#include <string.h>
+#include <assert.h>
+
 Nodes *nbrsubtypes;
 
 // Declare built-in number types and their names
@@ -21,15 +24,44 @@ void stdNbrInit() {
 	newNameDclNodeStr("u16", VtypeNameDclNode, (AstNode*)(u16Type = newNbrTypeNode(UintNbrType, 16)));
 	newNameDclNodeStr("u32", VtypeNameDclNode, (AstNode*)(u32Type = newNbrTypeNode(UintNbrType, 32)));
 	newNameDclNodeStr("u64", VtypeNameDclNode, (AstNode*)(u64Type = newNbrTypeNode(UintNbrType, 64)));
-	newNameDclNodeStr("usize", VtypeNameDclNode, (AstNode*)(usizeType = newNbrTypeNode(UintNbrType, 0)));
+	// usize and isize are pointer-sized, set once the target is known (see genlSetup)
+	newNameDclNodeStr("usize", VtypeNameDclNode, (AstNode*)(usizeType = newNbrTypeNode(UintNbrType, 64)));
 	newNameDclNodeStr("i8", VtypeNameDclNode, (AstNode*)(i8Type = newNbrTypeNode(IntNbrType, 8)));
 	newNameDclNodeStr("i16", VtypeNameDclNode, (AstNode*)(i16Type = newNbrTypeNode(IntNbrType, 16)));
 	newNameDclNodeStr("i32", VtypeNameDclNode, (AstNode*)(i32Type = newNbrTypeNode(IntNbrType, 32)));
 	newNameDclNodeStr("i64", VtypeNameDclNode, (AstNode*)(i64Type = newNbrTypeNode(IntNbrType, 64)));
-	newNameDclNodeStr("isize", VtypeNameDclNode, (AstNode*)(isizeType = newNbrTypeNode(UintNbrType, 0)));
+	newNameDclNodeStr("isize", VtypeNameDclNode, (AstNode*)(isizeType = newNbrTypeNode(IntNbrType, 64)));
 	newNameDclNodeStr("f32", VtypeNameDclNode, (AstNode*)(f32Type = newNbrTypeNode(FloatNbrType, 32)));
 	newNameDclNodeStr("f64", VtypeNameDclNode, (AstNode*)(f64Type = newNbrTypeNode(FloatNbrType, 64)));
 
+	// SIMD vector types. Masks (from comparisons) and shuffle indices come first,
+	// as the other vector types' methods use them.
+	VectorAstNode *mask2, *mask4, *mask8, *mask16, *idx2, *idx4, *idx8, *idx16;
+	newNameDclNodeStr("Boolx2", VtypeNameDclNode, (AstNode*)(mask2 = newVectorTypeNode(boolType, 2, NULL, NULL)));
+	newNameDclNodeStr("Boolx4", VtypeNameDclNode, (AstNode*)(mask4 = newVectorTypeNode(boolType, 4, NULL, NULL)));
+	newNameDclNodeStr("Boolx8", VtypeNameDclNode, (AstNode*)(mask8 = newVectorTypeNode(boolType, 8, NULL, NULL)));
+	newNameDclNodeStr("Boolx16", VtypeNameDclNode, (AstNode*)(mask16 = newVectorTypeNode(boolType, 16, NULL, NULL)));
+	newNameDclNodeStr("i32x2", VtypeNameDclNode, (AstNode*)(idx2 = newVectorTypeNode(i32Type, 2, mask2, NULL)));
+	newNameDclNodeStr("i32x4", VtypeNameDclNode, (AstNode*)(idx4 = newVectorTypeNode(i32Type, 4, mask4, NULL)));
+	newNameDclNodeStr("i32x8", VtypeNameDclNode, (AstNode*)(idx8 = newVectorTypeNode(i32Type, 8, mask8, NULL)));
+	newNameDclNodeStr("i32x16", VtypeNameDclNode, (AstNode*)(idx16 = newVectorTypeNode(i32Type, 16, mask16, NULL)));
+	newNameDclNodeStr("i8x16", VtypeNameDclNode, (AstNode*)newVectorTypeNode(i8Type, 16, mask16, idx16));
+	newNameDclNodeStr("u8x16", VtypeNameDclNode, (AstNode*)newVectorTypeNode(u8Type, 16, mask16, idx16));
+	newNameDclNodeStr("i16x8", VtypeNameDclNode, (AstNode*)newVectorTypeNode(i16Type, 8, mask8, idx8));
+	newNameDclNodeStr("u16x8", VtypeNameDclNode, (AstNode*)newVectorTypeNode(u16Type, 8, mask8, idx8));
+	newNameDclNodeStr("u32x4", VtypeNameDclNode, (AstNode*)newVectorTypeNode(u32Type, 4, mask4, idx4));
+	newNameDclNodeStr("u32x8", VtypeNameDclNode, (AstNode*)newVectorTypeNode(u32Type, 8, mask8, idx8));
+	newNameDclNodeStr("i64x2", VtypeNameDclNode, (AstNode*)newVectorTypeNode(i64Type, 2, mask2, idx2));
+	newNameDclNodeStr("i64x4", VtypeNameDclNode, (AstNode*)newVectorTypeNode(i64Type, 4, mask4, idx4));
+	newNameDclNodeStr("u64x2", VtypeNameDclNode, (AstNode*)newVectorTypeNode(u64Type, 2, mask2, idx2));
+	newNameDclNodeStr("u64x4", VtypeNameDclNode, (AstNode*)newVectorTypeNode(u64Type, 4, mask4, idx4));
+	newNameDclNodeStr("f32x4", VtypeNameDclNode, (AstNode*)newVectorTypeNode(f32Type, 4, mask4, idx4));
+	newNameDclNodeStr("f32x8", VtypeNameDclNode, (AstNode*)newVectorTypeNode(f32Type, 8, mask8, idx8));
+	newNameDclNodeStr("f32x16", VtypeNameDclNode, (AstNode*)newVectorTypeNode(f32Type, 16, mask16, idx16));
+	newNameDclNodeStr("f64x2", VtypeNameDclNode, (AstNode*)newVectorTypeNode(f64Type, 2, mask2, idx2));
+	newNameDclNodeStr("f64x4", VtypeNameDclNode, (AstNode*)newVectorTypeNode(f64Type, 4, mask4, idx4));
+	newNameDclNodeStr("f64x8", VtypeNameDclNode, (AstNode*)newVectorTypeNode(f64Type, 8, mask8, idx8));
+
 	// Reference to a literal string
 	ArrayAstNode *strArr = newArrayNode();
 	strArr->size = 0;
@@ -64,7 +96,7 @@ NbrAstNode *newNbrTypeNode(uint16_t typ, char bits) {
 	inodesAdd(&binsig->parms, parm2, (AstNode *)newNameDclNode(parm2, VarNameDclNode, (AstNode*)nbrtypenode, immPerm, NULL));
 
 	// Build method dictionary for the type, which ultimately point to internal op codes
-	nbrtypenode->methods = newNodes(16);
+	nbrtypenode->methods = newNodes(32);
 	Name *opsym;
 
 	// Arithmetic operators (not applicable to boolean)
@@ -98,12 +130,70 @@ NbrAstNode *newNbrTypeNode(uint16_t typ, char bits) {
 			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(ShlOpCode)));
 			opsym = nameFind("shr", 3);
 			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(ShrOpCode)));
+
+			// Bit manipulation (intrinsics)
+			opsym = nameFind("popcount", 8);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(PopcountOpCode)));
+			opsym = nameFind("clz", 3);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(ClzOpCode)));
+			opsym = nameFind("ctz", 3);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(CtzOpCode)));
+			if (bits != 8) {
+				opsym = nameFind("bswap", 5);
+				nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(BswapOpCode)));
+			}
+			opsym = nameFind("rotl", 4);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(RotlOpCode)));
+			opsym = nameFind("rotr", 4);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(RotrOpCode)));
+
+			// Saturating arithmetic clamps to the type's range, checked arithmetic traps on overflow
+			opsym = nameFind("addSat", 6);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(AddSatOpCode)));
+			opsym = nameFind("subSat", 6);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(SubSatOpCode)));
+			opsym = nameFind("addChecked", 10);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(AddCheckedOpCode)));
+			opsym = nameFind("subChecked", 10);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(SubCheckedOpCode)));
+			opsym = nameFind("mulChecked", 10);
+			nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(MulCheckedOpCode)));
 		}
 	}
 	// Floating point functions (intrinsics)
 	else {
 		opsym = nameFind("sqrt", 4);
 		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(SqrtOpCode)));
+		opsym = nameFind("abs", 3);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(AbsOpCode)));
+		opsym = nameFind("floor", 5);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(FloorOpCode)));
+		opsym = nameFind("ceil", 4);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(CeilOpCode)));
+		opsym = nameFind("trunc", 5);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(TruncOpCode)));
+		opsym = nameFind("round", 5);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)unarysig, immPerm, (AstNode *)newOpCodeNode(RoundOpCode)));
+		opsym = nameFind("copysign", 8);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(CopysignOpCode)));
+
+		// Fused multiply-add: a.fma(b, c) is a*b+c, rounded once
+		FnSigAstNode *fmasig = newFnSigNode();
+		fmasig->rettype = (AstNode*)nbrtypenode;
+		inodesAdd(&fmasig->parms, parm1, (AstNode *)newNameDclNode(parm1, VarNameDclNode, (AstNode*)nbrtypenode, immPerm, NULL));
+		inodesAdd(&fmasig->parms, parm2, (AstNode *)newNameDclNode(parm2, VarNameDclNode, (AstNode*)nbrtypenode, immPerm, NULL));
+		Name *parm3 = nameFind("c", 1);
+		inodesAdd(&fmasig->parms, parm3, (AstNode *)newNameDclNode(parm3, VarNameDclNode, (AstNode*)nbrtypenode, immPerm, NULL));
+		opsym = nameFind("fma", 3);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)fmasig, immPerm, (AstNode *)newOpCodeNode(FmaOpCode)));
+	}
+
+	// Minimum and maximum
+	if (bits > 1) {
+		opsym = nameFind("min", 3);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(MinOpCode)));
+		opsym = nameFind("max", 3);
+		nodesAdd(&nbrtypenode->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)binsig, immPerm, (AstNode *)newOpCodeNode(MaxOpCode)));
 	}
 
 	// Create function signature for comparison methods for this type
@@ -128,3 +218,93 @@ NbrAstNode *newNbrTypeNode(uint16_t typ, char bits) {
 
 	return nbrtypenode;
 }
+
+// Add a method implemented by an op code to a type
+static void stdAddOpMethod(TypeAstNode *type, char *name, FnSigAstNode *sig, int16_t opcode) {
+	Name *opsym = nameFind(name, strlen(name));
+	nodesAdd(&type->methods, (AstNode *)newNameDclNode(opsym, VarNameDclNode, (AstNode *)sig, immPerm, (AstNode *)newOpCodeNode(opcode)));
+}
+
+// Create a function signature, whose parameters are named a, b, c
+static FnSigAstNode *stdNewSig(AstNode *rettype, int nparms, AstNode *parm1, AstNode *parm2, AstNode *parm3) {
+	AstNode *parmtypes[3] = { parm1, parm2, parm3 };
+	FnSigAstNode *sig = newFnSigNode();
+	int i;
+	sig->rettype = rettype;
+	for (i = 0; i < nparms; i++) {
+		Name *parm = nameFind("abc" + i, 1);
+		inodesAdd(&sig->parms, parm, (AstNode *)newNameDclNode(parm, VarNameDclNode, parmtypes[i], immPerm, NULL));
+	}
+	return sig;
+}
+
+// Create a new SIMD vector type node (e.g., f32x4), whose lanes hold elemtype numbers.
+// Its comparisons produce masktype lanes (NULL if it is itself a mask type),
+// and its shuffles use idxtype lane indices (NULL if it is itself i32 lanes).
+VectorAstNode *newVectorTypeNode(NbrAstNode *elemtype, uint32_t lanes, VectorAstNode *masktype, VectorAstNode *idxtype) {
+	VectorAstNode *vectype;
+	newAstNode(vectype, VectorAstNode, VectorType);
+	vectype->subtypes = nbrsubtypes;
+	vectype->elemtype = elemtype;
+	vectype->lanes = lanes;
+	vectype->methods = newNodes(64);
+	if (masktype == NULL)
+		masktype = vectype;
+	if (idxtype == NULL)
+		idxtype = vectype;
+
+	// Every number method applies lane by lane. Give each the vector version of its
+	// element type's signature: lanes in place of numbers, masks in place of Bools.
+	// (Checked arithmetic is not offered, as it cannot say which lane overflowed.)
+	FnSigAstNode *elemsigs[8], *vecsigs[8];
+	int nsigs = 0;
+	AstNode **nodesp;
+	uint32_t cnt;
+	for (nodesFor(elemtype->methods, cnt, nodesp)) {
+		NameDclAstNode *method = (NameDclAstNode *)*nodesp;
+		FnSigAstNode *elemsig = (FnSigAstNode *)method->vtype;
+		int16_t opcode = ((OpCodeAstNode *)method->value)->opcode;
+		int i;
+		if (opcode == AddCheckedOpCode || opcode == SubCheckedOpCode || opcode == MulCheckedOpCode)
+			continue;
+		for (i = 0; i < nsigs && elemsigs[i] != elemsig; i++);
+		if (i == nsigs) {
+			SymNode *parmp;
+			uint32_t parmcnt;
+			assert(nsigs < 8);
+			elemsigs[nsigs] = elemsig;
+			vecsigs[nsigs] = newFnSigNode();
+			vecsigs[nsigs]->rettype = elemsig->rettype == (AstNode*)elemtype ? (AstNode*)vectype : (AstNode*)masktype;
+			for (inodesFor(elemsig->parms, parmcnt, parmp))
+				inodesAdd(&vecsigs[nsigs]->parms, parmp->name, (AstNode *)newNameDclNode(parmp->name, VarNameDclNode, (AstNode*)vectype, immPerm, NULL));
+			nsigs++;
+		}
+		nodesAdd(&vectype->methods, (AstNode *)newNameDclNode(method->namesym, VarNameDclNode, (AstNode *)vecsigs[i], immPerm, method->value));
+	}
+
+	// Lane access and rearrangement
+	stdAddOpMethod((TypeAstNode*)vectype, "extract", stdNewSig((AstNode*)elemtype, 2, (AstNode*)vectype, (AstNode*)u32Type, NULL), ExtractOpCode);
+	stdAddOpMethod((TypeAstNode*)vectype, "insert", stdNewSig((AstNode*)vectype, 3, (AstNode*)vectype, (AstNode*)u32Type, (AstNode*)elemtype), InsertOpCode);
+	stdAddOpMethod((TypeAstNode*)vectype, "shuffle", stdNewSig((AstNode*)vectype, 3, (AstNode*)vectype, (AstNode*)vectype, (AstNode*)idxtype), ShuffleOpCode);
+
+	// A mask selects, lane by lane, from one of two vectors with as many lanes
+	stdAddOpMethod((TypeAstNode*)masktype, "select", stdNewSig((AstNode*)vectype, 3, (AstNode*)masktype, (AstNode*)vectype, (AstNode*)vectype), SelectOpCode);
+
+	// Horizontal reductions, combining all lanes into one number
+	FnSigAstNode *reducesig = stdNewSig((AstNode*)elemtype, 1, (AstNode*)vectype, NULL, NULL);
+	if (elemtype == boolType) {
+		stdAddOpMethod((TypeAstNode*)vectype, "any", reducesig, ReduceOrOpCode);
+		stdAddOpMethod((TypeAstNode*)vectype, "all", reducesig, ReduceAndOpCode);
+		return vectype;
+	}
+	stdAddOpMethod((TypeAstNode*)vectype, "sum", reducesig, SumOpCode);
+	stdAddOpMethod((TypeAstNode*)vectype, "product", reducesig, ProductOpCode);
+	stdAddOpMethod((TypeAstNode*)vectype, "reduceMin", reducesig, ReduceMinOpCode);
+	stdAddOpMethod((TypeAstNode*)vectype, "reduceMax", reducesig, ReduceMaxOpCode);
+	if (elemtype->asttype != FloatNbrType) {
+		stdAddOpMethod((TypeAstNode*)vectype, "reduceAnd", reducesig, ReduceAndOpCode);
+		stdAddOpMethod((TypeAstNode*)vectype, "reduceOr", reducesig, ReduceOrOpCode);
+		stdAddOpMethod((TypeAstNode*)vectype, "reduceXor", reducesig, ReduceXorOpCode);
+	}
+	return vectype;
+}
@@ -32,7 +32,7 @@ void allocAllocate(AddrAstNode *anode, PtrAstNode *ptype) {
 		}
 	}
 	if (allocmeth == NULL || ((FnSigAstNode*)allocmeth->vtype)->parms->used != 1) {
-		errorMsgNode((AstNode*)ptype, ErrorBadAlloc, "Allocator is missing valid allocate method");
+		errorMsgNode((AstNode*)anode, ErrorBadAlloc, "Allocator is missing valid allocate method");
 		return;
 	}
 
@@ -14,6 +14,7 @@
 ArrayAstNode *newArrayNode() {
 	ArrayAstNode *anode;
 	newAstNode(anode, ArrayAstNode, ArrayType);
+	anode->llvmtype = NULL;
 	return anode;
 }
 
@@ -26,10 +27,30 @@ void arrayPrint(ArrayAstNode *node) {
 // Semantically analyze an array type
 void arrayPass(PassState *pstate, ArrayAstNode *node) {
 	astPass(pstate, node->elemtype);
+	if (pstate->pass == NameResolution)
+		node->elemtype = typeIntern(node->elemtype);
 }
 
-// Compare two struct signatures to see if they are equivalent
+// Compare two array types to see if they are equivalent
 int arrayEqual(ArrayAstNode *node1, ArrayAstNode *node2) {
-	return (node1->size == node2->size
-		/* && typeEqual(node1->elemtype, node2->elemtype*/);
+	return node1->size == node2->size
+		&& typeIsSame(node1->elemtype, node2->elemtype);
+}
+
+// Is the type a slice: a reference (or pointer) to an array of unknown size, e.g., &[] f32.
+// A slice is a fat pointer, holding both the address of its first element and its length.
+int isSlice(AstNode *vtype) {
+	AstNode *pvtype;
+	if ((vtype->asttype != RefType && vtype->asttype != PtrType) || ((PtrAstNode *)vtype)->pvtype == NULL)
+		return 0;
+	pvtype = typeGetVtype(((PtrAstNode *)vtype)->pvtype);
+	return pvtype->asttype == ArrayType && ((ArrayAstNode *)pvtype)->size == 0;
+}
+
+// Return the array type indexed by a value of this type: an array, or a reference
+// (or pointer or slice) to one. Otherwise NULL.
+ArrayAstNode *arrayIndexable(AstNode *vtype) {
+	if ((vtype->asttype == RefType || vtype->asttype == PtrType) && ((PtrAstNode *)vtype)->pvtype)
+		vtype = typeGetVtype(((PtrAstNode *)vtype)->pvtype);
+	return vtype->asttype == ArrayType ? (ArrayAstNode *)vtype : NULL;
 }
@@ -8,16 +8,19 @@
 #ifndef array_h
 #define array_h
 
-// For pointers
+// For arrays
 typedef struct ArrayAstNode {
 	TypeAstHdr;
-	uint32_t size;
+	uint32_t size;		// Number of elements (0 if unknown, for [] T)
 	AstNode *elemtype;
+	LLVMTypeRef llvmtype;	// Memoized LLVM type (set by generation)
 } ArrayAstNode;
 
 ArrayAstNode *newArrayNode();
 void arrayPrint(ArrayAstNode *node);
 void arrayPass(PassState *pstate, ArrayAstNode *name);
 int arrayEqual(ArrayAstNode *node1, ArrayAstNode *node2);
+int isSlice(AstNode *vtype);
+ArrayAstNode *arrayIndexable(AstNode *vtype);
 
 #endif
\ No newline at end of file
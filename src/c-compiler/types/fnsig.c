@@ -43,6 +43,8 @@ void fnSigPass(PassState *pstate, FnSigAstNode *sig) {
 	for (inodesFor(sig->parms, cnt, nodesp))
 		astPass(pstate, (AstNode*)nodesp->node);
 	astPass(pstate, sig->rettype);
+	if (pstate->pass == NameResolution)
+		sig->rettype = typeIntern(sig->rettype);
 }
 
 // Compare two function signatures to see if they are equivalent
@@ -59,6 +59,13 @@ uint16_t permGetFlags(AstNode *node) {
 int permIsMutable(AstNode *lval) {
 	if (lval->asttype == ElementNode) {
 		ElementAstNode *elem = (ElementAstNode *)lval;
+		if (elem->flags & FlagIndex) {
+			// Indexing through a reference (or slice) needs its permission; an array, its owner's
+			PtrAstNode *ownvtype = (PtrAstNode*)typeGetVtype(elem->owner);
+			if (ownvtype->asttype == RefType || ownvtype->asttype == PtrType)
+				return MayWrite & ownvtype->perm->flags;
+			return permIsMutable(elem->owner);
+		}
 		return MayWrite & permGetFlags(elem->owner) & permGetFlags(elem->element);
 	}
 	else
@@ -14,6 +14,7 @@
 PtrAstNode *newPtrTypeNode() {
 	PtrAstNode *ptrnode;
 	newAstNode(ptrnode, PtrAstNode, RefType);
+	ptrnode->llvmtype = NULL;
 	return ptrnode;
 }
 
@@ -33,6 +34,8 @@ void ptrTypePass(PassState *pstate, PtrAstNode *node) {
 	astPass(pstate, node->alloc);
 	astPass(pstate, (AstNode*)node->perm);
 	astPass(pstate, node->pvtype);
+	if (pstate->pass == NameResolution)
+		node->pvtype = typeIntern(node->pvtype);
 }
 
 // Compare two pointer signatures to see if they are equivalent
@@ -15,6 +15,7 @@ typedef struct PtrAstNode {
 	PermAstNode *perm;	// Permission
 	AstNode *alloc;		// Allocator
 	int16_t scope;		// Lifetime
+	LLVMTypeRef llvmtype;	// Memoized LLVM type (set by generation)
 } PtrAstNode;
 
 PtrAstNode *strType;
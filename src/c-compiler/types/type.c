@@ -10,6 +10,7 @@
 #include "../shared/memory.h"
 #include "../parser/lexer.h"
 #include "../shared/error.h"
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
@@ -80,11 +81,23 @@ int typeMatches(AstNode *totype, AstNode *fromtype) {
 	case ArrayType:
 		if (totype->asttype != fromtype->asttype)
 			return 0;
+		// An array of any size may be viewed (through a slice) as one of unknown size
+		if (((ArrayAstNode*)totype)->size == 0 && ((ArrayAstNode*)fromtype)->size != 0)
+			return typeIsSame(((ArrayAstNode*)totype)->elemtype, ((ArrayAstNode*)fromtype)->elemtype) ? 2 : 0;
 		return arrayEqual((ArrayAstNode*)totype, (ArrayAstNode*)fromtype);
 
 	//case FnSig:
 	//	return fnSigMatches((FnSigAstNode*)totype, (FnSigAstNode*)fromtype);
 
+	// A number converts into every lane of a vector (splat).
+	// A vector converts lane by lane into one with as many lanes, but only by a cast.
+	case VectorType:
+		if (isNbr(fromtype))
+			return 4;
+		if (fromtype->asttype == VectorType && ((VectorAstNode *)totype)->lanes == ((VectorAstNode *)fromtype)->lanes)
+			return 4;
+		return 0;
+
 	case UintNbrType:
 	case IntNbrType:
 	case FloatNbrType:
@@ -137,7 +150,9 @@ int typeCoerces(AstNode *to, AstNode **from) {
 		return match; // return fail or non-changing matches. Fall through to perform any coercion
 
 	// Add coercion operation. When both are numbers - cast between them
-	if (isNbr(to)) {
+	// A number is also coerced to a vector, by copying it into every lane,
+	// and a reference to an array to a slice, by adding its length
+	if (isNbr(to) || (to->asttype == VectorType && isNbr(fromtype)) || isSlice(to)) {
 		*from = (AstNode*) newCastAstNode(*from, to);
 		return 1;
 	}
@@ -156,7 +171,7 @@ char *typeMangle(char *bufp, AstNode *vtype) {
 	case RefType: case PtrType:
 	{
 		PtrAstNode *pvtype = (PtrAstNode *)vtype;
-		*bufp++ = '&';
+		*bufp++ = vtype->asttype == RefType ? '&' : '*';
 		if (pvtype->perm != constPerm) {
 			bufp = typeMangle(bufp, (AstNode*)pvtype->perm);
 			*bufp++ = ' ';
@@ -164,6 +179,63 @@ char *typeMangle(char *bufp, AstNode *vtype) {
 		bufp = typeMangle(bufp, pvtype->pvtype);
 		break;
 	}
+	case PermType:
+	{
+		PermAstNode *perm = (PermAstNode *)vtype;
+		strcpy(bufp, perm == uniPerm ? "uni" : perm == mutPerm ? "mut" : perm == immPerm ? "imm"
+			: perm == mutxPerm ? "mutx" : perm == idPerm ? "id" : "const");
+		break;
+	}
+	// An unnamed type (e.g., a generic's type argument inferred from a literal)
+	// is mangled as its standard name would be
+	case IntNbrType: case UintNbrType: case FloatNbrType:
+	{
+		NbrAstNode *nbr = (NbrAstNode *)vtype;
+		if (nbr->bits == 1)
+			strcpy(bufp, "Bool");
+		else if (vtype == (AstNode*)isizeType || vtype == (AstNode*)usizeType)
+			strcpy(bufp, vtype == (AstNode*)isizeType ? "isize" : "usize");
+		else
+			sprintf(bufp, "%c%d", vtype->asttype == IntNbrType ? 'i' : vtype->asttype == UintNbrType ? 'u' : 'f', nbr->bits);
+		break;
+	}
+	case VectorType:
+	{
+		VectorAstNode *vec = (VectorAstNode *)vtype;
+		bufp = typeMangle(bufp, (AstNode*)vec->elemtype);
+		sprintf(bufp, "x%d", (int)vec->lanes);
+		break;
+	}
+	case ArrayType:
+	{
+		ArrayAstNode *atype = (ArrayAstNode *)vtype;
+		if (atype->size)
+			bufp += sprintf(bufp, "[%u]", atype->size);
+		else
+			bufp += sprintf(bufp, "[]");
+		bufp = typeMangle(bufp, atype->elemtype);
+		break;
+	}
+	case FnSig:
+	{
+		FnSigAstNode *fnsig = (FnSigAstNode *)vtype;
+		SymNode *nodesp;
+		uint32_t cnt;
+		bufp += sprintf(bufp, "fn(");
+		for (inodesFor(fnsig->parms, cnt, nodesp)) {
+			bufp = typeMangle(bufp, ((TypedAstNode *)nodesp->node)->vtype);
+			if (cnt > 1)
+				*bufp++ = ',';
+		}
+		*bufp++ = ')';
+		*bufp = '\0';
+		if (fnsig->rettype != voidType)
+			bufp = typeMangle(bufp, fnsig->rettype);
+		break;
+	}
+	case VoidType:
+		strcpy(bufp, "void");
+		break;
 	default:
 		assert(0 && "unknown type for parameter type mangling");
 	}
@@ -30,6 +30,12 @@ int typeCoerces(AstNode *to, AstNode **from);
 
 char *typeMangle(char *bufp, AstNode *vtype);
 
+// Type interning table (hash-consed canonical types) - typetbl.c
+size_t gTypeTblUsed;	// Number of unique interned types
+size_t gTypeTblHits;	// Number of type nodes replaced by an existing canonical node
+AstNode *typeIntern(AstNode *type);
+void typeTblReset();
+
 VoidTypeAstNode *newVoidNode();
 void voidPrint(VoidTypeAstNode *voidnode);
 
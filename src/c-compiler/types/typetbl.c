@@ -0,0 +1,163 @@
+/** Type Interning Table
+ * @file
+ *
+ * Every occurrence of an anonymous type in source (e.g., `&mut Point` or `[4] f32`)
+ * is parsed into its own node. After name resolution, such types are hash-consed:
+ * structurally identical types are replaced by a single canonical node.
+ * This shrinks the AST and lets generation build (and memoize) only one
+ * LLVMTypeRef for each distinct type.
+ *
+ * A type is keyed on its asttype and the identity of its component parts.
+ * Component types are interned first, so identity (==) comparison is sufficient.
+ * A resolved type name is identified by the type it declares.
+ *
+ * Like the global name table, this uses open addressing with quadratic probing
+ * and doubles in size whenever it gets close to full.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "../shared/memory.h"
+
+#include <string.h>
+#include <assert.h>
+
+// Public globals
+size_t gTypeTblUsed = 0;		// Number of unique interned types
+size_t gTypeTblHits = 0;		// Number of type nodes replaced by an existing canonical node
+
+// Private globals
+static AstNode **gTypeTable = NULL;	// The type table array
+static size_t gTypeTblAvail = 0;	// Number of allocated type table slots (power of 2)
+static size_t gTypeTblCeil = 0;		// Ceiling that triggers table growth
+static size_t gTypeTblFill = 0;		// Number of occupied type table slots
+
+// Identity of a component type: a resolved name is identified by the type it names.
+// A not yet instantiated generic's name (within a template) is only identical to itself.
+#define typeIdentity(node) \
+	((node) && (node)->asttype == NameUseNode && ((NameUseAstNode *)(node))->dclnode \
+	 && ((NameUseAstNode *)(node))->dclnode->asttype != GenericNode? \
+	 ((NameUseAstNode *)(node))->dclnode->value : (node))
+
+// Combine a pointer-sized value into a running hash
+#define typeHashMix(hash, val) \
+	(hash = ((hash << 5) + hash) ^ ((size_t)(val) >> 4))
+
+// Hash a type node, using its asttype and the identity of its components
+static size_t typeHash(AstNode *type) {
+	size_t hash = 5381;
+	typeHashMix(hash, type->asttype << 4);
+	switch (type->asttype) {
+	case RefType: case PtrType:
+	{
+		PtrAstNode *ptype = (PtrAstNode *)type;
+		typeHashMix(hash, typeIdentity(ptype->pvtype));
+		typeHashMix(hash, ptype->perm);
+		typeHashMix(hash, ptype->alloc);
+		break;
+	}
+	case ArrayType:
+	{
+		ArrayAstNode *atype = (ArrayAstNode *)type;
+		typeHashMix(hash, (size_t)atype->size << 4);
+		typeHashMix(hash, typeIdentity(atype->elemtype));
+		break;
+	}
+	}
+	return hash;
+}
+
+// Are two type nodes (of the same hash) structurally identical?
+static int typeSameStruct(AstNode *node1, AstNode *node2) {
+	if (node1->asttype != node2->asttype)
+		return 0;
+	switch (node1->asttype) {
+	case RefType: case PtrType:
+	{
+		PtrAstNode *ptype1 = (PtrAstNode *)node1;
+		PtrAstNode *ptype2 = (PtrAstNode *)node2;
+		return typeIdentity(ptype1->pvtype) == typeIdentity(ptype2->pvtype)
+			&& ptype1->perm == ptype2->perm
+			&& ptype1->alloc == ptype2->alloc;
+	}
+	case ArrayType:
+	{
+		ArrayAstNode *atype1 = (ArrayAstNode *)node1;
+		ArrayAstNode *atype2 = (ArrayAstNode *)node2;
+		return atype1->size == atype2->size
+			&& typeIdentity(atype1->elemtype) == typeIdentity(atype2->elemtype);
+	}
+	default:
+		return 0;
+	}
+}
+
+// Find the table slot that is either empty or holds the type's canonical node
+static AstNode **typeFindSlot(AstNode *type, size_t hash) {
+	size_t tbli, step;
+	for (tbli = hash & (gTypeTblAvail - 1), step = 1;; ++step) {
+		AstNode *slot = gTypeTable[tbli];
+		if (slot == NULL || typeSameStruct(slot, type))
+			return &gTypeTable[tbli];
+		tbli = (tbli + step) & (gTypeTblAvail - 1);
+	}
+}
+
+// Grow the type table, by either creating it or doubling its size
+static void typeTblGrow() {
+	AstNode **oldTable = gTypeTable;
+	size_t oldTblAvail = gTypeTblAvail;
+	size_t oldslot;
+
+	gTypeTblAvail = oldTblAvail == 0 ? 1024 : oldTblAvail << 1;
+	gTypeTblCeil = (80 * gTypeTblAvail) / 100;
+	gTypeTable = (AstNode **)memAllocBlk(gTypeTblAvail * sizeof(AstNode *));
+	memset(gTypeTable, 0, gTypeTblAvail * sizeof(AstNode *));
+
+	// Re-hash existing canonical types into the new table
+	for (oldslot = 0; oldslot < oldTblAvail; oldslot++) {
+		AstNode *type = oldTable[oldslot];
+		if (type)
+			*typeFindSlot(type, typeHash(type)) = type;
+	}
+}
+
+// Return the canonical node for a type, adding it to the table if new.
+// Only anonymous, structural types (references, pointers and arrays) are interned.
+// Any component types must already be name resolved and interned.
+AstNode *typeIntern(AstNode *type) {
+	AstNode **slotp;
+	switch (type->asttype) {
+	case RefType: case PtrType:
+		// A reference whose value type has not yet been inferred cannot be keyed
+		if (((PtrAstNode *)type)->pvtype == NULL)
+			return type;
+		break;
+	case ArrayType:
+		break;
+	default:
+		return type;
+	}
+
+	if (gTypeTblFill >= gTypeTblCeil)
+		typeTblGrow();
+	slotp = typeFindSlot(type, typeHash(type));
+	if (*slotp) {
+		if (*slotp != type)
+			++gTypeTblHits;
+		return *slotp;
+	}
+	++gTypeTblUsed;
+	++gTypeTblFill;
+	return *slotp = type;
+}
+
+// Empty the type table, so that a new source file's types are not
+// shared with those of a previously compiled one
+void typeTblReset() {
+	if (gTypeTable)
+		memset(gTypeTable, 0, gTypeTblAvail * sizeof(AstNode *));
+	gTypeTblFill = 0;
+}
@@ -0,0 +1,17 @@
+/** AST handling for SIMD vector types
+ * @file
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include "../ast/ast.h"
+#include "../shared/memory.h"
+#include "../parser/lexer.h"
+#include "../ast/nametbl.h"
+
+// Serialize a vector type (e.g., f32x4)
+void vectorPrint(VectorAstNode *node) {
+	nbrTypePrint(node->elemtype);
+	astFprint("x%d", (int)node->lanes);
+}
@@ -0,0 +1,23 @@
+/** AST handling for SIMD vector types
+ * @file
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#ifndef vector_h
+#define vector_h
+
+// A fixed number of lanes, each a number of the same type (e.g., f32x4)
+// Its number operations apply lane by lane. Comparisons produce a mask:
+// a vector of Bool with the same number of lanes (e.g., Boolx4).
+typedef struct VectorAstNode {
+	TypeAstHdr;
+	uint32_t lanes;			// Number of lanes (a power of 2)
+	NbrAstNode *elemtype;	// Type of each lane
+} VectorAstNode;
+
+VectorAstNode *newVectorTypeNode(NbrAstNode *elemtype, uint32_t lanes, VectorAstNode *masktype, VectorAstNode *idxtype);
+void vectorPrint(VectorAstNode *node);
+
+#endif
@@ -0,0 +1,441 @@
+/** conebench - Compiler throughput benchmark
+ * @file
+ *
+ * conebench generates synthetic, parameterized Cone programs and measures how
+ * quickly conec compiles each one. Every benchmark case stresses some aspect of the
+ * compiler: many modules, many functions, deeply nested expressions, many structs
+ * and methods, long string literals, or heavily indented (off-side) blocks.
+ *
+ * For each case, conec is run (with --time-trace) several times. The fastest run's
+ * wall time, lines/sec, peak resident memory and per-phase times are written
+ * as one JSON object per line (to stdout and <out>/results.jsonl),
+ * so that results can be compared across builds.
+ *
+ * Usage: conebench [--conec path] [--out dir] [--runs n] [--scale n] [--case name]
+ *        conebench --gen dir [--modules n] [--functions n] [--depth n]
+ *                  [--structs n] [--strlen n] [--indent n]
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#else
+#include <direct.h>
+#endif
+
+// Parameters for a generated Cone program
+typedef struct GenParms {
+	char *name;		// Benchmark case name
+	int modules;	// Number of submodules (each in its own source file)
+	int functions;	// Number of functions per module
+	int depth;		// Nesting depth of generated arithmetic expressions
+	int structs;	// Number of structs (each with methods) per module
+	int strlen;		// Length of each string literal
+	int indent;		// Nesting depth of indented if/while blocks
+} GenParms;
+
+// The standard benchmark cases (sizes are multiplied by --scale)
+static GenParms benchCases[] = {
+	// name, modules, functions, depth, structs, strlen, indent
+	{ "hello", 0, 1, 1, 0, 13, 1 },
+	{ "modules", 64, 8, 4, 1, 16, 2 },
+	{ "functions", 1, 1000, 4, 0, 16, 2 },
+	{ "deepexpr", 1, 100, 200, 0, 16, 2 },
+	{ "structs", 1, 50, 3, 400, 16, 2 },
+	{ "strings", 1, 400, 2, 0, 4000, 1 },
+	{ "indent", 1, 200, 3, 0, 16, 40 },
+	{ NULL }
+};
+
+static long genLines;	// Lines written by generator
+
+// Write a line of generated source, indented by the specified number of levels
+static void genLine(FILE *file, int indent, const char *fmt, ...) {
+	va_list args;
+	while (indent--)
+		fputs("  ", file);
+	va_start(args, fmt);
+	vfprintf(file, fmt, args);
+	va_end(args);
+	fputc('\n', file);
+	genLines++;
+}
+
+// Write a right-nested arithmetic expression over a and b of the requested depth
+static void genExpr(FILE *file, int depth) {
+	static const char *ops[] = { "+", "-", "*", "&", "|", "^" };
+	int i;
+	for (i = 0; i < depth; i++)
+		fprintf(file, "(%s %s ", i & 1 ? "b" : "a", ops[i % 6]);
+	fputs("a", file);
+	for (i = 0; i < depth; i++)
+		fputc(')', file);
+}
+
+// Generate one module's structs and functions
+static void genModuleBody(FILE *file, GenParms *parms, char *prefix) {
+	int f, s, i;
+
+	for (s = 0; s < parms->structs; s++) {
+		genLine(file, 0, "struct %sS%d", prefix, s);
+		genLine(file, 1, "x i32");
+		genLine(file, 1, "y i32");
+		genLine(file, 1, "fn sum(self &) i32");
+		genLine(file, 2, "self.x + self.y");
+		genLine(file, 1, "fn scale(self &, k i32) i32");
+		genLine(file, 2, "self.x * k + self.y");
+		genLine(file, 0, "");
+	}
+
+	for (f = 0; f < parms->functions; f++) {
+		genLine(file, 0, "fn %sfun%d(a i32, b i32) i32", prefix, f);
+		genLine(file, 1, "mut acc = a");
+		genLine(file, 1, "mut i = 0");
+		genLine(file, 1, "while i < b");
+		// Heavy off-side indentation: nested if blocks
+		for (i = 0; i < parms->indent; i++)
+			genLine(file, 2 + i, "if acc > %d", i * 7 + 1);
+		for (i = 0; i < 2 + parms->indent; i++)
+			fputs("  ", file);
+		fputs("acc = acc + ", file);
+		genExpr(file, parms->depth);
+		fputc('\n', file);
+		genLines++;
+		for (i = parms->indent - 1; i >= 0; i--) {
+			genLine(file, 2 + i, "else");
+			genLine(file, 3 + i, "acc = acc - %d", i + 1);
+		}
+		genLine(file, 2, "i = i + 1");
+		if (parms->structs > 0) {
+			s = f % parms->structs;
+			genLine(file, 1, "mut pt %sS%d", prefix, s);
+			genLine(file, 1, "pt.x = acc");
+			genLine(file, 1, "pt.y = b");
+			genLine(file, 1, "acc = (&pt).sum() + (&pt).scale(a)");
+		}
+		if (f > 0)
+			genLine(file, 1, "acc + %sfun%d(a, b - 1)", prefix, f - 1);
+		else
+			genLine(file, 1, "acc");
+		genLine(file, 0, "");
+	}
+}
+
+// Create a directory, if it does not already exist
+static void makeDir(char *dir) {
+#ifdef _WIN32
+	_mkdir(dir);
+#else
+	mkdir(dir, 0777);
+#endif
+}
+
+// Generate a program (main file plus one file per submodule) into dir.
+// Return the main source file's path
+static char *genProgram(char *dir, GenParms *parms) {
+	static char mainfn[1024];
+	char fn[1024];
+	FILE *file;
+	int m, i;
+
+	genLines = 0;
+
+	// Submodules, each in its own source file
+	for (m = 0; m < parms->modules; m++) {
+		snprintf(fn, sizeof(fn), "%s/m%d.cone", dir, m);
+		if (!(file = fopen(fn, "wb"))) {
+			fprintf(stderr, "conebench: cannot write %s\n", fn);
+			exit(1);
+		}
+		genLine(file, 0, "// Generated by conebench (%s): module m%d", parms->name, m);
+		genModuleBody(file, parms, "");
+		fclose(file);
+	}
+
+	// Main program
+	snprintf(mainfn, sizeof(mainfn), "%s/%s.cone", dir, parms->name);
+	if (!(file = fopen(mainfn, "wb"))) {
+		fprintf(stderr, "conebench: cannot write %s\n", mainfn);
+		exit(1);
+	}
+	genLine(file, 0, "// Generated by conebench: %s", parms->name);
+	genLine(file, 0, "extern fn print(str &u8)");
+	genLine(file, 0, "");
+	for (m = 0; m < parms->modules; m++)
+		genLine(file, 0, "mod m%d", m);
+	genLine(file, 0, "");
+	genModuleBody(file, parms, "main");
+
+	// Long string literals
+	genLine(file, 0, "fn banners()");
+	for (i = 0; i < parms->functions && i < 1000; i++) {
+		int c;
+		fputs("  print(\"", file);
+		for (c = 0; c < parms->strlen; c++)
+			fputc('a' + (c + i) % 26, file);
+		fputs("\\n\")\n", file);
+		genLines++;
+	}
+	genLine(file, 0, "");
+
+	genLine(file, 0, "fn main() i32");
+	genLine(file, 1, "banners()");
+	for (m = 0; m < parms->modules; m++) {
+		if (parms->functions > 0)
+			genLine(file, 1, "m%d::fun%d(1, 3)", m, parms->functions - 1);
+	}
+	genLine(file, 1, "mainfun%d(2, 3)", parms->functions - 1);
+	fclose(file);
+	return mainfn;
+}
+
+// Parse an integer option value
+static int optInt(int argc, char **argv, int *i) {
+	if (*i + 1 >= argc) {
+		fprintf(stderr, "conebench: %s needs a value\n", argv[*i]);
+		exit(1);
+	}
+	return atoi(argv[++*i]);
+}
+
+// ----------------------------------------------------------------------------
+// Measurement
+
+// Per-phase times, as read back from conec's time trace
+#define MaxPhases 32
+typedef struct Phases {
+	int count;
+	char *names[MaxPhases];
+	double usecs[MaxPhases];
+	double lastend[MaxPhases];
+} Phases;
+
+// Accumulate a traced span into its phase.
+// A span nested within another span of the same name (e.g., a function's pass
+// within the whole pass) is not counted twice
+static void phaseAdd(Phases *phases, char *name, double ts, double dur) {
+	int i;
+	for (i = 0; i < phases->count; i++)
+		if (strcmp(phases->names[i], name) == 0)
+			break;
+	if (i == phases->count) {
+		if (i == MaxPhases)
+			return;
+		phases->names[i] = strdup(name);
+		phases->usecs[i] = 0.0;
+		phases->lastend[i] = -1.0;
+		phases->count++;
+	}
+	if (ts < phases->lastend[i])
+		return;
+	phases->usecs[i] += dur;
+	phases->lastend[i] = ts + dur;
+}
+
+// Read the spans from a Chrome trace-event file written by conec --time-trace
+// Spans are written in the order they close, so an enclosing span comes after
+// those nested in it: sort-free overlap detection needs them in start order.
+static void phasesRead(Phases *phases, char *tracefn) {
+	FILE *file;
+	char line[4096];
+	typedef struct { char name[64]; double ts, dur; } Span;
+	Span *spans = NULL;
+	int nspans = 0, avail = 0, i, j;
+
+	for (i = 0; i < phases->count; i++)
+		free(phases->names[i]);
+	phases->count = 0;
+	if (!(file = fopen(tracefn, "rb")))
+		return;
+	while (fgets(line, sizeof(line), file)) {
+		char *tsp = strstr(line, "\"ts\":");
+		char *durp = strstr(line, "\"dur\":");
+		char *namep = strstr(line, "\"name\":\"");
+		char *endp;
+		if (!tsp || !durp || !namep)
+			continue;
+		if (nspans == avail) {
+			avail = avail ? avail * 2 : 256;
+			spans = (Span *)realloc(spans, avail * sizeof(Span));
+		}
+		namep += 8;
+		endp = strchr(namep, '"');
+		if (!endp || endp - namep >= 64)
+			continue;
+		memcpy(spans[nspans].name, namep, endp - namep);
+		spans[nspans].name[endp - namep] = '\0';
+		spans[nspans].ts = atof(tsp + 5);
+		spans[nspans].dur = atof(durp + 6);
+		nspans++;
+	}
+	fclose(file);
+
+	// Insertion sort by start time, enclosing (longer) spans first
+	for (i = 1; i < nspans; i++) {
+		Span tmp = spans[i];
+		for (j = i - 1; j >= 0 && (spans[j].ts > tmp.ts || (spans[j].ts == tmp.ts && spans[j].dur < tmp.dur)); j--)
+			spans[j + 1] = spans[j];
+		spans[j + 1] = tmp;
+	}
+	for (i = 0; i < nspans; i++)
+		phaseAdd(phases, spans[i].name, spans[i].ts, spans[i].dur);
+	free(spans);
+}
+
+// Run conec once on srcfn. Return wall seconds (or -1 on failure) and peak RSS (kb)
+static double runConec(char *conec, char *srcfn, char *outdir, long *peakrss) {
+#ifdef _WIN32
+	char cmd[4096];
+	snprintf(cmd, sizeof(cmd), "\"%s\" --time-trace -o \"%s\" \"%s\"", conec, outdir, srcfn);
+	*peakrss = 0;
+	clock_t start = clock();
+	if (system(cmd) != 0)
+		return -1.0;
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+#else
+	struct timeval start, end;
+	struct rusage usage;
+	int status;
+	pid_t pid;
+
+	gettimeofday(&start, NULL);
+	if ((pid = fork()) == 0) {
+		// Quiet the compiler's summary line
+		freopen("/dev/null", "w", stderr);
+		execl(conec, conec, "--time-trace", "-o", outdir, srcfn, (char *)NULL);
+		_exit(127);
+	}
+	if (pid < 0 || wait4(pid, &status, 0, &usage) < 0)
+		return -1.0;
+	gettimeofday(&end, NULL);
+	*peakrss = usage.ru_maxrss;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -1.0;
+	return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+#endif
+}
+
+// Generate, compile and report on one benchmark case
+static int benchCase(FILE *results, char *conec, char *outdir, GenParms *parms, int runs) {
+	char casedir[1024], tracefn[sizeof(casedir) + 64], result[4096];
+	char *srcfn;
+	double best = -1.0;
+	long bestrss = 0, lines;
+	Phases phases;
+	size_t len;
+	int run, i;
+
+	// The case name is one of ours, so only a very long output directory may not fit
+	if ((size_t)snprintf(casedir, sizeof(casedir), "%s/%s", outdir, parms->name) >= sizeof(casedir)
+		|| (size_t)snprintf(tracefn, sizeof(tracefn), "%s/%s.time-trace.json", casedir, parms->name) >= sizeof(tracefn)) {
+		fprintf(stderr, "conebench: output directory name is too long: %s\n", outdir);
+		return 0;
+	}
+	makeDir(casedir);
+	srcfn = genProgram(casedir, parms);
+	lines = genLines;
+	phases.count = 0;
+
+	for (run = 0; run < runs; run++) {
+		long rss;
+		double secs = runConec(conec, srcfn, casedir, &rss);
+		if (secs < 0.0) {
+			fprintf(stderr, "conebench: conec failed to compile %s\n", srcfn);
+			return 0;
+		}
+		// Each run rewrites the trace, so read the fastest run's phases as it is found
+		if (best < 0.0 || secs < best) {
+			best = secs;
+			bestrss = rss;
+			phasesRead(&phases, tracefn);
+		}
+	}
+
+	len = snprintf(result, sizeof(result), "{\"case\":\"%s\",\"lines\":%ld,\"seconds\":%.6f,\"lines_per_sec\":%.0f,\"peak_rss_kb\":%ld,\"phases_ms\":{",
+		parms->name, lines, best, best > 0.0 ? lines / best : 0.0, bestrss);
+	for (i = 0; i < phases.count && len < sizeof(result) - 128; i++)
+		len += snprintf(result + len, sizeof(result) - len, "%s\"%s\":%.3f", i ? "," : "", phases.names[i], phases.usecs[i] / 1000.0);
+	snprintf(result + len, sizeof(result) - len, "}}\n");
+	fputs(result, results);
+	fflush(results);
+	fputs(result, stdout);
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	char *conec = "./conec";
+	char *outdir = "bench-results";
+	char *gendir = NULL;
+	char *onlycase = NULL;
+	char resultsfn[1024];
+	FILE *results;
+	GenParms parms = { "gen", 4, 50, 8, 4, 64, 3 };
+	GenParms *bcase;
+	int runs = 3, scale = 1, ok = 1, i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--conec") == 0 && i + 1 < argc) conec = argv[++i];
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outdir = argv[++i];
+		else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc) onlycase = argv[++i];
+		else if (strcmp(argv[i], "--gen") == 0 && i + 1 < argc) gendir = argv[++i];
+		else if (strcmp(argv[i], "--runs") == 0) runs = optInt(argc, argv, &i);
+		else if (strcmp(argv[i], "--scale") == 0) scale = optInt(argc, argv, &i);
+		else if (strcmp(argv[i], "--modules") == 0) parms.modules = optInt(argc, argv, &i);
+		else if (strcmp(argv[i], "--functions") == 0) parms.functions = optInt(argc, argv, &i);
+		else if (strcmp(argv[i], "--depth") == 0) parms.depth = optInt(argc, argv, &i);
+		else if (strcmp(argv[i], "--structs") == 0) parms.structs = optInt(argc, argv, &i);
+		else if (strcmp(argv[i], "--strlen") == 0) parms.strlen = optInt(argc, argv, &i);
+		else if (strcmp(argv[i], "--indent") == 0) parms.indent = optInt(argc, argv, &i);
+		else {
+			fprintf(stderr, "Usage: conebench [--conec path] [--out dir] [--runs n] [--scale n] [--case name]\n"
+				"       conebench --gen dir [--modules n] [--functions n] [--depth n] [--structs n] [--strlen n] [--indent n]\n");
+			return 1;
+		}
+	}
+	if (parms.functions < 1)
+		parms.functions = 1;
+
+	// Only generate a program
+	if (gendir) {
+		char *srcfn;
+		makeDir(gendir);
+		srcfn = genProgram(gendir, &parms);
+		printf("%s (%ld lines)\n", srcfn, genLines);
+		return 0;
+	}
+
+	makeDir(outdir);
+	snprintf(resultsfn, sizeof(resultsfn), "%s/results.jsonl", outdir);
+	if (!(results = fopen(resultsfn, "wb"))) {
+		fprintf(stderr, "conebench: cannot write %s\n", resultsfn);
+		return 1;
+	}
+	for (bcase = benchCases; bcase->name; bcase++) {
+		GenParms scaled = *bcase;
+		if (onlycase && strcmp(onlycase, bcase->name) != 0)
+			continue;
+		if (strcmp(bcase->name, "hello") != 0) {
+			if (scaled.modules > 1)
+				scaled.modules *= scale;
+			else
+				scaled.functions *= scale;
+		}
+		ok &= benchCase(results, conec, outdir, &scaled, runs);
+	}
+	fclose(results);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+/** cpu - Which CPU features the running program can use
+ * @file
+ *
+ * A program compiled with --multiversion asks, as it loads, which x86-64
+ * feature level (as defined by the x86-64 psABI) the CPU supports,
+ * to choose which version of each multiversioned function to run.
+ * This may run before the C runtime has initialized (in an ifunc resolver).
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include <stdint.h>
+
+// Return the CPU's x86-64 feature level: 1 (baseline) to 4 (AVX-512)
+int coneCpuLevel(void) {
+#if (defined(__x86_64__) || defined(__amd64__)) && (defined(__GNUC__) || defined(__clang__))
+	static int level = 0;
+	if (level)
+		return level;
+	__builtin_cpu_init();
+	level = 1;
+	if (__builtin_cpu_supports("sse3") && __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1")
+		&& __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+		level = 2;
+	else
+		return level;
+	if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi")
+		&& __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma"))
+		level = 3;
+	else
+		return level;
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512cd")
+		&& __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl"))
+		level = 4;
+	return level;
+#else
+	return 1;
+#endif
+}
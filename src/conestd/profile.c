@@ -0,0 +1,191 @@
+/** profile - Execution counts for profile-guided optimization
+ * @file
+ *
+ * A program compiled with --profile-generate counts how often each function
+ * is entered and which way each of its conditional branches goes. Each of its
+ * modules registers its counters here when the program starts. When the program
+ * exits, the counts are added to those already in the profile file, so that
+ * several runs accumulate into one profile for --profile-use.
+ *
+ * The profile file is CONE_PROFILE_FILE, or default.profraw. Each of its lines
+ * holds one function's counts: its name, a tab, the number of counters, and the
+ * counters themselves (the entry count first). A function is identified by its
+ * name and number of counters, as the compiler looks it up. So functions of the
+ * same name (in different modules) with as many counters share one line, and a
+ * function's line from before its code changed is replaced.
+ *
+ * This source file is part of the Cone Programming Language C compiler
+ * See Copyright Notice in conec.h
+*/
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A function's counters, as laid out by the compiler
+typedef struct ConeProfFn {
+	char *name;
+	uint64_t *counts;
+	uint32_t ncounts;
+} ConeProfFn;
+
+// A module's table of functions
+typedef struct ConeProfModule {
+	ConeProfFn *fns;
+	uint32_t nfns;
+} ConeProfModule;
+
+static ConeProfModule *coneProfModules = NULL;
+static uint32_t coneProfModulesUsed = 0;
+static uint32_t coneProfModulesAvail = 0;
+static int coneProfAtExit = 0;
+
+// Order functions by name, then number of counters
+static int coneProfFnCmp(const void *a, const void *b) {
+	ConeProfFn *fa = *(ConeProfFn **)a, *fb = *(ConeProfFn **)b;
+	int cmp = strcmp(fa->name, fb->name);
+	if (cmp != 0)
+		return cmp;
+	return fa->ncounts < fb->ncounts ? -1 : fa->ncounts > fb->ncounts ? 1 : 0;
+}
+
+// Compare functions by name only
+static int coneProfNameCmp(const void *a, const void *b) {
+	return strcmp((*(ConeProfFn **)a)->name, (*(ConeProfFn **)b)->name);
+}
+
+// Find the first of the (sorted) registered functions with a name and number of counters
+// (or, if ncounts is 0, any with the name). Return its index, or -1.
+static long coneProfFind(ConeProfFn **fns, uint32_t nfns, char *name, uint32_t ncounts) {
+	ConeProfFn key, *keyp = &key, **found;
+	key.name = name;
+	key.ncounts = ncounts;
+	found = (ConeProfFn **)bsearch(&keyp, fns, nfns, sizeof(ConeProfFn *), ncounts ? coneProfFnCmp : coneProfNameCmp);
+	if (!found)
+		return -1;
+	while (found > fns && (ncounts ? coneProfFnCmp : coneProfNameCmp)(&keyp, found - 1) == 0)
+		--found;
+	return (long)(found - fns);
+}
+
+// Read one line's function name (up to the tab) into a malloc'd string. Return NULL at end of file.
+static char *coneProfReadName(FILE *file) {
+	size_t len = 0, avail = 64;
+	char *name = malloc(avail);
+	int c;
+	while ((c = getc(file)) != EOF && c != '\t' && c != '\n') {
+		if (len + 1 >= avail)
+			name = realloc(name, avail <<= 1);
+		name[len++] = (char)c;
+	}
+	if (c != '\t') {
+		free(name);
+		return NULL;
+	}
+	name[len] = '\0';
+	return name;
+}
+
+// Write the counts of one function
+static void coneProfWriteFn(FILE *file, char *name, uint64_t *counts, uint32_t ncounts) {
+	uint32_t i;
+	fprintf(file, "%s\t%" PRIu32, name, ncounts);
+	for (i = 0; i < ncounts; i++)
+		fprintf(file, " %" PRIu64, counts[i]);
+	fputc('\n', file);
+}
+
+// Merge this run's counts with the profile file's, and rewrite it
+static void coneProfWrite(void) {
+	char *path = getenv("CONE_PROFILE_FILE");
+	char *tmppath, *name;
+	FILE *old, *file;
+	ConeProfFn **fns;
+	uint32_t nfns, m, f, i, j, ncounts;
+	uint64_t count, *counts;
+	long found;
+	int c;
+
+	if (coneProfModulesUsed == 0)
+		return;
+	if (path == NULL || *path == '\0')
+		path = "default.profraw";
+	tmppath = malloc(strlen(path) + 5);
+	sprintf(tmppath, "%s.tmp", path);
+	if ((file = fopen(tmppath, "w")) == NULL) {
+		fprintf(stderr, "Could not write profile %s\n", path);
+		free(tmppath);
+		return;
+	}
+
+	// Sort this run's functions, so that the same named ones with as many counters are together
+	for (nfns = 0, m = 0; m < coneProfModulesUsed; m++)
+		nfns += coneProfModules[m].nfns;
+	fns = malloc((nfns + 1) * sizeof(ConeProfFn *));
+	for (nfns = 0, m = 0; m < coneProfModulesUsed; m++) {
+		for (f = 0; f < coneProfModules[m].nfns; f++)
+			fns[nfns++] = &coneProfModules[m].fns[f];
+	}
+	qsort(fns, nfns, sizeof(ConeProfFn *), coneProfFnCmp);
+
+	// Add in the counts from earlier runs. Keep functions this program does not have,
+	// but drop the counts of one whose counters no longer match its code.
+	if ((old = fopen(path, "r"))) {
+		while ((name = coneProfReadName(old))) {
+			if (fscanf(old, "%" SCNu32, &ncounts) != 1) {
+				free(name);
+				break;
+			}
+			found = ncounts ? coneProfFind(fns, nfns, name, ncounts) : -1;
+			counts = found < 0 ? calloc(ncounts ? ncounts : 1, sizeof(uint64_t)) : fns[found]->counts;
+			for (i = 0; i < ncounts && fscanf(old, "%" SCNu64, &count) == 1; i++)
+				counts[i] += count;
+			while ((c = getc(old)) != '\n' && c != EOF)
+				;
+			if (found < 0) {
+				if (coneProfFind(fns, nfns, name, 0) < 0)
+					coneProfWriteFn(file, name, counts, ncounts);
+				free(counts);
+			}
+			free(name);
+		}
+		fclose(old);
+	}
+
+	// Write this run's functions, one line for those with the same name and number of counters
+	for (f = 0; f < nfns; f = j) {
+		for (j = f + 1; j < nfns && coneProfFnCmp(&fns[f], &fns[j]) == 0; j++) {
+			for (i = 0; i < fns[f]->ncounts; i++)
+				fns[f]->counts[i] += fns[j]->counts[i];
+		}
+		coneProfWriteFn(file, fns[f]->name, fns[f]->counts, fns[f]->ncounts);
+	}
+	free(fns);
+	fclose(file);
+	remove(path);
+	rename(tmppath, path);
+	free(tmppath);
+}
+
+// Register a module's function counters. Called as the program starts.
+void coneProfRegister(ConeProfFn *fns, uint32_t nfns) {
+	if (!coneProfAtExit) {
+		atexit(coneProfWrite);
+		coneProfAtExit = 1;
+	}
+	if (coneProfModulesUsed >= coneProfModulesAvail) {
+		coneProfModulesAvail = coneProfModulesAvail ? coneProfModulesAvail << 1 : 16;
+		coneProfModules = realloc(coneProfModules, coneProfModulesAvail * sizeof(ConeProfModule));
+	}
+	coneProfModules[coneProfModulesUsed].fns = fns;
+	coneProfModules[coneProfModulesUsed++].nfns = nfns;
+}
+
+// Write the profile now, and forget the registered counters.
+// For a program run in-process (conec --run), whose counters are freed once it returns.
+void coneProfFlush(void) {
+	coneProfWrite();
+	coneProfModulesUsed = 0;
+}